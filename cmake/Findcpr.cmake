@@ -1,3 +1,5 @@
 cmake_minimum_required(VERSION 3.16)
 
+# the tvdb api is accessed over https
+set(CPR_ENABLE_SSL ON CACHE BOOL "" FORCE)
 add_subdirectory(${CMAKE_SOURCE_DIR}/vendor/cpr)
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include <thread>
 #include <functional>
 #include <memory>
+#include <algorithm>
+#include <fstream>
 
 #include <spdlog/spdlog.h>
 #include <fmt/core.h>
@@ -15,8 +17,10 @@
 #include "app_config.h"
 #include "app_credentials.h"
 #include "app_folder.h"
+#include "app_library_index.h"
 
 #include "tvdb_api/tvdb_api.h"
+#include "tvdb_api/tvdb_http_cache.h"
 #include "tvdb_api/tvdb_json.h"
 
 #include "util/file_loading.h"
@@ -26,21 +30,40 @@ namespace app
 
 namespace fs = std::filesystem;
 
+constexpr const char* LIBRARY_INDEX_FN = ".torrent_renamer_index.json";
+// time of the last sync with the tvdb updates feed
+constexpr const char* LIBRARY_SYNC_FN = ".torrent_renamer_sync.json";
+// api responses that are revalidated instead of being downloaded again
+constexpr const char* HTTP_CACHE_DIRECTORY = ".torrent_renamer_http_cache";
+
 App::App(const char* config_filepath)
 {
-    const int num_threads = 1000;
-    m_thread_pool.resize(num_threads);
-
     m_current_folder = nullptr;
     m_global_busy_count = 0;
+    m_refresh_generation = 0;
+    m_saved_index_generation = 0;
+    m_is_index_saving = false;
+    m_saved_cache_generation = 0;
+    m_is_store_saving = false;
+    m_is_json_cache_exported = true;
+    m_is_binary_cache_exported = false;
 
     auto cfg_opt = load_app_config_from_filepath(config_filepath);
     if (!cfg_opt) {
         queue_app_error(cfg_opt.error());
+        create_thread_pools(AppConfig{});
+        m_tvdb_client = std::make_unique<tvdb_api::TvdbClient>();
         return;
     }
 
     auto& cfg = cfg_opt.value();
+    create_thread_pools(cfg);
+    m_tvdb_client = std::make_unique<tvdb_api::TvdbClient>(cfg.tvdb_client);
+    m_auto_match_config = cfg.auto_match;
+    m_library_sync_config = cfg.library_sync;
+    m_is_json_cache_exported = cfg.export_json_cache;
+    m_is_binary_cache_exported = cfg.export_binary_cache;
+
     // setup our renaming config
     for (auto& v: cfg.blacklist_extensions) {
         m_cfg.blacklist_extensions.push_back(v);
@@ -59,7 +82,23 @@ App::App(const char* config_filepath)
     authenticate();
 }
 
-// get a new token which can be used for a few hours
+// write out any changes since the last save so the next startup is up to date
+App::~App() {
+    // NOTE: Async requests complete by queueing onto the thread pools so they are stopped before the pools
+    m_tvdb_client->stop_async_requests();
+    if (m_root.empty()) {
+        return;
+    }
+    if (m_library_stats.get_generation() != m_saved_index_generation) {
+        save_library_index(m_root / LIBRARY_INDEX_FN, get_library_index_json());
+    }
+    if (!m_is_store_saving && (m_library_stats.get_cache_generation() != m_saved_cache_generation)) {
+        save_metadata_store(m_root);
+    }
+}
+
+// keep a valid token in the background so startup does not wait on the network
+// NOTE: A saved token is used straight away and is replaced if the api rejects it
 void App::authenticate() {
     auto filepath = m_credentials_filepath.c_str();
     
@@ -70,65 +109,702 @@ void App::authenticate() {
     }
 
     auto& credentials = credentials_opt.value();
-    auto token_opt = tvdb_api::login(
-        credentials.api_key.c_str(), 
-        credentials.user_key.c_str(),
-        credentials.username.c_str()
-    );
-
-    if (!token_opt) {
-        queue_app_warning(token_opt.error());
-        return;
+    if (credentials.token) {
+        m_tvdb_client->set_token(credentials.token.value());
     }
 
-    auto& token = token_opt.value();
-    m_token = std::move(token);
+    m_tvdb_client->start_authenticator(
+        { credentials.api_key, credentials.user_key, credentials.username },
+        [this](const std::string& error) {
+            queue_app_warning(error);
+        }
+    );
 }
 
 // create folder objects for each folder in the root directory
+// NOTE: The library index lets us show the last known state of every folder immediately
+//       The folder list is then revalidated against the disk in the background
+//       Refreshing the same root only adds and removes folders so loaded caches are kept
 void App::refresh_folders() {
-    if (m_global_busy_count > 0) {
+    const bool is_new_root = (m_root != m_loaded_root);
+    // NOTE: Busy folders are only a problem if we are throwing away the folder list
+    if (is_new_root && (m_global_busy_count > 0)) {
         return;
     }
 
-    m_folders.clear();
-    m_current_folder = nullptr;
+    const uint64_t refresh_generation = ++m_refresh_generation;
+    if (is_new_root) {
+        std::list<std::shared_ptr<AppFolder>> folders;
+
+        // NOTE: We expect that the store may not exist if the root hasn't been opened before
+        //       The folders then load their json caches which are written into a new store
+        //       A damaged store falls back to the generation before it
+        std::shared_ptr<const MetadataStore> store = nullptr;
+        for (auto& file: metadata_store::list_store_files(m_root)) {
+            auto store_opt = MetadataStore::open(file.path);
+            if (!store_opt) {
+                queue_app_warning(store_opt.error());
+                continue;
+            }
+            store = std::move(store_opt.value());
+            break;
+        }
+        {
+            auto lock = std::scoped_lock(m_metadata_store_mutex);
+            m_metadata_store = store;
+            m_metadata_store_root = m_root;
+        }
+
+        // NOTE: We expect that the index may not exist if the root hasn't been opened before
+        const auto index_fn = m_root / LIBRARY_INDEX_FN;
+        auto res = util::load_document_from_file(index_fn.string().c_str());
+        if (res.code == util::DocumentLoadCode::OK) {
+            auto index_opt = load_library_index(res.doc);
+            if (!index_opt) {
+                queue_app_warning(index_opt.error());
+            } else {
+                for (auto& entry: index_opt.value().folders) {
+                    auto folder = create_folder(m_root / entry.name);
+                    folder->seed_from_index(entry);
+                    folders.push_back(folder);
+                }
+            }
+        }
+
+        {
+            auto lock = std::scoped_lock(m_folders_mutex);
+            m_folders = std::move(folders);
+        }
+        select_folder(nullptr);
+        m_loaded_root = m_root;
+        // NOTE: Reads and writes of the cache are small and gate requests in flight
+        //       So they are interactive to avoid waiting behind the walks of a library scan
+        auto http_cache = std::make_shared<tvdb_api::HttpCache>(m_root / HTTP_CACHE_DIRECTORY);
+        m_tvdb_client->set_http_cache(http_cache, [this](std::function<void ()> task) {
+            queue_async_call([task = std::move(task)](int pid) {
+                task();
+            }, TaskLane::DISK, TaskPriority::INTERACTIVE);
+        });
+        // bodies can be left behind when an entry is replaced by a newer response
+        queue_async_call([http_cache](int pid) {
+            http_cache->collect_garbage();
+        }, TaskLane::DISK, TaskPriority::BACKGROUND);
+        // the seeded folders are what is already on disk
+        m_saved_index_generation = m_library_stats.get_generation();
+        m_saved_cache_generation = m_library_stats.get_cache_generation();
+    }
+
+    const auto root = m_root;
+    queue_async_call([this, refresh_generation, root](int pid) {
+        revalidate_folders(refresh_generation, root);
+    }, TaskLane::DISK, TaskPriority::INTERACTIVE);
+}
 
+// diff the folder list against the directories on disk
+// NOTE: Folders that are still present keep their cache, state and bookmarks
+//       Only new folders and those seeded from the library index are scanned
+void App::revalidate_folders(uint64_t refresh_generation, const fs::path& root) {
     // NOTE: An I/O error will throw an exception
-    try {
-        for (auto& subdir: fs::directory_iterator(m_root)) {
-            if (!subdir.is_directory()) {
+    std::vector<fs::path> paths;
+    for (auto& subdir: fs::directory_iterator(root)) {
+        if (!subdir.is_directory()) {
+            continue;
+        }
+        if (subdir.path().filename() == HTTP_CACHE_DIRECTORY) {
+            continue;
+        }
+        paths.push_back(subdir.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<std::shared_ptr<AppFolder>> scan_folders;
+    std::vector<std::shared_ptr<AppFolder>> removed_folders;
+    {
+        auto lock = std::scoped_lock(m_folders_mutex);
+        if (refresh_generation != m_refresh_generation) {
+            return;
+        }
+
+        std::map<fs::path, std::shared_ptr<AppFolder>> existing_folders;
+        for (auto& folder: m_folders) {
+            existing_folders.emplace(folder->GetPath(), folder);
+        }
+
+        std::list<std::shared_ptr<AppFolder>> folders;
+        for (auto& path: paths) {
+            auto res = existing_folders.find(path);
+            if (res == existing_folders.end()) {
+                auto folder = create_folder(path);
+                scan_folders.push_back(folder);
+                folders.push_back(std::move(folder));
                 continue;
             }
-            auto folder = std::make_shared<AppFolder>(subdir, m_cfg, m_global_busy_count);
-            m_folders.push_back(folder);
+
+            auto& folder = res->second;
+            if (!folder->m_is_scanned) {
+                scan_folders.push_back(folder);
+            }
+            folders.push_back(std::move(folder));
+            existing_folders.erase(res);
+        }
+
+        for (auto& [path, folder]: existing_folders) {
+            folder->m_is_removed = true;
+            removed_folders.push_back(std::move(folder));
+        }
+        m_folders = std::move(folders);
+    }
+
+    for (auto& folder: removed_folders) {
+        cancel_folder_task(folder.get(), FolderOperation::SCAN);
+    }
+
+    for (auto& folder: scan_folders) {
+        queue_folder_task(folder, FolderOperation::SCAN, [folder](const util::CancellationToken& token) {
+            folder->update_state_from_cache(token);
+        }, TaskLane::DISK, TaskPriority::BACKGROUND);
+    }
+}
+
+// NOTE: We wait for the queues to drain so a bulk scan doesn't rewrite the index for every folder
+void App::update_library_index() {
+    if (m_root.empty()) {
+        return;
+    }
+
+    const uint64_t generation = m_library_stats.get_generation();
+    const uint64_t cache_generation = m_library_stats.get_cache_generation();
+    const bool is_index_changed = !m_is_index_saving && (generation != m_saved_index_generation);
+    const bool is_store_changed = !m_is_store_saving && (cache_generation != m_saved_cache_generation);
+    if (!is_index_changed && !is_store_changed) {
+        return;
+    }
+
+    for (auto lane: { TaskLane::DISK, TaskLane::NETWORK, TaskLane::CPU }) {
+        const auto& pool = get_pool(lane);
+        if ((pool.get_total_pending() > 0) || (pool.get_total_running() > 0)) {
+            return;
+        }
+    }
+
+    if (is_index_changed) {
+        m_saved_index_generation = generation;
+        m_is_index_saving = true;
+        auto json_str = get_library_index_json();
+        auto index_fn = m_root / LIBRARY_INDEX_FN;
+        queue_async_call([this, json_str = std::move(json_str), index_fn = std::move(index_fn)](int pid) {
+            save_library_index(index_fn, json_str);
+            m_is_index_saving = false;
+        }, TaskLane::DISK, TaskPriority::BACKGROUND);
+    }
+
+    if (is_store_changed) {
+        m_saved_cache_generation = cache_generation;
+        m_is_store_saving = true;
+        queue_async_call([this, root = m_root](int pid) {
+            save_metadata_store(root);
+            m_is_store_saving = false;
+        }, TaskLane::DISK, TaskPriority::BACKGROUND);
+    }
+}
+
+std::string App::get_library_index_json() {
+    LibraryIndex index;
+    {
+        auto lock = std::scoped_lock(m_folders_mutex);
+        index.folders.reserve(m_folders.size());
+        for (auto& folder: m_folders) {
+            index.folders.push_back(folder->get_index_entry());
+        }
+    }
+    return json_stringify_library_index(index);
+}
+
+// NOTE: The index is written to a temporary file and renamed so a crash never leaves it truncated
+bool App::save_library_index(const fs::path& filepath, const std::string& json_str) {
+    auto lock = std::scoped_lock(m_index_file_mutex);
+    auto temp_filepath = filepath;
+    temp_filepath += ".tmp";
+    {
+        std::ofstream file(temp_filepath, std::ios::trunc);
+        if (!file.is_open()) {
+            queue_app_warning("Failed to save library index");
+            return false;
+        }
+        file << json_str << std::endl;
+        file.close();
+        if (!file.good()) {
+            std::error_code ec;
+            fs::remove(temp_filepath, ec);
+            queue_app_warning("Failed to save library index");
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_filepath, filepath, ec);
+    if (ec) {
+        fs::remove(temp_filepath, ec);
+        queue_app_warning("Failed to save library index");
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<AppFolder> App::create_folder(const fs::path& path) {
+    auto folder = std::make_shared<AppFolder>(path, m_cfg, m_global_busy_count, m_library_stats, m_diagnostics);
+    folder->m_is_json_exported = m_is_json_cache_exported;
+    folder->m_is_binary_exported = m_is_binary_cache_exported;
+    auto store = get_metadata_store();
+    // NOTE: The store has its own copy of which series each folder is matched to
+    //       So a folder is still matched if the library index is missing or out of date
+    if (store) {
+        auto id = store->find_folder_series(path.filename().string());
+        if (id) {
+            folder->m_series_id = id.value();
         }
-    } catch (std::exception& e) {
-        queue_app_error(e.what());
     }
+    folder->set_metadata_store(std::move(store));
+    return folder;
+}
+
+std::shared_ptr<const MetadataStore> App::get_metadata_store() {
+    auto lock = std::scoped_lock(m_metadata_store_mutex);
+    return m_metadata_store;
+}
+
+// write the caches of every folder into a new store and move the folders onto it
+// NOTE: Folders that haven't loaded their cache yet are copied over from the current store
+void App::save_metadata_store(const fs::path& root) {
+    std::vector<std::shared_ptr<AppFolder>> folders;
+    {
+        auto lock = std::scoped_lock(m_folders_mutex);
+        folders.assign(m_folders.begin(), m_folders.end());
+    }
+    auto old_store = get_metadata_store();
+
+    MetadataStoreBuilder builder;
+    for (auto& folder: folders) {
+        const auto name = folder->GetPath().filename().string();
+        auto cache_lock = std::shared_lock(folder->m_cache_mutex);
+        if (folder->m_is_info_cached) {
+            const auto cache = folder->get_cache_view();
+            builder.add(cache);
+            builder.add_folder(name, cache.get_series().id);
+            continue;
+        }
+        if (!old_store) {
+            continue;
+        }
+        uint32_t id = folder->m_series_id;
+        if (id == 0) {
+            id = old_store->find_folder_series(name).value_or(0);
+        }
+        auto index = old_store->find_series(id);
+        if (index) {
+            builder.add(CacheView(*old_store, index.value()));
+            builder.add_folder(name, id);
+        }
+    }
+
+    const auto old_files = metadata_store::list_store_files(root);
+    const uint64_t generation = old_files.empty() ? 1 : (old_files.front().generation + 1);
+    const auto store_fn = metadata_store::get_store_path(root, generation);
+    if (!builder.write(store_fn)) {
+        queue_app_warning("Failed to save metadata store");
+        return;
+    }
+    auto store_opt = MetadataStore::open(store_fn);
+    if (!store_opt) {
+        queue_app_warning(store_opt.error());
+        return;
+    }
+
+    // NOTE: The root may have changed while we were writing so the store is only used if it still matches
+    //       The new generation is still the newest for that root so it is opened next time
+    auto store = std::move(store_opt.value());
+    {
+        auto lock = std::scoped_lock(m_metadata_store_mutex);
+        if (root != m_metadata_store_root) {
+            return;
+        }
+        m_metadata_store = store;
+    }
+    for (auto& folder: folders) {
+        folder->set_metadata_store(store);
+    }
+
+    // NOTE: The store may be the only copy of a folder's cache if the json cache isn't exported
+    //       So older generations are kept if a folder that is still present was dropped from the new one
+    if (old_store) {
+        for (auto& folder: folders) {
+            const auto name = folder->GetPath().filename().string();
+            if (old_store->find_folder_series(name) && !store->find_folder_series(name)) {
+                queue_app_warning(fmt::format("Keeping older metadata stores since {} is missing from the new one", name));
+                return;
+            }
+        }
+    }
+
+    // NOTE: A generation that is still mapped fails to be deleted on windows and is retried on the next save
+    old_store = nullptr;
+    for (auto& file: old_files) {
+        std::error_code ec;
+        fs::remove(file.path, ec);
+    }
+}
+
+// size each lane's thread pool from the config, with zero meaning one thread per core
+void App::create_thread_pools(const AppConfig& cfg) {
+    const int total_cores = std::max(1, int(std::thread::hardware_concurrency()));
+    auto get_total_threads = [total_cores](int n) {
+        return (n > 0) ? n : total_cores;
+    };
+    m_disk_pool = std::make_unique<util::WorkStealingPool>(get_total_threads(cfg.disk_threads));
+    m_network_pool = std::make_unique<util::WorkStealingPool>(get_total_threads(cfg.network_threads));
+    m_cpu_pool = std::make_unique<util::WorkStealingPool>(get_total_threads(cfg.cpu_threads));
+
+    // each stage of a scan can keep the threads of its lane busy without queueing the whole library
+    const int total_disk_threads = get_total_threads(cfg.disk_threads);
+    const int total_cpu_threads = get_total_threads(cfg.cpu_threads);
+    for (int i = 0; i < TOTAL_SCAN_STAGES; i++) {
+        const bool is_disk = (get_scan_stage_lane(ScanStage(i)) == TaskLane::DISK);
+        m_scan_config.max_in_flight[i] = is_disk ? total_disk_threads : total_cpu_threads;
+    }
+}
+
+void App::scan_all_folders() {
+    std::vector<std::shared_ptr<AppFolder>> folders;
+    {
+        auto lock = std::scoped_lock(m_folders_mutex);
+        folders.assign(m_folders.begin(), m_folders.end());
+    }
+
+    // NOTE: Destroying the previous scan only cancels it so the UI thread never waits on it
+    //       Its queued stages are replaced by the first stage of the new scan
+    m_scan_pipeline = nullptr;
+    m_scan_pipeline = std::make_unique<LibraryScanPipeline>(
+        std::move(folders), m_scan_config,
+        [this](std::shared_ptr<AppFolder> folder, TaskLane lane, FolderTaskCall call) {
+            queue_folder_task(std::move(folder), FolderOperation::SCAN, std::move(call), lane, TaskPriority::BACKGROUND);
+        },
+        [this](std::shared_ptr<AppFolder> folder, TaskLane lane, FolderTaskCall call) {
+            continue_folder_task(std::move(folder), FolderOperation::SCAN, std::move(call), lane, TaskPriority::BACKGROUND);
+        });
+}
+
+// NOTE: Folders are checked for a cache by the matcher so the UI thread doesn't touch the disk
+void App::auto_match_folders() {
+    std::vector<std::shared_ptr<AppFolder>> folders;
+    {
+        auto lock = std::scoped_lock(m_folders_mutex);
+        folders.assign(m_folders.begin(), m_folders.end());
+    }
+
+    // NOTE: Destroying the previous match cancels it and waits for its thread
+    m_auto_matcher = nullptr;
+    m_auto_matcher = std::make_unique<AutoMatcher>(
+        std::move(folders), m_auto_match_config, *m_tvdb_client,
+        [this](std::shared_ptr<AppFolder> folder, uint32_t id) {
+            queue_download_cache(std::move(folder), id, TaskPriority::BACKGROUND);
+        },
+        [this](const std::string& error) { queue_app_error(error); });
+}
+
+// NOTE: Only folders whose cache was patched are rescanned
+void App::sync_library() {
+    if (m_root.empty()) {
+        return;
+    }
+
+    std::vector<std::shared_ptr<AppFolder>> folders;
+    {
+        auto lock = std::scoped_lock(m_folders_mutex);
+        folders.assign(m_folders.begin(), m_folders.end());
+    }
+
+    // NOTE: Destroying the previous sync cancels it and waits for its thread
+    m_library_sync = nullptr;
+    m_library_sync = std::make_unique<LibrarySync>(
+        std::move(folders), m_root / LIBRARY_SYNC_FN, m_library_sync_config, *m_tvdb_client,
+        [this](std::shared_ptr<AppFolder> folder) {
+            queue_folder_task(folder, FolderOperation::SCAN, [folder](const util::CancellationToken& token) {
+                folder->update_state_from_cache(token);
+            }, TaskLane::DISK, TaskPriority::BACKGROUND);
+        },
+        [this](const std::string& error) { queue_app_error(error); });
+}
+
+// NOTE: The requests are in flight on the client's event loop so no lane thread waits on the network
+//       Once both have completed the cache is stored and the state is updated on the disk lane
+void App::queue_download_cache(std::shared_ptr<AppFolder> folder, uint32_t id, TaskPriority priority) {
+    auto token = begin_folder_graph(folder.get(), FolderOperation::DOWNLOAD_CACHE);
+    folder->download_cache_from_tvdb(id, *m_tvdb_client, [this, folder, priority, token](std::shared_ptr<TvdbDownload> download) {
+        // a newer download of the folder has replaced this one
+        if (token.is_cancelled()) {
+            return;
+        }
+        auto graph = std::make_shared<TaskGraph>();
+        auto store = graph->add_node("store_cache", TaskLane::DISK, [folder, download](const util::CancellationToken& token) {
+            return folder->store_cache_from_tvdb(*download);
+        });
+        graph->add_node("update_state", TaskLane::DISK, [folder](const util::CancellationToken& token) {
+            return folder->update_state_from_cache(token);
+        }, { store });
+        queue_folder_graph(folder, FolderOperation::DOWNLOAD_CACHE, std::move(graph), priority, token);
+    });
+}
+
+util::WorkStealingPool& App::get_pool(TaskLane lane) {
+    switch (lane) {
+    case TaskLane::DISK:    return *m_disk_pool;
+    case TaskLane::NETWORK: return *m_network_pool;
+    case TaskLane::CPU:
+    default:                return *m_cpu_pool;
+    }
+}
+
+const util::WorkStealingPool& App::get_thread_pool(TaskLane lane) const {
+    return const_cast<App*>(this)->get_pool(lane);
 }
 
 // Asynchronously run a callable in our thread pool to prevent blocking the UI thread
-void App::queue_async_call(std::function<void (int)> call) {
-    m_thread_pool.push([call, this](int pid) {
+// Use the interactive priority for work the user is waiting on so it jumps ahead of bulk operations
+void App::queue_async_call(std::function<void (int)> call, TaskLane lane, TaskPriority priority) {
+    get_pool(lane).push([call, this](int pid) {
         // NOTE: We may perform IO here in the thread pool which can raise exceptions
         try {
             call(pid);
         } catch (std::exception& e) {
             queue_app_error(e.what());
         }
+    }, priority);
+}
+
+// Queue an operation on a folder while coalescing it with any identical pending operation
+// NOTE: The call should hold onto the folder since the task can outlive a refresh of the folder list
+void App::queue_folder_task(
+    std::shared_ptr<AppFolder> folder, FolderOperation operation, FolderTaskCall call,
+    TaskLane lane, TaskPriority priority) 
+{
+    // NOTE: The replaced call is destroyed after the lock is released since that can queue more tasks
+    FolderTaskCall replaced_call = nullptr;
+    auto key = FolderTaskKey{ folder.get(), operation };
+    auto lock = std::scoped_lock(m_folder_tasks_mutex);
+    auto& entry = m_folder_tasks[key];
+    replaced_call = std::move(entry.pending_call);
+    push_folder_task(key, entry, std::move(call), lane, priority);
+}
+
+// NOTE: Requires the folder tasks mutex to be held
+void App::push_folder_task(
+    const FolderTaskKey& key, FolderTaskEntry& entry, FolderTaskCall call,
+    TaskLane lane, TaskPriority priority)
+{
+    // a background task that is already queued has to be overtaken by an interactive request
+    const bool is_priority_upgrade = 
+        (entry.total_queued > 0) && 
+        (entry.priority == TaskPriority::BACKGROUND) && 
+        (priority == TaskPriority::INTERACTIVE);
+
+    entry.pending_call = std::move(call);
+    entry.lane = lane;
+    if ((entry.total_queued == 0) || is_priority_upgrade) {
+        entry.priority = priority;
+    }
+
+    // the running task will queue the pending call once it finishes
+    if (entry.is_running) {
+        return;
+    }
+
+    if ((entry.total_queued == 0) || is_priority_upgrade) {
+        push_folder_task_runner(key, entry);
+    }
+}
+
+void App::continue_folder_task(
+    std::shared_ptr<AppFolder> folder, FolderOperation operation, FolderTaskCall call,
+    TaskLane lane, TaskPriority priority)
+{
+    auto key = FolderTaskKey{ folder.get(), operation };
+    auto lock = std::scoped_lock(m_folder_tasks_mutex);
+    auto& entry = m_folder_tasks[key];
+    // NOTE: The dropped call is only destroyed once the lock has been released
+    if (entry.pending_call) {
+        return;
+    }
+    push_folder_task(key, entry, std::move(call), lane, priority);
+}
+
+// Cancel the running task and drop the pending one
+void App::cancel_folder_task(const AppFolder* folder, FolderOperation operation) {
+    FolderTaskCall dropped_call = nullptr;
+    auto key = FolderTaskKey{ folder, operation };
+    auto lock = std::scoped_lock(m_folder_tasks_mutex);
+    auto res = m_folder_tasks.find(key);
+    if (res == m_folder_tasks.end()) {
+        return;
+    }
+
+    auto& entry = res->second;
+    entry.token.cancel();
+    entry.token = util::CancellationToken::create();
+    dropped_call = std::move(entry.pending_call);
+    entry.pending_call = nullptr;
+}
+
+// NOTE: Requires the folder tasks mutex to be held
+void App::push_folder_task_runner(const FolderTaskKey& key, FolderTaskEntry& entry) {
+    entry.total_queued++;
+    get_pool(entry.lane).push([this, key](int pid) {
+        run_folder_task(key);
+    }, entry.priority);
+}
+
+void App::run_folder_task(const FolderTaskKey& key) {
+    FolderTaskCall call = nullptr;
+    util::CancellationToken token;
+    {
+        auto lock = std::scoped_lock(m_folder_tasks_mutex);
+        auto res = m_folder_tasks.find(key);
+        if (res == m_folder_tasks.end()) {
+            return;
+        }
+
+        auto& entry = res->second;
+        entry.total_queued--;
+        // another runner has already taken the call
+        if (entry.is_running || !entry.pending_call) {
+            if (!entry.is_running && !entry.pending_call && (entry.total_queued == 0)) {
+                m_folder_tasks.erase(res);
+            }
+            return;
+        }
+
+        call = std::move(entry.pending_call);
+        entry.pending_call = nullptr;
+        entry.is_running = true;
+        token = entry.token;
+    }
+
+    // NOTE: We may perform IO here in the thread pool which can raise exceptions
+    try {
+        call(token);
+    } catch (std::exception& e) {
+        queue_app_error(e.what());
+    }
+
+    auto lock = std::scoped_lock(m_folder_tasks_mutex);
+    auto res = m_folder_tasks.find(key);
+    if (res == m_folder_tasks.end()) {
+        return;
+    }
+
+    auto& entry = res->second;
+    entry.is_running = false;
+    if (entry.pending_call && (entry.total_queued == 0)) {
+        push_folder_task_runner(key, entry);
+    } else if (!entry.pending_call && (entry.total_queued == 0)) {
+        m_folder_tasks.erase(res);
+    }
+}
+
+// Run each node of the graph on its lane once its dependencies have succeeded
+// NOTE: Nodes check the token themselves, nodes that haven't started are skipped once it is cancelled
+void App::queue_task_graph(std::shared_ptr<TaskGraph> graph, TaskPriority priority, util::CancellationToken token) {
+    for (auto id: graph->start()) {
+        push_task_graph_node(graph, id, priority, token);
+    }
+}
+
+void App::push_task_graph_node(
+    std::shared_ptr<TaskGraph> graph, TaskGraph::NodeId id, 
+    TaskPriority priority, util::CancellationToken token) 
+{
+    const auto lane = graph->get_lane(id);
+    get_pool(lane).push([this, graph, id, priority, token](int pid) {
+        bool is_success = false;
+        if (!token.is_cancelled()) {
+            // NOTE: We may perform IO here in the thread pool which can raise exceptions
+            try {
+                is_success = graph->run_node(id, token);
+            } catch (std::exception& e) {
+                queue_app_error(e.what());
+            }
+        }
+        is_success = is_success && !token.is_cancelled();
+        for (auto next_id: graph->complete_node(id, is_success)) {
+            push_task_graph_node(graph, next_id, priority, token);
+        }
+    }, priority);
+}
+
+// Queue a graph of operations on a folder and cancel the previous graph for the same operation
+void App::queue_folder_graph(
+    std::shared_ptr<AppFolder> folder, FolderOperation operation, 
+    std::shared_ptr<TaskGraph> graph, TaskPriority priority) 
+{
+    auto token = begin_folder_graph(folder.get(), operation);
+    queue_folder_graph(std::move(folder), operation, std::move(graph), priority, std::move(token));
+}
+
+util::CancellationToken App::begin_folder_graph(const AppFolder* folder, FolderOperation operation) {
+    const auto key = FolderTaskKey{ folder, operation };
+    auto token = util::CancellationToken::create();
+    auto lock = std::scoped_lock(m_folder_graphs_mutex);
+    auto& prev_token = m_folder_graphs[key];
+    prev_token.cancel();
+    prev_token = token;
+    return token;
+}
+
+void App::queue_folder_graph(
+    std::shared_ptr<AppFolder> folder, FolderOperation operation, 
+    std::shared_ptr<TaskGraph> graph, TaskPriority priority, util::CancellationToken token) 
+{
+    const auto key = FolderTaskKey{ folder.get(), operation };
+
+    // NOTE: The folder is kept alive until the graph finishes so the key isn't reused
+    graph->set_on_finish([this, key, token, folder]() {
+        auto lock = std::scoped_lock(m_folder_graphs_mutex);
+        auto res = m_folder_graphs.find(key);
+        if ((res != m_folder_graphs.end()) && (res->second == token)) {
+            m_folder_graphs.erase(res);
+        }
+    });
+    queue_task_graph(std::move(graph), priority, token);
+}
+
+// load the state then bookmarks of the folder, where the bookmarks don't depend on the state
+void App::select_folder(std::shared_ptr<AppFolder> folder) {
+    m_current_folder_token.cancel();
+    m_current_folder_token = util::CancellationToken::create();
+    m_current_folder = folder;
+    if (folder == nullptr) {
+        return;
+    }
+
+    auto graph = std::make_shared<TaskGraph>();
+    auto load_cache = graph->add_node("load_cache", TaskLane::DISK, [folder](const util::CancellationToken& token) {
+        return folder->load_cache_if_missing();
+    });
+    graph->add_node("update_state", TaskLane::DISK, [folder](const util::CancellationToken& token) {
+        return folder->update_state_from_cache(token);
+    }, { load_cache });
+    graph->add_node("load_bookmarks", TaskLane::DISK, [folder](const util::CancellationToken& token) {
+        return folder->load_bookmarks_from_file();
     });
+    queue_task_graph(std::move(graph), TaskPriority::INTERACTIVE, m_current_folder_token);
 }
 
-// mutex protected addition of error
+// NOTE: These can be called from any thread without blocking
 void App::queue_app_error(const std::string& error) {
-    auto lock = std::scoped_lock(m_app_errors_mutex);
-    m_app_errors.push_back(error);
+    m_diagnostics.push(Severity::SEVERITY_ERROR, APP_DIAGNOSTIC_ID, error);
 }
 
 void App::queue_app_warning(const std::string& warning) {
-    auto lock = std::scoped_lock(m_app_warnings_mutex);
-    m_app_warnings.push_back(warning);
+    m_diagnostics.push(Severity::SEVERITY_WARNING, APP_DIAGNOSTIC_ID, warning);
 }
 
 };
@@ -8,15 +8,38 @@
 #include <atomic>
 #include <mutex>
 #include <functional>
+#include <map>
 
 #include "file_intents.h"
-#include "util/ctpl_stl.h"
+#include "app_library_stats.h"
+#include "app_library_scan.h"
+#include "app_auto_match.h"
+#include "app_library_sync.h"
+#include "app_diagnostics.h"
+#include "app_task_graph.h"
+#include "app_metadata_store.h"
+#include "tvdb_api/tvdb_api.h"
+#include "util/work_stealing_pool.h"
+#include "util/cancellation_token.h"
 
 namespace app 
 {
 
 // NOTE: foward declare
 class AppFolder;
+struct AppConfig;
+
+// Operations on a folder which are coalesced if they are requested while already queued
+enum class FolderOperation {
+    SCAN,
+    REFRESH_CACHE,
+    DOWNLOAD_CACHE,
+    EXECUTE,
+    SAVE_BOOKMARKS,
+    SEARCH,
+};
+
+using FolderTaskCall = std::function<void (const util::CancellationToken&)>;
 
 
 // Main app object which contains all folders
@@ -25,27 +48,151 @@ class App
 public:
     std::filesystem::path m_root;
     FilterRules m_cfg;
-    std::string m_token;
+    // errors and warnings from the app and its folders
+    // NOTE: Declared before the folders since they hold a reference to it
+    //       Declared before the client since its authenticator reports failures to it
+    DiagnosticsChannel m_diagnostics;
+
+    // NOTE: Declared before the thread pools since their tasks use the client
+    std::unique_ptr<tvdb_api::TvdbClient> m_tvdb_client;
     std::string m_credentials_filepath;
 
+    // totals across all folders which are updated as each folder changes
+    // NOTE: Declared before the folders since they deregister themselves on destruction
+    AppLibraryStats m_library_stats;
+    // NOTE: The folder list is rebuilt in the background when revalidating the library index
+    //       Hold this mutex when iterating over or modifying the folder list
     std::list<std::shared_ptr<AppFolder>> m_folders;
+    std::mutex m_folders_mutex;
     std::shared_ptr<AppFolder> m_current_folder;
-
-    std::vector<std::string> m_app_errors;
-    std::mutex m_app_errors_mutex;
-    std::list<std::string> m_app_warnings;
-    std::mutex m_app_warnings_mutex;
+    // cancelled when another folder is selected so its loading is skipped
+    util::CancellationToken m_current_folder_token;
 private:
-    ctpl::thread_pool m_thread_pool;
+    // At most one task is running and one is pending for each folder and operation
+    // A new request replaces the pending task so that only the latest one is run
+    struct FolderTaskKey {
+        const AppFolder* folder;
+        FolderOperation operation;
+        bool operator<(const FolderTaskKey& rhs) const {
+            if (folder != rhs.folder) return folder < rhs.folder;
+            return operation < rhs.operation;
+        }
+    };
+    struct FolderTaskEntry {
+        FolderTaskCall pending_call = nullptr;
+        util::CancellationToken token = util::CancellationToken::create();
+        TaskLane lane = TaskLane::CPU;
+        TaskPriority priority = TaskPriority::BACKGROUND;
+        int total_queued = 0;
+        bool is_running = false;
+    };
+    std::map<FolderTaskKey, FolderTaskEntry> m_folder_tasks;
+    std::mutex m_folder_tasks_mutex;
+    // a graph that is still running is stale once another graph for the same folder operation is queued
+    std::map<FolderTaskKey, util::CancellationToken> m_folder_graphs;
+    std::mutex m_folder_graphs_mutex;
+
+    // a newer refresh makes any running revalidation stale
+    std::atomic<uint64_t> m_refresh_generation;
+    // the root that the folder list was built from so a refresh of the same root is diffed
+    std::filesystem::path m_loaded_root;
+    // the library index is only written when the totals have changed since the last save
+    uint64_t m_saved_index_generation;
+    std::atomic<bool> m_is_index_saving;
+    std::mutex m_index_file_mutex;
+    // series and episodes of the library which the folders read their caches from
+    // NOTE: Replaced by a newly written store when the caches of folders have changed
+    std::shared_ptr<const MetadataStore> m_metadata_store;
+    std::filesystem::path m_metadata_store_root;
+    std::mutex m_metadata_store_mutex;
+    uint64_t m_saved_cache_generation;
+    std::atomic<bool> m_is_store_saving;
+    // write series.json and episodes.json into each folder as well as the metadata store
+    bool m_is_json_cache_exported;
+    // write cache.bin into each folder as well as the metadata store
+    bool m_is_binary_cache_exported;
+
     std::atomic<int> m_global_busy_count;
+    std::unique_ptr<util::WorkStealingPool> m_disk_pool;
+    std::unique_ptr<util::WorkStealingPool> m_network_pool;
+    std::unique_ptr<util::WorkStealingPool> m_cpu_pool;
+    LibraryScanConfig m_scan_config;
+    // NOTE: Declared after the pools since the scan queues its stages onto them
+    std::unique_ptr<LibraryScanPipeline> m_scan_pipeline;
+    // NOTE: Declared after the pools since accepted matches are queued onto them
+    AutoMatchConfig m_auto_match_config;
+    std::unique_ptr<AutoMatcher> m_auto_matcher;
+    // NOTE: Declared after the pools since patched folders are rescanned on them
+    LibrarySyncConfig m_library_sync_config;
+    std::unique_ptr<LibrarySync> m_library_sync;
 public:
     App(const char* config_filepath);
+    ~App();
     void authenticate();
     void refresh_folders();
+    // save the library index and metadata store once background work has settled, called once per frame
+    void update_library_index();
     int get_folder_busy_count() { return m_global_busy_count; }
-    void queue_async_call(std::function<void (int)> call);
+    void queue_async_call(
+        std::function<void (int)> call, 
+        TaskLane lane=TaskLane::CPU, 
+        TaskPriority priority=TaskPriority::BACKGROUND);
+    const util::WorkStealingPool& get_thread_pool(TaskLane lane) const;
+    // rescan every folder, this cancels any library scan that is still running
+    void scan_all_folders();
+    const LibraryScanPipeline* get_scan_pipeline() const { return m_scan_pipeline.get(); }
+    // search for the series of every folder without a cache, this cancels any match that is still running
+    void auto_match_folders();
+    AutoMatcher* get_auto_matcher() { return m_auto_matcher.get(); }
+    // fetch the series that changed on tvdb since the last sync and patch their caches
+    // NOTE: This cancels any sync that is still running
+    void sync_library();
+    const LibrarySync* get_library_sync() const { return m_library_sync.get(); }
+    LibrarySync* get_library_sync() { return m_library_sync.get(); }
+    // download the series and episodes of a folder and rescan it
+    void queue_download_cache(std::shared_ptr<AppFolder> folder, uint32_t id, TaskPriority priority=TaskPriority::INTERACTIVE);
+    void queue_folder_task(
+        std::shared_ptr<AppFolder> folder, FolderOperation operation, FolderTaskCall call,
+        TaskLane lane, TaskPriority priority);
+    // Same as queue_folder_task but the call is dropped if a newer request is already pending
+    // NOTE: Used by a running task to queue the next step of its operation
+    void continue_folder_task(
+        std::shared_ptr<AppFolder> folder, FolderOperation operation, FolderTaskCall call,
+        TaskLane lane, TaskPriority priority);
+    void cancel_folder_task(const AppFolder* folder, FolderOperation operation);
+    void queue_task_graph(
+        std::shared_ptr<TaskGraph> graph, TaskPriority priority, 
+        util::CancellationToken token={});
+    void queue_folder_graph(
+        std::shared_ptr<AppFolder> folder, FolderOperation operation, 
+        std::shared_ptr<TaskGraph> graph, TaskPriority priority);
+    // Cancels the previous graph of the operation now and gives the token to queue the graph with later
+    // NOTE: Used when the graph is only built once a request has completed
+    util::CancellationToken begin_folder_graph(const AppFolder* folder, FolderOperation operation);
+    void queue_folder_graph(
+        std::shared_ptr<AppFolder> folder, FolderOperation operation, 
+        std::shared_ptr<TaskGraph> graph, TaskPriority priority, util::CancellationToken token);
+    // select the folder and load it while cancelling the loading of the previous selection
+    void select_folder(std::shared_ptr<AppFolder> folder);
     void queue_app_error(const std::string& error);
     void queue_app_warning(const std::string& warning);
+private:
+    void create_thread_pools(const AppConfig& cfg);
+    void revalidate_folders(uint64_t refresh_generation, const std::filesystem::path& root);
+    std::string get_library_index_json();
+    bool save_library_index(const std::filesystem::path& filepath, const std::string& json_str);
+    std::shared_ptr<AppFolder> create_folder(const std::filesystem::path& path);
+    std::shared_ptr<const MetadataStore> get_metadata_store();
+    void save_metadata_store(const std::filesystem::path& root);
+    void push_folder_task(
+        const FolderTaskKey& key, FolderTaskEntry& entry, FolderTaskCall call,
+        TaskLane lane, TaskPriority priority);
+    void push_folder_task_runner(const FolderTaskKey& key, FolderTaskEntry& entry);
+    void run_folder_task(const FolderTaskKey& key);
+    void push_task_graph_node(
+        std::shared_ptr<TaskGraph> graph, TaskGraph::NodeId id, 
+        TaskPriority priority, util::CancellationToken token);
+    util::WorkStealingPool& get_pool(TaskLane lane);
 };
 
 };
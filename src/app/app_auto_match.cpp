@@ -0,0 +1,417 @@
+#include "app_auto_match.h"
+#include "app_folder.h"
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <string_view>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "util/trace.h"
+
+namespace app
+{
+
+// a candidate from a different year is kept but drops below an exact match from the right year
+constexpr float YEAR_MISMATCH_PENALTY = 0.9f;
+// NOTE: The matcher waits with a timeout so that a cancel isn't stuck behind the rate limiter
+constexpr auto SEARCH_POLL_INTERVAL = std::chrono::milliseconds(100);
+
+// tags that are added to the folder name by a release and never start a series name
+static const char* RELEASE_TAGS[] = {
+    "complete", "season", "seasons",
+    "4k", "uhd", "hdr", "10bit", "8bit",
+    "x264", "x265", "h264", "h265", "hevc", "avc", "xvid", "divx",
+    "bluray", "blu-ray", "bdrip", "brrip", "webrip", "web-dl", "webdl", "hdtv", "dvdrip", "remux",
+    "aac", "ac3", "dts", "proper", "repack", "subbed", "dubbed",
+};
+
+static bool get_is_digits(const char* str, size_t length) {
+    if (length == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!isdigit((unsigned char)str[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns 0 if the string isn't a year
+static int parse_year(const char* str, size_t length) {
+    if ((length != 4) || !get_is_digits(str, length)) {
+        return 0;
+    }
+    const int year = atoi(std::string(str, length).c_str());
+    return ((year >= 1900) && (year <= 2099)) ? year : 0;
+}
+
+// NOTE: The word is lowercase
+static bool get_is_release_tag(const std::string& word) {
+    // the release group is joined to the last tag with a hyphen, e.g. x264-GROUP
+    const size_t hyphen = word.find('-');
+    const auto prefix = (hyphen == std::string::npos) ? word : word.substr(0, hyphen);
+    for (const char* tag: RELEASE_TAGS) {
+        if ((word == tag) || (prefix == tag)) {
+            return true;
+        }
+    }
+
+    const char* str = prefix.c_str();
+    const size_t length = prefix.size();
+    // season and episode numbers, e.g. s01, s01e02, s01-s05, e01
+    if ((length >= 2) && ((str[0] == 's') || (str[0] == 'e')) && isdigit((unsigned char)str[1])) {
+        return true;
+    }
+    // resolution, e.g. 720p, 1080i
+    if ((length >= 4) && (length <= 5) && ((str[length-1] == 'p') || (str[length-1] == 'i'))) {
+        return get_is_digits(str, length-1);
+    }
+    return false;
+}
+
+FolderQuery get_folder_query(const std::string& folder_name) {
+    // groups like [SubsPlease] and {hash} are dropped and separators become spaces
+    std::string cleaned;
+    cleaned.reserve(folder_name.size());
+    int depth = 0;
+    for (char c: folder_name) {
+        if ((c == '[') || (c == '{')) {
+            depth++;
+            cleaned.push_back(' ');
+        } else if ((c == ']') || (c == '}')) {
+            depth = std::max(depth-1, 0);
+        } else if (depth > 0) {
+            continue;
+        } else if ((c == '.') || (c == '_') || (c == '(') || (c == ')')) {
+            cleaned.push_back(' ');
+        } else {
+            cleaned.push_back(c);
+        }
+    }
+
+    std::vector<std::string> words;
+    size_t start = 0;
+    while (start < cleaned.size()) {
+        size_t end = cleaned.find(' ', start);
+        if (end == std::string::npos) {
+            end = cleaned.size();
+        }
+        if (end > start) {
+            words.push_back(cleaned.substr(start, end-start));
+        }
+        start = end+1;
+    }
+
+    // the name ends at the first year or release tag
+    // NOTE: The first word is always kept so series such as "1923" or "Complete" still have a name
+    FolderQuery query;
+    std::string name;
+    for (size_t i = 0; i < words.size(); i++) {
+        const auto& word = words[i];
+        if (i > 0) {
+            const int year = parse_year(word.c_str(), word.size());
+            if (year != 0) {
+                query.year = year;
+                break;
+            }
+            auto lower = word;
+            std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return char(tolower((unsigned char)c)); });
+            if (get_is_release_tag(lower)) {
+                break;
+            }
+            // an episode number after a separator, e.g. "Name - 01"
+            if ((word == "-") && ((i+1) < words.size()) && get_is_digits(words[i+1].c_str(), words[i+1].size())) {
+                break;
+            }
+        }
+        if (word == "-") {
+            continue;
+        }
+        if (!name.empty()) {
+            name.push_back(' ');
+        }
+        name += word;
+    }
+    query.name = std::move(name);
+    return query;
+}
+
+// lowercase letters and digits with a single space between words
+static std::string normalise_name(const std::string& name) {
+    std::string out;
+    out.reserve(name.size());
+    for (char c: name) {
+        if (isalnum((unsigned char)c)) {
+            out.push_back(char(tolower((unsigned char)c)));
+        } else if (c == '\'') {
+            // NOTE: "Grey's" and "Greys" should be the same name
+            continue;
+        } else if (!out.empty() && (out.back() != ' ')) {
+            out.push_back(' ');
+        }
+    }
+    if (!out.empty() && (out.back() == ' ')) {
+        out.pop_back();
+    }
+    if (out.rfind("the ", 0) == 0) {
+        out.erase(0, 4);
+    }
+    return out;
+}
+
+static std::vector<uint16_t> get_sorted_bigrams(const std::string& str) {
+    std::vector<uint16_t> bigrams;
+    if (str.size() < 2) {
+        return bigrams;
+    }
+    bigrams.reserve(str.size()-1);
+    for (size_t i = 0; (i+1) < str.size(); i++) {
+        bigrams.push_back(uint16_t((uint8_t(str[i]) << 8) | uint8_t(str[i+1])));
+    }
+    std::sort(bigrams.begin(), bigrams.end());
+    return bigrams;
+}
+
+float get_name_similarity(const std::string& a, const std::string& b) {
+    const auto norm_a = normalise_name(a);
+    const auto norm_b = normalise_name(b);
+    if (norm_a.empty() || norm_b.empty()) {
+        return 0.0f;
+    }
+    if (norm_a == norm_b) {
+        return 1.0f;
+    }
+
+    const auto bigrams_a = get_sorted_bigrams(norm_a);
+    const auto bigrams_b = get_sorted_bigrams(norm_b);
+    if (bigrams_a.empty() || bigrams_b.empty()) {
+        return 0.0f;
+    }
+
+    // size of the intersection of the two multisets
+    size_t total_shared = 0;
+    size_t i = 0, j = 0;
+    while ((i < bigrams_a.size()) && (j < bigrams_b.size())) {
+        if (bigrams_a[i] == bigrams_b[j]) {
+            total_shared++;
+            i++;
+            j++;
+        } else if (bigrams_a[i] < bigrams_b[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return float(2*total_shared) / float(bigrams_a.size() + bigrams_b.size());
+}
+
+std::vector<MatchCandidate> rank_candidates(const FolderQuery& query, std::vector<tvdb_api::SeriesInfo> results) {
+    std::vector<MatchCandidate> candidates;
+    candidates.reserve(results.size());
+    for (auto& series: results) {
+        // NOTE: Series that share a name have their year appended, e.g. "Doctor Who (2005)"
+        auto name = std::string_view(series.name);
+        int year = 0;
+        if ((name.size() >= 6) && (name.back() == ')') && (name[name.size()-6] == '(')) {
+            year = parse_year(name.data() + name.size()-5, 4);
+            if (year != 0) {
+                name = name.substr(0, name.size()-6);
+            }
+        }
+        if (year == 0) {
+            year = parse_year(series.air_date.c_str(), std::min<size_t>(series.air_date.size(), 4));
+        }
+
+        float score = get_name_similarity(query.name, std::string(name));
+        if ((query.year != 0) && (year != 0) && (year != query.year)) {
+            score *= YEAR_MISMATCH_PENALTY;
+        }
+        auto& candidate = candidates.emplace_back();
+        candidate.series = std::move(series);
+        candidate.score = score;
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+        return a.score > b.score;
+    });
+    return candidates;
+}
+
+AutoMatcher::AutoMatcher(
+    std::vector<std::shared_ptr<AppFolder>> folders,
+    const AutoMatchConfig& cfg,
+    tvdb_api::TvdbClient& client,
+    MatchCallback on_match,
+    ErrorCallback on_error)
+: m_cfg(cfg), m_folders(std::move(folders)), m_client(client),
+  m_on_match(std::move(on_match)), m_on_error(std::move(on_error)),
+  m_token(util::CancellationToken::create()),
+  m_start_time(std::chrono::steady_clock::now())
+{
+    m_total_processed = 0;
+    m_total_skipped = 0;
+    m_total_searched = 0;
+    m_total_accepted = 0;
+    m_total_failed = 0;
+    m_total_in_flight = 0;
+    m_is_finished = false;
+    m_finish_time = -1;
+    m_thread = std::thread([this]() { run(); });
+}
+
+AutoMatcher::~AutoMatcher() {
+    cancel();
+    m_thread.join();
+}
+
+void AutoMatcher::cancel() {
+    m_token.cancel();
+}
+
+AutoMatchProgress AutoMatcher::get_progress() const {
+    AutoMatchProgress progress;
+    progress.total_folders = int(m_folders.size());
+    progress.total_processed = m_total_processed;
+    progress.total_skipped = m_total_skipped;
+    progress.total_searched = m_total_searched;
+    progress.total_accepted = m_total_accepted;
+    progress.total_failed = m_total_failed;
+    progress.total_in_flight = m_total_in_flight;
+    progress.is_finished = m_is_finished;
+    {
+        auto lock = std::scoped_lock(m_reviews_mutex);
+        progress.total_review = int(m_reviews.size());
+    }
+
+    const int64_t finish_time = m_finish_time;
+    const int64_t elapsed_time = (finish_time >= 0) ? finish_time : get_elapsed_nanoseconds();
+    if (elapsed_time > 0) {
+        progress.searches_per_second = float(progress.total_searched) * 1e9f / float(elapsed_time);
+    }
+    return progress;
+}
+
+std::vector<AutoMatchReview> AutoMatcher::get_reviews() const {
+    auto lock = std::scoped_lock(m_reviews_mutex);
+    return m_reviews;
+}
+
+void AutoMatcher::remove_review(const AppFolder* folder) {
+    auto lock = std::scoped_lock(m_reviews_mutex);
+    m_reviews.erase(
+        std::remove_if(m_reviews.begin(), m_reviews.end(), [folder](const auto& review) {
+            return review.folder.get() == folder;
+        }),
+        m_reviews.end());
+}
+
+void AutoMatcher::add_review(AutoMatchReview&& review) {
+    // NOTE: The candidates are also shown in the series selection of the folder
+    {
+        auto& folder = *review.folder;
+        std::vector<tvdb_api::SeriesInfo> search_result;
+        search_result.reserve(review.candidates.size());
+        for (auto& candidate: review.candidates) {
+            search_result.push_back(candidate.series);
+        }
+        auto lock = std::scoped_lock(folder.m_search_mutex);
+        folder.m_search_result = std::move(search_result);
+    }
+    auto lock = std::scoped_lock(m_reviews_mutex);
+    m_reviews.push_back(std::move(review));
+}
+
+void AutoMatcher::run() {
+    struct Search {
+        std::shared_ptr<AppFolder> folder;
+        FolderQuery query;
+        std::future<tl::expected<std::vector<tvdb_api::SeriesInfo>, std::string>> result;
+    };
+
+    const size_t max_in_flight = size_t(std::max(m_cfg.max_searches_in_flight, 1));
+    const float accept_score = float(m_cfg.accept_score_percent) / 100.0f;
+    const float min_margin = float(m_cfg.min_margin_percent) / 100.0f;
+    const size_t max_candidates = size_t(std::max(m_cfg.max_candidates, 1));
+
+    std::deque<Search> searches;
+    size_t next_folder = 0;
+    while (!m_token.is_cancelled()) {
+        // keep the window of searches full
+        while ((searches.size() < max_in_flight) && (next_folder < m_folders.size())) {
+            auto& folder = m_folders[next_folder++];
+            if (!folder->get_is_unmatched()) {
+                m_total_skipped++;
+                m_total_processed++;
+                continue;
+            }
+            auto query = get_folder_query(folder->GetPath().filename().string());
+            if (query.name.empty()) {
+                add_review({ folder, std::move(query), {}, "Couldn't find a series name in the folder name" });
+                m_total_processed++;
+                continue;
+            }
+            auto result = m_client.search_series_info_async(query.name.c_str());
+            searches.push_back({ folder, std::move(query), std::move(result) });
+        }
+        m_total_in_flight = int(searches.size());
+        if (searches.empty()) {
+            break;
+        }
+
+        // NOTE: Searches start in the order they were submitted so we wait on the oldest one
+        auto& search = searches.front();
+        if (search.result.wait_for(SEARCH_POLL_INTERVAL) != std::future_status::ready) {
+            continue;
+        }
+        auto result = search.result.get();
+        auto folder = std::move(search.folder);
+        auto query = std::move(search.query);
+        searches.pop_front();
+        m_total_searched++;
+        m_total_processed++;
+
+        if (!result) {
+            m_total_failed++;
+            m_on_error(result.error());
+            add_review({ std::move(folder), std::move(query), {}, std::move(result.error()) });
+            continue;
+        }
+
+        auto candidates = [&]() {
+            TRACE_SCOPE("cpu", "AutoMatcher::rank_candidates");
+            return rank_candidates(query, std::move(result.value()));
+        }();
+        // NOTE: A unique exact match is accepted even if a longer name scores close to it
+        //       e.g. "Mock Series 12" and "Mock Series 120"
+        const bool is_confident =
+            !candidates.empty() &&
+            (candidates[0].score >= accept_score) &&
+            ((candidates.size() < 2) || 
+             ((candidates[0].score - candidates[1].score) >= min_margin) ||
+             ((candidates[0].score == 1.0f) && (candidates[1].score < 1.0f)));
+        if (is_confident) {
+            m_total_accepted++;
+            m_on_match(std::move(folder), candidates[0].series.id);
+            continue;
+        }
+
+        if (candidates.size() > max_candidates) {
+            candidates.resize(max_candidates);
+        }
+        add_review({ std::move(folder), std::move(query), std::move(candidates), "" });
+    }
+
+    m_total_in_flight = 0;
+    m_finish_time = get_elapsed_nanoseconds();
+    m_is_finished = true;
+}
+
+int64_t AutoMatcher::get_elapsed_nanoseconds() const {
+    const auto dt = std::chrono::steady_clock::now() - m_start_time;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
+}
+
+};
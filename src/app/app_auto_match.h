@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "tvdb_api/tvdb_api.h"
+#include "tvdb_api/tvdb_models.h"
+#include "util/cancellation_token.h"
+
+namespace app
+{
+
+// NOTE: foward declare
+class AppFolder;
+
+struct AutoMatchConfig {
+    // searches are still paced by the rate limiter of the client
+    int max_searches_in_flight = 32;
+    // a match is accepted if the best candidate scores at least this
+    // and is ahead of the next candidate by the margin or is the only exact match
+    int accept_score_percent = 90;
+    int min_margin_percent = 10;
+    // number of candidates that are kept for review
+    int max_candidates = 10;
+};
+
+// the series name and year that are guessed from the name of a folder
+struct FolderQuery {
+    std::string name;
+    int year = 0;   // 0 if there is no year in the folder name
+};
+
+struct MatchCandidate {
+    tvdb_api::SeriesInfo series;
+    float score = 0.0f;
+};
+
+// Folders that couldn't be matched with enough confidence
+struct AutoMatchReview {
+    std::shared_ptr<AppFolder> folder;
+    FolderQuery query;
+    // NOTE: Sorted from the best to the worst score
+    std::vector<MatchCandidate> candidates;
+    // set if the search failed
+    std::string error;
+};
+
+struct AutoMatchProgress {
+    int total_folders = 0;
+    int total_processed = 0;
+    int total_skipped = 0;      // folders that already have a cache
+    int total_searched = 0;
+    int total_accepted = 0;
+    int total_review = 0;
+    int total_failed = 0;
+    int total_in_flight = 0;
+    bool is_finished = false;
+    float searches_per_second = 0.0f;
+};
+
+// Strips release tags such as the resolution, codec, season range and group from a folder name
+// e.g. "The.Office.US.2005.S01-S09.1080p.WEB-DL.x264-GROUP" gives "The Office US" and 2005
+FolderQuery get_folder_query(const std::string& folder_name);
+// Dice coefficient over the character bigrams of the normalised names between 0 and 1
+// NOTE: Case, punctuation and a leading "the" are ignored
+float get_name_similarity(const std::string& a, const std::string& b);
+// NOTE: A candidate from a different year than the query is scored lower
+std::vector<MatchCandidate> rank_candidates(const FolderQuery& query, std::vector<tvdb_api::SeriesInfo> results);
+
+// Searches for the series of each folder without a cache from a single thread
+// The searches run concurrently on the event loop of the client with a bounded number in flight
+// High confidence matches are passed to a callback and the rest are kept for review
+class AutoMatcher
+{
+public:
+    using MatchCallback = std::function<void (std::shared_ptr<AppFolder>, uint32_t)>;
+    using ErrorCallback = std::function<void (const std::string&)>;
+private:
+    const AutoMatchConfig m_cfg;
+    std::vector<std::shared_ptr<AppFolder>> m_folders;
+    tvdb_api::TvdbClient& m_client;
+    MatchCallback m_on_match;
+    ErrorCallback m_on_error;
+    util::CancellationToken m_token;
+
+    std::atomic<int> m_total_processed;
+    std::atomic<int> m_total_skipped;
+    std::atomic<int> m_total_searched;
+    std::atomic<int> m_total_accepted;
+    std::atomic<int> m_total_failed;
+    std::atomic<int> m_total_in_flight;
+    std::atomic<bool> m_is_finished;
+    // nanoseconds since the start of the match
+    std::atomic<int64_t> m_finish_time;
+    const std::chrono::steady_clock::time_point m_start_time;
+
+    std::vector<AutoMatchReview> m_reviews;
+    mutable std::mutex m_reviews_mutex;
+    std::thread m_thread;
+public:
+    AutoMatcher(
+        std::vector<std::shared_ptr<AppFolder>> folders,
+        const AutoMatchConfig& cfg,
+        tvdb_api::TvdbClient& client,
+        MatchCallback on_match,
+        ErrorCallback on_error);
+    ~AutoMatcher();
+    // NOTE: Searches that are in flight are abandoned
+    void cancel();
+    bool get_is_cancelled() const { return m_token.is_cancelled(); }
+    bool get_is_finished() const { return m_is_finished; }
+    AutoMatchProgress get_progress() const;
+    std::vector<AutoMatchReview> get_reviews() const;
+    void remove_review(const AppFolder* folder);
+
+    AutoMatcher(const AutoMatcher&) = delete;
+    AutoMatcher(AutoMatcher&&) = delete;
+    AutoMatcher& operator=(const AutoMatcher&) = delete;
+    AutoMatcher& operator=(AutoMatcher&&) = delete;
+private:
+    void run();
+    void add_review(AutoMatchReview&& review);
+    int64_t get_elapsed_nanoseconds() const;
+};
+
+};
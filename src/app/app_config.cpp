@@ -26,6 +26,14 @@ std::vector<std::string> load_string_list(rapidjson::Document& doc, const char*
     return vec;
 };
 
+static
+int load_int_default(rapidjson::Value& obj, const char* key, int default_value) {
+    if (!obj.HasMember(key) || !obj[key].IsInt()) {
+        return default_value;
+    }
+    return obj[key].GetInt();
+}
+
 tl::expected<AppConfig, std::string> load_app_config_from_filepath(const char* filename) {
     auto load_result = util::load_document_from_file(filename);
     if (load_result.code != util::DocumentLoadCode::OK) {
@@ -45,6 +53,56 @@ tl::expected<AppConfig, std::string> load_app_config_from_filepath(const char* f
     cfg.whitelist_filenames = load_string_list(doc, "whitelist_filenames");
     cfg.whitelist_folders = load_string_list(doc, "whitelist_folders");
     cfg.whitelist_tags = load_string_list(doc, "whitelist_tags");
+
+    if (doc.HasMember("thread_pool")) {
+        auto& pool = doc["thread_pool"];
+        cfg.disk_threads = load_int_default(pool, "disk_threads", cfg.disk_threads);
+        cfg.network_threads = load_int_default(pool, "network_threads", cfg.network_threads);
+        cfg.cpu_threads = load_int_default(pool, "cpu_threads", cfg.cpu_threads);
+    }
+
+    if (doc.HasMember("tvdb_api")) {
+        auto& api = doc["tvdb_api"];
+        auto& client = cfg.tvdb_client;
+        if (api.HasMember("base_url")) {
+            client.base_url = api["base_url"].GetString();
+        }
+        client.max_idle_sessions = load_int_default(api, "max_idle_sessions", client.max_idle_sessions);
+        client.max_pages_in_flight = load_int_default(api, "max_pages_in_flight", client.max_pages_in_flight);
+        client.timeout_ms = load_int_default(api, "timeout_ms", client.timeout_ms);
+        client.connect_timeout_ms = load_int_default(api, "connect_timeout_ms", client.connect_timeout_ms);
+        client.max_requests_per_second = load_int_default(api, "max_requests_per_second", client.max_requests_per_second);
+        client.max_burst_requests = load_int_default(api, "max_burst_requests", client.max_burst_requests);
+        client.max_retries = load_int_default(api, "max_retries", client.max_retries);
+        client.retry_base_delay_ms = load_int_default(api, "retry_base_delay_ms", client.retry_base_delay_ms);
+        client.retry_max_delay_ms = load_int_default(api, "retry_max_delay_ms", client.retry_max_delay_ms);
+        client.token_refresh_interval_ms = load_int_default(api, "token_refresh_interval_ms", client.token_refresh_interval_ms);
+        client.auth_retry_base_delay_ms = load_int_default(api, "auth_retry_base_delay_ms", client.auth_retry_base_delay_ms);
+        client.auth_retry_max_delay_ms = load_int_default(api, "auth_retry_max_delay_ms", client.auth_retry_max_delay_ms);
+    }
+
+    if (doc.HasMember("auto_match")) {
+        auto& match = doc["auto_match"];
+        auto& auto_match = cfg.auto_match;
+        auto_match.max_searches_in_flight = load_int_default(match, "max_searches_in_flight", auto_match.max_searches_in_flight);
+        auto_match.accept_score_percent = load_int_default(match, "accept_score_percent", auto_match.accept_score_percent);
+        auto_match.min_margin_percent = load_int_default(match, "min_margin_percent", auto_match.min_margin_percent);
+        auto_match.max_candidates = load_int_default(match, "max_candidates", auto_match.max_candidates);
+    }
+
+    if (doc.HasMember("library_sync")) {
+        auto& sync = doc["library_sync"];
+        auto& library_sync = cfg.library_sync;
+        library_sync.max_series_in_flight = load_int_default(sync, "max_series_in_flight", library_sync.max_series_in_flight);
+        library_sync.max_delta_days = load_int_default(sync, "max_delta_days", library_sync.max_delta_days);
+    }
+
+    if (doc.HasMember("export_json_cache")) {
+        cfg.export_json_cache = doc["export_json_cache"].GetBool();
+    }
+    if (doc.HasMember("export_binary_cache")) {
+        cfg.export_binary_cache = doc["export_binary_cache"].GetBool();
+    }
     return cfg;
 }
 
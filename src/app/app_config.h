@@ -3,6 +3,9 @@
 #include <string>
 #include <vector>
 #include "util/expected.hpp"
+#include "tvdb_api/tvdb_api.h"
+#include "app_auto_match.h"
+#include "app_library_sync.h"
 
 namespace app {
 
@@ -12,6 +15,18 @@ struct AppConfig {
     std::vector<std::string> whitelist_filenames;
     std::vector<std::string> blacklist_extensions; 
     std::vector<std::string> whitelist_tags; 
+    // number of threads for each lane of async work
+    // NOTE: A value of 0 means it is sized to the hardware
+    int disk_threads = 2;
+    int network_threads = 16;
+    int cpu_threads = 0;
+    tvdb_api::TvdbClientConfig tvdb_client;
+    AutoMatchConfig auto_match;
+    LibrarySyncConfig library_sync;
+    // write series.json and episodes.json into each folder alongside the library metadata store
+    bool export_json_cache = false;
+    // write a binary cache.bin into each folder which loads faster than the json cache
+    bool export_binary_cache = false;
 };
 
 tl::expected<AppConfig, std::string> load_app_config_from_filepath(const char* filename);
@@ -0,0 +1,62 @@
+#include "app_diagnostics.h"
+#include <algorithm>
+
+namespace app 
+{
+
+DiagnosticsChannel::DiagnosticsChannel(size_t capacity, size_t max_log_entries)
+: m_queue(capacity), m_total_dropped(0), m_max_log_entries(std::max(max_log_entries, size_t(1)))
+{}
+
+void DiagnosticsChannel::push(Severity severity, uint64_t folder_id, std::string message) {
+    auto diagnostic = Diagnostic{};
+    diagnostic.severity = severity;
+    diagnostic.folder_id = folder_id;
+    diagnostic.message = std::move(message);
+    diagnostic.timestamp = std::chrono::system_clock::now();
+    if (!m_queue.try_push(std::move(diagnostic))) {
+        m_total_dropped++;
+    }
+}
+
+// merge repeated messages into the existing entry and move it to the end
+void DiagnosticsChannel::drain() {
+    Diagnostic diagnostic;
+    while (m_queue.try_pop(diagnostic)) {
+        auto key = Key{ diagnostic.severity, diagnostic.folder_id, diagnostic.message };
+        auto res = m_log_lookup.find(key);
+        if (res == m_log_lookup.end()) {
+            // NOTE: Repeats are moved to the end so the front is the least recent diagnostic
+            if (m_log.size() >= m_max_log_entries) {
+                remove(m_log.begin());
+            }
+            m_log.push_back(std::move(diagnostic));
+            m_log_lookup.emplace(std::move(key), std::prev(m_log.end()));
+            continue;
+        }
+
+        auto it = res->second;
+        it->total_repeats++;
+        it->timestamp = diagnostic.timestamp;
+        m_log.splice(m_log.end(), m_log, it);
+    }
+}
+
+void DiagnosticsChannel::remove(std::list<Diagnostic>::const_iterator it) {
+    m_log_lookup.erase(Key{ it->severity, it->folder_id, it->message });
+    m_log.erase(it);
+}
+
+void DiagnosticsChannel::remove_all(Severity severity, uint64_t folder_id) {
+    auto it = m_log.begin();
+    while (it != m_log.end()) {
+        if ((it->severity == severity) && (it->folder_id == folder_id)) {
+            m_log_lookup.erase(Key{ it->severity, it->folder_id, it->message });
+            it = m_log.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+};
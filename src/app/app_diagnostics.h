@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <tuple>
+#include <atomic>
+#include <chrono>
+
+#include "util/mpsc_queue.h"
+
+namespace app 
+{
+
+// NOTE: Prefixed since windows.h defines ERROR as a macro
+enum class Severity: uint8_t {
+    SEVERITY_INFO, SEVERITY_WARNING, SEVERITY_ERROR,
+};
+
+// folder ids start at 1 so this is used for diagnostics that belong to the app
+constexpr uint64_t APP_DIAGNOSTIC_ID = 0;
+
+struct Diagnostic {
+    Severity severity = Severity::SEVERITY_INFO;
+    uint64_t folder_id = APP_DIAGNOSTIC_ID;
+    std::string message;
+    std::chrono::system_clock::time_point timestamp;
+    // number of identical messages that were merged into this one
+    int total_repeats = 1;
+};
+
+// Errors and warnings are pushed from worker threads without taking a lock
+// The render thread drains them once per frame into a log where repeated messages are merged
+// NOTE: The log is capped so the oldest diagnostics are evicted once it is full
+class DiagnosticsChannel 
+{
+private:
+    util::MPSCQueue<Diagnostic> m_queue;
+    std::atomic<int> m_total_dropped;
+    const size_t m_max_log_entries;
+
+    // NOTE: Only accessed from the consumer thread
+    using Key = std::tuple<Severity, uint64_t, std::string>;
+    std::list<Diagnostic> m_log;
+    std::map<Key, std::list<Diagnostic>::iterator> m_log_lookup;
+public:
+    explicit DiagnosticsChannel(size_t capacity=1024, size_t max_log_entries=1024);
+    // NOTE: The diagnostic is dropped if the queue is full
+    void push(Severity severity, uint64_t folder_id, std::string message);
+    int get_total_dropped() const { return m_total_dropped; }
+
+    // NOTE: The following may only be called from the consumer thread
+    void drain();
+    const std::list<Diagnostic>& get_log() const { return m_log; }
+    void remove(std::list<Diagnostic>::const_iterator it);
+    void remove_all(Severity severity, uint64_t folder_id);
+
+    DiagnosticsChannel(const DiagnosticsChannel&) = delete;
+    DiagnosticsChannel(DiagnosticsChannel&&) = delete;
+    DiagnosticsChannel& operator=(const DiagnosticsChannel&) = delete;
+    DiagnosticsChannel& operator=(DiagnosticsChannel&&) = delete;
+};
+
+};
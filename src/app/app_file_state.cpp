@@ -18,6 +18,57 @@ void AppFileState::SetAction(FileIntent::Action new_action) {
         return;
     }
 
+    auto cmd = AppFolderState::EditCommand{};
+    cmd.file = this;
+    cmd.type = AppFolderState::EditCommand::Type::ACTION;
+    cmd.old_action = m_intent.action;
+    cmd.new_action = new_action;
+
+    auto old_dest = m_intent.dest;
+    ApplyAction(new_action);
+    // only store the destination if it was auto filled
+    if (old_dest != m_intent.dest) {
+        cmd.old_dest = std::move(old_dest);
+        cmd.new_dest = m_intent.dest;
+    }
+    m_folder.PushEdit(std::move(cmd));
+}
+
+void AppFileState::SetIsActive(bool new_is_active) {
+    if (m_intent.is_active == new_is_active) {
+        return;
+    }
+
+    auto cmd = AppFolderState::EditCommand{};
+    cmd.file = this;
+    cmd.type = AppFolderState::EditCommand::Type::IS_ACTIVE;
+    cmd.old_is_active = m_intent.is_active;
+    cmd.new_is_active = new_is_active;
+
+    ApplyIsActive(new_is_active);
+    m_folder.PushEdit(std::move(cmd));
+}
+
+void AppFileState::OnDestChange() {
+    if (m_old_dest == m_intent.dest) {
+        return;
+    }
+
+    auto cmd = AppFolderState::EditCommand{};
+    cmd.file = this;
+    cmd.type = AppFolderState::EditCommand::Type::DEST;
+    cmd.old_dest = m_old_dest;
+    cmd.new_dest = m_intent.dest;
+
+    UpdateDestBookkeeping();
+    m_folder.PushEdit(std::move(cmd));
+}
+
+void AppFileState::ApplyAction(FileIntent::Action new_action) {
+    if (m_intent.action == new_action) {
+        return;
+    }
+
     m_folder.UpdateActionCount(m_intent.action, -1);
     m_folder.UpdateActionCount(new_action, +1);
 
@@ -45,7 +96,7 @@ void AppFileState::SetAction(FileIntent::Action new_action) {
     } 
 }
 
-void AppFileState::SetIsActive(bool new_is_active) {
+void AppFileState::ApplyIsActive(bool new_is_active) {
     if (m_intent.is_active == new_is_active) {
         return;
     }
@@ -66,7 +117,12 @@ void AppFileState::SetIsActive(bool new_is_active) {
     } 
 }
 
-void AppFileState::OnDestChange() {
+void AppFileState::ApplyDest(const std::string& new_dest) {
+    m_intent.dest = new_dest;
+    UpdateDestBookkeeping();
+}
+
+void AppFileState::UpdateDestBookkeeping() {
     m_folder.is_conflict_table_dirty = true;
     const bool is_rename = (m_intent.action == FileIntent::Action::RENAME);
     if (m_intent.is_active && is_rename) {
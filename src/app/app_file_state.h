@@ -31,6 +31,11 @@ public:
     void OnDestChange();
 private:
     void SetIsConflict(bool new_is_conflict) { m_intent.is_conflict = new_is_conflict; }
+    // apply changes and update folder bookkeeping without recording them into the edit history
+    void ApplyAction(FileIntent::Action new_action);
+    void ApplyIsActive(bool new_is_active);
+    void ApplyDest(const std::string& new_dest);
+    void UpdateDestBookkeeping();
     friend class AppFolderState;
 };
 
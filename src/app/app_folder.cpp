@@ -5,76 +5,174 @@
 #include <vector>
 #include <memory>
 #include <mutex>
-#include <condition_variable>
+#include <shared_mutex>
+#include <future>
 #include <spdlog/spdlog.h>
 #include <fmt/core.h>
 
 #include "app_folder_state.h"
 #include "app_folder_bookmarks_json.h"
+#include "app_folder_cache_binary.h"
 #include "file_intents.h"
 #include "tvdb_api/tvdb_api.h"
 #include "tvdb_api/tvdb_models.h"
 #include "tvdb_api/tvdb_json.h"
 #include "util/file_loading.h"
+#include "util/work_stealing_pool.h"
+#include "util/trace.h"
+#include "util/metrics.h"
 #include "os_dep.h"
 
-constexpr const char* EPISODES_CACHE_FN = "episodes.json";
-constexpr const char* SERIES_CACHE_FN = "series.json";
-constexpr const char* BOOKMARKS_FN = "bookmarks.json";
-
-
 namespace app 
 {
 
 namespace fs = std::filesystem;
 
-// TODO: We force all operations on a folder to be atomic
-//       This means operations coming in from multiple threads will block each other
-//       This is because there is alot of inter data dependencies in our data structure 
-//       However it may be possible to have certain operations occur in parallel with other ones
-class BusyLock 
+// Keeps count of the operations in flight so the UI can show which folders are busy
+// NOTE: This doesn't serialise operations, each operation locks only the resources it touches
+class BusyCounter 
 {
 public:
-    std::unique_lock<std::mutex> m_is_busy_lock;
-    bool& m_is_busy;
-    std::atomic<int>& m_busy_count;
-    BusyLock(std::mutex& is_busy_mutex, bool& is_busy, std::atomic<int>& busy_count)
-    : m_is_busy_lock(is_busy_mutex), m_is_busy(is_busy), m_busy_count(busy_count) 
+    std::atomic<int>& m_folder_count;
+    std::atomic<int>& m_global_count;
+    BusyCounter(std::atomic<int>& folder_count, std::atomic<int>& global_count)
+    : m_folder_count(folder_count), m_global_count(global_count) 
     {
-        m_is_busy = true;
-        m_busy_count++;
+        // the global count is the number of busy folders rather than operations
+        if (m_folder_count.fetch_add(1) == 0) {
+            m_global_count++;
+        }
     }
-    ~BusyLock() {
-        m_is_busy = false;
-        m_busy_count--;
+    ~BusyCounter() {
+        if (m_folder_count.fetch_sub(1) == 1) {
+            m_global_count--;
+        }
     }
-    BusyLock(const BusyLock&) = delete;
-    BusyLock(BusyLock&&) = delete;
-    BusyLock& operator=(const BusyLock&) = delete;
-    BusyLock& operator=(BusyLock&&) = delete;
+    BusyCounter(const BusyCounter&) = delete;
+    BusyCounter(BusyCounter&&) = delete;
+    BusyCounter& operator=(const BusyCounter&) = delete;
+    BusyCounter& operator=(BusyCounter&&) = delete;
 };
 
+// NOTE: Zero is reserved for diagnostics from the app
+static std::atomic<uint64_t> NEXT_FOLDER_ID = 1;
+
 AppFolder::AppFolder(
     const fs::path& path, 
     FilterRules& cfg,
-    std::atomic<int>& busy_count) 
-: m_path(path), m_cfg(cfg), m_global_busy_count(busy_count) 
+    std::atomic<int>& busy_count,
+    AppLibraryStats& library_stats,
+    DiagnosticsChannel& diagnostics) 
+: m_path(path), m_id(NEXT_FOLDER_ID++), m_cfg(cfg), m_global_busy_count(busy_count), 
+  m_library_stats(library_stats), m_diagnostics(diagnostics)
 {
     m_is_info_cached = false;
+    m_cache_store_index = 0;
+    m_is_json_exported = true;
+    m_is_binary_exported = false;
+    m_series_id = 0;
+    m_is_removed = false;
+    m_is_scanned = false;
     m_status = AppFolder::Status::UNKNOWN;
     m_state = std::make_unique<AppFolderState>();
-    m_is_busy = false;
+    m_summary_revision = m_state->GetRevision();
+    m_busy_count = 0;
+
+    m_summary.status = AppFolder::Status::UNKNOWN;
+    m_library_stats.add_folder(m_summary);
+}
+
+AppFolder::~AppFolder() {
+    m_library_stats.remove_folder(m_summary);
 }
 
 void AppFolder::push_error(const std::string& str) {
-    std::scoped_lock lock(m_errors_mutex);
-    m_errors.push_back(str);
+    m_diagnostics.push(Severity::SEVERITY_ERROR, m_id, str);
+}
+
+// NOTE: The library writes the changed cache into the next metadata store
+void AppFolder::set_cache(tvdb_api::TVDB_Cache&& cache) {
+    m_cache = std::move(cache);
+    m_cache_store = nullptr;
+    m_cache_store_index = 0;
+    m_series_id = m_cache.series.id;
+    m_is_info_cached = true;
+    m_library_stats.notify_cache_changed();
+}
+
+CacheView AppFolder::get_cache_view() const {
+    if (m_cache_store) {
+        return CacheView(*m_cache_store, m_cache_store_index);
+    }
+    return CacheView(m_cache);
+}
+
+void AppFolder::set_metadata_store(std::shared_ptr<const MetadataStore> store) {
+    auto lock = std::unique_lock(m_cache_mutex);
+    if (m_cache_store && store) {
+        const uint32_t id = m_cache_store->get_series(m_cache_store_index).id;
+        auto index = store->find_series(id);
+        if (index) {
+            m_cache_store = store;
+            m_cache_store_index = index.value();
+        }
+    }
+    m_store = std::move(store);
+}
+
+bool AppFolder::load_cache_from_store() {
+    TRACE_SCOPE("io", "AppFolder::load_cache_from_store");
+    const uint32_t id = m_series_id;
+    if (id == 0) {
+        return false;
+    }
+    auto lock = std::unique_lock(m_cache_mutex);
+    if (!m_store) {
+        return false;
+    }
+    auto index = m_store->find_series(id);
+    if (!index) {
+        return false;
+    }
+    m_cache = tvdb_api::TVDB_Cache{};
+    m_cache_store = m_store;
+    m_cache_store_index = index.value();
+    m_is_info_cached = true;
+    return true;
+}
+
+// apply the difference to the library totals so they never have to be recounted
+void AppFolder::set_summary(const AppFolderSummary& summary) {
+    auto lock = std::scoped_lock(m_summary_mutex);
+    m_library_stats.update_folder(m_summary, summary);
+    m_summary = summary;
+    m_status = static_cast<Status>(summary.status);
+}
+
+// NOTE: A folder that isn't matched in the index keeps the match from the metadata store
+void AppFolder::seed_from_index(const LibraryIndexEntry& entry) {
+    if (entry.series_id != 0) {
+        m_series_id = entry.series_id;
+    }
+    set_summary(entry.summary);
+}
+
+// NOTE: Folders are direct children of the root so they are indexed by their name
+LibraryIndexEntry AppFolder::get_index_entry() {
+    LibraryIndexEntry entry;
+    entry.name = m_path.filename().string();
+    entry.series_id = m_series_id;
+    {
+        auto lock = std::scoped_lock(m_summary_mutex);
+        entry.summary = m_summary;
+    }
+    return entry;
 }
 
-bool AppFolder::load_search_series_from_tvdb(const char* name, const char* token) {
-    auto busy_lock = BusyLock(m_is_busy_mutex, m_is_busy, m_global_busy_count);
+bool AppFolder::load_search_series_from_tvdb(const char* name, tvdb_api::TvdbClient& client) {
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
 
-    auto search_opt = tvdb_api::search_series(name, token);
+    auto search_opt = client.search_series(name);
     if (!search_opt) {
         push_error(search_opt.error());
         return false;
@@ -92,70 +190,287 @@ bool AppFolder::load_search_series_from_tvdb(const char* name, const char* token
     return true;
 }
 
-bool AppFolder::load_cache_from_tvdb(uint32_t id, const char* token) {
-    auto busy_lock = BusyLock(m_is_busy_mutex, m_is_busy, m_global_busy_count);
+bool AppFolder::get_is_unmatched() {
+    if (m_is_info_cached || (m_series_id != 0)) {
+        return false;
+    }
+    std::error_code ec;
+    return !fs::exists(m_path / SERIES_CACHE_FN, ec) && !fs::exists(m_path / BINARY_CACHE_FN, ec);
+}
+
+// NOTE: This blocks the calling thread until both requests are done
+bool AppFolder::load_cache_from_tvdb(uint32_t id, tvdb_api::TvdbClient& client) {
+    auto promise = std::make_shared<std::promise<std::shared_ptr<TvdbDownload>>>();
+    auto future = promise->get_future();
+    download_cache_from_tvdb(id, client, [promise](std::shared_ptr<TvdbDownload> download) {
+        promise->set_value(std::move(download));
+    });
+    auto download = future.get();
+    return store_cache_from_tvdb(*download);
+}
+
+void AppFolder::download_cache_from_tvdb(
+    uint32_t id, tvdb_api::TvdbClient& client, 
+    std::function<void (std::shared_ptr<TvdbDownload>)> on_download) 
+{
+    struct Request {
+        std::shared_ptr<TvdbDownload> download;
+        std::function<void (std::shared_ptr<TvdbDownload>)> on_download;
+        std::atomic<int> total_remaining = 2;
+    };
+    auto request = std::make_shared<Request>();
+    request->download = std::make_shared<TvdbDownload>();
+    request->download->busy_counter = std::make_shared<BusyCounter>(m_busy_count, m_global_busy_count);
+    request->on_download = std::move(on_download);
+
+    // NOTE: A request submitted after the client has stopped completes on this thread
+    auto complete = [](Request& request) {
+        if (--request.total_remaining == 0) {
+            request.on_download(std::move(request.download));
+        }
+    };
+    client.get_series_async(id, [request, complete](tl::expected<tvdb_api::SeriesInfo, std::string> series_opt) {
+        request->download->series = std::move(series_opt);
+        complete(*request);
+    });
+    client.get_series_episodes_async(id, [request, complete](tl::expected<tvdb_api::EpisodesMap, std::string> episodes_opt) {
+        request->download->episodes = std::move(episodes_opt);
+        complete(*request);
+    });
+}
 
-    // attempt to fetch data from tvdb api
-    auto series_opt = tvdb_api::get_series(id, token);
+bool AppFolder::store_cache_from_tvdb(TvdbDownload& download) {
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
+    auto& series_opt = download.series;
+    auto& episodes_opt = download.episodes;
     if (!series_opt) {
         push_error(series_opt.error());
         return false;
     }
 
-    auto episodes_opt = tvdb_api::get_series_episodes(id, token);
     if (!episodes_opt) {
         push_error(episodes_opt.error());
         return false;
     }
 
-    auto& series_doc = series_opt.value();
-    auto& episodes_doc = episodes_opt.value();
+    // NOTE: The cache files are written from the models since there is no document
+    auto cache = tvdb_api::TVDB_Cache{std::move(series_opt.value()), std::move(episodes_opt.value())};
+    const bool is_json_exported = m_is_json_exported;
+    const bool is_binary_exported = m_is_binary_exported;
+    const auto series_json = is_json_exported ? tvdb_api::json_stringify_series_info(cache.series) : "";
+    const auto episodes_json = is_json_exported ? tvdb_api::json_stringify_episodes_info(cache.episodes) : "";
+    const auto binary_data = is_binary_exported ? serialise_folder_cache_binary(cache) : "";
 
     // update cache
     {
-        auto series_cache_opt = tvdb_api::load_series_info(series_doc);
-        if (!series_cache_opt) {
-            push_error(series_cache_opt.error());
+        auto lock = std::unique_lock(m_cache_mutex);
+        set_cache(std::move(cache));
+    }
+
+    // write cache to series folder
+    // NOTE: The binary cache is written last so that it is never older than the json cache
+    if (is_json_exported) {
+        const auto series_cache_path = fs::absolute(m_path / SERIES_CACHE_FN);
+        const auto episodes_cache_path = fs::absolute(m_path / EPISODES_CACHE_FN);
+        if (!util::write_json_string_to_file(series_cache_path.string().c_str(), series_json)) {
+            push_error("Failed to write series cache file");
             return false;
         }
 
-        auto episodes_cache_opt = tvdb_api::load_series_episodes_info(episodes_doc);
-        if (!episodes_cache_opt) {
-            push_error(episodes_cache_opt.error());
+        if (!util::write_json_string_to_file(episodes_cache_path.string().c_str(), episodes_json)) {
+            push_error("Failed to write episodes cache file");
             return false;
         }
-
-        auto& series_cache = series_cache_opt.value();
-        auto& episodes_cache = episodes_cache_opt.value();
-        std::scoped_lock lock(m_cache_mutex);
-        auto cache = tvdb_api::TVDB_Cache{std::move(series_cache), std::move(episodes_cache)};
-        m_cache = std::move(cache);
-        m_is_info_cached = true;
     }
 
-    // write cache to series folder
-    const auto series_cache_path = fs::absolute(m_path / SERIES_CACHE_FN);
-    const auto episodes_cache_path = fs::absolute(m_path / EPISODES_CACHE_FN);
-    if (!util::write_document_to_file(series_cache_path.string().c_str(), series_doc)) {
-        push_error("Failed to write series cache file");
+    if (is_binary_exported && !write_binary_cache_file(binary_data)) {
         return false;
     }
 
-    if (!util::write_document_to_file(episodes_cache_path.string().c_str(), episodes_doc)) {
-        push_error("Failed to write episodes cache file");
+    return true;
+}
+
+static bool get_is_same_series(const tvdb_api::SeriesInfo& a, const tvdb_api::SeriesInfo& b) {
+    return (a.id == b.id) && (a.name == b.name) && (a.air_date == b.air_date) &&
+           (a.status == b.status) && (a.overview == b.overview);
+}
+
+static bool get_is_same_episode(const tvdb_api::EpisodeInfo& a, const tvdb_api::EpisodeInfo& b) {
+    return (a.id == b.id) && (a.season == b.season) && (a.episode == b.episode) &&
+           (a.air_date == b.air_date) && (a.name == b.name) && (a.overview == b.overview);
+}
+
+bool AppFolder::patch_cache(tvdb_api::SeriesInfo&& series, tvdb_api::EpisodesMap&& episodes, CachePatch& patch) {
+    TRACE_SCOPE("cpu", "AppFolder::patch_cache");
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
+    patch = CachePatch{};
+
+    std::optional<std::string> series_json = std::nullopt;
+    std::optional<std::string> episodes_json = std::nullopt;
+    std::optional<std::string> binary_data = std::nullopt;
+    {
+        auto lock = std::unique_lock(m_cache_mutex);
+        if (!m_is_info_cached) {
+            push_error("Cannot patch a cache that hasn't been loaded");
+            return false;
+        }
+        if (get_cache_view().get_series().id != series.id) {
+            return true;
+        }
+        // NOTE: A cache in the metadata store is copied out so it can be changed
+        if (m_cache_store) {
+            set_cache(get_cache_view().to_cache());
+        }
+
+        if (!get_is_same_series(m_cache.series, series)) {
+            m_cache.series = std::move(series);
+            patch.is_series_changed = true;
+        }
+
+        auto& cached_episodes = m_cache.episodes;
+        for (auto it = cached_episodes.begin(); it != cached_episodes.end();) {
+            if (episodes.find(it->first) == episodes.end()) {
+                it = cached_episodes.erase(it);
+                patch.total_removed++;
+            } else {
+                it++;
+            }
+        }
+        for (auto& [key, episode]: episodes) {
+            auto res = cached_episodes.find(key);
+            if (res == cached_episodes.end()) {
+                cached_episodes.emplace(key, std::move(episode));
+                patch.total_added++;
+            } else if (!get_is_same_episode(res->second, episode)) {
+                res->second = std::move(episode);
+                patch.total_changed++;
+            }
+        }
+
+        if (!patch.get_is_empty()) {
+            m_library_stats.notify_cache_changed();
+        }
+        if (!patch.get_is_empty() && m_is_binary_exported) {
+            binary_data = serialise_folder_cache_binary(m_cache);
+        }
+        if (patch.is_series_changed && m_is_json_exported) {
+            series_json = tvdb_api::json_stringify_series_info(m_cache.series);
+        }
+        if (((patch.total_added + patch.total_changed + patch.total_removed) > 0) && m_is_json_exported) {
+            episodes_json = tvdb_api::json_stringify_episodes_info(m_cache.episodes);
+        }
+    }
+
+    if (series_json) {
+        const auto series_cache_path = fs::absolute(m_path / SERIES_CACHE_FN);
+        if (!util::write_json_string_to_file(series_cache_path.string().c_str(), series_json.value())) {
+            push_error("Failed to write series cache file");
+            return false;
+        }
+    }
+
+    if (episodes_json) {
+        const auto episodes_cache_path = fs::absolute(m_path / EPISODES_CACHE_FN);
+        if (!util::write_json_string_to_file(episodes_cache_path.string().c_str(), episodes_json.value())) {
+            push_error("Failed to write episodes cache file");
+            return false;
+        }
+    }
+
+    if (binary_data && !write_binary_cache_file(binary_data.value())) {
         return false;
     }
 
     return true;
 }
 
+// NOTE: The file is read in a single call and then decoded from the buffer
+std::optional<tvdb_api::TVDB_Cache> AppFolder::load_cache_from_binary_file(const fs::path& filepath) {
+    TRACE_SCOPE("io", "AppFolder::load_cache_from_binary_file");
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return std::nullopt;
+    }
+    const auto size = file.tellg();
+    if (size < 0) {
+        return std::nullopt;
+    }
+    std::string data(size_t(size), '\0');
+    file.seekg(0);
+    if (!file.read(data.data(), size)) {
+        return std::nullopt;
+    }
+
+    auto cache_opt = load_folder_cache_binary(data);
+    if (!cache_opt) {
+        // NOTE: A damaged binary cache is replaced once the json cache has been loaded
+        m_diagnostics.push(Severity::SEVERITY_WARNING, m_id, fmt::format("{}, falling back to json cache", cache_opt.error()));
+        return std::nullopt;
+    }
+    return std::move(cache_opt.value());
+}
+
+// NOTE: The cache is written to a temporary file and renamed so a reader never sees a partial file
+bool AppFolder::write_binary_cache_file(const std::string& data) {
+    const auto binary_cache_path = fs::absolute(m_path / BINARY_CACHE_FN);
+    const auto temp_path = fs::absolute(m_path / BINARY_CACHE_TEMP_FN);
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            push_error("Failed to write binary cache file");
+            return false;
+        }
+        file.write(data.data(), data.size());
+        file.close();
+        if (!file.good()) {
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            push_error("Failed to write binary cache file");
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, binary_cache_path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        push_error("Failed to write binary cache file");
+        return false;
+    }
+    return true;
+}
+
 bool AppFolder::load_cache_from_file() {
-    auto busy_lock = BusyLock(m_is_busy_mutex, m_is_busy, m_global_busy_count);
+    TRACE_SCOPE("io", "AppFolder::load_cache_from_file");
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
 
     // load cache from series folder
     // NOTE: We expect that this may not load since the cache hasn't been downloaded from api
     const fs::path series_cache_fn = m_path / SERIES_CACHE_FN;
     const fs::path episodes_cache_fn = m_path / EPISODES_CACHE_FN;
+    const fs::path binary_cache_fn = m_path / BINARY_CACHE_FN;
+
+    // NOTE: A json cache written after the binary cache means that it was updated without the binary export
+    //       Either file can be the newer one since a patch may only rewrite the series
+    std::error_code ec;
+    const auto binary_time = fs::last_write_time(binary_cache_fn, ec);
+    if (!ec) {
+        std::error_code series_ec;
+        std::error_code episodes_ec;
+        const auto series_time = fs::last_write_time(series_cache_fn, series_ec);
+        const auto episodes_time = fs::last_write_time(episodes_cache_fn, episodes_ec);
+        const bool is_series_newer = !series_ec && (series_time > binary_time);
+        const bool is_episodes_newer = !episodes_ec && (episodes_time > binary_time);
+        if (!is_series_newer && !is_episodes_newer) {
+            auto cache_opt = load_cache_from_binary_file(binary_cache_fn);
+            if (cache_opt) {
+                auto lock = std::unique_lock(m_cache_mutex);
+                set_cache(std::move(cache_opt.value()));
+                return true;
+            }
+        }
+    }
+
     auto series_res = util::load_document_from_file(series_cache_fn.string().c_str());
     if (series_res.code != util::DocumentLoadCode::OK) {
         return false;
@@ -184,51 +499,137 @@ bool AppFolder::load_cache_from_file() {
 
     auto& series_cache = series_cache_opt.value();
     auto& episodes_cache = episodes_cache_opt.value();
+    auto cache = tvdb_api::TVDB_Cache{std::move(series_cache), std::move(episodes_cache)};
+    // regenerate the binary cache so the next load skips the json
+    const auto binary_data = m_is_binary_exported ? serialise_folder_cache_binary(cache) : "";
     {
-        auto lock = std::scoped_lock(m_cache_mutex);
-        auto cache = tvdb_api::TVDB_Cache{std::move(series_cache), std::move(episodes_cache)};
-        m_cache = std::move(cache);
-        m_is_info_cached = true;
+        auto lock = std::unique_lock(m_cache_mutex);
+        set_cache(std::move(cache));
+    }
+    // NOTE: The cache was still loaded if the binary cache couldn't be written
+    if (!binary_data.empty()) {
+        write_binary_cache_file(binary_data);
     }
     return true;
 }
 
 // update folder diff after cache has been loaded
-bool AppFolder::update_state_from_cache() {
-    if (!m_is_info_cached && !load_cache_from_file()) {
+bool AppFolder::update_state_from_cache(const util::CancellationToken& token) {
+    TRACE_SCOPE("scan", "AppFolder::update_state_from_cache");
+    static auto& SCAN_LATENCY = util::metrics::get_histogram("scan.folder_latency");
+    auto scan_latency = util::metrics::ScopedLatency(SCAN_LATENCY);
+    if (!load_cache_if_missing()) {
+        return false;
+    }
+
+    // let interactive work take the disk if we are part of a bulk scan
+    // NOTE: This is done before taking the folder locks since an interactive task may be waiting on them
+    util::WorkStealingPool::yield_to_interactive();
+
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
+    if (token.is_cancelled()) {
+        return false;
+    }
+
+    // NOTE: The cache and files are only read so other scans can run alongside us
+    auto files_lock = std::shared_lock(m_files_mutex);
+    auto cache_lock = std::shared_lock(m_cache_mutex);
+
+    auto hooks = DirectoryWalkHooks{};
+    hooks.cancel_token = token;
+
+    auto intents = get_directory_file_intents(m_path, m_cfg, get_cache_view(), hooks);
+    cache_lock.unlock();
+    files_lock.unlock();
+    if (token.is_cancelled()) {
         return false;
     }
 
-    auto busy_lock = BusyLock(m_is_busy_mutex, m_is_busy, m_global_busy_count);
+    update_state_from_intents(std::move(intents));
+    return true;
+}
+
+bool AppFolder::load_cache_if_missing() {
+    if (m_is_info_cached || load_cache_from_store() || load_cache_from_file()) {
+        return true;
+    }
+    // NOTE: A status seeded from the library index is stale if the cache has since gone missing
+    set_summary(AppFolderSummary{ Status::UNKNOWN });
+    return false;
+}
+
+std::vector<std::string> AppFolder::list_files(const DirectoryWalkHooks& hooks) {
+    TRACE_SCOPE("scan", "AppFolder::list_files");
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
+    auto files_lock = std::shared_lock(m_files_mutex);
+    return get_directory_files(m_path, hooks);
+}
+
+std::vector<FileIntent> AppFolder::get_file_intents(const std::vector<std::string>& files) {
+    TRACE_SCOPE("scan", "AppFolder::get_file_intents");
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
+    auto cache_lock = std::shared_lock(m_cache_mutex);
+    const auto cache = get_cache_view();
+    auto intents = std::vector<FileIntent>();
+    intents.reserve(files.size());
+    for (auto& relative_path: files) {
+        intents.push_back(get_file_intent(relative_path, m_cfg, cache));
+    }
+    return intents;
+}
+
+void AppFolder::update_state_from_intents(std::vector<FileIntent>&& intents) {
+    TRACE_SCOPE("scan", "AppFolder::update_state_from_intents");
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
 
-    auto intents = get_directory_file_intents(m_path, m_cfg, m_cache);
     auto new_state = std::make_unique<AppFolderState>();
     for (auto& intent: intents) {
         new_state->AddIntent(std::move(intent));
     }
 
-    auto& counts = new_state->GetActionCount();
-    auto& conflict_table = new_state->GetConflicts();
+    const auto summary = get_state_summary(*new_state);
+
+    auto lock = std::unique_lock(m_state_mutex);
+    m_state = std::move(new_state);
+    m_summary_revision = m_state->GetRevision();
+    set_summary(summary);
+    m_is_scanned = true;
+}
+
+void AppFolder::update_summary_from_state() {
+    // NOTE: This is called every frame while the folder is shown so skip it if nothing was edited
+    if (m_summary_revision == m_state->GetRevision()) {
+        return;
+    }
+    m_summary_revision = m_state->GetRevision();
+    set_summary(get_state_summary(*m_state));
+}
+
+AppFolderSummary AppFolder::get_state_summary(AppFolderState& state) {
+    auto& counts = state.GetActionCount();
+    auto& conflict_table = state.GetConflicts();
+
+    auto summary = AppFolderSummary{};
+    summary.renames = counts.renames;
+    summary.deletes = counts.deletes;
+    summary.conflicts = int(conflict_table.size());
 
     if (counts.deletes > 0) {
-        m_status = Status::PENDING_DELETES;
+        summary.status = Status::PENDING_DELETES;
     } else if (conflict_table.size() > 0) {
-        m_status = Status::CONFLICTS;
+        summary.status = Status::CONFLICTS;
     } else if ((counts.renames > 0) || (counts.ignores > 0)) {
-        m_status = Status::PENDING_RENAME;
+        summary.status = Status::PENDING_RENAME;
     } else if (counts.completes > 0) {
-        m_status = Status::COMPLETED;
+        summary.status = Status::COMPLETED;
     } else {
-        m_status = Status::EMPTY;
+        summary.status = Status::EMPTY;
     }
-
-    auto lock = std::scoped_lock(m_state_mutex);
-    m_state = std::move(new_state);
-    return true;
+    return summary;
 }
 
 bool AppFolder::load_bookmarks_from_file() {
-    auto busy_lock = BusyLock(m_is_busy_mutex, m_is_busy, m_global_busy_count);
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
 
     const fs::path bookmarks_fn = m_path / BOOKMARKS_FN;
     auto res = util::load_document_from_file(bookmarks_fn.string().c_str());
@@ -252,7 +653,7 @@ bool AppFolder::load_bookmarks_from_file() {
 }
 
 bool AppFolder::save_bookmarks_to_file() {
-    auto busy_lock = BusyLock(m_is_busy_mutex, m_is_busy, m_global_busy_count);
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
 
     const fs::path bookmarks_fn = m_path / BOOKMARKS_FN;
 
@@ -272,9 +673,11 @@ bool AppFolder::save_bookmarks_to_file() {
 }
 
 int AppFolder::execute_actions() {
-    auto busy_lock = BusyLock(m_is_busy_mutex, m_is_busy, m_global_busy_count);
+    TRACE_SCOPE("io", "AppFolder::execute_actions");
+    auto busy_counter = BusyCounter(m_busy_count, m_global_busy_count);
 
-    auto lock = std::scoped_lock(m_state_mutex);
+    auto files_lock = std::unique_lock(m_files_mutex);
+    auto state_lock = std::shared_lock(m_state_mutex);
     auto& intents = m_state->GetIntents();
     int total_errors = 0;
 
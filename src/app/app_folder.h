@@ -4,22 +4,52 @@
 #include <filesystem>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <atomic>
 #include <vector>
 #include <list>
 #include <optional>
+#include <functional>
 
 #include "file_intents.h"
 #include "app_folder_state.h"
 #include "app_folder_bookmarks.h"
+#include "app_library_stats.h"
+#include "app_library_index.h"
+#include "app_diagnostics.h"
+#include "app_metadata_store.h"
+#include "tvdb_api/tvdb_api.h"
 #include "tvdb_api/tvdb_models.h"
+#include "util/cancellation_token.h"
 
 namespace app {
 
+// changes that a patch made to the cache of a folder
+struct CachePatch {
+    bool is_series_changed = false;
+    int total_added = 0;
+    int total_changed = 0;
+    int total_removed = 0;
+    bool get_is_empty() const {
+        return !is_series_changed && (total_added == 0) && (total_changed == 0) && (total_removed == 0);
+    }
+};
+
+// NOTE: foward declare
+class BusyCounter;
+
+// series and episodes of a folder that were downloaded from the api and are waiting to be stored
+struct TvdbDownload {
+    tl::expected<tvdb_api::SeriesInfo, std::string> series = tl::make_unexpected<std::string>("Series wasn't downloaded");
+    tl::expected<tvdb_api::EpisodesMap, std::string> episodes = tl::make_unexpected<std::string>("Episodes weren't downloaded");
+    // NOTE: The folder is busy until the download is stored or dropped
+    std::shared_ptr<BusyCounter> busy_counter;
+};
+
 // contains the necessary data structures to execute actions on a managed folder
 // primarily contains:
 // - Managed folder object
-// - TVDB_Cache for that series
+// - TVDB_Cache for that series or its record in the metadata store
 // - Search results of a tvdb api search
 // - The renaming config that is loaded from config file
 class AppFolder 
@@ -35,24 +65,36 @@ public:
     };
 private:
     const std::filesystem::path m_path;
+    // unique for the lifetime of the app so diagnostics can be matched to a folder
+    const uint64_t m_id;
 public:
     FilterRules& m_cfg;
 
     // keep a mutex on members which are used in rendering and undergo mutation during actions
+    // NOTE: Each resource has its own lock so operations on disjoint resources can run in parallel
+    //       Readers of the cache and state take a shared lock
 
     // cache of tvdb data
+    // NOTE: The cache is read from the metadata store without copying until it is changed
+    //       Read it through get_cache_view() instead of m_cache
     tvdb_api::TVDB_Cache m_cache;
-    bool m_is_info_cached;
-    std::mutex m_cache_mutex;
+    std::shared_ptr<const MetadataStore> m_cache_store;     // set if the cache is in the store
+    uint32_t m_cache_store_index;
+    std::atomic<bool> m_is_info_cached;
+    std::atomic<uint32_t> m_series_id;      // known from the library index or metadata store before the cache is loaded
+    std::shared_mutex m_cache_mutex;
+    // series.json and episodes.json are written when the cache changes if this is set
+    std::atomic<bool> m_is_json_exported;
+    // cache.bin is written when the cache changes if this is set
+    std::atomic<bool> m_is_binary_exported;
 
     // set of current actions
     std::unique_ptr<AppFolderState> m_state;
     std::atomic<Status> m_status;
-    std::mutex m_state_mutex;
-
-    // errors accumulated from operations
-    std::list<std::string> m_errors;
-    std::mutex m_errors_mutex;
+    std::shared_mutex m_state_mutex;
+    // revision of the state that the summary was last computed from
+    // NOTE: Guarded by the state mutex
+    uint64_t m_summary_revision;
 
     // store the search result for a tvdb search query
     std::vector<tvdb_api::SeriesInfo> m_search_result;
@@ -64,33 +106,99 @@ public:
 
     std::optional<tvdb_api::EpisodeKey> selected_episode = std::nullopt;
 
+    // set when the folder is no longer in the directory listing of the root
+    std::atomic<bool> m_is_removed;
+    // set once the folder has been scanned instead of showing its state from the library index
+    std::atomic<bool> m_is_scanned;
+
     // use this to keep count of the global count of busy folders
-    bool m_is_busy;
+    std::atomic<int> m_busy_count;
     std::atomic<int>& m_global_busy_count;
 private:
-    std::mutex m_is_busy_mutex;
+    // scans take a shared lock while executing changes takes an exclusive lock
+    // this stops a scan from seeing a partially renamed folder
+    std::shared_mutex m_files_mutex;
+
+    // the latest metadata store of the library which the cache is loaded from
+    // NOTE: Guarded by the cache mutex
+    std::shared_ptr<const MetadataStore> m_store;
+
+    // our contribution to the library wide totals
+    AppFolderSummary m_summary;
+    std::mutex m_summary_mutex;
+    AppLibraryStats& m_library_stats;
+    // errors from operations are sent to the app
+    DiagnosticsChannel& m_diagnostics;
 public:
     AppFolder(
         const std::filesystem::path& path, 
         FilterRules& cfg,
-        std::atomic<int>& busy_count);
+        std::atomic<int>& busy_count,
+        AppLibraryStats& library_stats,
+        DiagnosticsChannel& diagnostics);
+    ~AppFolder();
+    AppFolder(const AppFolder&) = delete;
+    AppFolder(AppFolder&&) = delete;
+    AppFolder& operator=(const AppFolder&) = delete;
+    AppFolder& operator=(AppFolder&&) = delete;
 
     // NOTE: If the return value is a boolean
     //       Then the boolean indicates complete success
-    bool load_cache_from_tvdb(uint32_t id, const char* token);
+    bool load_cache_from_tvdb(uint32_t id, tvdb_api::TvdbClient& client);
+    // Both requests are in flight on the client's event loop without blocking the calling thread
+    // NOTE: The callback is called on the event loop thread so it should queue the store elsewhere
+    void download_cache_from_tvdb(uint32_t id, tvdb_api::TvdbClient& client, std::function<void (std::shared_ptr<TvdbDownload>)> on_download);
+    // set the cache from the download and write it to the series folder
+    bool store_cache_from_tvdb(TvdbDownload& download);
+    // NOTE: The binary cache is preferred over the json cache unless the json is newer
     bool load_cache_from_file();
-    bool update_state_from_cache();
-    bool load_search_series_from_tvdb(const char* name, const char* token);
+    // NOTE: This needs the series id from the library index or the store's folder table since the store is keyed by it
+    bool load_cache_from_store();
+    // A cache that is read from an older store is moved to the new one
+    void set_metadata_store(std::shared_ptr<const MetadataStore> store);
+    // NOTE: Hold a lock on the cache mutex while using the view
+    //       The view is only valid if the info is cached
+    CacheView get_cache_view() const;
+    // Replaces only the episodes that were added, changed or removed from the loaded cache
+    // NOTE: The cache files are only rewritten if something changed
+    //       The cache is left alone if the folder was matched to another series in the meantime
+    bool patch_cache(tvdb_api::SeriesInfo&& series, tvdb_api::EpisodesMap&& episodes, CachePatch& patch);
+    // NOTE: The state is left untouched if the token is cancelled during the scan
+    bool update_state_from_cache(const util::CancellationToken& token={});
+    // The separate stages of update_state_from_cache so that a library scan can pipeline them
+    // NOTE: Sets the status to unknown if there is no cache
+    bool load_cache_if_missing();
+    std::vector<std::string> list_files(const DirectoryWalkHooks& hooks={});
+    std::vector<FileIntent> get_file_intents(const std::vector<std::string>& files);
+    void update_state_from_intents(std::vector<FileIntent>&& intents);
+    // Recomputes the summary after the state was edited so the library totals follow manual changes
+    // NOTE: Hold an exclusive lock on the state mutex
+    void update_summary_from_state();
+    bool load_search_series_from_tvdb(const char* name, tvdb_api::TvdbClient& client);
+    // NOTE: This checks for the cache file since the cache is only loaded when the folder is scanned
+    bool get_is_unmatched();
     bool load_bookmarks_from_file();
     bool save_bookmarks_to_file();
 
     int execute_actions();
+    bool get_is_busy() const { return m_busy_count > 0; }
     const auto&  GetPath() const { return m_path; }
+    uint64_t get_id() const { return m_id; }
     void open_folder(const std::string& path);
     void open_file(const std::string& path);
 
+    // show the last known state from the library index until the folder is rescanned
+    void seed_from_index(const LibraryIndexEntry& entry);
+    LibraryIndexEntry get_index_entry();
+
 private:
     void push_error(const std::string& str);
+    // NOTE: Hold an exclusive lock on the cache mutex
+    void set_cache(tvdb_api::TVDB_Cache&& cache);
+    std::optional<tvdb_api::TVDB_Cache> load_cache_from_binary_file(const std::filesystem::path& filepath);
+    bool write_binary_cache_file(const std::string& data);
+    void set_summary(const AppFolderSummary& summary);
+    static AppFolderSummary get_state_summary(AppFolderState& state);
 };
 
 }
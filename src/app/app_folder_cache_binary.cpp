@@ -0,0 +1,165 @@
+#include "app_folder_cache_binary.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <fmt/core.h>
+
+#include "util/trace.h"
+
+namespace app
+{
+
+using metadata_store::StringRef;
+using metadata_store::SeriesRecord;
+using metadata_store::EpisodeRecord;
+using folder_cache::Header;
+
+// NOTE: The layout of the header is part of the file format
+static_assert(sizeof(Header) == 24);
+
+static uint32_t get_checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= uint8_t(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static std::optional<std::string> get_optional_string(const char* pool, const StringRef& ref) {
+    if (ref.offset == metadata_store::NULL_STRING_OFFSET) {
+        return std::nullopt;
+    }
+    return std::string(pool + ref.offset, ref.length);
+}
+
+tl::expected<tvdb_api::TVDB_Cache, std::string> load_folder_cache_binary(std::string_view data) {
+    TRACE_SCOPE("cpu", "load_folder_cache_binary");
+    if (data.size() < sizeof(Header)) {
+        return tl::make_unexpected<std::string>("Binary cache is missing its header");
+    }
+
+    // NOTE: The records are copied out since the buffer has no alignment guarantees
+    Header header;
+    memcpy(&header, data.data(), sizeof(Header));
+    if (memcmp(header.magic, folder_cache::MAGIC, sizeof(folder_cache::MAGIC)) != 0) {
+        return tl::make_unexpected<std::string>("Binary cache has an invalid magic");
+    }
+    if (header.version != folder_cache::VERSION) {
+        return tl::make_unexpected(fmt::format("Binary cache has version {} instead of {}", header.version, folder_cache::VERSION));
+    }
+    const uint64_t expected_size =
+        uint64_t(sizeof(Header)) +
+        uint64_t(sizeof(SeriesRecord)) +
+        uint64_t(sizeof(EpisodeRecord)) * header.total_episodes +
+        uint64_t(header.string_pool_size);
+    if (uint64_t(data.size()) != expected_size) {
+        return tl::make_unexpected(fmt::format("Binary cache has {} bytes instead of {}", data.size(), expected_size));
+    }
+    const char* body = data.data() + sizeof(Header);
+    if (get_checksum(body, data.size() - sizeof(Header)) != header.checksum) {
+        return tl::make_unexpected<std::string>("Binary cache has an invalid checksum");
+    }
+
+    SeriesRecord series;
+    memcpy(&series, body, sizeof(SeriesRecord));
+    const char* episodes = body + sizeof(SeriesRecord);
+    const char* pool = episodes + sizeof(EpisodeRecord) * header.total_episodes;
+    const uint32_t pool_size = header.string_pool_size;
+
+    // NOTE: The checksum only catches damage so the offsets are still bounds checked
+    auto is_valid_string = [pool, pool_size](const StringRef& ref, bool is_optional) {
+        return metadata_store::get_is_valid_string(ref, pool, pool_size, is_optional);
+    };
+    if (!is_valid_string(series.name, false) || !is_valid_string(series.air_date, false) ||
+        !is_valid_string(series.status, false) || !is_valid_string(series.overview, true))
+    {
+        return tl::make_unexpected(fmt::format("Binary cache of series {} has an invalid string", series.id));
+    }
+    if (series.total_episodes != header.total_episodes) {
+        return tl::make_unexpected(fmt::format("Binary cache of series {} has a mismatched episode count", series.id));
+    }
+
+    tvdb_api::TVDB_Cache cache;
+    cache.series.id = series.id;
+    cache.series.name = std::string(pool + series.name.offset, series.name.length);
+    cache.series.air_date = std::string(pool + series.air_date.offset, series.air_date.length);
+    cache.series.status = std::string(pool + series.status.offset, series.status.length);
+    cache.series.overview = get_optional_string(pool, series.overview);
+
+    cache.episodes.reserve(header.total_episodes);
+    for (uint32_t i = 0; i < header.total_episodes; i++) {
+        EpisodeRecord record;
+        memcpy(&record, episodes + sizeof(EpisodeRecord) * i, sizeof(EpisodeRecord));
+        if ((record.series_id != series.id) ||
+            !is_valid_string(record.air_date, false) || !is_valid_string(record.name, false) ||
+            !is_valid_string(record.overview, true))
+        {
+            return tl::make_unexpected(fmt::format("Binary cache of series {} has an invalid episode {}", series.id, record.id));
+        }
+
+        tvdb_api::EpisodeInfo episode;
+        episode.id = record.id;
+        episode.season = record.season;
+        episode.episode = record.episode;
+        episode.air_date = std::string(pool + record.air_date.offset, record.air_date.length);
+        episode.name = std::string(pool + record.name.offset, record.name.length);
+        episode.overview = get_optional_string(pool, record.overview);
+        cache.episodes.emplace(tvdb_api::EpisodeKey{ episode.season, episode.episode }, std::move(episode));
+    }
+    return cache;
+}
+
+std::string serialise_folder_cache_binary(const CacheView& cache) {
+    TRACE_SCOPE("cpu", "serialise_folder_cache_binary");
+    metadata_store::StringPoolBuilder strings;
+
+    const auto series_view = cache.get_series();
+    SeriesRecord series;
+    series.id = series_view.id;
+    series.first_episode = 0;
+    series.name = strings.add(series_view.name);
+    series.air_date = strings.add(series_view.air_date);
+    series.status = strings.add(series_view.status);
+    series.overview = strings.add_optional(series_view.overview);
+
+    std::vector<EpisodeRecord> episodes;
+    for (auto& view: cache.get_episodes()) {
+        auto& episode = episodes.emplace_back();
+        episode.series_id = series.id;
+        episode.id = view.id;
+        episode.season = view.season;
+        episode.episode = view.episode;
+        episode.air_date = strings.add(view.air_date);
+        episode.name = strings.add(view.name);
+        episode.overview = strings.add_optional(view.overview);
+    }
+    std::sort(episodes.begin(), episodes.end(), [](const EpisodeRecord& a, const EpisodeRecord& b) {
+        return metadata_store::get_is_episode_before(a, b.season, b.episode);
+    });
+    series.total_episodes = uint32_t(episodes.size());
+
+    const auto& pool = strings.get_pool();
+    Header header;
+    memcpy(header.magic, folder_cache::MAGIC, sizeof(folder_cache::MAGIC));
+    header.version = folder_cache::VERSION;
+    header.checksum = 0;
+    header.total_episodes = uint32_t(episodes.size());
+    header.string_pool_size = uint32_t(pool.size());
+    header.reserved = 0;
+
+    std::string data;
+    data.reserve(sizeof(Header) + sizeof(SeriesRecord) + sizeof(EpisodeRecord)*episodes.size() + pool.size());
+    data.append(reinterpret_cast<const char*>(&header), sizeof(Header));
+    data.append(reinterpret_cast<const char*>(&series), sizeof(SeriesRecord));
+    data.append(reinterpret_cast<const char*>(episodes.data()), sizeof(EpisodeRecord)*episodes.size());
+    data.append(pool);
+
+    // NOTE: The checksum is patched into the header once the body is known
+    header.checksum = get_checksum(data.data() + sizeof(Header), data.size() - sizeof(Header));
+    memcpy(data.data(), &header, sizeof(Header));
+    return data;
+}
+
+};
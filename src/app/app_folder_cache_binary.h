@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include "tvdb_api/tvdb_models.h"
+#include "util/expected.hpp"
+#include "./app_metadata_store.h"
+
+namespace app
+{
+
+// Layout of the binary cache file that is kept in each series folder
+// - header
+// - series record
+// - episode records sorted by season and episode
+// - string pool of null terminated strings
+// NOTE: The records and string pool are the same as those in the metadata store
+//       So the version is bumped if either the header or the store records change
+namespace folder_cache {
+
+constexpr char MAGIC[4] = {'T', 'R', 'F', 'C'};
+constexpr uint32_t VERSION = 1;
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t checksum;      // fnv-1a of everything after the header
+    uint32_t total_episodes;
+    uint32_t string_pool_size;
+    uint32_t reserved;
+};
+
+};
+
+// NOTE: The whole file is checked against its checksum before any record is read
+tl::expected<tvdb_api::TVDB_Cache, std::string> load_folder_cache_binary(std::string_view data);
+
+std::string serialise_folder_cache_binary(const CacheView& cache);
+
+};
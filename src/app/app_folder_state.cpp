@@ -13,7 +13,10 @@ namespace app
 
 AppFolderState::AppFolderState() 
 : intents(), conflicts(), upcoming_rename_counts(), 
-  is_conflict_table_dirty(false) 
+  is_conflict_table_dirty(false),
+  edit_history(), edit_cursor(0), 
+  next_edit_group(0), current_edit_group(0), edit_group_depth(0),
+  revision(0)
 {
 
 }
@@ -103,4 +106,87 @@ void AppFolderState::UpdateActionCount(FileIntent::Action action, int delta) {
     }
 }
 
+void AppFolderState::BeginEditGroup() {
+    if (edit_group_depth == 0) {
+        current_edit_group = next_edit_group++;
+    }
+    edit_group_depth++;
+}
+
+void AppFolderState::EndEditGroup() {
+    if (edit_group_depth > 0) {
+        edit_group_depth--;
+    }
+}
+
+void AppFolderState::PushEdit(EditCommand&& cmd) {
+    revision++;
+    // a new edit invalidates anything that was undone
+    edit_history.erase(edit_history.begin() + edit_cursor, edit_history.end());
+
+    // NOTE: Imgui calls OnDestChange on every keystroke
+    //       We merge consecutive edits to the same destination into one command
+    if ((cmd.type == EditCommand::Type::DEST) && (edit_group_depth == 0) && (edit_cursor > 0)) {
+        auto& last = edit_history[edit_cursor-1];
+        if ((last.type == EditCommand::Type::DEST) && (last.file == cmd.file)) {
+            last.new_dest = std::move(cmd.new_dest);
+            return;
+        }
+    }
+
+    cmd.group = (edit_group_depth > 0) ? current_edit_group : next_edit_group++;
+    edit_history.push_back(std::move(cmd));
+    edit_cursor = edit_history.size();
+}
+
+bool AppFolderState::Undo() {
+    if (!GetCanUndo()) {
+        return false;
+    }
+
+    // commands are reverted in the opposite order they were applied
+    const uint32_t group = edit_history[edit_cursor-1].group;
+    while ((edit_cursor > 0) && (edit_history[edit_cursor-1].group == group)) {
+        edit_cursor--;
+        ApplyEdit(edit_history[edit_cursor], true);
+    }
+    return true;
+}
+
+bool AppFolderState::Redo() {
+    if (!GetCanRedo()) {
+        return false;
+    }
+
+    const uint32_t group = edit_history[edit_cursor].group;
+    while ((edit_cursor < edit_history.size()) && (edit_history[edit_cursor].group == group)) {
+        ApplyEdit(edit_history[edit_cursor], false);
+        edit_cursor++;
+    }
+    return true;
+}
+
+// reuse the same bookkeeping as a manual edit without recording it again
+void AppFolderState::ApplyEdit(const EditCommand& cmd, bool is_undo) {
+    revision++;
+    auto& file = *cmd.file;
+    switch (cmd.type) {
+    case EditCommand::Type::ACTION:
+        file.ApplyAction(is_undo ? cmd.old_action : cmd.new_action);
+        // restore the destination if it was auto filled by the action change
+        if (cmd.old_dest != cmd.new_dest) {
+            file.ApplyDest(is_undo ? cmd.old_dest : cmd.new_dest);
+        }
+        return;
+    case EditCommand::Type::IS_ACTIVE:
+        file.ApplyIsActive(is_undo ? cmd.old_is_active : cmd.new_is_active);
+        return;
+    case EditCommand::Type::DEST:
+        file.ApplyDest(is_undo ? cmd.old_dest : cmd.new_dest);
+        return;
+    default:
+        return;
+    }
+}
+
 }
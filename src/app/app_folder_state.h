@@ -13,6 +13,8 @@
 #include <list>
 #include <map>
 #include <unordered_map>
+#include <vector>
+#include <stdint.h>
 
 #include "file_intents.h"
 #include "app_file_state.h"
@@ -35,12 +37,39 @@ public:
         int completes = 0;
         int whitelists = 0;
     };
+
+    // A reversible edit to a file state which is stored in the edit history
+    // NOTE: File states are referenced by pointer since std::map never relocates its nodes
+    //       The destination strings are only populated if the edit changed the destination
+    struct EditCommand {
+        enum class Type: uint8_t {
+            ACTION, IS_ACTIVE, DEST,
+        };
+        AppFileState* file = nullptr;
+        uint32_t group = 0;
+        Type type = Type::ACTION;
+        FileIntent::Action old_action = FileIntent::Action::IGNORE;
+        FileIntent::Action new_action = FileIntent::Action::IGNORE;
+        bool old_is_active = false;
+        bool new_is_active = false;
+        std::string old_dest;
+        std::string new_dest;
+    };
 private:
     FileTable intents;
     ConflictTable conflicts;
     UpcomingRenames upcoming_rename_counts;
     ActionCount action_counts;
     bool is_conflict_table_dirty;
+
+    // commands before the cursor can be undone, and commands after it can be redone
+    std::vector<EditCommand> edit_history;
+    size_t edit_cursor;
+    uint32_t next_edit_group;
+    uint32_t current_edit_group;
+    int edit_group_depth;
+    // incremented on every edit, undo and redo so observers can tell when the counts changed
+    uint64_t revision;
 public:
     AppFolderState();
     ~AppFolderState();
@@ -53,6 +82,17 @@ public:
         return action_counts; 
     }
 
+    // Edits made between these calls are undone and redone as a single step
+    // NOTE: Calls can be nested, the group is closed by the outermost call
+    void BeginEditGroup();
+    void EndEditGroup();
+    // Reverts or reapplies the last group of edits without rescanning the folder
+    bool Undo();
+    bool Redo();
+    bool GetCanUndo() const { return edit_cursor > 0; }
+    bool GetCanRedo() const { return edit_cursor < edit_history.size(); }
+    uint64_t GetRevision() const { return revision; }
+
     // NOTE: Cannot change location of folder state since the file state takes it via reference
     AppFolderState(const AppFolderState&) = delete;
     AppFolderState(AppFolderState&&) = delete;
@@ -61,6 +101,8 @@ public:
 private:
     void UpdateConflictTable();
     void UpdateActionCount(FileIntent::Action action, int delta);
+    void PushEdit(EditCommand&& cmd);
+    void ApplyEdit(const EditCommand& cmd, bool is_undo);
     friend AppFileState;
 };
 
@@ -0,0 +1,68 @@
+#include "./app_library_index.h"
+#include "./app_schemas.h"
+#include "util/expected.hpp"
+#include "util/file_loading.h"
+
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/schema.h>
+
+template <typename T>
+static int get_int_default(const T& v, const char* key) {
+    if (!v.HasMember(key)) {
+        return 0;
+    }
+    return v[key].IsInt() ? v[key].GetInt() : 0;
+}
+
+namespace app 
+{
+
+tl::expected<LibraryIndex, const char*> load_library_index(const rapidjson::Document& doc) {
+    if (!util::validate_document(doc, LIBRARY_INDEX_SCHEMA_DOC)) {
+        return tl::make_unexpected<const char*>("Failed to validate library index data");
+    }
+
+    LibraryIndex index;
+
+    auto data = doc["folders"].GetArray();
+    index.folders.reserve(data.Size());
+    for (auto& e: data) {
+        auto& entry = index.folders.emplace_back();
+        entry.name = e["name"].GetString();
+        entry.series_id = e.HasMember("series_id") ? e["series_id"].GetUint() : 0;
+        entry.summary.status = e["status"].GetUint();
+        entry.summary.renames = get_int_default(e, "renames");
+        entry.summary.deletes = get_int_default(e, "deletes");
+        entry.summary.conflicts = get_int_default(e, "conflicts");
+    }
+    return index;
+}
+
+// NOTE: The index can have thousands of entries so we don't pretty print it
+std::string json_stringify_library_index(const LibraryIndex& index) {
+    rapidjson::StringBuffer sb;
+    auto writer = rapidjson::Writer<rapidjson::StringBuffer>(sb);
+    writer.StartObject();
+    writer.Key("folders");
+    writer.StartArray();
+    for (const auto& entry: index.folders) {
+        writer.StartObject();
+        writer.Key("name");
+        writer.String(entry.name.c_str());
+        if (entry.series_id > 0) { writer.Key("series_id"); writer.Uint(entry.series_id); }
+        writer.Key("status"); writer.Uint(entry.summary.status);
+        writer.Key("renames"); writer.Int(entry.summary.renames);
+        writer.Key("deletes"); writer.Int(entry.summary.deletes);
+        writer.Key("conflicts"); writer.Int(entry.summary.conflicts);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+
+    auto str = std::string(sb.GetString(), sb.GetSize());
+    return str;
+}
+
+};
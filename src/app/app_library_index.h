@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <rapidjson/document.h>
+#include "util/expected.hpp"
+#include "./app_library_stats.h"
+
+namespace app 
+{
+
+// Last known state of a folder which lets the library be shown before any folder is scanned
+struct LibraryIndexEntry {
+    std::string name;           // name of the folder relative to the library root
+    uint32_t series_id = 0;     // 0 if the series is unknown
+    AppFolderSummary summary;
+};
+
+struct LibraryIndex {
+    std::vector<LibraryIndexEntry> folders;
+};
+
+tl::expected<LibraryIndex, const char*> load_library_index(const rapidjson::Document& doc);
+
+std::string json_stringify_library_index(const LibraryIndex& index);
+
+}
@@ -0,0 +1,345 @@
+#include "app_library_scan.h"
+#include "app_folder.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <deque>
+#include <mutex>
+
+#include "util/work_stealing_pool.h"
+#include "util/metrics.h"
+
+namespace app
+{
+
+namespace fs = std::filesystem;
+
+const char* get_scan_stage_name(ScanStage stage) {
+    switch (stage) {
+    case ScanStage::LOAD_CACHE:         return "Load cache";
+    case ScanStage::ENUMERATE:          return "Enumerate";
+    case ScanStage::COMPUTE_INTENTS:    return "Compute intents";
+    case ScanStage::BUILD_STATE:        return "Build state";
+    default:                            return "Unknown";
+    }
+}
+
+TaskLane get_scan_stage_lane(ScanStage stage) {
+    switch (stage) {
+    case ScanStage::LOAD_CACHE:         return TaskLane::DISK;
+    case ScanStage::ENUMERATE:          return TaskLane::DISK;
+    case ScanStage::COMPUTE_INTENTS:    return TaskLane::CPU;
+    case ScanStage::BUILD_STATE:        return TaskLane::CPU;
+    default:                            return TaskLane::CPU;
+    }
+}
+
+struct LibraryScanPipeline::State {
+    struct Stage {
+        std::atomic<int> total_entered = 0;
+        std::atomic<int> total_processed = 0;
+        std::atomic<int> total_skipped = 0;
+        std::atomic<int> total_waiting = 0;
+        // nanoseconds since the start of the scan
+        std::atomic<int64_t> finish_time = -1;
+        int max_in_flight = 1;
+        // NOTE: Guarded by the mutex
+        // folders holding a slot which includes those waiting for a slot in the next stage
+        int total_in_flight = 0;
+        std::deque<std::shared_ptr<Item>> waiting;
+    };
+    const int total_folders;
+    std::array<Stage, TOTAL_SCAN_STAGES> stages;
+    std::atomic<int> total_finished_folders = 0;
+    util::CancellationToken token = util::CancellationToken::create();
+    QueueStage queue_stage;
+    ContinueStage continue_stage;
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    // folders that haven't been given a slot in the first stage yet
+    // NOTE: Guarded by the mutex
+    std::vector<std::shared_ptr<AppFolder>> folders;
+    size_t next_folder = 0;
+    std::mutex mutex;
+
+    State(int _total_folders, QueueStage _queue_stage, ContinueStage _continue_stage)
+    : total_folders(_total_folders), queue_stage(std::move(_queue_stage)), continue_stage(std::move(_continue_stage)) {}
+
+    // folders that weren't skipped before reaching the stage
+    int get_total_items(int stage) const {
+        int total = total_folders;
+        for (int i = 0; i < stage; i++) {
+            total -= stages[i].total_skipped;
+        }
+        return total;
+    }
+
+    bool get_is_stage_finished(int stage) const {
+        return stages[stage].total_processed == get_total_items(stage);
+    }
+
+    void leave_stage(ScanStage stage_id, bool is_forwarded) {
+        const int i = int(stage_id);
+        auto& stage = stages[i];
+        if (!is_forwarded) {
+            stage.total_skipped++;
+        }
+        stage.total_processed++;
+        if (!is_forwarded || (i == (TOTAL_SCAN_STAGES-1))) {
+            total_finished_folders++;
+        }
+
+        // NOTE: A skip can finish later stages since they no longer wait on the folder
+        for (int j = i; j < TOTAL_SCAN_STAGES; j++) {
+            int64_t expected = -1;
+            if (get_is_stage_finished(j)) {
+                stages[j].finish_time.compare_exchange_strong(expected, get_elapsed_nanoseconds());
+            }
+        }
+    }
+
+    void release_slot(int stage) {
+        auto lock = std::scoped_lock(mutex);
+        stages[stage].total_in_flight--;
+    }
+
+    void push_waiting(std::shared_ptr<Item> item, int stage) {
+        auto lock = std::scoped_lock(mutex);
+        stages[stage].waiting.push_back(std::move(item));
+        stages[stage].total_waiting++;
+    }
+
+    int64_t get_elapsed_nanoseconds() const {
+        const auto dt = std::chrono::steady_clock::now() - start_time;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
+    }
+};
+
+// A folder as it moves through the stages
+// NOTE: A stage that is dropped before it runs releases the item which counts it as skipped
+struct LibraryScanPipeline::Item {
+    std::shared_ptr<State> state;
+    std::shared_ptr<AppFolder> folder;
+    ScanStage stage = ScanStage::LOAD_CACHE;
+    std::vector<std::string> files;
+    std::vector<FileIntent> intents;
+    std::chrono::steady_clock::time_point start_time;
+    bool is_finished = false;
+    // the stage whose slot is held or -1 once the folder has left the scan
+    int slot = -1;
+
+    ~Item() {
+        if (!is_finished) {
+            state->leave_stage(stage, false);
+        }
+        if (slot >= 0) {
+            state->release_slot(slot);
+            admit_folders(state);
+        }
+    }
+};
+
+LibraryScanPipeline::LibraryScanPipeline(
+    std::vector<std::shared_ptr<AppFolder>> folders,
+    const LibraryScanConfig& cfg,
+    QueueStage queue_stage,
+    ContinueStage continue_stage)
+{
+    m_state = std::make_shared<State>(int(folders.size()), std::move(queue_stage), std::move(continue_stage));
+    for (int i = 0; i < TOTAL_SCAN_STAGES; i++) {
+        m_state->stages[i].max_in_flight = std::max(cfg.max_in_flight[i], 1);
+    }
+    m_state->folders = std::move(folders);
+    admit_folders(m_state);
+}
+
+LibraryScanPipeline::~LibraryScanPipeline() {
+    cancel();
+}
+
+// stages that are queued skip their folder once they run
+void LibraryScanPipeline::cancel() {
+    m_state->token.cancel();
+    admit_folders(m_state);
+}
+
+bool LibraryScanPipeline::get_is_cancelled() const {
+    return m_state->token.is_cancelled();
+}
+
+bool LibraryScanPipeline::get_is_finished() const {
+    return m_state->total_finished_folders == m_state->total_folders;
+}
+
+int LibraryScanPipeline::get_total_folders() const {
+    return m_state->total_folders;
+}
+
+ScanStageProgress LibraryScanPipeline::get_progress(ScanStage stage_id) const {
+    const int i = int(stage_id);
+    auto& state = *m_state;
+    auto& stage = state.stages[i];
+
+    ScanStageProgress progress;
+    progress.total_items = state.get_total_items(i);
+    progress.total_processed = stage.total_processed;
+    progress.total_skipped = stage.total_skipped;
+    progress.total_queued = std::max(stage.total_entered - progress.total_processed, 0);
+    progress.total_waiting = stage.total_waiting;
+    progress.max_in_flight = stage.max_in_flight;
+    progress.is_finished = (progress.total_processed == progress.total_items);
+
+    const int64_t finish_time = stage.finish_time;
+    const int64_t elapsed_time = (finish_time >= 0) ? finish_time : state.get_elapsed_nanoseconds();
+    if (elapsed_time > 0) {
+        progress.items_per_second = float(progress.total_processed) * 1e9f / float(elapsed_time);
+    }
+    return progress;
+}
+
+LibraryScanPipeline::StageCall LibraryScanPipeline::create_stage_call(std::shared_ptr<Item> item, ScanStage stage) {
+    return [item = std::move(item), stage](const util::CancellationToken& token) {
+        run_stage(item, stage, token);
+    };
+}
+
+void LibraryScanPipeline::run_stage(std::shared_ptr<Item> item, ScanStage stage_id, const util::CancellationToken& token) {
+    auto& state = *item->state;
+    auto& folder = *item->folder;
+    auto is_cancelled = [&state, &token]() {
+        return state.token.is_cancelled() || token.is_cancelled();
+    };
+    // NOTE: We aren't holding any folder locks so interactive work on the same lane can go first
+    if (get_scan_stage_lane(stage_id) == TaskLane::DISK) {
+        util::WorkStealingPool::yield_to_interactive();
+    }
+
+    bool is_forwarded = false;
+    if (!is_cancelled()) {
+        switch (stage_id) {
+        case ScanStage::LOAD_CACHE:
+            is_forwarded = folder.load_cache_if_missing();
+            break;
+        case ScanStage::ENUMERATE:
+            {
+                auto hooks = DirectoryWalkHooks{};
+                hooks.cancel_token = state.token;
+                item->files = folder.list_files(hooks);
+                is_forwarded = !is_cancelled();
+                break;
+            }
+        case ScanStage::COMPUTE_INTENTS:
+            item->intents = folder.get_file_intents(item->files);
+            item->files.clear();
+            is_forwarded = true;
+            break;
+        case ScanStage::BUILD_STATE:
+            {
+                folder.update_state_from_intents(std::move(item->intents));
+                static auto& SCAN_LATENCY = util::metrics::get_histogram("scan.folder_latency");
+                const auto dt = std::chrono::steady_clock::now() - item->start_time;
+                SCAN_LATENCY.record(std::chrono::duration_cast<std::chrono::microseconds>(dt).count());
+                is_forwarded = true;
+                break;
+            }
+        default:
+            break;
+        }
+    }
+
+    item->is_finished = true;
+    state.leave_stage(stage_id, is_forwarded);
+    auto state_ptr = item->state;
+    const int next = int(stage_id)+1;
+    if (!is_forwarded || (next >= TOTAL_SCAN_STAGES)) {
+        // the folder has left the scan so its slot can go to the next one
+        state.release_slot(item->slot);
+        item->slot = -1;
+    } else {
+        // NOTE: The folder keeps its slot until it gets one in the next stage
+        item->stage = ScanStage(next);
+        item->is_finished = false;
+        state.push_waiting(std::move(item), next);
+    }
+    admit_folders(state_ptr);
+}
+
+void LibraryScanPipeline::admit_folders(const std::shared_ptr<State>& state_ptr) {
+    struct Admission {
+        std::shared_ptr<Item> item;
+        ScanStage stage;
+    };
+    auto& state = *state_ptr;
+    std::vector<Admission> admissions;
+    // NOTE: Items are released after the lock since their destructor releases their slot
+    std::vector<std::shared_ptr<Item>> dropped_items;
+    int total_dropped_folders = 0;
+    {
+        auto lock = std::scoped_lock(state.mutex);
+        // NOTE: Later stages go first since a folder that moves on frees a slot in the stage before it
+        for (int i = TOTAL_SCAN_STAGES-1; i >= 0; i--) {
+            auto& stage = state.stages[i];
+            if (state.token.is_cancelled()) {
+                stage.total_entered += int(stage.waiting.size());
+                for (auto& item: stage.waiting) {
+                    dropped_items.push_back(std::move(item));
+                }
+                stage.waiting.clear();
+                stage.total_waiting = 0;
+                continue;
+            }
+
+            while (stage.total_in_flight < stage.max_in_flight) {
+                std::shared_ptr<Item> item;
+                if (i == 0) {
+                    if (state.next_folder >= state.folders.size()) {
+                        break;
+                    }
+                    item = std::make_shared<Item>();
+                    item->state = state_ptr;
+                    item->folder = std::move(state.folders[state.next_folder++]);
+                    item->stage = ScanStage(i);
+                    item->start_time = std::chrono::steady_clock::now();
+                } else {
+                    if (stage.waiting.empty()) {
+                        break;
+                    }
+                    item = std::move(stage.waiting.front());
+                    stage.waiting.pop_front();
+                    stage.total_waiting--;
+                    state.stages[i-1].total_in_flight--;
+                }
+                stage.total_in_flight++;
+                stage.total_entered++;
+                item->slot = i;
+                admissions.push_back({ std::move(item), ScanStage(i) });
+            }
+        }
+
+        // folders that never entered the scan are skipped by the first stage
+        if (state.token.is_cancelled()) {
+            total_dropped_folders = int(state.folders.size() - state.next_folder);
+            state.folders.clear();
+            state.next_folder = 0;
+        }
+    }
+
+    if (total_dropped_folders > 0) {
+        state.stages[0].total_entered += total_dropped_folders;
+        for (int i = 0; i < total_dropped_folders; i++) {
+            state.leave_stage(ScanStage::LOAD_CACHE, false);
+        }
+    }
+
+    for (auto& admission: admissions) {
+        auto folder = admission.item->folder;
+        const auto lane = get_scan_stage_lane(admission.stage);
+        auto call = create_stage_call(std::move(admission.item), admission.stage);
+        if (admission.stage == ScanStage::LOAD_CACHE) {
+            state.queue_stage(std::move(folder), lane, std::move(call));
+        } else {
+            state.continue_stage(std::move(folder), lane, std::move(call));
+        }
+    }
+}
+
+};
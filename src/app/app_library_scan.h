@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "file_intents.h"
+#include "app_task_graph.h"
+#include "util/cancellation_token.h"
+
+namespace app
+{
+
+// NOTE: foward declare
+class AppFolder;
+
+// A library scan is split into stages so disk and cpu work run on their own lanes
+// NOTE: The cache is loaded first so folders without one aren't walked
+enum class ScanStage {
+    LOAD_CACHE,         // read and validate the series and episodes cache
+    ENUMERATE,          // walk the folder for files
+    COMPUTE_INTENTS,    // parse descriptors and get the intent for each file
+    BUILD_STATE,        // build the folder state and detect conflicts
+};
+
+constexpr int TOTAL_SCAN_STAGES = 4;
+
+const char* get_scan_stage_name(ScanStage stage);
+TaskLane get_scan_stage_lane(ScanStage stage);
+
+struct LibraryScanConfig {
+    // folders that can be queued or running in each stage
+    std::array<int, TOTAL_SCAN_STAGES> max_in_flight = {1,1,1,1};
+};
+
+struct ScanStageProgress {
+    int total_items = 0;            // folders that weren't skipped by an earlier stage
+    int total_processed = 0;        // folders that have left the stage
+    int total_skipped = 0;          // folders without a cache or whose scan was replaced or cancelled
+    int total_queued = 0;           // queued or running in the stage, this is at most max_in_flight
+    int total_waiting = 0;          // finished the previous stage and are waiting for a slot in this one
+    int max_in_flight = 0;
+    bool is_finished = false;
+    float items_per_second = 0.0f;
+};
+
+// Scans a list of folders with each stage queued as a folder task on its lane
+// - Each stage has a limited number of slots and a folder is only queued into a stage once it has one
+// - A folder keeps the slot of its current stage until it gets one in the next stage
+//   So the folders that hold onto their files and intents between stages are bounded
+// - A newer scan of the folder replaces the remaining stages and the folder is counted as skipped
+// NOTE: Destroying the scan only cancels it, stages that are running finish in the background
+class LibraryScanPipeline
+{
+public:
+    using StageCall = std::function<void (const util::CancellationToken&)>;
+    // queue the first stage of a folder's scan
+    using QueueStage = std::function<void (std::shared_ptr<AppFolder>, TaskLane, StageCall)>;
+    // queue the next stage unless a newer request for the folder is already pending
+    using ContinueStage = std::function<void (std::shared_ptr<AppFolder>, TaskLane, StageCall)>;
+private:
+    // NOTE: Shared with the queued stages since they can outlive the scan
+    struct State;
+    struct Item;
+    std::shared_ptr<State> m_state;
+public:
+    // NOTE: The stages are queued through the callbacks without any lock of the scan held
+    LibraryScanPipeline(
+        std::vector<std::shared_ptr<AppFolder>> folders,
+        const LibraryScanConfig& cfg,
+        QueueStage queue_stage,
+        ContinueStage continue_stage);
+    ~LibraryScanPipeline();
+    void cancel();
+    bool get_is_cancelled() const;
+    bool get_is_finished() const;
+    int get_total_folders() const;
+    ScanStageProgress get_progress(ScanStage stage) const;
+
+    LibraryScanPipeline(const LibraryScanPipeline&) = delete;
+    LibraryScanPipeline(LibraryScanPipeline&&) = delete;
+    LibraryScanPipeline& operator=(const LibraryScanPipeline&) = delete;
+    LibraryScanPipeline& operator=(LibraryScanPipeline&&) = delete;
+private:
+    static void run_stage(std::shared_ptr<Item> item, ScanStage stage, const util::CancellationToken& token);
+    static StageCall create_stage_call(std::shared_ptr<Item> item, ScanStage stage);
+    // queue every folder that can be given a slot in its next stage
+    static void admit_folders(const std::shared_ptr<State>& state);
+};
+
+};
@@ -0,0 +1,67 @@
+#include "app_library_stats.h"
+
+namespace app 
+{
+
+// status flags are single bits so we use the bit position as the index
+static int get_status_index(uint32_t status) {
+    for (int i = 0; i < AppLibraryStats::TOTAL_STATUSES; i++) {
+        if (status == (1u << i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+AppLibraryStats::AppLibraryStats() {
+    for (auto& count: m_status_counts) {
+        count = 0;
+    }
+    m_total_renames = 0;
+    m_total_deletes = 0;
+    m_total_conflicts = 0;
+    m_generation = 0;
+    m_cache_generation = 0;
+}
+
+void AppLibraryStats::add_folder(const AppFolderSummary& summary) {
+    apply_delta(summary, +1);
+}
+
+void AppLibraryStats::remove_folder(const AppFolderSummary& summary) {
+    apply_delta(summary, -1);
+}
+
+void AppLibraryStats::update_folder(const AppFolderSummary& prev, const AppFolderSummary& next) {
+    if (prev.status != next.status) {
+        const int prev_index = get_status_index(prev.status);
+        const int next_index = get_status_index(next.status);
+        if (prev_index >= 0) m_status_counts[prev_index]--;
+        if (next_index >= 0) m_status_counts[next_index]++;
+    }
+    m_total_renames += (next.renames - prev.renames);
+    m_total_deletes += (next.deletes - prev.deletes);
+    m_total_conflicts += (next.conflicts - prev.conflicts);
+    m_generation++;
+}
+
+int AppLibraryStats::get_status_count(uint32_t status) const {
+    const int index = get_status_index(status);
+    if (index < 0) {
+        return 0;
+    }
+    return m_status_counts[index];
+}
+
+void AppLibraryStats::apply_delta(const AppFolderSummary& summary, int delta) {
+    const int index = get_status_index(summary.status);
+    if (index >= 0) {
+        m_status_counts[index] += delta;
+    }
+    m_total_renames += delta*summary.renames;
+    m_total_deletes += delta*summary.deletes;
+    m_total_conflicts += delta*summary.conflicts;
+    m_generation++;
+}
+
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+
+namespace app 
+{
+
+// Snapshot of a folder's state which contributes to the library wide totals
+struct AppFolderSummary {
+    uint32_t status = 0;    // AppFolder::Status flag
+    int renames = 0;
+    int deletes = 0;
+    int conflicts = 0;
+};
+
+// Library wide totals that are maintained by deltas when a folder's summary changes
+// This avoids having to walk every folder to get the totals
+class AppLibraryStats 
+{
+public:
+    static constexpr int TOTAL_STATUSES = 6;
+private:
+    std::array<std::atomic<int>, TOTAL_STATUSES> m_status_counts;
+    std::atomic<int> m_total_renames;
+    std::atomic<int> m_total_deletes;
+    std::atomic<int> m_total_conflicts;
+    // incremented on every change so observers can tell when the totals are stale
+    std::atomic<uint64_t> m_generation;
+    // incremented when the cache of a folder is loaded or changed outside of the metadata store
+    std::atomic<uint64_t> m_cache_generation;
+public:
+    AppLibraryStats();
+    void add_folder(const AppFolderSummary& summary);
+    void remove_folder(const AppFolderSummary& summary);
+    void update_folder(const AppFolderSummary& prev, const AppFolderSummary& next);
+    int get_status_count(uint32_t status) const;
+    int get_total_renames() const { return m_total_renames; }
+    int get_total_deletes() const { return m_total_deletes; }
+    int get_total_conflicts() const { return m_total_conflicts; }
+    uint64_t get_generation() const { return m_generation; }
+    void notify_cache_changed() { m_cache_generation++; }
+    uint64_t get_cache_generation() const { return m_cache_generation; }
+
+    AppLibraryStats(const AppLibraryStats&) = delete;
+    AppLibraryStats(AppLibraryStats&&) = delete;
+    AppLibraryStats& operator=(const AppLibraryStats&) = delete;
+    AppLibraryStats& operator=(AppLibraryStats&&) = delete;
+private:
+    void apply_delta(const AppFolderSummary& summary, int delta);
+};
+
+};
@@ -0,0 +1,289 @@
+#include "app_library_sync.h"
+#include "app_folder.h"
+#include "app_schemas.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <future>
+
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <fmt/core.h>
+
+#include "util/file_loading.h"
+#include "util/trace.h"
+
+namespace app
+{
+
+// NOTE: The updates feed only gives up to a week of changes in a single query
+constexpr int64_t UPDATE_WINDOW_SECONDS = 7*24*60*60;
+constexpr int64_t SECONDS_PER_DAY = 24*60*60;
+// NOTE: The sync waits with a timeout so that a cancel isn't stuck behind the rate limiter
+constexpr auto SYNC_POLL_INTERVAL = std::chrono::milliseconds(100);
+
+tl::expected<LibrarySyncState, const char*> load_library_sync_state(const rapidjson::Document& doc) {
+    if (!util::validate_document(doc, LIBRARY_SYNC_SCHEMA_DOC)) {
+        return tl::make_unexpected<const char*>("Failed to validate library sync data");
+    }
+    LibrarySyncState state;
+    state.last_sync_time = doc["last_sync_time"].GetInt64();
+    return state;
+}
+
+std::string json_stringify_library_sync_state(const LibrarySyncState& state) {
+    rapidjson::StringBuffer sb;
+    auto writer = rapidjson::Writer<rapidjson::StringBuffer>(sb);
+    writer.StartObject();
+    writer.Key("last_sync_time"); writer.Int64(state.last_sync_time);
+    writer.EndObject();
+    return std::string(sb.GetString(), sb.GetSize());
+}
+
+static int64_t get_unix_time() {
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::seconds>(now).count();
+}
+
+template <typename T>
+static bool wait_until_ready(std::future<T>& future, const util::CancellationToken& token) {
+    while (!token.is_cancelled()) {
+        if (future.wait_for(SYNC_POLL_INTERVAL) == std::future_status::ready) {
+            return true;
+        }
+    }
+    return false;
+}
+
+LibrarySync::LibrarySync(
+    std::vector<std::shared_ptr<AppFolder>> folders,
+    const std::filesystem::path& state_filepath,
+    const LibrarySyncConfig& cfg,
+    tvdb_api::TvdbClient& client,
+    PatchCallback on_patch,
+    ErrorCallback on_error)
+: m_cfg(cfg), m_folders(std::move(folders)), m_state_filepath(state_filepath), m_client(client),
+  m_on_patch(std::move(on_patch)), m_on_error(std::move(on_error)),
+  m_token(util::CancellationToken::create()),
+  m_start_time(std::chrono::steady_clock::now())
+{
+    m_total_update_queries = 0;
+    m_total_series = 0;
+    m_total_processed = 0;
+    m_total_patched = 0;
+    m_total_failed = 0;
+    m_total_in_flight = 0;
+    m_is_full_refresh = false;
+    m_is_finished = false;
+    m_is_saved = false;
+    m_last_sync_time = 0;
+    m_finish_time = -1;
+    m_thread = std::thread([this]() { run(); });
+}
+
+LibrarySync::~LibrarySync() {
+    cancel();
+    m_thread.join();
+}
+
+void LibrarySync::cancel() {
+    m_token.cancel();
+}
+
+LibrarySyncProgress LibrarySync::get_progress() const {
+    LibrarySyncProgress progress;
+    progress.total_folders = int(m_folders.size());
+    progress.total_update_queries = m_total_update_queries;
+    progress.total_series = m_total_series;
+    progress.total_processed = m_total_processed;
+    progress.total_patched = m_total_patched;
+    progress.total_failed = m_total_failed;
+    progress.total_in_flight = m_total_in_flight;
+    progress.is_full_refresh = m_is_full_refresh;
+    progress.is_finished = m_is_finished;
+    progress.is_saved = m_is_saved;
+    progress.last_sync_time = m_last_sync_time;
+
+    const int64_t finish_time = m_finish_time;
+    const int64_t elapsed_time = (finish_time >= 0) ? finish_time : get_elapsed_nanoseconds();
+    if (elapsed_time > 0) {
+        progress.series_per_second = float(progress.total_processed) * 1e9f / float(elapsed_time);
+    }
+    return progress;
+}
+
+// NOTE: Returns nullopt if a query failed or the sync was cancelled
+//       The window is queried at least once since a sync can start in the same second as the last one
+std::optional<std::vector<uint32_t>> LibrarySync::get_updated_series(int64_t from_time, int64_t to_time) {
+    TRACE_SCOPE("network", "LibrarySync::get_updated_series");
+    std::set<uint32_t> ids;
+    int64_t start = from_time;
+    do {
+        const int64_t end = std::min(start + UPDATE_WINDOW_SECONDS, to_time);
+        auto result = m_client.get_updated_series_async(start, end);
+        if (!wait_until_ready(result, m_token)) {
+            return std::nullopt;
+        }
+        auto updates_opt = result.get();
+        m_total_update_queries++;
+        if (!updates_opt) {
+            m_on_error(updates_opt.error());
+            return std::nullopt;
+        }
+        for (auto& update: updates_opt.value()) {
+            ids.insert(update.id);
+        }
+        start = end;
+    } while (start < to_time);
+    return std::vector<uint32_t>(ids.begin(), ids.end());
+}
+
+void LibrarySync::patch_folders(uint32_t id, const std::vector<std::shared_ptr<AppFolder>>& folders, tvdb_api::TVDB_Cache&& cache) {
+    for (size_t i = 0; i < folders.size(); i++) {
+        auto& folder = folders[i];
+        // NOTE: The last folder of the series takes the fetched data instead of a copy
+        const bool is_last = (i == folders.size()-1);
+        auto series = is_last ? std::move(cache.series) : cache.series;
+        auto episodes = is_last ? std::move(cache.episodes) : cache.episodes;
+
+        CachePatch patch;
+        if (!folder->load_cache_if_missing() || !folder->patch_cache(std::move(series), std::move(episodes), patch)) {
+            m_total_failed++;
+            m_on_error(fmt::format("Failed to patch the cache of {} for series {}", folder->GetPath().filename().string(), id));
+            continue;
+        }
+        if (!patch.get_is_empty()) {
+            m_total_patched++;
+            m_on_patch(folder);
+        }
+    }
+}
+
+void LibrarySync::run() {
+    struct Fetch {
+        uint32_t id;
+        std::future<tl::expected<tvdb_api::SeriesInfo, std::string>> series;
+        std::future<tl::expected<tvdb_api::EpisodesMap, std::string>> episodes;
+    };
+
+    // NOTE: Changes made while we are syncing are picked up by the next sync
+    const int64_t sync_time = get_unix_time();
+    auto finish = [this]() {
+        m_total_in_flight = 0;
+        m_finish_time = get_elapsed_nanoseconds();
+        m_is_finished = true;
+    };
+
+    std::optional<LibrarySyncState> last_state = std::nullopt;
+    {
+        // NOTE: We expect that the state may not exist if the library hasn't been synced before
+        auto res = util::load_document_from_file(m_state_filepath.string().c_str());
+        if (res.code == util::DocumentLoadCode::OK) {
+            auto state_opt = load_library_sync_state(res.doc);
+            if (state_opt) {
+                last_state = state_opt.value();
+                m_last_sync_time = last_state->last_sync_time;
+            }
+        }
+    }
+
+    // NOTE: Folders seeded from the library index already know their series without loading the cache
+    std::map<uint32_t, std::vector<std::shared_ptr<AppFolder>>> series_folders;
+    for (auto& folder: m_folders) {
+        if (m_token.is_cancelled()) {
+            finish();
+            return;
+        }
+        uint32_t id = folder->m_series_id;
+        if ((id == 0) && !folder->get_is_unmatched() && folder->load_cache_if_missing()) {
+            id = folder->m_series_id;
+        }
+        if (id != 0) {
+            series_folders[id].push_back(folder);
+        }
+    }
+
+    const int64_t max_delta_seconds = int64_t(std::max(m_cfg.max_delta_days, 1)) * SECONDS_PER_DAY;
+    const bool is_full_refresh =
+        !last_state ||
+        (last_state->last_sync_time > sync_time) ||
+        ((sync_time - last_state->last_sync_time) > max_delta_seconds);
+    m_is_full_refresh = is_full_refresh;
+
+    std::vector<uint32_t> series_ids;
+    if (is_full_refresh) {
+        series_ids.reserve(series_folders.size());
+        for (auto& [id, folders]: series_folders) {
+            series_ids.push_back(id);
+        }
+    } else {
+        auto updated_opt = get_updated_series(last_state->last_sync_time, sync_time);
+        if (!updated_opt) {
+            finish();
+            return;
+        }
+        for (auto id: updated_opt.value()) {
+            if (series_folders.find(id) != series_folders.end()) {
+                series_ids.push_back(id);
+            }
+        }
+    }
+    m_total_series = int(series_ids.size());
+
+    const size_t max_in_flight = size_t(std::max(m_cfg.max_series_in_flight, 1));
+    std::deque<Fetch> fetches;
+    size_t next_series = 0;
+    while (!m_token.is_cancelled()) {
+        // keep the window of fetches full
+        while ((fetches.size() < max_in_flight) && (next_series < series_ids.size())) {
+            const uint32_t id = series_ids[next_series++];
+            fetches.push_back({ id, m_client.get_series_async(id), m_client.get_series_episodes_async(id) });
+        }
+        m_total_in_flight = int(fetches.size());
+        if (fetches.empty()) {
+            break;
+        }
+
+        // NOTE: Fetches start in the order they were submitted so we wait on the oldest one
+        auto& fetch = fetches.front();
+        if ((fetch.series.wait_for(SYNC_POLL_INTERVAL) != std::future_status::ready) ||
+            (fetch.episodes.wait_for(SYNC_POLL_INTERVAL) != std::future_status::ready))
+        {
+            continue;
+        }
+        const uint32_t id = fetch.id;
+        auto series_opt = fetch.series.get();
+        auto episodes_opt = fetch.episodes.get();
+        fetches.pop_front();
+        m_total_processed++;
+
+        if (!series_opt || !episodes_opt) {
+            m_total_failed++;
+            m_on_error(!series_opt ? series_opt.error() : episodes_opt.error());
+            continue;
+        }
+        patch_folders(id, series_folders[id], { std::move(series_opt.value()), std::move(episodes_opt.value()) });
+    }
+
+    // NOTE: A failed series would be missed by the next sync if the time was advanced past its update
+    if (!m_token.is_cancelled() && (m_total_failed == 0)) {
+        const auto json_str = json_stringify_library_sync_state({ sync_time });
+        if (util::write_json_string_to_file(m_state_filepath.string().c_str(), json_str)) {
+            m_last_sync_time = sync_time;
+            m_is_saved = true;
+        } else {
+            m_on_error("Failed to save library sync state");
+        }
+    }
+    finish();
+}
+
+int64_t LibrarySync::get_elapsed_nanoseconds() const {
+    const auto dt = std::chrono::steady_clock::now() - m_start_time;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
+}
+
+};
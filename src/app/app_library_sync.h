@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+#include <optional>
+#include <rapidjson/document.h>
+
+#include "tvdb_api/tvdb_api.h"
+#include "util/expected.hpp"
+#include "util/cancellation_token.h"
+
+namespace app
+{
+
+// NOTE: foward declare
+class AppFolder;
+
+struct LibrarySyncConfig {
+    // each series has its series and episodes requests in flight together
+    int max_series_in_flight = 8;
+    // every cached series is refreshed instead if the last sync is older than this
+    int max_delta_days = 28;
+};
+
+// Time of the last sync that every cached folder was brought up to date at
+struct LibrarySyncState {
+    int64_t last_sync_time = 0;     // unix time in seconds
+};
+
+tl::expected<LibrarySyncState, const char*> load_library_sync_state(const rapidjson::Document& doc);
+std::string json_stringify_library_sync_state(const LibrarySyncState& state);
+
+struct LibrarySyncProgress {
+    int total_folders = 0;
+    int total_update_queries = 0;   // time windows of the updates feed that were read
+    int total_series = 0;           // series that are fetched again
+    int total_processed = 0;
+    int total_patched = 0;          // folders whose cache changed
+    int total_failed = 0;
+    int total_in_flight = 0;
+    bool is_full_refresh = false;
+    bool is_finished = false;
+    // the sync time is only advanced if every changed series was patched
+    bool is_saved = false;
+    int64_t last_sync_time = 0;
+    float series_per_second = 0.0f;
+};
+
+// Brings the cache of every matched folder up to date from a single thread
+// Only the series that the updates feed reports as changed since the last sync are fetched again
+// The cache of each folder is then patched with the episodes that were added, changed or removed
+// NOTE: Every cached series is fetched if there was no previous sync or it is too old
+//       The http cache means that pages that haven't changed are only revalidated
+class LibrarySync
+{
+public:
+    using PatchCallback = std::function<void (std::shared_ptr<AppFolder>)>;
+    using ErrorCallback = std::function<void (const std::string&)>;
+private:
+    const LibrarySyncConfig m_cfg;
+    std::vector<std::shared_ptr<AppFolder>> m_folders;
+    const std::filesystem::path m_state_filepath;
+    tvdb_api::TvdbClient& m_client;
+    PatchCallback m_on_patch;
+    ErrorCallback m_on_error;
+    util::CancellationToken m_token;
+
+    std::atomic<int> m_total_update_queries;
+    std::atomic<int> m_total_series;
+    std::atomic<int> m_total_processed;
+    std::atomic<int> m_total_patched;
+    std::atomic<int> m_total_failed;
+    std::atomic<int> m_total_in_flight;
+    std::atomic<bool> m_is_full_refresh;
+    std::atomic<bool> m_is_finished;
+    std::atomic<bool> m_is_saved;
+    std::atomic<int64_t> m_last_sync_time;
+    // nanoseconds since the start of the sync
+    std::atomic<int64_t> m_finish_time;
+    const std::chrono::steady_clock::time_point m_start_time;
+    std::thread m_thread;
+public:
+    LibrarySync(
+        std::vector<std::shared_ptr<AppFolder>> folders,
+        const std::filesystem::path& state_filepath,
+        const LibrarySyncConfig& cfg,
+        tvdb_api::TvdbClient& client,
+        PatchCallback on_patch,
+        ErrorCallback on_error);
+    ~LibrarySync();
+    // NOTE: The sync time isn't advanced if the sync is cancelled
+    void cancel();
+    bool get_is_cancelled() const { return m_token.is_cancelled(); }
+    bool get_is_finished() const { return m_is_finished; }
+    LibrarySyncProgress get_progress() const;
+
+    LibrarySync(const LibrarySync&) = delete;
+    LibrarySync(LibrarySync&&) = delete;
+    LibrarySync& operator=(const LibrarySync&) = delete;
+    LibrarySync& operator=(LibrarySync&&) = delete;
+private:
+    void run();
+    std::optional<std::vector<uint32_t>> get_updated_series(int64_t from_time, int64_t to_time);
+    void patch_folders(uint32_t id, const std::vector<std::shared_ptr<AppFolder>>& folders, tvdb_api::TVDB_Cache&& cache);
+    int64_t get_elapsed_nanoseconds() const;
+};
+
+};
@@ -0,0 +1,494 @@
+#include "app_metadata_store.h"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <string.h>
+#include <stdlib.h>
+
+#include <fmt/core.h>
+
+#include "util/trace.h"
+#include "util/metrics.h"
+
+namespace app
+{
+
+namespace fs = std::filesystem;
+using namespace metadata_store;
+
+// NOTE: The layout of the records is part of the file format
+static_assert(sizeof(Header) == 24);
+static_assert(sizeof(SeriesRecord) == 44);
+static_assert(sizeof(EpisodeRecord) == 40);
+static_assert(sizeof(FolderRecord) == 12);
+
+// NOTE: Each save writes a new generation instead of replacing the file in place
+//       Windows can't replace or delete a file while it is mapped and folders keep the old store mapped
+//       So older generations are deleted once they can be, which may only be on a later save
+constexpr const char* STORE_PREFIX = ".torrent_renamer_metadata.";
+constexpr const char* STORE_EXTENSION = ".bin";
+
+namespace metadata_store {
+
+bool get_is_episode_before(const EpisodeRecord& a, int season, int episode) {
+    if (a.season != season) return a.season < season;
+    return a.episode < episode;
+}
+
+fs::path get_store_path(const fs::path& root, uint64_t generation) {
+    return root / fmt::format("{}{}{}", STORE_PREFIX, generation, STORE_EXTENSION);
+}
+
+std::vector<StoreFile> list_store_files(const fs::path& root) {
+    const std::string prefix = STORE_PREFIX;
+    const std::string extension = STORE_EXTENSION;
+    std::vector<StoreFile> files;
+    std::error_code ec;
+    for (auto& entry: fs::directory_iterator(root, ec)) {
+        const auto filename = entry.path().filename().string();
+        if ((filename.size() <= (prefix.size() + extension.size())) ||
+            (filename.compare(0, prefix.size(), prefix) != 0) ||
+            (filename.compare(filename.size()-extension.size(), extension.size(), extension) != 0))
+        {
+            continue;
+        }
+        const auto generation = filename.substr(prefix.size(), filename.size()-prefix.size()-extension.size());
+        if (!std::all_of(generation.begin(), generation.end(), [](char c) { return (c >= '0') && (c <= '9'); })) {
+            continue;
+        }
+        files.push_back({ std::strtoull(generation.c_str(), NULL, 10), entry.path() });
+    }
+    std::sort(files.begin(), files.end(), [](const StoreFile& a, const StoreFile& b) {
+        return a.generation > b.generation;
+    });
+    return files;
+}
+
+bool get_is_valid_string(const StringRef& ref, const char* pool, uint32_t pool_size, bool is_optional) {
+    if (is_optional && (ref.offset == NULL_STRING_OFFSET)) {
+        return true;
+    }
+    return (uint64_t(ref.offset) + uint64_t(ref.length) < uint64_t(pool_size)) &&
+           (pool[ref.offset + ref.length] == '\0');
+}
+
+// NOTE: Identical strings such as the status and air dates are only stored once
+StringRef StringPoolBuilder::add(std::string_view str) {
+    auto key = std::string(str);
+    auto res = m_offsets.find(key);
+    if (res != m_offsets.end()) {
+        return StringRef{ res->second, uint32_t(str.size()) };
+    }
+    const auto offset = uint32_t(m_pool.size());
+    m_pool.append(str);
+    m_pool.push_back('\0');
+    m_offsets.emplace(std::move(key), offset);
+    return StringRef{ offset, uint32_t(str.size()) };
+}
+
+StringRef StringPoolBuilder::add_optional(const std::optional<std::string_view>& str) {
+    if (!str) {
+        return StringRef{ NULL_STRING_OFFSET, 0 };
+    }
+    return add(str.value());
+}
+
+};
+
+MetadataStore::MetadataStore(std::unique_ptr<util::MappedFile> file)
+: m_file(std::move(file))
+{
+    const uint8_t* data = m_file->data();
+    m_header = reinterpret_cast<const Header*>(data);
+    data += sizeof(Header);
+    m_series = reinterpret_cast<const SeriesRecord*>(data);
+    data += sizeof(SeriesRecord) * m_header->total_series;
+    m_episodes = reinterpret_cast<const EpisodeRecord*>(data);
+    data += sizeof(EpisodeRecord) * m_header->total_episodes;
+    m_folders = reinterpret_cast<const FolderRecord*>(data);
+    data += sizeof(FolderRecord) * m_header->total_folders;
+    m_strings = reinterpret_cast<const char*>(data);
+}
+
+tl::expected<std::shared_ptr<const MetadataStore>, std::string> MetadataStore::open(const fs::path& filepath) {
+    TRACE_SCOPE("io", "MetadataStore::open");
+    auto file_opt = util::MappedFile::open(filepath.string().c_str());
+    if (!file_opt) {
+        return tl::make_unexpected(std::move(file_opt.error()));
+    }
+
+    // NOTE: The header is checked before the tables are located from it
+    auto& file = file_opt.value();
+    if (file->size() < sizeof(Header)) {
+        return tl::make_unexpected(fmt::format("Metadata store {} is missing its header", filepath.string()));
+    }
+    const auto* header = reinterpret_cast<const Header*>(file->data());
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return tl::make_unexpected(fmt::format("Metadata store {} has an invalid magic", filepath.string()));
+    }
+    if (header->version != VERSION) {
+        return tl::make_unexpected(fmt::format("Metadata store {} has version {} instead of {}", filepath.string(), header->version, VERSION));
+    }
+    const uint64_t expected_size =
+        uint64_t(sizeof(Header)) +
+        uint64_t(sizeof(SeriesRecord)) * header->total_series +
+        uint64_t(sizeof(EpisodeRecord)) * header->total_episodes +
+        uint64_t(sizeof(FolderRecord)) * header->total_folders +
+        uint64_t(header->string_pool_size);
+    if (uint64_t(file->size()) != expected_size) {
+        return tl::make_unexpected(fmt::format("Metadata store {} has {} bytes instead of {}", filepath.string(), file->size(), expected_size));
+    }
+
+    static auto& TOTAL_BYTES_MAPPED = util::metrics::get_counter("metadata_store.bytes_mapped");
+    TOTAL_BYTES_MAPPED.add(int64_t(file->size()));
+
+    auto store = std::shared_ptr<MetadataStore>(new MetadataStore(std::move(file)));
+    auto error = store->validate();
+    if (error) {
+        return tl::make_unexpected(fmt::format("Metadata store {} is corrupt: {}", filepath.string(), error.value()));
+    }
+    return store;
+}
+
+// NOTE: Every string must end in a null terminator inside the pool so views can be printed
+std::optional<std::string> MetadataStore::validate() const {
+    TRACE_SCOPE("cpu", "MetadataStore::validate");
+    const uint32_t pool_size = m_header->string_pool_size;
+    auto is_valid_string = [this, pool_size](const StringRef& ref, bool is_optional) {
+        return get_is_valid_string(ref, m_strings, pool_size, is_optional);
+    };
+
+    uint32_t next_episode = 0;
+    for (uint32_t i = 0; i < m_header->total_series; i++) {
+        const auto& series = m_series[i];
+        if ((i > 0) && (m_series[i-1].id >= series.id)) {
+            return fmt::format("series {} is out of order", series.id);
+        }
+        if (!is_valid_string(series.name, false) || !is_valid_string(series.air_date, false) ||
+            !is_valid_string(series.status, false) || !is_valid_string(series.overview, true))
+        {
+            return fmt::format("series {} has an invalid string", series.id);
+        }
+        if (series.first_episode != next_episode) {
+            return fmt::format("series {} has episodes that are not contiguous", series.id);
+        }
+        if (uint64_t(series.first_episode) + uint64_t(series.total_episodes) > uint64_t(m_header->total_episodes)) {
+            return fmt::format("series {} has too many episodes", series.id);
+        }
+        next_episode += series.total_episodes;
+
+        for (uint32_t j = series.first_episode; j < next_episode; j++) {
+            const auto& episode = m_episodes[j];
+            if (episode.series_id != series.id) {
+                return fmt::format("episode {} is in the wrong series", episode.id);
+            }
+            if ((j > series.first_episode) && !get_is_episode_before(m_episodes[j-1], episode.season, episode.episode)) {
+                return fmt::format("episode {} is out of order", episode.id);
+            }
+            if (!is_valid_string(episode.air_date, false) || !is_valid_string(episode.name, false) ||
+                !is_valid_string(episode.overview, true))
+            {
+                return fmt::format("episode {} has an invalid string", episode.id);
+            }
+        }
+    }
+
+    if (next_episode != m_header->total_episodes) {
+        return std::string("there are episodes that don't belong to a series");
+    }
+
+    for (uint32_t i = 0; i < m_header->total_folders; i++) {
+        const auto& folder = m_folders[i];
+        if (!is_valid_string(folder.name, false)) {
+            return fmt::format("folder {} has an invalid name", i);
+        }
+        if ((i > 0) && (get_string(m_folders[i-1].name) >= get_string(folder.name))) {
+            return fmt::format("folder {} is out of order", get_string(folder.name));
+        }
+        if (!find_series(folder.series_id)) {
+            return fmt::format("folder {} has a missing series {}", get_string(folder.name), folder.series_id);
+        }
+    }
+    return std::nullopt;
+}
+
+std::string_view MetadataStore::get_string(const StringRef& ref) const {
+    return std::string_view(m_strings + ref.offset, ref.length);
+}
+
+std::optional<std::string_view> MetadataStore::get_optional_string(const StringRef& ref) const {
+    if (ref.offset == NULL_STRING_OFFSET) {
+        return std::nullopt;
+    }
+    return get_string(ref);
+}
+
+std::optional<uint32_t> MetadataStore::find_series(uint32_t id) const {
+    const auto* begin = m_series;
+    const auto* end = m_series + m_header->total_series;
+    const auto* res = std::lower_bound(begin, end, id, [](const SeriesRecord& series, uint32_t id) {
+        return series.id < id;
+    });
+    if ((res == end) || (res->id != id)) {
+        return std::nullopt;
+    }
+    return uint32_t(res - begin);
+}
+
+SeriesView MetadataStore::get_series(uint32_t series_index) const {
+    const auto& series = m_series[series_index];
+    SeriesView view;
+    view.id = series.id;
+    view.name = get_string(series.name);
+    view.air_date = get_string(series.air_date);
+    view.status = get_string(series.status);
+    view.overview = get_optional_string(series.overview);
+    return view;
+}
+
+std::optional<EpisodeView> MetadataStore::find_episode(uint32_t series_index, const tvdb_api::EpisodeKey& key) const {
+    const auto& series = m_series[series_index];
+    const auto* begin = m_episodes + series.first_episode;
+    const auto* end = begin + series.total_episodes;
+    const auto* res = std::lower_bound(begin, end, key, [](const EpisodeRecord& episode, const tvdb_api::EpisodeKey& key) {
+        return get_is_episode_before(episode, key.season, key.episode);
+    });
+    if ((res == end) || (res->season != key.season) || (res->episode != key.episode)) {
+        return std::nullopt;
+    }
+    return get_episode(uint32_t(res - m_episodes));
+}
+
+std::optional<uint32_t> MetadataStore::find_folder_series(std::string_view name) const {
+    const auto* begin = m_folders;
+    const auto* end = m_folders + m_header->total_folders;
+    const auto* res = std::lower_bound(begin, end, name, [this](const FolderRecord& folder, std::string_view name) {
+        return get_string(folder.name) < name;
+    });
+    if ((res == end) || (get_string(res->name) != name)) {
+        return std::nullopt;
+    }
+    return res->series_id;
+}
+
+EpisodeView MetadataStore::get_episode(uint32_t episode_index) const {
+    const auto& episode = m_episodes[episode_index];
+    EpisodeView view;
+    view.id = episode.id;
+    view.season = episode.season;
+    view.episode = episode.episode;
+    view.air_date = get_string(episode.air_date);
+    view.name = get_string(episode.name);
+    view.overview = get_optional_string(episode.overview);
+    return view;
+}
+
+static std::optional<std::string_view> get_optional_view(const std::optional<std::string>& str) {
+    if (!str) {
+        return std::nullopt;
+    }
+    return std::string_view(str.value());
+}
+
+static EpisodeView get_episode_view(const tvdb_api::EpisodeInfo& episode) {
+    EpisodeView view;
+    view.id = episode.id;
+    view.season = episode.season;
+    view.episode = episode.episode;
+    view.air_date = episode.air_date;
+    view.name = episode.name;
+    view.overview = get_optional_view(episode.overview);
+    return view;
+}
+
+CacheView::CacheView(const tvdb_api::TVDB_Cache& cache)
+: m_cache(&cache), m_store(nullptr), m_series_index(0)
+{}
+
+CacheView::CacheView(const MetadataStore& store, uint32_t series_index)
+: m_cache(nullptr), m_store(&store), m_series_index(series_index)
+{}
+
+SeriesView CacheView::get_series() const {
+    if (m_store != nullptr) {
+        return m_store->get_series(m_series_index);
+    }
+    const auto& series = m_cache->series;
+    SeriesView view;
+    view.id = series.id;
+    view.name = series.name;
+    view.air_date = series.air_date;
+    view.status = series.status;
+    view.overview = get_optional_view(series.overview);
+    return view;
+}
+
+std::optional<EpisodeView> CacheView::find_episode(const tvdb_api::EpisodeKey& key) const {
+    if (m_store != nullptr) {
+        return m_store->find_episode(m_series_index, key);
+    }
+    auto res = m_cache->episodes.find(key);
+    if (res == m_cache->episodes.end()) {
+        return std::nullopt;
+    }
+    return get_episode_view(res->second);
+}
+
+std::vector<EpisodeView> CacheView::get_episodes() const {
+    std::vector<EpisodeView> episodes;
+    if (m_store != nullptr) {
+        const uint32_t first = m_store->get_first_episode(m_series_index);
+        const uint32_t total = m_store->get_total_episodes(m_series_index);
+        episodes.reserve(total);
+        for (uint32_t i = first; i < first+total; i++) {
+            episodes.push_back(m_store->get_episode(i));
+        }
+        return episodes;
+    }
+    episodes.reserve(m_cache->episodes.size());
+    for (auto& [key, episode]: m_cache->episodes) {
+        episodes.push_back(get_episode_view(episode));
+    }
+    return episodes;
+}
+
+static std::optional<std::string> to_optional_string(const std::optional<std::string_view>& view) {
+    if (!view) {
+        return std::nullopt;
+    }
+    return std::string(view.value());
+}
+
+tvdb_api::TVDB_Cache CacheView::to_cache() const {
+    if (m_cache != nullptr) {
+        return *m_cache;
+    }
+    tvdb_api::TVDB_Cache cache;
+    const auto series = get_series();
+    cache.series.id = series.id;
+    cache.series.name = series.name;
+    cache.series.air_date = series.air_date;
+    cache.series.status = series.status;
+    cache.series.overview = to_optional_string(series.overview);
+    for (auto& view: get_episodes()) {
+        tvdb_api::EpisodeInfo episode;
+        episode.id = view.id;
+        episode.season = view.season;
+        episode.episode = view.episode;
+        episode.air_date = view.air_date;
+        episode.name = view.name;
+        episode.overview = to_optional_string(view.overview);
+        cache.episodes.emplace(tvdb_api::EpisodeKey{ episode.season, episode.episode }, std::move(episode));
+    }
+    return cache;
+}
+
+bool MetadataStoreBuilder::add(const CacheView& cache) {
+    const auto series = cache.get_series();
+    if (!m_series_ids.insert(series.id).second) {
+        return false;
+    }
+
+    auto& record = m_series.emplace_back();
+    record.id = series.id;
+    record.first_episode = 0;
+    record.name = m_strings.add(series.name);
+    record.air_date = m_strings.add(series.air_date);
+    record.status = m_strings.add(series.status);
+    record.overview = m_strings.add_optional(series.overview);
+
+    auto& episodes = m_series_episodes.emplace_back();
+    for (auto& view: cache.get_episodes()) {
+        auto& episode = episodes.emplace_back();
+        episode.series_id = series.id;
+        episode.id = view.id;
+        episode.season = view.season;
+        episode.episode = view.episode;
+        episode.air_date = m_strings.add(view.air_date);
+        episode.name = m_strings.add(view.name);
+        episode.overview = m_strings.add_optional(view.overview);
+    }
+    std::sort(episodes.begin(), episodes.end(), [](const EpisodeRecord& a, const EpisodeRecord& b) {
+        return get_is_episode_before(a, b.season, b.episode);
+    });
+    record.total_episodes = uint32_t(episodes.size());
+    return true;
+}
+
+void MetadataStoreBuilder::add_folder(std::string_view name, uint32_t series_id) {
+    auto key = std::string(name);
+    if (m_folders.find(key) != m_folders.end()) {
+        return;
+    }
+    FolderRecord record;
+    record.name = m_strings.add(name);
+    record.series_id = series_id;
+    m_folders.emplace(std::move(key), record);
+}
+
+bool MetadataStoreBuilder::write(const fs::path& filepath) const {
+    TRACE_SCOPE("io", "MetadataStoreBuilder::write");
+    std::vector<size_t> order(m_series.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return m_series[a].id < m_series[b].id;
+    });
+
+    std::vector<SeriesRecord> series_table;
+    series_table.reserve(m_series.size());
+    uint32_t total_episodes = 0;
+    for (auto i: order) {
+        auto& record = series_table.emplace_back(m_series[i]);
+        record.first_episode = total_episodes;
+        total_episodes += record.total_episodes;
+    }
+
+    // NOTE: A folder whose series wasn't added would make the store fail validation
+    std::vector<FolderRecord> folder_table;
+    folder_table.reserve(m_folders.size());
+    for (auto& [name, record]: m_folders) {
+        if (m_series_ids.find(record.series_id) != m_series_ids.end()) {
+            folder_table.push_back(record);
+        }
+    }
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.total_series = uint32_t(series_table.size());
+    header.total_episodes = total_episodes;
+    const auto& strings = m_strings.get_pool();
+    header.string_pool_size = uint32_t(strings.size());
+    header.total_folders = uint32_t(folder_table.size());
+
+    auto temp_filepath = filepath;
+    temp_filepath += ".tmp";
+    {
+        std::ofstream file(temp_filepath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(series_table.data()), sizeof(SeriesRecord) * series_table.size());
+        for (auto i: order) {
+            auto& episodes = m_series_episodes[i];
+            file.write(reinterpret_cast<const char*>(episodes.data()), sizeof(EpisodeRecord) * episodes.size());
+        }
+        file.write(reinterpret_cast<const char*>(folder_table.data()), sizeof(FolderRecord) * folder_table.size());
+        file.write(strings.data(), strings.size());
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_filepath, filepath, ec);
+    if (ec) {
+        fs::remove(temp_filepath, ec);
+        return false;
+    }
+    return true;
+}
+
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "tvdb_api/tvdb_models.h"
+#include "util/expected.hpp"
+#include "util/mapped_file.h"
+
+namespace app
+{
+
+// Layout of the metadata store file
+// - header
+// - series records sorted by id
+// - episode records sorted by series, season and episode
+// - folder records sorted by name
+// - string pool of null terminated strings
+// NOTE: Records are written in the byte order of the machine and are 4 byte aligned
+namespace metadata_store {
+
+constexpr char MAGIC[4] = {'T', 'R', 'M', 'S'};
+constexpr uint32_t VERSION = 2;
+// the overview is optional so a missing one has this offset
+constexpr uint32_t NULL_STRING_OFFSET = UINT32_MAX;
+
+struct StringRef {
+    uint32_t offset;
+    uint32_t length;    // excludes the null terminator
+};
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t total_series;
+    uint32_t total_episodes;
+    uint32_t string_pool_size;
+    uint32_t total_folders;
+};
+
+struct SeriesRecord {
+    uint32_t id;
+    uint32_t first_episode;
+    uint32_t total_episodes;
+    StringRef name;
+    StringRef air_date;
+    StringRef status;
+    StringRef overview;
+};
+
+struct EpisodeRecord {
+    uint32_t series_id;
+    uint32_t id;
+    int32_t season;
+    int32_t episode;
+    StringRef air_date;
+    StringRef name;
+    StringRef overview;
+};
+
+// the series that a folder of the library is matched to
+// NOTE: This is a copy of the library index so the store can be read without it
+struct FolderRecord {
+    StringRef name;
+    uint32_t series_id;
+};
+
+// Strings are stored once with a null terminator and referenced by their offset into the pool
+class StringPoolBuilder
+{
+private:
+    std::string m_pool;
+    std::unordered_map<std::string, uint32_t> m_offsets;
+public:
+    StringRef add(std::string_view str);
+    StringRef add_optional(const std::optional<std::string_view>& str);
+    const std::string& get_pool() const { return m_pool; }
+};
+
+// NOTE: A valid string ends in a null terminator inside the pool
+bool get_is_valid_string(const StringRef& ref, const char* pool, uint32_t pool_size, bool is_optional);
+// NOTE: Episodes of a series are sorted by season and then by episode
+bool get_is_episode_before(const EpisodeRecord& a, int season, int episode);
+
+// a generation of the store in the library root
+struct StoreFile {
+    uint64_t generation;
+    std::filesystem::path path;
+};
+
+std::filesystem::path get_store_path(const std::filesystem::path& root, uint64_t generation);
+// every generation of the store in the root from newest to oldest
+std::vector<StoreFile> list_store_files(const std::filesystem::path& root);
+
+};
+
+// NOTE: The strings point into the store or the cache that the view was made from
+//       They are always null terminated so they can be passed to printf with data()
+struct SeriesView {
+    uint32_t id = 0;
+    std::string_view name;
+    std::string_view air_date;
+    std::string_view status;
+    std::optional<std::string_view> overview = std::nullopt;
+};
+
+struct EpisodeView {
+    uint32_t id = 0;
+    int season = 0;
+    int episode = 0;
+    std::string_view air_date;
+    std::string_view name;
+    std::optional<std::string_view> overview = std::nullopt;
+};
+
+// Series and episodes of every matched folder in the library in a single memory mapped file
+// This replaces parsing the json caches of each folder when the library is opened
+// NOTE: The store is immutable once opened, changes are made by writing a new store
+//       The whole file is validated when it is opened so lookups don't need bounds checks
+class MetadataStore
+{
+private:
+    std::unique_ptr<util::MappedFile> m_file;
+    const metadata_store::Header* m_header;
+    const metadata_store::SeriesRecord* m_series;
+    const metadata_store::EpisodeRecord* m_episodes;
+    const metadata_store::FolderRecord* m_folders;
+    const char* m_strings;
+public:
+    static tl::expected<std::shared_ptr<const MetadataStore>, std::string> open(const std::filesystem::path& filepath);
+    size_t get_total_series() const { return m_header->total_series; }
+    size_t get_total_episodes() const { return m_header->total_episodes; }
+    // binary search of the series table, returns the index of the series
+    std::optional<uint32_t> find_series(uint32_t id) const;
+    SeriesView get_series(uint32_t series_index) const;
+    // binary search of the episodes of the series
+    std::optional<EpisodeView> find_episode(uint32_t series_index, const tvdb_api::EpisodeKey& key) const;
+    // NOTE: The episodes of a series are contiguous and the index is into the whole episode table
+    uint32_t get_first_episode(uint32_t series_index) const { return m_series[series_index].first_episode; }
+    uint32_t get_total_episodes(uint32_t series_index) const { return m_series[series_index].total_episodes; }
+    EpisodeView get_episode(uint32_t episode_index) const;
+    size_t get_total_folders() const { return m_header->total_folders; }
+    // binary search of the folder table, returns the id of the series the folder is matched to
+    std::optional<uint32_t> find_folder_series(std::string_view name) const;
+
+    MetadataStore(const MetadataStore&) = delete;
+    MetadataStore(MetadataStore&&) = delete;
+    MetadataStore& operator=(const MetadataStore&) = delete;
+    MetadataStore& operator=(MetadataStore&&) = delete;
+private:
+    MetadataStore(std::unique_ptr<util::MappedFile> file);
+    std::string_view get_string(const metadata_store::StringRef& ref) const;
+    std::optional<std::string_view> get_optional_string(const metadata_store::StringRef& ref) const;
+    std::optional<std::string> validate() const;
+};
+
+// Read access to the series and episodes of a folder without copying them
+// NOTE: Backed by either a cache that was loaded into memory or a series in the metadata store
+//       The backing cache or store must outlive the view
+class CacheView
+{
+private:
+    const tvdb_api::TVDB_Cache* m_cache;
+    const MetadataStore* m_store;
+    uint32_t m_series_index;
+public:
+    CacheView(const tvdb_api::TVDB_Cache& cache);
+    CacheView(const MetadataStore& store, uint32_t series_index);
+    SeriesView get_series() const;
+    std::optional<EpisodeView> find_episode(const tvdb_api::EpisodeKey& key) const;
+    // NOTE: Episodes from the store are sorted while those from a loaded cache are in no particular order
+    std::vector<EpisodeView> get_episodes() const;
+    tvdb_api::TVDB_Cache to_cache() const;
+};
+
+// Collects the caches of the library and writes them as a new metadata store
+class MetadataStoreBuilder
+{
+private:
+    std::vector<metadata_store::SeriesRecord> m_series;
+    std::unordered_set<uint32_t> m_series_ids;
+    // the episodes of each series in the order they were added
+    std::vector<std::vector<metadata_store::EpisodeRecord>> m_series_episodes;
+    // sorted by name
+    std::map<std::string, metadata_store::FolderRecord> m_folders;
+    metadata_store::StringPoolBuilder m_strings;
+public:
+    // NOTE: Returns false if the series was already added by another folder
+    bool add(const CacheView& cache);
+    // NOTE: The series must also be added since a folder can't refer to a series outside of the store
+    void add_folder(std::string_view name, uint32_t series_id);
+    size_t get_total_series() const { return m_series.size(); }
+    // NOTE: The store is written to a temporary file which then replaces the old one
+    //       So a store that is mapped by a reader is never modified
+    bool write(const std::filesystem::path& filepath) const;
+};
+
+};
@@ -36,7 +36,51 @@ R"({
             "items": {
                 "type": "string"
             }
-        }
+        },
+        "thread_pool": {
+            "type": "object",
+            "properties": {
+                "disk_threads": { "type": "integer", "minimum": 0 },
+                "network_threads": { "type": "integer", "minimum": 0 },
+                "cpu_threads": { "type": "integer", "minimum": 0 }
+            }
+        },
+        "tvdb_api": {
+            "type": "object",
+            "properties": {
+                "base_url": { "type": "string" },
+                "max_idle_sessions": { "type": "integer", "minimum": 0 },
+                "max_pages_in_flight": { "type": "integer", "minimum": 1 },
+                "timeout_ms": { "type": "integer", "minimum": 0 },
+                "connect_timeout_ms": { "type": "integer", "minimum": 0 },
+                "max_requests_per_second": { "type": "integer", "minimum": 0 },
+                "max_burst_requests": { "type": "integer", "minimum": 1 },
+                "max_retries": { "type": "integer", "minimum": 0 },
+                "retry_base_delay_ms": { "type": "integer", "minimum": 0 },
+                "retry_max_delay_ms": { "type": "integer", "minimum": 0 },
+                "token_refresh_interval_ms": { "type": "integer", "minimum": 0 },
+                "auth_retry_base_delay_ms": { "type": "integer", "minimum": 0 },
+                "auth_retry_max_delay_ms": { "type": "integer", "minimum": 0 }
+            }
+        },
+        "auto_match": {
+            "type": "object",
+            "properties": {
+                "max_searches_in_flight": { "type": "integer", "minimum": 1 },
+                "accept_score_percent": { "type": "integer", "minimum": 0, "maximum": 100 },
+                "min_margin_percent": { "type": "integer", "minimum": 0, "maximum": 100 },
+                "max_candidates": { "type": "integer", "minimum": 1 }
+            }
+        },
+        "library_sync": {
+            "type": "object",
+            "properties": {
+                "max_series_in_flight": { "type": "integer", "minimum": 1 },
+                "max_delta_days": { "type": "integer", "minimum": 1 }
+            }
+        },
+        "export_json_cache": { "type": "boolean" },
+        "export_binary_cache": { "type": "boolean" }
     },
     "required": ["credentials_file"]
 })";
@@ -80,8 +124,46 @@ R"({
     }
 })";
 
+const char* LIBRARY_INDEX_SCHEMA_CSTR = 
+R"({
+    "title": "library index",
+    "description": "Last known state of each folder in the library root",
+    "type": "object",
+    "properties": {
+        "folders": {
+            "type": "array",
+            "items": {
+                "type": "object",
+                "properties": {
+                    "name": { "type": "string" },
+                    "series_id": { "type": "integer", "minimum": 0 },
+                    "status": { "type": "integer", "minimum": 0 },
+                    "renames": { "type": "integer" },
+                    "deletes": { "type": "integer" },
+                    "conflicts": { "type": "integer" }
+                },
+                "required": ["name", "status"]
+            }
+        }
+    },
+    "required": ["folders"]
+})";
+
+const char* LIBRARY_SYNC_SCHEMA_CSTR = 
+R"({
+    "title": "library sync",
+    "description": "Time of the last sync of the library root with the tvdb updates",
+    "type": "object",
+    "properties": {
+        "last_sync_time": { "type": "integer", "minimum": 0 }
+    },
+    "required": ["last_sync_time"]
+})";
+
 rapidjson::SchemaDocument APP_FOLDER_BOOKMARKS_SCHEMA_DOC = util::load_schema_from_cstr(APP_FOLDER_BOOKMARKS_SCHEMA_CSTR);
 rapidjson::SchemaDocument APP_SCHEMA_DOC = util::load_schema_from_cstr(APP_CONFIG_SCHEMA);
 rapidjson::SchemaDocument CREDENTIALS_SCHEMA = util::load_schema_from_cstr(CREDENTIALS_SCHEMA_STR);
+rapidjson::SchemaDocument LIBRARY_INDEX_SCHEMA_DOC = util::load_schema_from_cstr(LIBRARY_INDEX_SCHEMA_CSTR);
+rapidjson::SchemaDocument LIBRARY_SYNC_SCHEMA_DOC = util::load_schema_from_cstr(LIBRARY_SYNC_SCHEMA_CSTR);
 
 };
\ No newline at end of file
@@ -8,5 +8,7 @@ namespace app
 extern rapidjson::SchemaDocument CREDENTIALS_SCHEMA;
 extern rapidjson::SchemaDocument APP_SCHEMA_DOC;
 extern rapidjson::SchemaDocument APP_FOLDER_BOOKMARKS_SCHEMA_DOC;
+extern rapidjson::SchemaDocument LIBRARY_INDEX_SCHEMA_DOC;
+extern rapidjson::SchemaDocument LIBRARY_SYNC_SCHEMA_DOC;
 
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "app_task_graph.h"
+
+#include <assert.h>
+
+namespace app 
+{
+
+TaskGraph::TaskGraph()
+: m_total_finished(0), m_is_started(false)
+{}
+
+// NOTE: Dependencies must already be in the graph so it can't contain cycles
+TaskGraph::NodeId TaskGraph::add_node(const char* name, TaskLane lane, Call call, std::initializer_list<NodeId> dependencies) {
+    assert(!m_is_started);
+    const NodeId id = m_nodes.size();
+    auto node = std::make_unique<Node>();
+    node->name = name;
+    node->lane = lane;
+    node->call = std::move(call);
+    node->total_dependencies = int(dependencies.size());
+    node->total_remaining_dependencies = node->total_dependencies;
+    node->is_skipped = false;
+    for (auto dependency: dependencies) {
+        assert(dependency < id);
+        m_nodes[dependency]->dependents.push_back(id);
+    }
+    m_nodes.push_back(std::move(node));
+    return id;
+}
+
+std::vector<TaskGraph::NodeId> TaskGraph::start() {
+    assert(!m_is_started);
+    m_is_started = true;
+    std::vector<NodeId> ready_nodes;
+    for (NodeId id = 0; id < m_nodes.size(); id++) {
+        if (m_nodes[id]->total_dependencies == 0) {
+            ready_nodes.push_back(id);
+        }
+    }
+    if (m_nodes.empty() && m_on_finish) {
+        m_on_finish();
+    }
+    return ready_nodes;
+}
+
+bool TaskGraph::run_node(NodeId id, const util::CancellationToken& token) {
+    auto& node = *m_nodes[id];
+    return node.call ? node.call(token) : true;
+}
+
+std::vector<TaskGraph::NodeId> TaskGraph::complete_node(NodeId id, bool is_success) {
+    std::vector<NodeId> ready_nodes;
+    for (auto dependent_id: m_nodes[id]->dependents) {
+        if (!is_success) {
+            skip_node(dependent_id);
+            continue;
+        }
+        auto& dependent = *m_nodes[dependent_id];
+        // NOTE: Another dependency may have failed and skipped this node already
+        if ((--dependent.total_remaining_dependencies == 0) && !dependent.is_skipped) {
+            ready_nodes.push_back(dependent_id);
+        }
+    }
+    finish_node();
+    return ready_nodes;
+}
+
+void TaskGraph::skip_node(NodeId id) {
+    auto& node = *m_nodes[id];
+    if (node.is_skipped.exchange(true)) {
+        return;
+    }
+    for (auto dependent_id: node.dependents) {
+        skip_node(dependent_id);
+    }
+    finish_node();
+}
+
+void TaskGraph::finish_node() {
+    if ((++m_total_finished == m_nodes.size()) && m_on_finish) {
+        m_on_finish();
+    }
+}
+
+};
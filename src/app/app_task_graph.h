@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <initializer_list>
+
+#include "util/cancellation_token.h"
+#include "util/work_stealing_pool.h"
+
+namespace app 
+{
+
+// Async work is split into lanes so that each kind of resource gets its own level of concurrency
+// - DISK: Directory walks and file reads/writes which thrash spinning disks when run too wide
+// - NETWORK: Blocking tvdb api calls which mostly wait on the server
+// - CPU: Work that only touches memory
+enum class TaskLane {
+    DISK, NETWORK, CPU,
+};
+
+using util::TaskPriority;
+
+// Graph of operations where each node runs as soon as all of its dependencies have succeeded
+// - Nodes without a path between them run in parallel on their lanes
+// - If a node fails then every node that depends on it is skipped
+// NOTE: A graph is built once and then run by App::queue_task_graph
+class TaskGraph 
+{
+public:
+    using NodeId = size_t;
+    // returns false if the dependents shouldn't run
+    using Call = std::function<bool (const util::CancellationToken&)>;
+private:
+    struct Node {
+        const char* name;
+        TaskLane lane;
+        Call call;
+        std::vector<NodeId> dependents;
+        int total_dependencies = 0;
+        std::atomic<int> total_remaining_dependencies;
+        std::atomic<bool> is_skipped;
+    };
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    std::atomic<size_t> m_total_finished;
+    std::function<void ()> m_on_finish;
+    bool m_is_started;
+public:
+    TaskGraph();
+    NodeId add_node(const char* name, TaskLane lane, Call call, std::initializer_list<NodeId> dependencies={});
+    // called once every node has either run or been skipped
+    void set_on_finish(std::function<void ()> on_finish) { m_on_finish = std::move(on_finish); }
+
+    // NOTE: The following are used by the scheduler
+    std::vector<NodeId> start();
+    bool run_node(NodeId id, const util::CancellationToken& token);
+    // returns the nodes which are now ready to run
+    std::vector<NodeId> complete_node(NodeId id, bool is_success);
+    TaskLane get_lane(NodeId id) const { return m_nodes[id]->lane; }
+    const char* get_name(NodeId id) const { return m_nodes[id]->name; }
+    size_t get_total_nodes() const { return m_nodes.size(); }
+    bool get_is_finished() const { return m_total_finished == m_nodes.size(); }
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph(TaskGraph&&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+    TaskGraph& operator=(TaskGraph&&) = delete;
+private:
+    void skip_node(NodeId id);
+    void finish_node();
+};
+
+};
@@ -1,5 +1,7 @@
 #include "file_intents.h"
 #include "file_descriptor.h"
+#include "util/trace.h"
+#include "util/metrics.h"
 #include <filesystem>
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
@@ -16,10 +18,23 @@ std::string create_filename(
 namespace app 
 {
 
+// NOTE: A temporary file is left behind if the app exits while writing it
+static bool get_is_app_file(const std::string& filename) {
+    static const char* APP_FILENAMES[] = {
+        EPISODES_CACHE_FN, SERIES_CACHE_FN, BINARY_CACHE_FN, BINARY_CACHE_TEMP_FN, BOOKMARKS_FN,
+    };
+    for (auto* app_filename: APP_FILENAMES) {
+        if (filename.compare(app_filename) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 FileIntent get_file_intent(
     const std::string& relative_path, 
     const FilterRules& rules, 
-    const tvdb_api::TVDB_Cache& api_cache) 
+    const CacheView& api_cache) 
 {
     const auto fs_filepath = fs::path(relative_path);
     const auto fs_parent_path = fs_filepath.parent_path();
@@ -31,6 +46,12 @@ FileIntent get_file_intent(
     intent.is_active = false;
     intent.is_conflict = false;
 
+    // the app's own files are only written to the root of the series folder
+    if (fs_parent_path.empty() && get_is_app_file(filename)) {
+        intent.action = FileIntent::Action::WHITELIST;
+        return intent;
+    }
+
     for (auto& blacklist_ext: rules.blacklist_extensions) {
         if (ext.compare(blacklist_ext) == 0) {
             intent.action = FileIntent::Action::DELETE;
@@ -55,11 +76,15 @@ FileIntent get_file_intent(
         }
     }
 
+    static auto& TOTAL_DESCRIPTOR_HITS = util::metrics::get_counter("scan.descriptor_hits");
+    static auto& TOTAL_DESCRIPTOR_MISSES = util::metrics::get_counter("scan.descriptor_misses");
     auto opt_descriptor = find_descriptor(filename);
     if (!opt_descriptor) {
+        TOTAL_DESCRIPTOR_MISSES.add();
         intent.action = FileIntent::Action::IGNORE;
         return intent;
     }
+    TOTAL_DESCRIPTOR_HITS.add();
 
     // Try to rename file
     const auto& descriptor = opt_descriptor.value(); 
@@ -81,20 +106,19 @@ FileIntent get_file_intent(
     // Get the new filepath
     const auto new_folder = fmt::format("Season {:02d}", episode_key.season);
     std::string new_filename;
-    const auto& episodes_cache = api_cache.episodes;
-    const auto& cache_result = episodes_cache.find(episode_key);
-    if (cache_result != episodes_cache.end()) {
-        auto& episode_data = cache_result->second;
+    const auto series_name = std::string(api_cache.get_series().name);
+    const auto episode_opt = api_cache.find_episode(episode_key);
+    if (episode_opt) {
         new_filename = create_filename(
-            clean_title(api_cache.series.name),
+            clean_title(series_name),
             descriptor.season, descriptor.episode,
-            clean_name(episode_data.name),
+            clean_name(std::string(episode_opt->name)),
             descriptor.ext,
             valid_tags
         );
     } else {
         new_filename = create_filename(
-            clean_title(api_cache.series.name),
+            clean_title(series_name),
             descriptor.season, descriptor.episode,
             "",
             descriptor.ext,
@@ -118,34 +142,55 @@ FileIntent get_file_intent(
     return intent;
 }
 
-std::vector<FileIntent> get_directory_file_intents(
+std::vector<std::string> get_directory_files(
     const std::filesystem::path& root, 
-    const FilterRules& rules, 
-    const tvdb_api::TVDB_Cache& api_cache)
+    const DirectoryWalkHooks& hooks)
 {
-    auto intents = std::vector<FileIntent>();
+    TRACE_SCOPE("scan", "get_directory_files");
+    auto files = std::vector<std::string>();
     
     if (!fs::is_directory(root)) {
-        return intents;
+        return files;
     }
 
     auto directory_iter = fs::recursive_directory_iterator(root);
     for (auto& entry: directory_iter) {
+        if (hooks.cancel_token.is_cancelled()) {
+            break;
+        }
+
         if (!fs::is_regular_file(entry)) {
             continue;
         }
 
         const auto& fs_path = entry.path();
         const auto& fs_relative_path = fs_path.lexically_relative(root);
-        const auto relative_path = fs_relative_path.string();
-        auto intent = get_file_intent(relative_path, rules, api_cache);
-        intents.push_back(intent);
+        files.push_back(fs_relative_path.string());
     }
 
+    static auto& TOTAL_FILES_SCANNED = util::metrics::get_counter("scan.files");
+    TOTAL_FILES_SCANNED.add(int64_t(files.size()));
+    return files;
+}
+
+std::vector<FileIntent> get_directory_file_intents(
+    const std::filesystem::path& root, 
+    const FilterRules& rules, 
+    const CacheView& api_cache,
+    const DirectoryWalkHooks& hooks)
+{
+    TRACE_SCOPE("scan", "get_directory_file_intents");
+    const auto files = get_directory_files(root, hooks);
+    auto intents = std::vector<FileIntent>();
+    intents.reserve(files.size());
+    for (auto& relative_path: files) {
+        intents.push_back(get_file_intent(relative_path, rules, api_cache));
+    }
     return intents;
 }
 
 void execute_file_intent(const std::filesystem::path& root, const FileIntent& intent) {
+    TRACE_SCOPE("io", "execute_file_intent");
     if (!intent.is_active) {
         return;
     }
@@ -154,8 +199,10 @@ void execute_file_intent(const std::filesystem::path& root, const FileIntent& in
     //       Usually this means we are removing an old filepath 
     //       that is the same as an upcoming renamed filepath
     if (intent.action == FileIntent::Action::DELETE) {
+        static auto& TOTAL_DELETES = util::metrics::get_counter("execute.deletes");
         auto src_path = root / intent.src;
         fs::remove(src_path);
+        TOTAL_DELETES.add();
         return;
     }
 
@@ -170,6 +217,8 @@ void execute_file_intent(const std::filesystem::path& root, const FileIntent& in
         auto dest_path_folder = fs::path(dest_path).remove_filename();
         fs::create_directories(dest_path_folder);
         fs::rename(src_path, dest_path);
+        static auto& TOTAL_RENAMES = util::metrics::get_counter("execute.renames");
+        TOTAL_RENAMES.add();
         return;
     }
 }
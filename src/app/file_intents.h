@@ -6,10 +6,20 @@
 #include <string>
 #include <optional>
 #include "tvdb_api/tvdb_models.h"
+#include "app_metadata_store.h"
+#include "util/cancellation_token.h"
 
 namespace app 
 {
 
+// files that the app writes into each series folder
+// NOTE: These are always whitelisted so they are kept even if the config doesn't list them
+constexpr const char* EPISODES_CACHE_FN = "episodes.json";
+constexpr const char* SERIES_CACHE_FN = "series.json";
+constexpr const char* BINARY_CACHE_FN = "cache.bin";
+constexpr const char* BINARY_CACHE_TEMP_FN = "cache.bin.tmp";
+constexpr const char* BOOKMARKS_FN = "bookmarks.json";
+
 // TODO: The metadata for different actions is stored in the same struct
 //        We could use a variant here to save memory possibly
 struct FileIntent {
@@ -39,12 +49,24 @@ struct FilterRules {
 FileIntent get_file_intent(
     const std::string& relative_path, 
     const FilterRules& rules, 
-    const tvdb_api::TVDB_Cache& api_cache);
+    const CacheView& api_cache);
+
+// Optional hooks for long running directory walks
+struct DirectoryWalkHooks {
+    // checked between entries, the walk stops early and returns a partial result if cancelled
+    util::CancellationToken cancel_token;
+};
+
+// relative paths of all regular files under the root
+std::vector<std::string> get_directory_files(
+    const std::filesystem::path& root, 
+    const DirectoryWalkHooks& hooks={});
 
 std::vector<FileIntent> get_directory_file_intents(
     const std::filesystem::path& root, 
     const FilterRules& rules, 
-    const tvdb_api::TVDB_Cache& api_cache);
+    const CacheView& api_cache,
+    const DirectoryWalkHooks& hooks={});
 
 // THROWS: If there is an IO exception it will propagate upwards
 void execute_file_intent(const std::filesystem::path& root, const FileIntent& intent);
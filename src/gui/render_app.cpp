@@ -4,9 +4,16 @@
 #include <stdio.h>
 #include <string>
 #include <mutex>
+#include <shared_mutex>
 #include <array>
 #include <filesystem>
 #include <optional>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <vector>
+#include <memory>
+#include <map>
 
 #include <imgui.h>
 #include <imgui_stdlib.h>
@@ -17,6 +24,8 @@
 #include "tvdb_api/tvdb_models.h"
 
 #include "os_dep.h"
+#include "util/trace.h"
+#include "util/metrics.h"
 
 namespace app::gui 
 {
@@ -26,6 +35,10 @@ namespace fs = std::filesystem;
 
 // render components
 static void RenderSeriesList(App& main_app);
+static void RenderLibraryScanProgress(App& main_app);
+static void RenderAutoMatchProgress(App& main_app);
+static void RenderLibrarySyncProgress(App& main_app);
+static void RenderTracingMenu(App& main_app);
 static void RenderSeriesSelectModal(App& main_app, AppFolder& folder);
 static void RenderEpisodes(App& main_app);
 static void RenderEpisodesGenericList(AppFolder& folder, const char* table_id, FileIntent::Action action, ImGuiTextFilter& search_filter);
@@ -39,6 +52,7 @@ static void RenderFileContextMenu(AppFolder& folder, AppFileState& intent, const
 static void RenderSeriesInfo(App& main_app);
 static void RenderEpisodeInfo(App& main_app);
 static void RenderErrors(App& main_app);
+static void RenderMetrics(App& main_app);
 static void RenderAppWarnings(App& main_app);
 static void RenderAppErrors(App& main_app);
 
@@ -95,7 +109,24 @@ static FolderStatusCharacter GetFolderStatusCharacter(AppFolder::Status status)
     }
 }
 
+// timestamp and repeat count are shown in front of the message
+static void RenderDiagnostic(const Diagnostic& diagnostic) {
+    const auto time = std::chrono::system_clock::to_time_t(diagnostic.timestamp);
+    char time_buffer[16] = {0};
+    std::strftime(time_buffer, sizeof(time_buffer), "%H:%M:%S", std::localtime(&time));
+    ImGui::TextDisabled("%s", time_buffer);
+    ImGui::SameLine();
+    if (diagnostic.total_repeats > 1) {
+        ImGui::TextDisabled("(x%d)", diagnostic.total_repeats);
+        ImGui::SameLine();
+    }
+    ImGui::TextWrapped("%s", diagnostic.message.c_str());
+}
+
+// the folder is only rescanned once the download has succeeded
 void RenderApp(App& main_app) {
+    main_app.m_diagnostics.drain();
+    main_app.update_library_index();
     // render out of order to get last item as default focus
     RenderAppWarnings(main_app);
     RenderSeriesList(main_app);
@@ -116,11 +147,214 @@ void RenderApp(App& main_app) {
     RenderErrors(main_app);
     ImGui::End();
 
+    ImGui::Begin("Metrics");
+    RenderMetrics(main_app);
+    ImGui::End();
+
     RenderAppErrors(main_app);
 }
 
+void RenderLibraryScanProgress(App& main_app) {
+    const auto* scan = main_app.get_scan_pipeline();
+    if (scan == nullptr) {
+        return;
+    }
+
+    const int total_folders = scan->get_total_folders();
+    if (scan->get_is_finished()) {
+        ImGui::Text("Library scan %s (%d folders)", scan->get_is_cancelled() ? "cancelled" : "finished", total_folders);
+    }
+    if (!ImGui::CollapsingHeader("Library scan", scan->get_is_finished() ? 0 : ImGuiTreeNodeFlags_DefaultOpen)) {
+        return;
+    }
+
+    static char LABEL_BUFFER[MAX_BUFFER_SIZE+1] = {0};
+    for (int i = 0; i < TOTAL_SCAN_STAGES; i++) {
+        const auto stage = ScanStage(i);
+        const auto progress = scan->get_progress(stage);
+        // NOTE: Folders skipped by an earlier stage are taken out of the total
+        const float fraction = (progress.total_items > 0) ? float(progress.total_processed)/float(progress.total_items) : 1.0f;
+        snprintf(
+            LABEL_BUFFER, MAX_BUFFER_SIZE,
+            "%d/%d", progress.total_processed, progress.total_items);
+        ImGui::ProgressBar(fraction, ImVec2(-1,0), LABEL_BUFFER);
+        ImGui::Text("%s lane=%s queued=%d/%d waiting=%d skipped=%d %.1f/s", 
+            get_scan_stage_name(stage), (get_scan_stage_lane(stage) == TaskLane::DISK) ? "disk" : "cpu", 
+            progress.total_queued, progress.max_in_flight, progress.total_waiting, progress.total_skipped, progress.items_per_second);
+    }
+}
+
+// Folders that were matched with low confidence are listed with their best candidate
+// NOTE: The rest of the candidates are in the series selection of the folder
+void RenderAutoMatchProgress(App& main_app) {
+    auto* matcher = main_app.get_auto_matcher();
+    if (matcher == nullptr) {
+        return;
+    }
+
+    const auto progress = matcher->get_progress();
+    if (progress.is_finished) {
+        ImGui::Text("Auto match %s (%d accepted, %d to review)", 
+            matcher->get_is_cancelled() ? "cancelled" : "finished", 
+            progress.total_accepted, progress.total_review);
+    }
+    if (!ImGui::CollapsingHeader("Auto match", progress.is_finished ? 0 : ImGuiTreeNodeFlags_DefaultOpen)) {
+        return;
+    }
+
+    static char LABEL_BUFFER[MAX_BUFFER_SIZE+1] = {0};
+    const float fraction = (progress.total_folders > 0) ? float(progress.total_processed)/float(progress.total_folders) : 1.0f;
+    snprintf(
+        LABEL_BUFFER, MAX_BUFFER_SIZE,
+        "%d/%d", progress.total_processed, progress.total_folders);
+    ImGui::ProgressBar(fraction, ImVec2(-1,0), LABEL_BUFFER);
+    ImGui::Text("skipped=%d searched=%d in_flight=%d accepted=%d review=%d failed=%d %.1f/s",
+        progress.total_skipped, progress.total_searched, progress.total_in_flight,
+        progress.total_accepted, progress.total_review, progress.total_failed, progress.searches_per_second);
+
+    if (!progress.is_finished) {
+        if (ImGui::Button("Cancel auto match")) {
+            matcher->cancel();
+        }
+    }
+
+    ImGuiTableFlags flags = 
+        ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | 
+        ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY;
+    const auto reviews = matcher->get_reviews();
+    if (reviews.empty()) {
+        return;
+    }
+
+    if (ImGui::BeginTable("##auto match review", 4, flags, ImVec2(0, ImGui::GetTextLineHeightWithSpacing()*10))) {
+        ImGui::TableSetupColumn("Folder",       ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Best match",   ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Score",        ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Action",       ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableHeadersRow();
+
+        int review_id = 0;
+        for (auto& review: reviews) {
+            auto& folder = review.folder;
+            // picked from the series selection since the review was added
+            if (folder->m_is_info_cached || (folder->m_series_id != 0)) {
+                continue;
+            }
+
+            ImGui::TableNextRow();
+            ImGui::PushID(review_id++);
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", folder->GetPath().filename().string().c_str());
+            ImGui::TableSetColumnIndex(1);
+            if (!review.error.empty()) {
+                ImGui::TextDisabled("%s", review.error.c_str());
+            } else if (review.candidates.empty()) {
+                ImGui::TextDisabled("No results for \"%s\"", review.query.name.c_str());
+            } else {
+                auto& series = review.candidates[0].series;
+                ImGui::Text("%s (%s)", series.name.c_str(), series.air_date.c_str());
+            }
+            ImGui::TableSetColumnIndex(2);
+            if (!review.candidates.empty()) {
+                ImGui::Text("%.0f%%", review.candidates[0].score * 100.0f);
+            }
+            ImGui::TableSetColumnIndex(3);
+            if (!review.candidates.empty()) {
+                if (ImGui::Button("Accept")) {
+                    main_app.queue_download_cache(folder, review.candidates[0].series.id);
+                    matcher->remove_review(folder.get());
+                }
+                ImGui::SameLine();
+            }
+            if (ImGui::Button("Select")) {
+                main_app.select_folder(folder);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Dismiss")) {
+                matcher->remove_review(folder.get());
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+}
+
+void RenderLibrarySyncProgress(App& main_app) {
+    auto* sync = main_app.get_library_sync();
+    if (sync == nullptr) {
+        return;
+    }
+
+    const auto progress = sync->get_progress();
+    char time_buffer[32] = "never";
+    if (progress.last_sync_time > 0) {
+        const auto time = std::time_t(progress.last_sync_time);
+        std::strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&time));
+    }
+    if (progress.is_finished) {
+        ImGui::Text("Library sync %s (%d patched, last synced %s)", 
+            sync->get_is_cancelled() ? "cancelled" : (progress.is_saved ? "finished" : "failed"), 
+            progress.total_patched, time_buffer);
+    }
+    if (!ImGui::CollapsingHeader("Library sync", progress.is_finished ? 0 : ImGuiTreeNodeFlags_DefaultOpen)) {
+        return;
+    }
+
+    static char LABEL_BUFFER[MAX_BUFFER_SIZE+1] = {0};
+    const float fraction = (progress.total_series > 0) ? float(progress.total_processed)/float(progress.total_series) : 1.0f;
+    snprintf(
+        LABEL_BUFFER, MAX_BUFFER_SIZE,
+        "%d/%d", progress.total_processed, progress.total_series);
+    ImGui::ProgressBar(fraction, ImVec2(-1,0), LABEL_BUFFER);
+    ImGui::Text("%s since %s queries=%d in_flight=%d patched=%d failed=%d %.1f/s",
+        progress.is_full_refresh ? "full refresh" : "changes", time_buffer,
+        progress.total_update_queries, progress.total_in_flight,
+        progress.total_patched, progress.total_failed, progress.series_per_second);
+
+    if (!progress.is_finished) {
+        if (ImGui::Button("Cancel library sync")) {
+            sync->cancel();
+        }
+    }
+}
+
+// NOTE: Left enabled while folders are busy since that is usually what we want to trace
+void RenderTracingMenu(App& main_app) {
+    if (!util::trace::get_is_compiled()) {
+        return;
+    }
+
+    static const char* TRACE_FILEPATH = "trace.json";
+    if (ImGui::BeginMenu("Tracing")) {
+        bool is_enabled = util::trace::get_is_enabled();
+        if (ImGui::MenuItem("Record spans", NULL, &is_enabled)) {
+            util::trace::set_is_enabled(is_enabled);
+        }
+        if (ImGui::MenuItem("Save chrome trace")) {
+            if (!util::trace::write_chrome_trace(TRACE_FILEPATH)) {
+                main_app.queue_app_warning(fmt::format("Failed to write trace to {}", TRACE_FILEPATH));
+            }
+        }
+        if (ImGui::MenuItem("Clear spans")) {
+            util::trace::clear();
+        }
+        ImGui::EndMenu();
+    }
+}
+
 void RenderSeriesList(App& main_app) {
-    auto& folders = main_app.m_folders;
+    // NOTE: The folder list can be replaced in the background by a revalidation
+    //       We take a copy so that we aren't holding the lock while refreshing from a button
+    std::vector<std::shared_ptr<AppFolder>> folders;
+    {
+        auto lock = std::scoped_lock(main_app.m_folders_mutex);
+        folders.assign(main_app.m_folders.begin(), main_app.m_folders.end());
+    }
+    // the selected folder's directory was removed during a refresh
+    if (main_app.m_current_folder && main_app.m_current_folder->m_is_removed) {
+        main_app.select_folder(nullptr);
+    }
     static char LABEL_BUFFER[MAX_BUFFER_SIZE+1] = {0};
 
     snprintf(
@@ -131,9 +365,9 @@ void RenderSeriesList(App& main_app) {
     ImGui::Begin(LABEL_BUFFER, NULL, win_flags);
 
     const int busy_count = main_app.get_folder_busy_count();
-    ImGui::BeginDisabled(busy_count > 0);
     
     if (ImGui::BeginMenuBar()) {
+        ImGui::BeginDisabled(busy_count > 0);
         if (ImGui::MenuItem("Select folder")) {
             auto opt = os_dep::open_folder_dialog();
             if (opt) {
@@ -141,48 +375,79 @@ void RenderSeriesList(App& main_app) {
                 main_app.refresh_folders();
             }
         }
+        ImGui::EndDisabled();
+        RenderTracingMenu(main_app);
         ImGui::EndMenuBar();
     }
 
+    // NOTE: Refreshing only adds and removes folders so it is safe while folders are busy
     if (ImGui::Button("Refresh project structure")) {
         main_app.refresh_folders();
     }
 
+    ImGui::BeginDisabled(busy_count > 0);
     if (ImGui::Button("Scan contents of all folders")) {
-        for (auto& folder: folders) {
-            main_app.queue_async_call([&folder](int pid) {
-                folder->update_state_from_cache();
-            });
-        }
+        main_app.scan_all_folders();
     }
     ImGui::EndDisabled();
 
+    // NOTE: Matching only downloads caches for folders without one so it is safe while folders are busy
+    ImGui::SameLine();
+    if (ImGui::Button("Auto match unmatched folders")) {
+        main_app.auto_match_folders();
+    }
+
+    // NOTE: Only folders whose cache changed are rescanned so it is safe while folders are busy
+    ImGui::SameLine();
+    if (ImGui::Button("Sync changes from tvdb")) {
+        main_app.sync_library();
+    }
+
+    RenderLibraryScanProgress(main_app);
+    RenderAutoMatchProgress(main_app);
+    RenderLibrarySyncProgress(main_app);
+
     ImGui::Text("Total busy folders (%d/%zu)", busy_count, folders.size());
+    ImGui::Text("Queued tasks disk=%d network=%d cpu=%d",
+        main_app.get_thread_pool(TaskLane::DISK).get_total_pending(),
+        main_app.get_thread_pool(TaskLane::NETWORK).get_total_pending(),
+        main_app.get_thread_pool(TaskLane::CPU).get_total_pending());
 
     ImGui::Separator();
     static ImGuiTextFilter search_filter;
     search_filter.Draw();
 
+    const auto& stats = main_app.m_library_stats;
+    ImGui::Text("Total renames=%d deletes=%d conflicts=%d", 
+        stats.get_total_renames(), stats.get_total_deletes(), stats.get_total_conflicts());
+
     // Render our status checkboxes for filtering
     static uint32_t search_status_flags = 0xFF;
+    auto RenderStatusCheckbox = [&stats](const char* name, AppFolder::Status status) {
+        snprintf(
+            LABEL_BUFFER, MAX_BUFFER_SIZE, 
+            "%s (%d)###%s", name, stats.get_status_count(status), name);
+        ImGui::CheckboxFlags(LABEL_BUFFER, &search_status_flags, status);
+    };
+
     if (ImGui::BeginTable("##status filter", 2)) {
         ImGui::TableNextRow();
         ImGui::TableSetColumnIndex(0);
-        ImGui::CheckboxFlags("Completed", &search_status_flags, AppFolder::Status::COMPLETED);
+        RenderStatusCheckbox("Completed", AppFolder::Status::COMPLETED);
         ImGui::TableSetColumnIndex(1);
-        ImGui::CheckboxFlags("Pending", &search_status_flags, AppFolder::Status::PENDING_RENAME);
+        RenderStatusCheckbox("Pending", AppFolder::Status::PENDING_RENAME);
 
         ImGui::TableNextRow();
         ImGui::TableSetColumnIndex(0);
-        ImGui::CheckboxFlags("Deletes",   &search_status_flags, AppFolder::Status::PENDING_DELETES);
+        RenderStatusCheckbox("Deletes", AppFolder::Status::PENDING_DELETES);
         ImGui::TableSetColumnIndex(1);
-        ImGui::CheckboxFlags("Conflicts", &search_status_flags, AppFolder::Status::CONFLICTS);
+        RenderStatusCheckbox("Conflicts", AppFolder::Status::CONFLICTS);
 
         ImGui::TableNextRow();
         ImGui::TableSetColumnIndex(0);
-        ImGui::CheckboxFlags("Unknown", &search_status_flags, AppFolder::Status::UNKNOWN);
+        RenderStatusCheckbox("Unknown", AppFolder::Status::UNKNOWN);
         ImGui::TableSetColumnIndex(1);
-        ImGui::CheckboxFlags("Empty", &search_status_flags, AppFolder::Status::EMPTY);
+        RenderStatusCheckbox("Empty", AppFolder::Status::EMPTY);
         ImGui::EndTable();
     }
 
@@ -223,11 +488,7 @@ void RenderSeriesList(App& main_app) {
             // folder name
             ImGui::Text("%s", folder_name.c_str());
             if (selected_pressed) {
-                main_app.m_current_folder = folder;
-                main_app.queue_async_call([&folder](int pid) {
-                    folder->update_state_from_cache();
-                    folder->load_bookmarks_from_file();
-                });
+                main_app.select_folder(folder);
             }
             ImGui::PopID();
         }
@@ -238,30 +499,39 @@ void RenderSeriesList(App& main_app) {
 }
 
 void RenderFileContextMenu(AppFolder& folder, AppFileState& intent, const char* label) {
+    auto& state = *folder.m_state;
     if (ImGui::IsItemHovered()) {
         // Shortcuts
         if (intent.GetAction() != FileIntent::Action::DELETE) {
             if (ImGui::IsKeyPressed(ImGuiKey_Delete, false)) {
+                state.BeginEditGroup();
                 intent.SetAction(FileIntent::Action::DELETE);
                 intent.SetIsActive(false);
+                state.EndEditGroup();
             }
         }
         if (intent.GetAction() != FileIntent::Action::RENAME) {
             if (ImGui::IsKeyPressed(ImGuiKey_R, false) && ImGui::IsKeyDown(ImGuiKey_LeftAlt)) {
+                state.BeginEditGroup();
                 intent.SetAction(FileIntent::Action::RENAME);
                 intent.SetIsActive(false);
+                state.EndEditGroup();
             }
         }
         if (intent.GetAction() != FileIntent::Action::IGNORE) {
             if (ImGui::IsKeyPressed(ImGuiKey_I, false) && ImGui::IsKeyDown(ImGuiKey_LeftAlt)) {
+                state.BeginEditGroup();
                 intent.SetAction(FileIntent::Action::IGNORE);
                 intent.SetIsActive(false);
+                state.EndEditGroup();
             }
         }
         if (intent.GetAction() != FileIntent::Action::WHITELIST) {
             if (ImGui::IsKeyPressed(ImGuiKey_W, false) && ImGui::IsKeyDown(ImGuiKey_LeftAlt)) {
+                state.BeginEditGroup();
                 intent.SetAction(FileIntent::Action::WHITELIST);
                 intent.SetIsActive(false);
+                state.EndEditGroup();
             }
         }
     }
@@ -293,8 +563,10 @@ void RenderFileContextMenu(AppFolder& folder, AppFileState& intent, const char*
             ImGui::Text("%s", p.shortcut);
             ImGui::PopStyleColor();
             if (is_pressed) {
+                state.BeginEditGroup();
                 intent.SetAction(p.action);
                 intent.SetIsActive(false);
+                state.EndEditGroup();
                 ImGui::CloseCurrentPopup();
             }
         }
@@ -316,39 +588,48 @@ void RenderEpisodes(App& main_app) {
     }
     prev_folder = main_app.m_current_folder.get();
 
-    auto& folder = *main_app.m_current_folder;
-    bool is_busy = folder.m_is_busy;
+    // NOTE: Async calls hold onto the folder in case it is removed before they run
+    auto folder_ptr = main_app.m_current_folder;
+    auto& folder = *folder_ptr;
+    bool is_busy = folder.get_is_busy();
 
     ImGui::BeginDisabled(is_busy);
 
     if (ImGui::Button("Scan for changes")) {
-        main_app.queue_async_call([&folder](int pid) {
-            folder.update_state_from_cache();
-        });
+        main_app.queue_folder_task(folder_ptr, FolderOperation::SCAN, [folder_ptr](const util::CancellationToken& token) {
+            folder_ptr->update_state_from_cache(token);
+        }, TaskLane::DISK, TaskPriority::INTERACTIVE);
     }
 
     ImGui::SameLine();
     if (ImGui::Button("Refresh from cache")) {
-        main_app.queue_async_call([&folder](int pid) {
-            folder.load_cache_from_file();
-            folder.update_state_from_cache();
+        auto graph = std::make_shared<TaskGraph>();
+        auto load_cache = graph->add_node("load_cache", TaskLane::DISK, [folder_ptr](const util::CancellationToken& token) {
+            return folder_ptr->load_cache_from_store() || folder_ptr->load_cache_from_file();
         });
+        graph->add_node("update_state", TaskLane::DISK, [folder_ptr](const util::CancellationToken& token) {
+            return folder_ptr->update_state_from_cache(token);
+        }, { load_cache });
+        main_app.queue_folder_graph(folder_ptr, FolderOperation::REFRESH_CACHE, std::move(graph), TaskPriority::INTERACTIVE);
     }
 
     ImGui::SameLine();
     if (ImGui::Button("Download and refresh from tvdb")) {
-        main_app.queue_async_call([&folder, &main_app](int pid) {
-            folder.load_cache_from_tvdb(folder.m_cache.series.id, main_app.m_token.c_str());
-            folder.update_state_from_cache();
-        });
+        uint32_t id = 0;
+        {
+            auto cache_lock = std::shared_lock(folder.m_cache_mutex);
+            id = folder.get_cache_view().get_series().id;
+        }
+        main_app.queue_download_cache(folder_ptr, id);
     }
 
     ImGui::SameLine();
     if (ImGui::Button("Execute changes")) {
-        main_app.queue_async_call([&folder, &main_app](int pid) {
-            folder.execute_actions();
-            folder.update_state_from_cache();
-        });
+        // NOTE: Executing changes is never cancelled since it would leave the folder half renamed
+        main_app.queue_folder_task(folder_ptr, FolderOperation::EXECUTE, [folder_ptr](const util::CancellationToken& token) {
+            folder_ptr->execute_actions();
+            folder_ptr->update_state_from_cache();
+        }, TaskLane::DISK, TaskPriority::INTERACTIVE);
     }
 
     ImGui::SameLine();
@@ -359,10 +640,28 @@ void RenderEpisodes(App& main_app) {
     ImGui::Separator();
 
     // render the state tree
-    std::scoped_lock state_lock(folder.m_state_mutex);
-    std::scoped_lock bookmarks_lock(folder.m_bookmarks_mutex);
+    // NOTE: Rendering can edit the state so we need exclusive access
+    auto state_lock = std::unique_lock(folder.m_state_mutex);
+    auto bookmarks_lock = std::scoped_lock(folder.m_bookmarks_mutex);
 
     auto& state = folder.m_state;
+
+    // NOTE: Text inputs have their own undo history so we don't steal their shortcuts
+    const bool is_shortcut_enabled = !is_busy && !ImGui::GetIO().WantTextInput && ImGui::IsKeyDown(ImGuiKey_LeftCtrl);
+    ImGui::BeginDisabled(is_busy || !state->GetCanUndo());
+    const bool is_undo_shortcut = is_shortcut_enabled && ImGui::IsKeyPressed(ImGuiKey_Z, false);
+    if (ImGui::Button(ICON_FA_UNDO " Undo") || is_undo_shortcut) {
+        state->Undo();
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::BeginDisabled(is_busy || !state->GetCanRedo());
+    const bool is_redo_shortcut = is_shortcut_enabled && ImGui::IsKeyPressed(ImGuiKey_Y, false);
+    if (ImGui::Button(ICON_FA_REPEAT " Redo") || is_redo_shortcut) {
+        state->Redo();
+    }
+    ImGui::EndDisabled();
+
     auto& counts = state->GetActionCount();
 
     bool show_tab_bar = ImGui::BeginTabBar("##file intent tab group");
@@ -418,12 +717,15 @@ void RenderEpisodes(App& main_app) {
     if (show_tab_bar) {
         ImGui::EndTabBar();
     }
+
+    // NOTE: Edits, undo and redo above change the folder's status and the library totals
+    folder.update_summary_from_state();
     
     if (folder.m_bookmarks.m_is_dirty) {
         folder.m_bookmarks.m_is_dirty = false;
-        main_app.queue_async_call([&folder, &main_app](int pid) {
-            folder.save_bookmarks_to_file();
-        });
+        main_app.queue_folder_task(folder_ptr, FolderOperation::SAVE_BOOKMARKS, [folder_ptr](const util::CancellationToken& token) {
+            folder_ptr->save_bookmarks_to_file();
+        }, TaskLane::DISK, TaskPriority::INTERACTIVE);
     }
 }
 
@@ -538,17 +840,21 @@ void RenderFilesWhitelist(AppFolder& folder) {
 void RenderFilesRename(AppFolder& folder) {
     auto& state = folder.m_state;
     if (ImGui::Button("Select all")) {
+        state->BeginEditGroup();
         for (auto& [key, intent]: state->GetIntents()) {
             if (intent.GetAction() != FileIntent::Action::RENAME) continue; 
             intent.SetIsActive(true);
         }
+        state->EndEditGroup();
     }
     ImGui::SameLine();
     if (ImGui::Button("Clear all")) {
+        state->BeginEditGroup();
         for (auto& [key, intent]: state->GetIntents()) {
             if (intent.GetAction() != FileIntent::Action::RENAME) continue; 
             intent.SetIsActive(false);
         }
+        state->EndEditGroup();
     }
     ImGui::Separator();
 
@@ -624,17 +930,21 @@ void RenderFilesDelete(AppFolder& folder) {
     auto& state = folder.m_state;
 
     if (ImGui::Button("Select all")) {
+        state->BeginEditGroup();
         for (auto& [key, intent]: state->GetIntents()) {
             if (intent.GetAction() != FileIntent::Action::DELETE) continue; 
             intent.SetIsActive(true);
         }
+        state->EndEditGroup();
     }
     ImGui::SameLine();
     if (ImGui::Button("Clear all")) {
+        state->BeginEditGroup();
         for (auto& [key, intent]: state->GetIntents()) {
             if (intent.GetAction() != FileIntent::Action::DELETE) continue; 
             intent.SetIsActive(false);
         }
+        state->EndEditGroup();
     }
     ImGui::Separator();
 
@@ -789,15 +1099,14 @@ void RenderSeriesInfo(App& main_app) {
     }
 
     auto& folder = *main_app.m_current_folder;
-    std::scoped_lock cache_lock(folder.m_cache_mutex);
-    const auto& cache = folder.m_cache;
-    const auto& is_cached = folder.m_is_info_cached;
+    auto cache_lock = std::shared_lock(folder.m_cache_mutex);
+    const bool is_cached = folder.m_is_info_cached;
     if (!is_cached) {
         ImGui::TextWrapped("Cache is missing");
         return;
     }
 
-    const auto& series = cache.series;
+    const auto series = folder.get_cache_view().get_series();
     const ImGuiTableFlags flags = ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
 
     if (ImGui::BeginTable("Series", 2, flags)) {
@@ -811,19 +1120,19 @@ void RenderSeriesInfo(App& main_app) {
         ImGui::TableSetColumnIndex(0);
         ImGui::Text("Name"); 
         ImGui::TableSetColumnIndex(1);
-        ImGui::TextWrapped("%s", series.name.c_str());
+        ImGui::TextWrapped("%s", series.name.data());
 
         ImGui::TableNextRow();
         ImGui::TableSetColumnIndex(0);
         ImGui::Text("Status"); 
         ImGui::TableSetColumnIndex(1);
-        ImGui::TextWrapped("%s", series.status.c_str());
+        ImGui::TextWrapped("%s", series.status.data());
 
         ImGui::TableNextRow();
         ImGui::TableSetColumnIndex(0);
         ImGui::Text("Air Date"); 
         ImGui::TableSetColumnIndex(1);
-        ImGui::TextWrapped("%s", series.air_date.c_str());
+        ImGui::TextWrapped("%s", series.air_date.data());
 
         if (series.overview) {
             auto& label = series.overview.value();
@@ -831,7 +1140,7 @@ void RenderSeriesInfo(App& main_app) {
             ImGui::TableSetColumnIndex(0);
             ImGui::Text("Overview"); 
             ImGui::TableSetColumnIndex(1);
-            ImGui::TextWrapped("%s", label.c_str());
+            ImGui::TextWrapped("%s", label.data());
         }
 
         ImGui::EndTable();
@@ -845,25 +1154,23 @@ void RenderEpisodeInfo(App& main_app) {
     }
 
     auto& folder = *main_app.m_current_folder;
-    std::scoped_lock cache_lock(folder.m_cache_mutex);
-    const auto& cache = folder.m_cache;
-    const auto& is_cached = folder.m_is_info_cached;
+    auto cache_lock = std::shared_lock(folder.m_cache_mutex);
+    const bool is_cached = folder.m_is_info_cached;
     if (!is_cached) {
         ImGui::TextWrapped("Cache is missing");
         return;
     }
 
-    auto& episodes = cache.episodes;
     if (!folder.selected_episode.has_value()) {
         ImGui::TextWrapped("No episode selected");
         return;
     }
-    auto res = episodes.find(folder.selected_episode.value());
-    if (res == episodes.end()) {
+    const auto episode_opt = folder.get_cache_view().find_episode(folder.selected_episode.value());
+    if (!episode_opt) {
         ImGui::TextWrapped("No episode selected");    
         return;
     }
-    const auto& episode = res->second;
+    const auto& episode = episode_opt.value();
 
     const ImGuiTableFlags flags = ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
 
@@ -884,13 +1191,13 @@ void RenderEpisodeInfo(App& main_app) {
         ImGui::TableSetColumnIndex(0);
         ImGui::Text("Name"); 
         ImGui::TableSetColumnIndex(1);
-        ImGui::TextWrapped("%*s", int(episode.name.size()), episode.name.c_str());
+        ImGui::TextWrapped("%*s", int(episode.name.size()), episode.name.data());
 
         ImGui::TableNextRow();
         ImGui::TableSetColumnIndex(0);
         ImGui::Text("Air Date"); 
         ImGui::TableSetColumnIndex(1);
-        ImGui::TextWrapped("%*s", int(episode.air_date.size()), episode.air_date.c_str());
+        ImGui::TextWrapped("%*s", int(episode.air_date.size()), episode.air_date.data());
 
         if (episode.overview) {
             auto& label = episode.overview.value();
@@ -898,7 +1205,7 @@ void RenderEpisodeInfo(App& main_app) {
             ImGui::TableSetColumnIndex(0);
             ImGui::Text("Overview"); 
             ImGui::TableSetColumnIndex(1);
-            ImGui::TextWrapped("%s", label.c_str());
+            ImGui::TextWrapped("%s", label.data());
         }
 
         ImGui::EndTable();
@@ -911,28 +1218,35 @@ void RenderErrors(App& main_app) {
         return;
     }
 
-    auto& folder = *main_app.m_current_folder;
-    std::scoped_lock errors_lock(folder.m_errors_mutex);
-    auto& errors = folder.m_errors;
+    const uint64_t folder_id = main_app.m_current_folder->get_id();
+    auto& diagnostics = main_app.m_diagnostics;
+    auto& log = diagnostics.get_log();
 
     ImGui::Text("Error List");
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Clear")) {
+        diagnostics.remove_all(Severity::SEVERITY_ERROR, folder_id);
+    }
     if (ImGui::BeginListBox("##Error List", ImVec2(-1,-1))) {
-        
-        auto it = errors.begin();
-        auto end = errors.end();
+        auto it = log.begin();
+        auto end = log.end();
 
         int gid = 0;
         while (it != end) {
             auto& error = *it;
+            if ((error.severity != Severity::SEVERITY_ERROR) || (error.folder_id != folder_id)) {
+                ++it;
+                continue;
+            }
 
             ImGui::PushID(gid++);
 
             bool is_pressed = ImGui::Button("X");
             ImGui::SameLine();
-            ImGui::TextWrapped("%s", error.c_str());
+            RenderDiagnostic(error);
 
             if (is_pressed) {
-                it = errors.erase(it);
+                diagnostics.remove(it++);
             } else {
                 ++it;
             }
@@ -944,7 +1258,97 @@ void RenderErrors(App& main_app) {
     }
 }
 
+void RenderMetrics(App& main_app) {
+    // rates are taken over the last second so they reflect what is happening now
+    struct CounterRate {
+        int64_t last_value = 0;
+        float per_second = 0.0f;
+    };
+    static std::map<std::string, CounterRate> counter_rates;
+    static double last_sample_time = -1.0;
+
+    auto counters = util::metrics::get_counters();
+    const double time = util::metrics::get_uptime_seconds();
+    const double dt = time - last_sample_time;
+    if ((last_sample_time < 0.0) || (dt >= 1.0)) {
+        for (auto& counter: counters) {
+            auto& rate = counter_rates[counter.name];
+            rate.per_second = (last_sample_time < 0.0) ? 0.0f : float(double(counter.value - rate.last_value) / dt);
+            rate.last_value = counter.value;
+        }
+        last_sample_time = time;
+    }
+
+    ImGui::Text("Queue depths (pending/running)");
+    auto RenderLane = [&main_app](const char* name, TaskLane lane) {
+        auto& pool = main_app.get_thread_pool(lane);
+        ImGui::Text("%s: %d/%d", name, pool.get_total_pending(), pool.get_total_running());
+    };
+    RenderLane("Disk", TaskLane::DISK);
+    ImGui::SameLine();
+    RenderLane("Network", TaskLane::NETWORK);
+    ImGui::SameLine();
+    RenderLane("Cpu", TaskLane::CPU);
+
+    int64_t total_hits = 0;
+    int64_t total_misses = 0;
+    for (auto& counter: counters) {
+        if (counter.name == "scan.descriptor_hits") total_hits = counter.value;
+        if (counter.name == "scan.descriptor_misses") total_misses = counter.value;
+    }
+    const int64_t total_parses = total_hits + total_misses;
+    ImGui::Text("Descriptor hit ratio: %.1f%%", (total_parses > 0) ? (100.0f * float(total_hits) / float(total_parses)) : 0.0f);
+    ImGui::Separator();
+
+    ImGuiTableFlags flags = 
+        ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
+
+    if (ImGui::BeginTable("##counters", 3, flags)) {
+        ImGui::TableSetupColumn("Counter", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Total", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Per second", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableHeadersRow();
+        for (auto& counter: counters) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", counter.name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%lld", (long long)counter.value);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.1f", counter_rates[counter.name].per_second);
+        }
+        ImGui::EndTable();
+    }
+
+    if (ImGui::BeginTable("##histograms", 6, flags)) {
+        ImGui::TableSetupColumn("Latency (us)", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("p50", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("p90", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("p99", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Max", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableHeadersRow();
+        for (auto& histogram: util::metrics::get_histograms()) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", histogram.name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%lld", (long long)histogram.count);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("<%lld", (long long)histogram.p50);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("<%lld", (long long)histogram.p90);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("<%lld", (long long)histogram.p99);
+            ImGui::TableSetColumnIndex(5);
+            ImGui::Text("%lld", (long long)histogram.max);
+        }
+        ImGui::EndTable();
+    }
+}
+
 void RenderSeriesSelectModal(App& main_app, AppFolder& folder) {
+    auto folder_ptr = main_app.m_current_folder;
     static const char* modal_title = "Select a series###series selection modal";
 
     if (ImGui::Button("Select Series")) {
@@ -965,9 +1369,9 @@ void RenderSeriesSelectModal(App& main_app, AppFolder& folder) {
 
         ImGui::SameLine();
         if (ImGui::Button("Search")) {
-            main_app.queue_async_call([&folder, buf, &main_app](int pid) {
-                folder.load_search_series_from_tvdb(buf, main_app.m_token.c_str());
-            });
+            main_app.queue_folder_task(folder_ptr, FolderOperation::SEARCH, [folder_ptr, buf, &main_app](const util::CancellationToken& token) {
+                folder_ptr->load_search_series_from_tvdb(buf, *main_app.m_tvdb_client);
+            }, TaskLane::NETWORK, TaskPriority::INTERACTIVE);
         }
         ImGui::Separator();
 
@@ -1000,10 +1404,7 @@ void RenderSeriesSelectModal(App& main_app, AppFolder& folder) {
                 ImGui::TableSetColumnIndex(4);
                 if (ImGui::Button("Select")) {
                     uint32_t id = r.id;
-                    main_app.queue_async_call([id, &folder, &main_app](int pid) {
-                        folder.load_cache_from_tvdb(id, main_app.m_token.c_str());
-                        folder.update_state_from_cache();
-                    });
+                    main_app.queue_download_cache(folder_ptr, id);
                     ImGui::CloseCurrentPopup(); 
                 }
                 ImGui::PopID();
@@ -1016,30 +1417,45 @@ void RenderSeriesSelectModal(App& main_app, AppFolder& folder) {
 }
 
 void RenderAppWarnings(App& main_app) {
-    auto lock = std::scoped_lock(main_app.m_app_warnings_mutex); 
-    auto& warnings = main_app.m_app_warnings;
+    auto& diagnostics = main_app.m_diagnostics;
+    auto& log = diagnostics.get_log();
+    int total_warnings = 0;
+    for (auto& diagnostic: log) {
+        if ((diagnostic.severity == Severity::SEVERITY_WARNING) && (diagnostic.folder_id == APP_DIAGNOSTIC_ID)) {
+            total_warnings++;
+        }
+    }
+
     static char window_name[MAX_BUFFER_SIZE+1] = {0};
     snprintf(
             window_name, MAX_BUFFER_SIZE, 
-            "Warnings (%zu)###application warnings", warnings.size()); 
+            "Warnings (%d)###application warnings", total_warnings); 
 
     ImGui::Begin(window_name);
+    const int total_dropped = diagnostics.get_total_dropped();
+    if (total_dropped > 0) {
+        ImGui::TextDisabled("%d messages were dropped since too many arrived at once", total_dropped);
+    }
     if (ImGui::BeginListBox("##Warning List", ImVec2(-1,-1))) {
-        auto it = warnings.begin();
-        auto end = warnings.end();
+        auto it = log.begin();
+        auto end = log.end();
 
         int gid = 0;
         while (it != end) {
             auto& warning = *it;
+            if ((warning.severity != Severity::SEVERITY_WARNING) || (warning.folder_id != APP_DIAGNOSTIC_ID)) {
+                ++it;
+                continue;
+            }
 
             ImGui::PushID(gid++);
 
             bool is_pressed = ImGui::Button("X");
             ImGui::SameLine();
-            ImGui::TextWrapped("%s", warning.c_str());
+            RenderDiagnostic(warning);
 
             if (is_pressed) {
-                it = warnings.erase(it);
+                diagnostics.remove(it++);
             } else {
                 ++it;
             }
@@ -1055,9 +1471,11 @@ void RenderAppWarnings(App& main_app) {
 void RenderAppErrors(App& main_app) {
     static const char* modal_title = "Application error###app error modal";
 
-    std::scoped_lock error_lock(main_app.m_app_errors_mutex); 
-    auto& errors = main_app.m_app_errors;
-    if (errors.size() == 0) {
+    auto& log = main_app.m_diagnostics.get_log();
+    auto is_app_error = [](const Diagnostic& diagnostic) {
+        return (diagnostic.severity == Severity::SEVERITY_ERROR) && (diagnostic.folder_id == APP_DIAGNOSTIC_ID);
+    };
+    if (std::find_if(log.begin(), log.end(), is_app_error) == log.end()) {
         return;
     }
 
@@ -1072,8 +1490,10 @@ void RenderAppErrors(App& main_app) {
         ImGui::Text("Please restart the application");
         ImGui::Separator();
         if (ImGui::BeginListBox("##app error list", ImVec2(-1,-1))) {
-            for (const auto& e: errors) {
-                ImGui::TextWrapped("%s", e.c_str());
+            for (const auto& e: log) {
+                if (is_app_error(e)) {
+                    RenderDiagnostic(e);
+                }
             }
 
             ImGui::EndListBox();
@@ -2,42 +2,68 @@
 #include <string>
 #include <filesystem>
 #include <optional>
+#include <memory>
+#include <string.h>
 
 #include "app/app_credentials.h"
 #include "app/app_config.h"
+#include "app/app_folder.h"
 #include "app/app_folder_state.h"
+#include "app/app_metadata_store.h"
 #include "app/file_intents.h"
 #include "tvdb_api/tvdb_api.h"
 #include "tvdb_api/tvdb_json.h"
 #include "util/file_loading.h"
 #include "util/console_colours.h"
+#include "util/trace.h"
+#include "util/metrics.h"
 
 namespace fs = std::filesystem;
 
 std::optional<rapidjson::Document> assert_document_load(util::DocumentLoadResult res, const char* message);
-std::string fetch_api_token();
+void login_api_client(tvdb_api::TvdbClient& client);
+std::shared_ptr<const app::MetadataStore> open_metadata_store(const fs::path& root);
+std::optional<tvdb_api::TVDB_Cache> load_cache_from_store(fs::path root, const app::MetadataStore* store);
 std::optional<tvdb_api::TVDB_Cache> load_cache_from_directory(fs::path root);
-std::optional<tvdb_api::TVDB_Cache> load_cache_from_api(fs::path root, const std::string& token);
+std::optional<tvdb_api::SeriesInfo> load_series_from_directory(fs::path root);
+std::optional<tvdb_api::TVDB_Cache> load_cache_from_api(fs::path root, tvdb_api::TvdbClient& client, const app::MetadataStore* store);
 void scan_directory(const fs::path &subdir, const tvdb_api::TVDB_Cache& tvdb_cache, const app::FilterRules& cfg);
+bool check_folder_edits(const fs::path &subdir, const tvdb_api::TVDB_Cache& tvdb_cache, app::FilterRules& cfg);
 
 // A headless scanner that goes through a directory of TV series 
 int main(int argc, char** argv) {
     // Argument parser
     if (argc <= 1) {
-        std::cout << "Usage: " << argv[0] << "(directory_path) [--use-api]" << std::endl;
+        std::cout << "Usage: " << argv[0] << "(directory_path) [--use-api] [--trace <trace.json>] [--metrics] [--check-edits]" << std::endl;
         return 1;
     }
 
     const auto root = fs::path(argv[1]);
     bool is_load_api = false;
-    if (argc >= 3) {
-        const auto* flag = argv[2];
+    const char* trace_filepath = NULL;
+    bool is_print_metrics = false;
+    bool is_check_edits = false;
+    for (int i = 2; i < argc; i++) {
+        const auto* flag = argv[i];
         if (strncmp(flag, "--use-api", 10) == 0) {
             is_load_api = true;
             std::cout << "Using tvdb api" << std::endl;
+        } else if ((strncmp(flag, "--trace", 8) == 0) && ((i+1) < argc)) {
+            trace_filepath = argv[++i];
+        } else if (strncmp(flag, "--metrics", 10) == 0) {
+            is_print_metrics = true;
+        } else if (strncmp(flag, "--check-edits", 14) == 0) {
+            is_check_edits = true;
         }
     }
 
+    if (trace_filepath != NULL) {
+        if (!util::trace::get_is_compiled()) {
+            std::cerr << "Tracing was not compiled in, rebuild with -DENABLE_TRACING=ON" << std::endl;
+        }
+        util::trace::set_is_enabled(true);
+    }
+
     // Load filter rules from application configuration file
     auto app_config_opt = app::load_app_config_from_filepath("res/app_config.json");
     if (!app_config_opt) {
@@ -51,34 +77,65 @@ int main(int argc, char** argv) {
     filter_rules.whitelist_folders      = std::move(app_config.whitelist_folders);
     filter_rules.whitelist_tags         = std::move(app_config.whitelist_tags);
 
+    // NOTE: A library that was opened by the app may only have its caches in the metadata store
+    const auto store = open_metadata_store(root);
+    int total_failed_checks = 0;
+
     if (!is_load_api) {
         // series and episodes data is from local cache
         for (auto& subdir: fs::directory_iterator(root)) {
             if (!subdir.is_directory()) {
                 continue;
             }
-            const auto cache_opt = load_cache_from_directory(subdir);
+            auto cache_opt = load_cache_from_store(subdir, store.get());
+            if (!cache_opt) {
+                cache_opt = load_cache_from_directory(subdir);
+            }
             if (cache_opt) {
                 auto& cache = cache_opt.value();
                 scan_directory(subdir, cache, filter_rules);
+                if (is_check_edits && !check_folder_edits(subdir, cache, filter_rules)) {
+                    total_failed_checks++;
+                }
             }
         }
     } else {
         // episodes data is from api
         // series data is from local cache
-        const auto token = fetch_api_token();
+        auto client = tvdb_api::TvdbClient(app_config.tvdb_client);
+        login_api_client(client);
         for (auto &subdir: fs::directory_iterator(root)) {
             if (!subdir.is_directory()) {
                 continue;
             }
-            const auto cache_opt = load_cache_from_api(subdir, token);
+            const auto cache_opt = load_cache_from_api(subdir, client, store.get());
             if (cache_opt) {
                 auto& cache = cache_opt.value();
                 scan_directory(subdir, cache, filter_rules);
+                if (is_check_edits && !check_folder_edits(subdir, cache, filter_rules)) {
+                    total_failed_checks++;
+                }
             }
         }
     }
 
+    if (is_print_metrics) {
+        std::cout << util::metrics::json_stringify_metrics() << std::endl;
+    }
+
+    if ((trace_filepath != NULL) && util::trace::get_is_compiled()) {
+        if (!util::trace::write_chrome_trace(trace_filepath)) {
+            std::cerr << "Failed to write trace to " << trace_filepath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote trace to " << trace_filepath << std::endl;
+    }
+
+    if (total_failed_checks > 0) {
+        std::cerr << "Failed edit checks in " << total_failed_checks << " folders" << std::endl;
+        return 1;
+    }
+
     return 0;
 }
 
@@ -91,6 +148,7 @@ std::optional<rapidjson::Document> assert_document_load(util::DocumentLoadResult
 }
 
 void scan_directory(const fs::path &subdir, const tvdb_api::TVDB_Cache& tvdb_cache, const app::FilterRules& cfg) {
+    TRACE_SCOPE("scan", "scan_directory");
     std::cout << "Scanning directory: " << subdir << std::endl;
 
     auto folder = app::AppFolderState();
@@ -144,7 +202,55 @@ void scan_directory(const fs::path &subdir, const tvdb_api::TVDB_Cache& tvdb_cac
     }
 }
 
-std::string fetch_api_token() {
+// Deletes a file like the gui does then checks that the library totals follow the edit, undo and redo
+bool check_folder_edits(const fs::path &subdir, const tvdb_api::TVDB_Cache& tvdb_cache, app::FilterRules& cfg) {
+    std::atomic<int> busy_count = 0;
+    auto stats = app::AppLibraryStats();
+    auto diagnostics = app::DiagnosticsChannel();
+    auto folder = app::AppFolder(subdir, cfg, busy_count, stats, diagnostics);
+    folder.update_state_from_intents(app::get_directory_file_intents(subdir, cfg, tvdb_cache));
+
+    auto& state = *folder.m_state;
+    app::AppFileState* file = nullptr;
+    for (auto& [key, intent]: state.GetIntents()) {
+        if (intent.GetAction() != app::FileIntent::Action::DELETE) {
+            file = &intent;
+            break;
+        }
+    }
+    if (file == nullptr) {
+        return true;
+    }
+
+    const int prev_deletes = stats.get_total_deletes();
+    auto check = [&](const char* step, int expected_deletes) {
+        folder.update_summary_from_state();
+        const int expected_status_count = (expected_deletes > 0) ? 1 : 0;
+        const bool is_ok = 
+            (stats.get_total_deletes() == expected_deletes) && 
+            (stats.get_status_count(app::AppFolder::Status::PENDING_DELETES) == expected_status_count) &&
+            (folder.m_status == app::AppFolder::Status::PENDING_DELETES) == (expected_deletes > 0);
+        if (!is_ok) {
+            std::cerr 
+                << FRED("[!] ") << "Stale totals after " << step << " in " << subdir 
+                << " (deletes=" << stats.get_total_deletes() << ", expected=" << expected_deletes << ")" << std::endl;
+        }
+        return is_ok;
+    };
+
+    state.BeginEditGroup();
+    file->SetAction(app::FileIntent::Action::DELETE);
+    file->SetIsActive(false);
+    state.EndEditGroup();
+    bool is_ok = check("edit", prev_deletes+1);
+    state.Undo();
+    is_ok = check("undo", prev_deletes) && is_ok;
+    state.Redo();
+    is_ok = check("redo", prev_deletes+1) && is_ok;
+    return is_ok;
+}
+
+void login_api_client(tvdb_api::TvdbClient& client) {
     auto credentials_opt = app::load_credentials_from_filepath("res/credentials");
     if (!credentials_opt) {
         std::cerr << "Failed to load credentials: " << credentials_opt.error() << std::endl;
@@ -152,7 +258,7 @@ std::string fetch_api_token() {
     }
 
     auto& credentials = credentials_opt.value();
-    auto token_opt = tvdb_api::login(
+    auto token_opt = client.login(
         credentials.api_key.c_str(),
         credentials.user_key.c_str(),
         credentials.username.c_str()
@@ -169,8 +275,34 @@ std::string fetch_api_token() {
         << "userkey=" << credentials.user_key << "\n"
         << "username=" << credentials.username << "\n"
         << "token=" << token << std::endl;
+}
 
-    return token;
+// NOTE: A damaged generation falls back to the one before it like the app does
+std::shared_ptr<const app::MetadataStore> open_metadata_store(const fs::path& root) {
+    for (auto& file: app::metadata_store::list_store_files(root)) {
+        auto store_opt = app::MetadataStore::open(file.path);
+        if (!store_opt) {
+            std::cerr << store_opt.error() << std::endl;
+            continue;
+        }
+        return std::move(store_opt.value());
+    }
+    return nullptr;
+}
+
+std::optional<tvdb_api::TVDB_Cache> load_cache_from_store(fs::path root, const app::MetadataStore* store) {
+    if (store == nullptr) {
+        return {};
+    }
+    const auto id = store->find_folder_series(root.filename().string());
+    if (!id) {
+        return {};
+    }
+    const auto index = store->find_series(id.value());
+    if (!index) {
+        return {};
+    }
+    return app::CacheView(*store, index.value()).to_cache();
 }
 
 std::optional<tvdb_api::TVDB_Cache> load_cache_from_directory(fs::path root) {
@@ -216,8 +348,7 @@ std::optional<tvdb_api::TVDB_Cache> load_cache_from_directory(fs::path root) {
     return std::move(tvdb_cache);
 }
 
-std::optional<tvdb_api::TVDB_Cache> load_cache_from_api(fs::path root, const std::string& token) {
-    // NOTE: We rely on the series info being cached already 
+std::optional<tvdb_api::SeriesInfo> load_series_from_directory(fs::path root) {
     const fs::path series_cache_fn = root / "series.json";
     auto series_doc_opt = assert_document_load(
         util::load_document_from_file(series_cache_fn.string().c_str()),
@@ -232,20 +363,23 @@ std::optional<tvdb_api::TVDB_Cache> load_cache_from_api(fs::path root, const std
         std::cerr << series_opt.error() << std::endl;
         return {};
     }
-    auto& series_info = series_opt.value();
+    return std::move(series_opt.value());
+}
 
-    // Load episodes data from api
-    const uint32_t id = series_info.id;
-    auto episodes_doc_opt = tvdb_api::get_series_episodes(id, token.c_str());
-    if (!episodes_doc_opt) {
-        std::cerr << "Failed to get episodes info from tvdb" << std::endl;
+std::optional<tvdb_api::TVDB_Cache> load_cache_from_api(fs::path root, tvdb_api::TvdbClient& client, const app::MetadataStore* store) {
+    // NOTE: We rely on the series info being cached already 
+    auto stored_opt = load_cache_from_store(root, store);
+    auto series_opt = stored_opt ? std::optional(std::move(stored_opt.value().series)) : load_series_from_directory(root);
+    if (!series_opt) {
         return {};
     }
+    auto& series_info = series_opt.value();
 
-    auto& episodes_doc = episodes_doc_opt.value();
-    auto episodes_opt = tvdb_api::load_series_episodes_info(episodes_doc);
+    // Load episodes data from api
+    const uint32_t id = series_info.id;
+    auto episodes_opt = client.get_series_episodes(id);
     if (!episodes_opt) {
-        std::cerr << episodes_opt.error() << std::endl;
+        std::cerr << "Failed to get episodes info from tvdb: " << episodes_opt.error() << std::endl;
         return {};
     }
     auto& episodes_info = episodes_opt.value();
@@ -0,0 +1,466 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <future>
+#include <filesystem>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <stdlib.h>
+
+#include <fmt/core.h>
+
+#include "mock_tvdb/mock_tvdb_server.h"
+#include "tvdb_api/tvdb_api.h"
+#include "tvdb_api/tvdb_http_cache.h"
+#include "tvdb_api/tvdb_json_sax.h"
+#include "app/app_folder.h"
+#include "app/app_auto_match.h"
+#include "app/app_library_sync.h"
+#include "util/trace.h"
+#include "util/metrics.h"
+
+namespace fs = std::filesystem;
+
+struct BenchmarkResult {
+    double elapsed_seconds = 0.0;
+    int total_series = 0;
+    int total_failed = 0;
+    size_t total_episodes = 0;
+};
+
+// fetch the series and episodes of every series like a library wide metadata refresh
+static BenchmarkResult run_refresh(tvdb_api::TvdbClient& client, int total_series, int total_threads) {
+    BenchmarkResult result;
+    std::atomic<int> next_id = 1;
+    std::atomic<int> total_failed = 0;
+    std::atomic<size_t> total_episodes = 0;
+
+    auto refresh_series = [&]() {
+        int id;
+        while ((id = next_id++) <= total_series) {
+            auto series_opt = client.get_series(tvdb_api::sid_t(id));
+            auto episodes_opt = client.get_series_episodes(tvdb_api::sid_t(id));
+            if (!series_opt || !episodes_opt) {
+                if (!series_opt) std::cerr << series_opt.error() << std::endl;
+                if (!episodes_opt) std::cerr << episodes_opt.error() << std::endl;
+                total_failed++;
+                continue;
+            }
+            total_episodes += episodes_opt.value().size();
+        }
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < total_threads; i++) {
+        threads.emplace_back(refresh_series);
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    result.elapsed_seconds = std::chrono::duration<double>(end - start).count();
+    result.total_series = total_series;
+    result.total_failed = total_failed;
+    result.total_episodes = total_episodes;
+    return result;
+}
+
+// same refresh but every request is in flight at once on the client's event loop
+static BenchmarkResult run_refresh_async(tvdb_api::TvdbClient& client, int total_series) {
+    BenchmarkResult result;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<tl::expected<tvdb_api::SeriesInfo, std::string>>> series_futures;
+    std::vector<std::future<tl::expected<tvdb_api::EpisodesMap, std::string>>> episodes_futures;
+    for (int id = 1; id <= total_series; id++) {
+        series_futures.push_back(client.get_series_async(tvdb_api::sid_t(id)));
+        episodes_futures.push_back(client.get_series_episodes_async(tvdb_api::sid_t(id)));
+    }
+
+    for (int i = 0; i < total_series; i++) {
+        auto series_opt = series_futures[i].get();
+        auto episodes_opt = episodes_futures[i].get();
+        if (!series_opt || !episodes_opt) {
+            if (!series_opt) std::cerr << series_opt.error() << std::endl;
+            if (!episodes_opt) std::cerr << episodes_opt.error() << std::endl;
+            result.total_failed++;
+            continue;
+        }
+        result.total_episodes += episodes_opt.value().size();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    result.elapsed_seconds = std::chrono::duration<double>(end - start).count();
+    result.total_series = total_series;
+    return result;
+}
+
+struct AutoMatchResult {
+    double elapsed_seconds = 0.0;
+    int total_folders = 0;
+    int total_accepted = 0;
+    int total_correct = 0;
+    int total_review = 0;
+    int total_failed = 0;
+};
+
+// match a folder for every series whose names look like releases against the search endpoint
+static AutoMatchResult run_auto_match(
+    tvdb_api::TvdbClient& client, int total_series, const fs::path& directory, 
+    const app::AutoMatchConfig& cfg) 
+{
+    static const char* NAME_FORMATS[] = {
+        "Mock.Series.{}.S01-S05.1080p.WEB-DL.x264-GROUP",
+        "[Group] Mock Series {} - 01 [720p]",
+        "Mock Series {} (2000) Season 1-3",
+        "mock_series_{}_complete",
+    };
+    constexpr int TOTAL_NAME_FORMATS = int(sizeof(NAME_FORMATS) / sizeof(NAME_FORMATS[0]));
+
+    fs::remove_all(directory);
+    auto filter_rules = app::FilterRules();
+    auto busy_count = std::atomic<int>(0);
+    auto library_stats = app::AppLibraryStats();
+    auto diagnostics = app::DiagnosticsChannel();
+
+    std::vector<std::shared_ptr<app::AppFolder>> folders;
+    std::map<const app::AppFolder*, uint32_t> expected_ids;
+    for (int id = 1; id <= total_series; id++) {
+        const auto path = directory / fmt::format(NAME_FORMATS[id % TOTAL_NAME_FORMATS], id);
+        fs::create_directories(path);
+        auto folder = std::make_shared<app::AppFolder>(path, filter_rules, busy_count, library_stats, diagnostics);
+        expected_ids[folder.get()] = uint32_t(id);
+        folders.push_back(std::move(folder));
+    }
+
+    AutoMatchResult result;
+    std::atomic<int> total_correct = 0;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        auto matcher = app::AutoMatcher(
+            folders, cfg, client,
+            [&](std::shared_ptr<app::AppFolder> folder, uint32_t id) {
+                if (expected_ids.at(folder.get()) == id) {
+                    total_correct++;
+                }
+            },
+            [](const std::string& error) { std::cerr << error << std::endl; });
+        while (!matcher.get_is_finished()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        const auto progress = matcher.get_progress();
+        result.total_accepted = progress.total_accepted;
+        result.total_review = progress.total_review;
+        result.total_failed = progress.total_failed;
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    result.elapsed_seconds = std::chrono::duration<double>(end - start).count();
+    result.total_folders = total_series;
+    result.total_correct = total_correct;
+    return result;
+}
+
+struct LibrarySyncResult {
+    double elapsed_seconds = 0.0;
+    app::LibrarySyncProgress progress;
+};
+
+// a library with a cached folder for every series that can be synced again and again
+struct SyncLibrary {
+    app::FilterRules filter_rules;
+    std::atomic<int> busy_count = 0;
+    app::AppLibraryStats library_stats;
+    app::DiagnosticsChannel diagnostics;
+    std::vector<std::shared_ptr<app::AppFolder>> folders;
+};
+
+// NOTE: The caches are downloaded from several threads like the blocking refresh
+static int create_sync_library(
+    SyncLibrary& library, tvdb_api::TvdbClient& client, 
+    int total_series, int total_threads, const fs::path& directory) 
+{
+    fs::remove_all(directory);
+    for (int id = 1; id <= total_series; id++) {
+        const auto path = directory / fmt::format("Mock Series {}", id);
+        fs::create_directories(path);
+        library.folders.push_back(std::make_shared<app::AppFolder>(
+            path, library.filter_rules, library.busy_count, library.library_stats, library.diagnostics));
+    }
+
+    std::atomic<int> next_index = 0;
+    std::atomic<int> total_failed = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < total_threads; i++) {
+        threads.emplace_back([&]() {
+            for (int index = next_index++; index < total_series; index = next_index++) {
+                if (!library.folders[index]->load_cache_from_tvdb(uint32_t(index+1), client)) {
+                    total_failed++;
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    return total_failed;
+}
+
+static LibrarySyncResult run_library_sync(
+    SyncLibrary& library, tvdb_api::TvdbClient& client, const fs::path& state_filepath, 
+    const app::LibrarySyncConfig& cfg)
+{
+    LibrarySyncResult result;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        auto sync = app::LibrarySync(
+            library.folders, state_filepath, cfg, client,
+            [](std::shared_ptr<app::AppFolder> folder) {},
+            [](const std::string& error) { std::cerr << error << std::endl; });
+        while (!sync.get_is_finished()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        result.progress = sync.get_progress();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    result.elapsed_seconds = std::chrono::duration<double>(end - start).count();
+    return result;
+}
+
+struct FixtureCheckResult {
+    int total_pages = 0;
+    int total_failed = 0;
+    size_t total_episodes = 0;
+    size_t total_specials = 0;
+};
+
+// parse every episodes page in the fixtures so a rejected page is reported before the benchmark runs
+// NOTE: The fixtures include specials since season 0 has to parse like any other season
+static FixtureCheckResult check_fixtures(const fs::path& directory) {
+    FixtureCheckResult result;
+    std::error_code ec;
+    for (auto& file: fs::recursive_directory_iterator(directory / "series", ec)) {
+        const auto& path = file.path();
+        if (!file.is_regular_file() || (path.extension() != ".json") || (path.parent_path().filename() != "episodes")) {
+            continue;
+        }
+        std::ifstream fp(path, std::ios::binary);
+        std::stringstream ss;
+        ss << fp.rdbuf();
+        const auto json = ss.str();
+
+        result.total_pages++;
+        auto page_opt = tvdb_api::parse_episodes_page_response(json.c_str(), json.size());
+        if (!page_opt) {
+            std::cerr << "Failed to parse fixture " << path.string() << ": " << page_opt.error() << std::endl;
+            result.total_failed++;
+            continue;
+        }
+        for (auto& episode: page_opt.value().episodes) {
+            result.total_episodes++;
+            if (episode.season == 0) {
+                result.total_specials++;
+            }
+        }
+    }
+    return result;
+}
+
+// Benchmark of a library wide metadata refresh against a local mock of the tvdb api
+// This lets the connection pooling, pagination and caching be measured without the network
+int main(int argc, char** argv) {
+    auto server_cfg = mock_tvdb::MockServerConfig();
+    auto client_cfg = tvdb_api::TvdbClientConfig();
+    int total_threads = 16;
+    int total_passes = 2;
+    bool is_async = false;
+    const char* cache_directory = NULL;
+    const char* auto_match_directory = NULL;
+    const char* delta_sync_directory = NULL;
+    int total_changed = 10;
+    const char* trace_filepath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* flag = argv[i];
+        const bool has_value = (i+1) < argc;
+        if ((strncmp(flag, "--series", 9) == 0) && has_value) {
+            server_cfg.total_series = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--episodes", 11) == 0) && has_value) {
+            server_cfg.episodes_per_series = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--latency-ms", 13) == 0) && has_value) {
+            server_cfg.latency_ms = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--jitter-ms", 12) == 0) && has_value) {
+            server_cfg.latency_jitter_ms = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--error-rate", 13) == 0) && has_value) {
+            server_cfg.server_error_rate = float(atof(argv[++i]));
+        } else if ((strncmp(flag, "--rate-limit-rate", 18) == 0) && has_value) {
+            server_cfg.rate_limit_rate = float(atof(argv[++i]));
+        } else if ((strncmp(flag, "--token-lifetime-ms", 20) == 0) && has_value) {
+            server_cfg.token_lifetime_ms = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--token-refresh-ms", 19) == 0) && has_value) {
+            client_cfg.token_refresh_interval_ms = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--fixtures", 11) == 0) && has_value) {
+            server_cfg.fixtures_directory = argv[++i];
+        } else if ((strncmp(flag, "--threads", 10) == 0) && has_value) {
+            total_threads = std::max(atoi(argv[++i]), 1);
+        } else if ((strncmp(flag, "--passes", 9) == 0) && has_value) {
+            total_passes = std::max(atoi(argv[++i]), 1);
+        } else if (strncmp(flag, "--async", 8) == 0) {
+            is_async = true;
+        } else if ((strncmp(flag, "--auto-match", 13) == 0) && has_value) {
+            auto_match_directory = argv[++i];
+        } else if ((strncmp(flag, "--delta-sync", 13) == 0) && has_value) {
+            delta_sync_directory = argv[++i];
+        } else if ((strncmp(flag, "--changed", 10) == 0) && has_value) {
+            total_changed = std::max(atoi(argv[++i]), 0);
+        } else if ((strncmp(flag, "--cache", 8) == 0) && has_value) {
+            cache_directory = argv[++i];
+        } else if ((strncmp(flag, "--pages-in-flight", 18) == 0) && has_value) {
+            client_cfg.max_pages_in_flight = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--idle-sessions", 16) == 0) && has_value) {
+            client_cfg.max_idle_sessions = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--requests-per-second", 22) == 0) && has_value) {
+            client_cfg.max_requests_per_second = atoi(argv[++i]);
+        } else if ((strncmp(flag, "--trace", 8) == 0) && has_value) {
+            trace_filepath = argv[++i];
+        } else {
+            std::cout
+                << "Usage: " << argv[0] << " [--series N] [--episodes N] [--latency-ms N] [--jitter-ms N]\n"
+                << "    [--error-rate F] [--rate-limit-rate F] [--token-lifetime-ms N] [--token-refresh-ms N]\n"
+                << "    [--fixtures <directory>]\n"
+                << "    [--threads N] [--async] [--auto-match <directory>] [--passes N] [--cache <directory>]\n"
+                << "    [--delta-sync <directory>] [--changed N]\n"
+                << "    [--pages-in-flight N] [--idle-sessions N] [--requests-per-second N] [--trace <trace.json>]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (trace_filepath != NULL) {
+        util::trace::set_is_enabled(true);
+    }
+
+    if (!server_cfg.fixtures_directory.empty()) {
+        const auto result = check_fixtures(server_cfg.fixtures_directory);
+        std::cout << fmt::format(
+            "fixtures pages={} failed={} episodes={} specials={}",
+            result.total_pages, result.total_failed, result.total_episodes, result.total_specials) << std::endl;
+        if ((result.total_failed > 0) || (result.total_specials == 0)) {
+            std::cerr << "Fixtures must parse and include a special in season 0" << std::endl;
+            return 1;
+        }
+    }
+
+    auto server = mock_tvdb::MockTvdbServer(server_cfg);
+    if (!server.start()) {
+        std::cerr << "Failed to start mock server" << std::endl;
+        return 1;
+    }
+    std::cout << "Mock server listening on " << server.get_base_url() << std::endl;
+
+    client_cfg.base_url = server.get_base_url();
+    auto client = tvdb_api::TvdbClient(client_cfg);
+    auto token_opt = client.login("apikey", "userkey", "username");
+    if (!token_opt) {
+        std::cerr << "Failed to login: " << token_opt.error() << std::endl;
+        return 1;
+    }
+    // NOTE: Requests that get a 401 after the token expires are sent again with a new token
+    client.start_authenticator({"apikey", "userkey", "username"}, [](const std::string& error) {
+        std::cerr << "Failed to authenticate: " << error << std::endl;
+    });
+
+    // NOTE: Revalidation is only visible after the first pass has filled the cache
+    if (cache_directory != NULL) {
+        fs::remove_all(cache_directory);
+        client.set_http_cache(std::make_shared<tvdb_api::HttpCache>(cache_directory));
+    }
+
+    // NOTE: Matching creates an empty folder for each series in the directory
+    for (int pass = 0; (pass < total_passes) && (auto_match_directory != NULL); pass++) {
+        const auto stats_before = server.get_stats();
+        const auto result = run_auto_match(client, server_cfg.total_series, auto_match_directory, app::AutoMatchConfig());
+        const auto stats_after = server.get_stats();
+
+        std::cout << fmt::format(
+            "pass={} elapsed={:.3f}s folders={} accepted={} correct={} review={} failed={} searches_per_second={:.1f} requests={}",
+            pass+1, result.elapsed_seconds, result.total_folders, result.total_accepted, result.total_correct,
+            result.total_review, result.total_failed, 
+            double(result.total_folders) / std::max(result.elapsed_seconds, 1e-9),
+            stats_after.total_requests - stats_before.total_requests) << std::endl;
+    }
+
+    // NOTE: The first sync is a full refresh since there is no previous sync time
+    //       Each later sync should only fetch the series that were changed before it
+    if (delta_sync_directory != NULL) {
+        SyncLibrary library;
+        const auto directory = fs::path(delta_sync_directory);
+        const auto state_filepath = directory / "sync.json";
+        fs::remove(state_filepath);
+        const int total_download_failed = create_sync_library(library, client, server_cfg.total_series, total_threads, directory / "library");
+        if (total_download_failed > 0) {
+            std::cerr << "Failed to download " << total_download_failed << " caches" << std::endl;
+        }
+
+        const int total_series = std::max(server_cfg.total_series, 1);
+        for (int pass = 0; pass <= total_passes; pass++) {
+            // spread the changes across the library
+            const int total_marked = (pass > 0) ? std::min(total_changed, total_series) : 0;
+            for (int i = 0; i < total_marked; i++) {
+                server.mark_series_updated(1 + int(int64_t(i) * total_series / total_marked));
+            }
+
+            const auto stats_before = server.get_stats();
+            const auto result = run_library_sync(library, client, state_filepath, app::LibrarySyncConfig());
+            const auto stats_after = server.get_stats();
+            const auto& progress = result.progress;
+            std::cout << fmt::format(
+                "sync={} elapsed={:.3f}s full_refresh={} changed={} fetched={} patched={} failed={} saved={} "
+                "update_queries={} requests={} not_modified={}",
+                pass, result.elapsed_seconds, progress.is_full_refresh, total_marked, 
+                progress.total_series, progress.total_patched, progress.total_failed, progress.is_saved,
+                progress.total_update_queries,
+                stats_after.total_requests - stats_before.total_requests,
+                stats_after.total_not_modified - stats_before.total_not_modified) << std::endl;
+        }
+    }
+
+    const bool is_refresh = (auto_match_directory == NULL) && (delta_sync_directory == NULL);
+    for (int pass = 0; (pass < total_passes) && is_refresh; pass++) {
+        const auto stats_before = server.get_stats();
+        const auto result = is_async ?
+            run_refresh_async(client, server_cfg.total_series) :
+            run_refresh(client, server_cfg.total_series, total_threads);
+        const auto stats_after = server.get_stats();
+
+        std::cout << fmt::format(
+            "pass={} elapsed={:.3f}s series={} failed={} episodes={} series_per_second={:.1f} "
+            "requests={} connections={} not_modified={} injected_errors={} unauthorized={} tokens_issued={}",
+            pass+1, result.elapsed_seconds, result.total_series, result.total_failed, result.total_episodes,
+            double(result.total_series) / std::max(result.elapsed_seconds, 1e-9),
+            stats_after.total_requests - stats_before.total_requests,
+            stats_after.total_connections - stats_before.total_connections,
+            stats_after.total_not_modified - stats_before.total_not_modified,
+            stats_after.total_injected_errors - stats_before.total_injected_errors,
+            stats_after.total_unauthorized - stats_before.total_unauthorized,
+            stats_after.total_tokens_issued - stats_before.total_tokens_issued) << std::endl;
+    }
+
+    server.stop();
+    std::cout << util::metrics::json_stringify_metrics() << std::endl;
+
+    if ((trace_filepath != NULL) && util::trace::get_is_compiled()) {
+        if (!util::trace::write_chrome_trace(trace_filepath)) {
+            std::cerr << "Failed to write trace to " << trace_filepath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote trace to " << trace_filepath << std::endl;
+    }
+    return 0;
+}
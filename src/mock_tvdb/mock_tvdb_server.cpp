@@ -0,0 +1,691 @@
+#include "mock_tvdb_server.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <fmt/core.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using socket_t = SOCKET;
+constexpr socket_t INVALID_SOCKET_VALUE = INVALID_SOCKET;
+constexpr int SEND_FLAGS = 0;
+static void close_socket(socket_t s) { closesocket(s); }
+static void shutdown_socket(socket_t s) { shutdown(s, SD_BOTH); }
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+using socket_t = int;
+constexpr socket_t INVALID_SOCKET_VALUE = -1;
+// NOTE: Writing to a socket the client has closed raises SIGPIPE which would kill the process
+//       Linux suppresses it per call while macos needs SO_NOSIGPIPE on the socket
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+static void close_socket(socket_t s) { close(s); }
+static void shutdown_socket(socket_t s) { shutdown(s, SHUT_RDWR); }
+#endif
+
+namespace fs = std::filesystem;
+
+namespace mock_tvdb
+{
+
+struct MockTvdbServer::Socket {
+    socket_t handle = INVALID_SOCKET_VALUE;
+};
+
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> params;
+    // NOTE: Header names are lowercase
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+struct HttpResponse {
+    int status_code = 200;
+    std::string body;
+    std::string etag;
+};
+
+static const char* get_status_text(int status_code) {
+    switch (status_code) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 429: return "Too Many Requests";
+    case 503: return "Service Unavailable";
+    default:  return "Unknown";
+    }
+}
+
+static std::string to_lower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return char(tolower(c)); });
+    return str;
+}
+
+static std::string url_decode(const std::string& str) {
+    std::string out;
+    out.reserve(str.size());
+    for (size_t i = 0; i < str.size(); i++) {
+        if ((str[i] == '%') && ((i+2) < str.size())) {
+            out.push_back(char(strtol(str.substr(i+1, 2).c_str(), NULL, 16)));
+            i += 2;
+        } else if (str[i] == '+') {
+            out.push_back(' ');
+        } else {
+            out.push_back(str[i]);
+        }
+    }
+    return out;
+}
+
+// escape a string so that it can be placed inside a json string
+static std::string json_escape(const std::string& str) {
+    std::string out;
+    out.reserve(str.size());
+    for (const char c: str) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        default:   out.push_back(c); break;
+        }
+    }
+    return out;
+}
+
+static std::string get_etag(const std::string& body) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char c: body) {
+        hash ^= uint64_t(uint8_t(c));
+        hash *= 0x100000001b3ull;
+    }
+    return fmt::format("\"{:016x}\"", hash);
+}
+
+static std::optional<std::string> read_fixture(const std::string& directory, const fs::path& path) {
+    if (directory.empty()) {
+        return std::nullopt;
+    }
+    auto file = std::ifstream(fs::path(directory) / path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+// parse the request line and headers, returns false if the request is malformed
+static bool parse_request_head(const std::string& head, HttpRequest& req) {
+    auto line_end = head.find("\r\n");
+    auto request_line = head.substr(0, line_end);
+    auto method_end = request_line.find(' ');
+    auto target_end = request_line.find(' ', method_end+1);
+    if ((method_end == std::string::npos) || (target_end == std::string::npos)) {
+        return false;
+    }
+    req.method = request_line.substr(0, method_end);
+    auto target = request_line.substr(method_end+1, target_end-method_end-1);
+
+    auto query_start = target.find('?');
+    req.path = url_decode(target.substr(0, query_start));
+    if (query_start != std::string::npos) {
+        auto query = target.substr(query_start+1);
+        size_t start = 0;
+        while (start < query.size()) {
+            auto end = query.find('&', start);
+            if (end == std::string::npos) end = query.size();
+            auto pair = query.substr(start, end-start);
+            auto eq = pair.find('=');
+            if (eq != std::string::npos) {
+                req.params[url_decode(pair.substr(0, eq))] = url_decode(pair.substr(eq+1));
+            }
+            start = end+1;
+        }
+    }
+
+    size_t start = line_end+2;
+    while (start < head.size()) {
+        auto end = head.find("\r\n", start);
+        if (end == std::string::npos) end = head.size();
+        auto line = head.substr(start, end-start);
+        auto colon = line.find(':');
+        if (colon != std::string::npos) {
+            auto value_start = line.find_first_not_of(' ', colon+1);
+            auto value = (value_start == std::string::npos) ? "" : line.substr(value_start);
+            req.headers[to_lower(line.substr(0, colon))] = value;
+        }
+        start = end+2;
+    }
+    return true;
+}
+
+// Series that were changed while the server is running
+// NOTE: Each change adds an episode and changes the overview so that cached responses are stale
+struct MockTvdbServer::UpdateLog {
+    struct Update {
+        int revision = 0;
+        int64_t last_updated = 0;   // unix time in seconds
+    };
+    std::map<int, Update> updates;
+    mutable std::mutex mutex;
+
+    void add(int id, int64_t time) {
+        auto lock = std::scoped_lock(mutex);
+        auto& update = updates[id];
+        update.revision++;
+        update.last_updated = time;
+    }
+
+    int get_revision(int id) const {
+        auto lock = std::scoped_lock(mutex);
+        auto res = updates.find(id);
+        return (res != updates.end()) ? res->second.revision : 0;
+    }
+
+    std::vector<std::pair<int, int64_t>> get_updated(int64_t from_time, int64_t to_time) const {
+        auto lock = std::scoped_lock(mutex);
+        std::vector<std::pair<int, int64_t>> updated;
+        for (auto& [id, update]: updates) {
+            if ((update.last_updated >= from_time) && (update.last_updated <= to_time)) {
+                updated.push_back({ id, update.last_updated });
+            }
+        }
+        return updated;
+    }
+};
+
+// the generated library has episodes numbered across seasons of a fixed length
+struct GeneratedLibrary {
+    const MockServerConfig& cfg;
+    const MockTvdbServer::UpdateLog& updates;
+
+    bool is_valid_series(int id) const {
+        return (id >= 1) && (id <= cfg.total_series);
+    }
+
+    std::string get_series_name(int id) const {
+        return fmt::format("Mock Series {}", id);
+    }
+
+    std::string get_series_json(int id) const {
+        const int revision = updates.get_revision(id);
+        auto overview = fmt::format("Generated series {}", id);
+        if (revision > 0) {
+            overview += fmt::format(" revision {}", revision);
+        }
+        return fmt::format(
+            R"({{"id":{},"seriesName":"{}","aliases":[],"firstAired":"2000-01-01","status":"Ended","genre":["Drama"],"overview":"{}"}})",
+            id, get_series_name(id), overview);
+    }
+
+    // NOTE: A new episode airs each time a series is changed
+    int get_total_episodes(int id) const {
+        return cfg.episodes_per_series + updates.get_revision(id);
+    }
+
+    int get_total_pages(int id) const {
+        const int page_size = std::max(cfg.page_size, 1);
+        return std::max(1, (get_total_episodes(id) + page_size - 1) / page_size);
+    }
+
+    std::string get_episodes_page_json(int id, int page) const {
+        const int page_size = std::max(cfg.page_size, 1);
+        const int per_season = std::max(cfg.episodes_per_season, 1);
+        const int last_page = get_total_pages(id);
+        const int start = (page-1) * page_size;
+        const int end = std::min(start + page_size, get_total_episodes(id));
+
+        std::string data;
+        for (int i = start; i < end; i++) {
+            if (i != start) data.push_back(',');
+            data += fmt::format(
+                R"({{"id":{},"airedSeason":{},"airedEpisodeNumber":{},"episodeName":"Episode {}","firstAired":"2000-01-{:02d}","overview":"Generated episode {}","directors":[],"guestStars":[],"language":{{"episodeName":"en","overview":"en"}}}})",
+                uint64_t(id-1)*uint64_t(cfg.episodes_per_series) + uint64_t(i) + 1, (i / per_season) + 1, (i % per_season) + 1, i+1, (i % 28) + 1, i+1);
+        }
+
+        auto get_link = [last_page](int p) {
+            return ((p >= 1) && (p <= last_page)) ? std::to_string(p) : std::string("null");
+        };
+        return fmt::format(
+            R"({{"links":{{"first":1,"last":{},"next":{},"prev":{}}},"data":[{}]}})",
+            last_page, get_link(page+1), get_link(page-1), data);
+    }
+};
+
+struct MockTvdbServer::TokenIssuer {
+    const MockServerConfig& cfg;
+    std::map<std::string, std::chrono::steady_clock::time_point> expiry_times;
+    uint64_t total_issued = 0;
+    std::mutex mutex;
+
+    TokenIssuer(const MockServerConfig& _cfg): cfg(_cfg) {}
+
+    std::string issue() {
+        auto lock = std::scoped_lock(mutex);
+        total_issued++;
+        if (cfg.token_lifetime_ms <= 0) {
+            return cfg.token;
+        }
+        auto token = fmt::format("{}-{}", cfg.token, total_issued);
+        expiry_times[token] = std::chrono::steady_clock::now() + std::chrono::milliseconds(cfg.token_lifetime_ms);
+        return token;
+    }
+
+    bool get_is_valid(const std::string& token) {
+        if (cfg.token_lifetime_ms <= 0) {
+            return token == cfg.token;
+        }
+        auto lock = std::scoped_lock(mutex);
+        auto res = expiry_times.find(token);
+        return (res != expiry_times.end()) && (std::chrono::steady_clock::now() < res->second);
+    }
+};
+
+static HttpResponse handle_request(
+    const HttpRequest& req, const MockServerConfig& cfg,
+    MockTvdbServer::TokenIssuer& tokens, const MockTvdbServer::UpdateLog& updates)
+{
+    const auto library = GeneratedLibrary{cfg, updates};
+    HttpResponse res;
+
+    if ((req.method == "POST") && (req.path == "/login")) {
+        res.body = fmt::format(R"({{"token":"{}"}})", tokens.issue());
+        return res;
+    }
+
+    const char* BEARER_PREFIX = "Bearer ";
+    auto auth = req.headers.find("authorization");
+    if ((auth == req.headers.end()) ||
+        (auth->second.rfind(BEARER_PREFIX, 0) != 0) ||
+        !tokens.get_is_valid(auth->second.substr(strlen(BEARER_PREFIX))))
+    {
+        res.status_code = 401;
+        res.body = R"({"Error":"Not authorized"})";
+        return res;
+    }
+
+    if (req.path == "/refresh_token") {
+        res.body = fmt::format(R"({{"token":"{}"}})", tokens.issue());
+        return res;
+    }
+
+    // NOTE: Like the real api the window is at most a week long and no updates gives a null
+    if (req.path == "/updated/query") {
+        constexpr int64_t MAX_WINDOW_SECONDS = 7*24*60*60;
+        if (!req.params.count("fromTime")) {
+            res.status_code = 400;
+            res.body = R"({"Error":"fromTime is required"})";
+            return res;
+        }
+        const int64_t from_time = strtoll(req.params.at("fromTime").c_str(), NULL, 10);
+        int64_t to_time = from_time + MAX_WINDOW_SECONDS;
+        if (req.params.count("toTime")) {
+            to_time = std::min(to_time, int64_t(strtoll(req.params.at("toTime").c_str(), NULL, 10)));
+        }
+        std::string data;
+        for (auto& [id, last_updated]: updates.get_updated(from_time, to_time)) {
+            if (!data.empty()) data.push_back(',');
+            data += fmt::format(R"({{"id":{},"lastUpdated":{}}})", id, last_updated);
+        }
+        res.body = data.empty() ? R"({"data":null})" : fmt::format(R"({{"data":[{}]}})", data);
+        return res;
+    }
+
+    if (req.path == "/search/series") {
+        auto name = req.params.count("name") ? to_lower(req.params.at("name")) : "";
+        std::string data;
+        for (int id = 1; id <= cfg.total_series; id++) {
+            auto series_name = library.get_series_name(id);
+            if (to_lower(series_name).find(name) == std::string::npos) {
+                continue;
+            }
+            if (!data.empty()) data.push_back(',');
+            data += fmt::format(
+                R"({{"id":{},"seriesName":"{}","firstAired":"2000-01-01","status":"Ended"}})",
+                id, json_escape(series_name));
+        }
+        if (data.empty()) {
+            res.status_code = 404;
+            res.body = R"({"Error":"Resource not found"})";
+            return res;
+        }
+        res.body = fmt::format(R"({{"data":[{}]}})", data);
+        return res;
+    }
+
+    // /series/<id> and /series/<id>/episodes
+    const char* SERIES_PREFIX = "/series/";
+    if (req.path.rfind(SERIES_PREFIX, 0) == 0) {
+        auto rest = req.path.substr(strlen(SERIES_PREFIX));
+        const int id = atoi(rest.c_str());
+        const bool is_episodes = (rest.find("/episodes") != std::string::npos);
+        const int page = req.params.count("page") ? atoi(req.params.at("page").c_str()) : 1;
+
+        auto fixture = is_episodes ?
+            read_fixture(cfg.fixtures_directory, fs::path("series") / std::to_string(id) / "episodes" / (std::to_string(page) + ".json")) :
+            read_fixture(cfg.fixtures_directory, fs::path("series") / (std::to_string(id) + ".json"));
+        if (fixture) {
+            res.body = std::move(fixture.value());
+            return res;
+        }
+
+        const bool is_valid_page = (page >= 1) && (page <= library.get_total_pages(id));
+        if (!library.is_valid_series(id) || (is_episodes && !is_valid_page)) {
+            res.status_code = 404;
+            res.body = R"({"Error":"Resource not found"})";
+            return res;
+        }
+
+        if (is_episodes) {
+            res.body = library.get_episodes_page_json(id, page);
+        } else {
+            res.body = fmt::format(R"({{"data":{}}})", library.get_series_json(id));
+        }
+        return res;
+    }
+
+    res.status_code = 404;
+    res.body = R"({"Error":"Resource not found"})";
+    return res;
+}
+
+MockTvdbServer::MockTvdbServer(const MockServerConfig& cfg)
+: m_cfg(cfg), m_port(0), m_is_running(false),
+  m_total_connections(0), m_total_requests(0), m_total_not_modified(0), m_total_injected_errors(0),
+  m_total_unauthorized(0)
+{
+    m_tokens = std::make_unique<TokenIssuer>(m_cfg);
+    m_updates = std::make_unique<UpdateLog>();
+}
+
+MockTvdbServer::~MockTvdbServer() {
+    stop();
+}
+
+void MockTvdbServer::mark_series_updated(int id) {
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    m_updates->add(id, std::chrono::duration_cast<std::chrono::seconds>(now).count());
+}
+
+std::string MockTvdbServer::get_base_url() const {
+    return fmt::format("http://127.0.0.1:{}/", m_port);
+}
+
+MockServerStats MockTvdbServer::get_stats() const {
+    MockServerStats stats;
+    stats.total_connections = m_total_connections;
+    stats.total_requests = m_total_requests;
+    stats.total_not_modified = m_total_not_modified;
+    stats.total_injected_errors = m_total_injected_errors;
+    stats.total_unauthorized = m_total_unauthorized;
+    {
+        auto lock = std::scoped_lock(m_tokens->mutex);
+        stats.total_tokens_issued = m_tokens->total_issued;
+    }
+    return stats;
+}
+
+bool MockTvdbServer::start() {
+    if (m_is_running) {
+        return true;
+    }
+
+    #ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return false;
+    }
+    #endif
+
+    const socket_t listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET_VALUE) {
+        return false;
+    }
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // NOTE: Port 0 lets the os pick a free port
+    addr.sin_port = 0;
+    if ((bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0) || (listen(listener, SOMAXCONN) != 0)) {
+        close_socket(listener);
+        return false;
+    }
+
+    socklen_t addr_length = sizeof(addr);
+    if (getsockname(listener, (sockaddr*)&addr, &addr_length) != 0) {
+        close_socket(listener);
+        return false;
+    }
+
+    m_port = ntohs(addr.sin_port);
+    m_listener = std::make_unique<Socket>();
+    m_listener->handle = listener;
+    m_is_running = true;
+    m_accept_thread = std::thread([this]() { run_accept_loop(); });
+    return true;
+}
+
+void MockTvdbServer::stop() {
+    if (!m_is_running.exchange(false)) {
+        return;
+    }
+
+    // NOTE: Shutting down the sockets unblocks the threads waiting on them
+    shutdown_socket(m_listener->handle);
+    close_socket(m_listener->handle);
+    m_accept_thread.join();
+    {
+        auto lock = std::scoped_lock(m_connections_mutex);
+        for (auto* socket: m_connections) {
+            shutdown_socket(socket->handle);
+        }
+    }
+    for (auto& thread: m_connection_threads) {
+        thread.join();
+    }
+    m_connection_threads.clear();
+    m_finished_connections.clear();
+    m_listener = nullptr;
+
+    #ifdef _WIN32
+    WSACleanup();
+    #endif
+}
+
+void MockTvdbServer::run_accept_loop() {
+    // NOTE: An error that keeps happening like running out of file descriptors would otherwise spin
+    constexpr int MIN_BACKOFF_MS = 1;
+    constexpr int MAX_BACKOFF_MS = 250;
+    int backoff_ms = 0;
+    while (m_is_running) {
+        const socket_t client = accept(m_listener->handle, NULL, NULL);
+        reap_connection_threads();
+        if (client == INVALID_SOCKET_VALUE) {
+            if (!m_is_running) {
+                break;
+            }
+            backoff_ms = std::clamp(backoff_ms*2, MIN_BACKOFF_MS, MAX_BACKOFF_MS);
+            std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+            continue;
+        }
+        backoff_ms = 0;
+
+        int flag = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag));
+        #ifdef SO_NOSIGPIPE
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&flag, sizeof(flag));
+        #endif
+        m_total_connections++;
+
+        auto* socket = new Socket();
+        socket->handle = client;
+        {
+            auto lock = std::scoped_lock(m_connections_mutex);
+            if (!m_is_running) {
+                close_socket(client);
+                delete socket;
+                break;
+            }
+            m_connections.insert(socket);
+        }
+        m_connection_threads.emplace_back([this, socket]() { run_connection(socket); });
+    }
+}
+
+// join the threads of connections that have closed so they don't pile up over a long run
+void MockTvdbServer::reap_connection_threads() {
+    std::vector<std::thread::id> finished;
+    {
+        auto lock = std::scoped_lock(m_connections_mutex);
+        finished.swap(m_finished_connections);
+    }
+    if (finished.empty()) {
+        return;
+    }
+    auto it = std::remove_if(m_connection_threads.begin(), m_connection_threads.end(), [&finished](std::thread& thread) {
+        if (std::find(finished.begin(), finished.end(), thread.get_id()) == finished.end()) {
+            return false;
+        }
+        thread.join();
+        return true;
+    });
+    m_connection_threads.erase(it, m_connection_threads.end());
+}
+
+// serve requests on a connection until the client closes it
+void MockTvdbServer::run_connection(Socket* socket) {
+    auto rng = std::mt19937(std::random_device{}());
+    auto probability = std::uniform_real_distribution<float>(0.0f, 1.0f);
+    auto jitter = std::uniform_int_distribution<int>(0, std::max(m_cfg.latency_jitter_ms, 0));
+
+    std::string buffer;
+    char chunk[4096];
+    while (m_is_running) {
+        // read the head of the request
+        size_t head_end = buffer.find("\r\n\r\n");
+        while (head_end == std::string::npos) {
+            const int total_read = int(recv(socket->handle, chunk, sizeof(chunk), 0));
+            if (total_read <= 0) {
+                break;
+            }
+            buffer.append(chunk, size_t(total_read));
+            head_end = buffer.find("\r\n\r\n");
+        }
+        if (head_end == std::string::npos) {
+            break;
+        }
+
+        HttpRequest req;
+        if (!parse_request_head(buffer.substr(0, head_end), req)) {
+            break;
+        }
+        buffer.erase(0, head_end+4);
+
+        // read the body if there is one
+        const size_t content_length = req.headers.count("content-length") ?
+            size_t(strtoull(req.headers["content-length"].c_str(), NULL, 10)) : 0;
+        while (buffer.size() < content_length) {
+            const int total_read = int(recv(socket->handle, chunk, sizeof(chunk), 0));
+            if (total_read <= 0) {
+                break;
+            }
+            buffer.append(chunk, size_t(total_read));
+        }
+        if (buffer.size() < content_length) {
+            break;
+        }
+        req.body = buffer.substr(0, content_length);
+        buffer.erase(0, content_length);
+        m_total_requests++;
+
+        const int latency_ms = std::max(m_cfg.latency_ms, 0) + jitter(rng);
+        if (latency_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+        }
+
+        HttpResponse res;
+        const float roll = probability(rng);
+        if (roll < m_cfg.server_error_rate) {
+            res.status_code = 503;
+            res.body = R"({"Error":"Injected server error"})";
+            m_total_injected_errors++;
+        } else if (roll < (m_cfg.server_error_rate + m_cfg.rate_limit_rate)) {
+            res.status_code = 429;
+            res.body = R"({"Error":"Injected rate limit"})";
+            m_total_injected_errors++;
+        } else {
+            res = handle_request(req, m_cfg, *m_tokens, *m_updates);
+            if (res.status_code == 401) {
+                m_total_unauthorized++;
+            }
+        }
+
+        if (res.status_code == 200) {
+            res.etag = get_etag(res.body);
+            auto match = req.headers.find("if-none-match");
+            if ((match != req.headers.end()) && (match->second == res.etag)) {
+                res.status_code = 304;
+                res.body.clear();
+                m_total_not_modified++;
+            }
+        }
+
+        const bool is_close = req.headers.count("connection") && (to_lower(req.headers["connection"]) == "close");
+        std::string head = fmt::format(
+            "HTTP/1.1 {} {}\r\nContent-Type: application/json\r\nContent-Length: {}\r\nConnection: {}\r\n",
+            res.status_code, get_status_text(res.status_code), res.body.size(), is_close ? "close" : "keep-alive");
+        if (!res.etag.empty()) {
+            head += fmt::format("ETag: {}\r\n", res.etag);
+        }
+        if (res.status_code == 429) {
+            head += "Retry-After: 1\r\n";
+        }
+        head += "\r\n";
+        head += res.body;
+
+        size_t total_sent = 0;
+        while (total_sent < head.size()) {
+            const int n = int(send(socket->handle, head.data() + total_sent, int(head.size() - total_sent), SEND_FLAGS));
+            if (n <= 0) {
+                break;
+            }
+            total_sent += size_t(n);
+        }
+        if ((total_sent < head.size()) || is_close) {
+            break;
+        }
+    }
+
+    {
+        auto lock = std::scoped_lock(m_connections_mutex);
+        m_connections.erase(socket);
+        m_finished_connections.push_back(std::this_thread::get_id());
+    }
+    close_socket(socket->handle);
+    delete socket;
+}
+
+};
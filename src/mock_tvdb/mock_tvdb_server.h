@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <set>
+#include <stdint.h>
+
+namespace mock_tvdb
+{
+
+struct MockServerConfig {
+    // series are generated with ids from 1 to total_series
+    int total_series = 100;
+    int episodes_per_series = 250;
+    int episodes_per_season = 20;
+    // same page size as the real api
+    int page_size = 100;
+    // every response is delayed by the latency plus a random amount up to the jitter
+    int latency_ms = 20;
+    int latency_jitter_ms = 10;
+    // fraction of requests that fail with a 503 or a 429
+    float server_error_rate = 0.0f;
+    float rate_limit_rate = 0.0f;
+    // Recorded responses which are served instead of the generated ones if they exist
+    // The layout follows the request path:
+    // - series/<id>.json
+    // - series/<id>/episodes/<page>.json
+    std::string fixtures_directory;
+    std::string token = "mock-token";
+    // Tokens expire after this long so that refreshing and logging in again can be exercised
+    // Each login or refresh then issues a new token which starts with the one above
+    // NOTE: A lifetime of 0 means the token above never expires
+    int token_lifetime_ms = 0;
+};
+
+struct MockServerStats {
+    uint64_t total_connections = 0;
+    uint64_t total_requests = 0;
+    uint64_t total_not_modified = 0;
+    uint64_t total_injected_errors = 0;
+    uint64_t total_tokens_issued = 0;
+    uint64_t total_unauthorized = 0;
+};
+
+// Local stand in for api.thetvdb.com which serves generated or recorded responses over http
+// Each connection is kept alive and served by its own thread like a real server would
+// NOTE: Responses carry an ETag so conditional requests get a 304 if nothing changed
+class MockTvdbServer
+{
+public:
+    // NOTE: Defined in the source file so that the socket headers are not exposed
+    struct Socket;
+    struct TokenIssuer;
+    struct UpdateLog;
+private:
+    const MockServerConfig m_cfg;
+    std::unique_ptr<TokenIssuer> m_tokens;
+    std::unique_ptr<UpdateLog> m_updates;
+    std::unique_ptr<Socket> m_listener;
+    int m_port;
+    std::atomic<bool> m_is_running;
+    std::thread m_accept_thread;
+    std::vector<std::thread> m_connection_threads;
+    std::set<Socket*> m_connections;
+    // threads of closed connections which are joined by the accept loop
+    std::vector<std::thread::id> m_finished_connections;
+    std::mutex m_connections_mutex;
+    std::atomic<uint64_t> m_total_connections;
+    std::atomic<uint64_t> m_total_requests;
+    std::atomic<uint64_t> m_total_not_modified;
+    std::atomic<uint64_t> m_total_injected_errors;
+    std::atomic<uint64_t> m_total_unauthorized;
+public:
+    MockTvdbServer(const MockServerConfig& cfg={});
+    ~MockTvdbServer();
+    MockTvdbServer(const MockTvdbServer&) = delete;
+    MockTvdbServer(MockTvdbServer&&) = delete;
+    MockTvdbServer& operator=(const MockTvdbServer&) = delete;
+    MockTvdbServer& operator=(MockTvdbServer&&) = delete;
+
+    // listens on a free port of the loopback interface
+    bool start();
+    void stop();
+    int get_port() const { return m_port; }
+    std::string get_base_url() const;
+    MockServerStats get_stats() const;
+    const MockServerConfig& get_config() const { return m_cfg; }
+    // the series is reported by /updated/query from now on and gets a new episode
+    void mark_series_updated(int id);
+private:
+    void run_accept_loop();
+    void run_connection(Socket* socket);
+    void reap_connection_threads();
+};
+
+};
@@ -2,6 +2,14 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <future>
+#include <stdexcept>
+#include <functional>
+#include <chrono>
 
 #include <cpr/cpr.h>
 #include <rapidjson/writer.h>
@@ -14,22 +22,440 @@
 #include <spdlog/spdlog.h>
 
 #include "tvdb_api.h"
+#include "tvdb_http_cache.h"
+#include "tvdb_json.h"
+#include "tvdb_json_sax.h"
+#include "tvdb_http_common.h"
+#include "tvdb_event_loop.h"
+#include "tvdb_authenticator.h"
 #include "util/file_loading.h"
 #include "util/expected.hpp"
-
-// NOTE: HTTPS requires extra work which I don't know how to do
-// #define BASE_URL "https://api.thetvdb.com/"
-#define BASE_URL "http://api.thetvdb.com/"
-constexpr int HTTP_CODE_OK = 200;
-
-cpr::Header create_token_header(const char* token) {
-    return cpr::Header{{"Authorization", "Bearer " + std::string(token)}};
+#include "util/trace.h"
+#include "util/metrics.h"
+#include "util/token_bucket.h"
+
+static std::string get_response_header(const cpr::Response& r, const char* key) {
+    auto res = r.header.find(key);
+    if (res == r.header.end()) {
+        return "";
+    }
+    return res->second;
 }
 
 namespace tvdb_api 
 {
 
-tl::expected<std::string, std::string> login(const char* apikey, const char* userkey, const char* username) {
+struct PooledSession {
+    cpr::Session session;
+    // generation of the authorization header that was last set on the session
+    // NOTE: This is empty if the session has some other header
+    //       A generation of 0 is the header without a token
+    std::optional<uint64_t> header_generation = std::nullopt;
+};
+
+class TvdbClient::SessionPool 
+{
+private:
+    const TvdbClientConfig& m_cfg;
+    std::vector<std::unique_ptr<PooledSession>> m_idle_sessions;
+    std::mutex m_idle_mutex;
+    cpr::Header m_auth_header;
+    uint64_t m_header_generation;
+    std::mutex m_header_mutex;
+    std::shared_ptr<HttpCache> m_http_cache;
+    std::mutex m_http_cache_mutex;
+    util::TokenBucket& m_rate_limiter;
+    // identical requests that are in flight share the response of the first one
+    std::map<std::string, std::shared_future<cpr::Response>> m_inflight_requests;
+    std::mutex m_inflight_mutex;
+    util::metrics::Counter& m_total_created;
+    util::metrics::Counter& m_total_reused;
+    util::metrics::Counter& m_total_cache_hits;
+    util::metrics::Counter& m_total_cache_misses;
+    util::metrics::Counter& m_total_retries;
+    util::metrics::Counter& m_total_shared_requests;
+    util::metrics::Histogram& m_rate_limit_wait;
+    // NOTE: Called when a request gets a 401 so it can be sent again with a new token
+    const std::function<bool (uint64_t)> m_reauthenticate;
+public:
+    SessionPool(const TvdbClientConfig& cfg, util::TokenBucket& rate_limiter, std::function<bool (uint64_t)> reauthenticate)
+    : m_cfg(cfg), m_header_generation(0),
+      m_rate_limiter(rate_limiter),
+      m_total_created(util::metrics::get_counter("tvdb.sessions_created")),
+      m_total_reused(util::metrics::get_counter("tvdb.sessions_reused")),
+      m_total_cache_hits(util::metrics::get_counter("tvdb.http_cache_hits")),
+      m_total_cache_misses(util::metrics::get_counter("tvdb.http_cache_misses")),
+      m_total_retries(util::metrics::get_counter("tvdb.retries")),
+      m_total_shared_requests(util::metrics::get_counter("tvdb.shared_requests")),
+      m_rate_limit_wait(util::metrics::get_histogram("tvdb.rate_limit_wait")),
+      m_reauthenticate(std::move(reauthenticate))
+    {}
+
+    void set_http_cache(std::shared_ptr<HttpCache> cache) {
+        auto lock = std::scoped_lock(m_http_cache_mutex);
+        m_http_cache = std::move(cache);
+    }
+
+    std::shared_ptr<HttpCache> get_http_cache() {
+        auto lock = std::scoped_lock(m_http_cache_mutex);
+        return m_http_cache;
+    }
+
+    void set_token(const std::string& token, uint64_t generation) {
+        auto lock = std::scoped_lock(m_header_mutex);
+        m_auth_header = cpr::Header{{"Authorization", "Bearer " + token}};
+        m_header_generation = generation;
+    }
+
+    // The key identifies the request by its path and parameters
+    // Requests with the same key that are in flight at the same time are only sent once
+    // NOTE: The response is shared so the key must cover everything that changes it
+    //       Requests without a key are not sent again after a 401 since the authenticator uses them
+    cpr::Response get(const std::string& path, const cpr::Parameters& params={}, const std::string& key="", bool is_cacheable=false) {
+        if (key.empty()) {
+            return send_get(path, params, nullptr);
+        }
+
+        std::promise<cpr::Response> promise;
+        {
+            auto lock = std::unique_lock(m_inflight_mutex);
+            auto res = m_inflight_requests.find(key);
+            if (res != m_inflight_requests.end()) {
+                auto future = res->second;
+                lock.unlock();
+                m_total_shared_requests.add();
+                return future.get();
+            }
+            m_inflight_requests.insert({key, promise.get_future().share()});
+        }
+        auto inflight = InflightRequest(*this, key, std::move(promise));
+
+        auto send = [&]() {
+            return is_cacheable ? get_revalidated(path, params, key) : send_get(path, params, nullptr);
+        };
+        try {
+            const uint64_t generation = get_header_generation();
+            auto r = send();
+            if ((r.status_code == HTTP_CODE_UNAUTHORIZED) && m_reauthenticate && m_reauthenticate(generation)) {
+                r = send();
+            }
+            inflight.set_value(r);
+            return r;
+        } catch (...) {
+            inflight.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    cpr::Response post_json(const std::string& path, std::string body) {
+        return send_with_retry([&]() {
+            auto session = acquire();
+            session->session.SetHeader(cpr::Header{{"Content-Type", "application/json"}});
+            session->header_generation = std::nullopt;
+            session->session.SetUrl(cpr::Url(m_cfg.base_url + path));
+            session->session.SetParameters(cpr::Parameters{});
+            session->session.SetBody(cpr::Body(body));
+            auto r = session->session.Post();
+            release(std::move(session));
+            return r;
+        });
+    }
+private:
+    // Owns the key of a request that is in flight so that it is removed and its waiters are woken on every path
+    // NOTE: Removed before the response is shared so that later requests are sent again
+    //       Waiters get an error if the request is abandoned without a response
+    class InflightRequest 
+    {
+    private:
+        SessionPool& m_pool;
+        const std::string& m_key;
+        std::promise<cpr::Response> m_promise;
+        bool m_is_done;
+    public:
+        InflightRequest(SessionPool& pool, const std::string& key, std::promise<cpr::Response>&& promise)
+        : m_pool(pool), m_key(key), m_promise(std::move(promise)), m_is_done(false) {}
+        ~InflightRequest() {
+            if (!m_is_done) {
+                set_exception(std::make_exception_ptr(std::runtime_error("Shared request was abandoned")));
+            }
+        }
+        void set_value(const cpr::Response& r) {
+            erase_key();
+            m_promise.set_value(r);
+        }
+        void set_exception(std::exception_ptr error) {
+            erase_key();
+            m_promise.set_exception(error);
+        }
+        InflightRequest(const InflightRequest&) = delete;
+        InflightRequest(InflightRequest&&) = delete;
+        InflightRequest& operator=(const InflightRequest&) = delete;
+        InflightRequest& operator=(InflightRequest&&) = delete;
+    private:
+        void erase_key() {
+            m_is_done = true;
+            auto lock = std::scoped_lock(m_pool.m_inflight_mutex);
+            m_pool.m_inflight_requests.erase(m_key);
+        }
+    };
+
+    // A response is revalidated against the http cache if there is one
+    // NOTE: A 304 response is returned as a 200 response with the cached body
+    cpr::Response get_revalidated(const std::string& path, const cpr::Parameters& params, const std::string& cache_key) {
+        auto cache = get_http_cache();
+        if (cache == nullptr) {
+            return send_get(path, params, nullptr);
+        }
+
+        auto entry = cache->find(cache_key);
+        if (entry) {
+            auto r = send_get(path, params, &entry.value());
+            if (r.status_code != HTTP_CODE_NOT_MODIFIED) {
+                store_response(*cache, cache_key, r);
+                return r;
+            }
+            auto body_opt = cache->load_body(entry.value());
+            if (body_opt) {
+                m_total_cache_hits.add();
+                r.status_code = HTTP_CODE_OK;
+                r.text = std::move(body_opt.value());
+                return r;
+            }
+            // NOTE: If the body is missing then we need the full response again
+        }
+
+        auto r = send_get(path, params, nullptr);
+        store_response(*cache, cache_key, r);
+        return r;
+    }
+
+    // NOTE: Sessions persist their parameters between requests so they are always reset
+    cpr::Response send_get(const std::string& path, const cpr::Parameters& params, const HttpCacheEntry* entry) {
+        return send_with_retry([&]() {
+            auto session = acquire();
+            if (entry == nullptr) {
+                apply_auth_header(*session);
+            } else {
+                apply_conditional_header(*session, *entry);
+            }
+            session->session.SetUrl(cpr::Url(m_cfg.base_url + path));
+            session->session.SetParameters(params);
+            auto r = session->session.Get();
+            release(std::move(session));
+            return r;
+        });
+    }
+
+    // Every attempt waits for the rate limiter
+    // Rate limited and server errors are retried with an exponential backoff
+    template <typename F>
+    cpr::Response send_with_retry(F&& send) {
+        for (int attempt = 0; ; attempt++) {
+            const auto wait_time = m_rate_limiter.acquire();
+            m_rate_limit_wait.record(std::chrono::duration_cast<std::chrono::microseconds>(wait_time).count());
+            auto r = send();
+            record_response_metrics(r.status_code, r.elapsed, r.text.size());
+            if (!get_is_retryable(r.status_code) || (attempt >= m_cfg.max_retries)) {
+                return r;
+            }
+            m_total_retries.add();
+            std::this_thread::sleep_for(get_retry_delay(m_cfg, attempt, get_response_header(r, "Retry-After")));
+        }
+    }
+
+    void store_response(HttpCache& cache, const std::string& cache_key, const cpr::Response& r) {
+        if (r.status_code != HTTP_CODE_OK) {
+            return;
+        }
+        m_total_cache_misses.add();
+        cache.store(cache_key, get_response_header(r, "ETag"), get_response_header(r, "Last-Modified"), r.text);
+    }
+
+    std::unique_ptr<PooledSession> acquire() {
+        {
+            auto lock = std::scoped_lock(m_idle_mutex);
+            if (!m_idle_sessions.empty()) {
+                auto session = std::move(m_idle_sessions.back());
+                m_idle_sessions.pop_back();
+                m_total_reused.add();
+                return session;
+            }
+        }
+
+        auto session = std::make_unique<PooledSession>();
+        session->session.SetTimeout(cpr::Timeout(m_cfg.timeout_ms));
+        session->session.SetConnectTimeout(cpr::ConnectTimeout(m_cfg.connect_timeout_ms));
+        m_total_created.add();
+        return session;
+    }
+
+    // NOTE: Sessions past the idle limit are closed along with their connection
+    void release(std::unique_ptr<PooledSession> session) {
+        auto lock = std::scoped_lock(m_idle_mutex);
+        if (int(m_idle_sessions.size()) < m_cfg.max_idle_sessions) {
+            m_idle_sessions.push_back(std::move(session));
+        }
+    }
+
+    uint64_t get_header_generation() {
+        auto lock = std::scoped_lock(m_header_mutex);
+        return m_header_generation;
+    }
+
+    // the header is only copied into a session when the token has changed since it was last used
+    // NOTE: A session without a token still has the other headers replaced
+    void apply_auth_header(PooledSession& session) {
+        auto lock = std::scoped_lock(m_header_mutex);
+        if (session.header_generation == m_header_generation) {
+            return;
+        }
+        session.session.SetHeader(m_auth_header);
+        session.header_generation = m_header_generation;
+    }
+
+    // the validators are only sent for this request so the auth header is reapplied afterwards
+    void apply_conditional_header(PooledSession& session, const HttpCacheEntry& entry) {
+        cpr::Header header;
+        {
+            auto lock = std::scoped_lock(m_header_mutex);
+            header = m_auth_header;
+        }
+        if (!entry.etag.empty()) {
+            header["If-None-Match"] = entry.etag;
+        }
+        if (!entry.last_modified.empty()) {
+            header["If-Modified-Since"] = entry.last_modified;
+        }
+        session.session.SetHeader(header);
+        session.header_generation = std::nullopt;
+    }
+};
+
+TvdbClient::TvdbClient(const TvdbClientConfig& cfg)
+: m_cfg(cfg),
+  m_rate_limiter(double(cfg.max_requests_per_second), double(cfg.max_burst_requests))
+{
+    m_token = std::make_shared<const AuthToken>();
+    m_sessions = std::make_unique<SessionPool>(m_cfg, m_rate_limiter, [this](uint64_t generation) {
+        return reauthenticate(generation);
+    });
+    m_event_loop = std::make_unique<EventLoop>(m_cfg, m_rate_limiter, [this](uint64_t generation) {
+        return request_reauthentication(generation);
+    });
+}
+
+// NOTE: The authenticator and event loop are stopped first since they use the rest of the client
+TvdbClient::~TvdbClient() {
+    {
+        auto lock = std::scoped_lock(m_authenticator_mutex);
+        m_authenticator = nullptr;
+    }
+    m_event_loop->stop();
+}
+
+void TvdbClient::set_token(const std::string& token) {
+    auto lock = std::scoped_lock(m_token_write_mutex);
+    auto auth_token = std::make_shared<AuthToken>();
+    auth_token->value = token;
+    auth_token->generation = std::atomic_load(&m_token)->generation + 1;
+    auth_token->acquired_at = std::chrono::steady_clock::now();
+    m_sessions->set_token(token, auth_token->generation);
+    m_event_loop->set_token(token, auth_token->generation);
+    std::atomic_store(&m_token, std::shared_ptr<const AuthToken>(std::move(auth_token)));
+}
+
+std::shared_ptr<const AuthToken> TvdbClient::get_auth_token() const {
+    return std::atomic_load(&m_token);
+}
+
+std::string TvdbClient::get_token() {
+    return get_auth_token()->value;
+}
+
+void TvdbClient::set_http_cache(std::shared_ptr<HttpCache> cache, DiskExecutor disk_executor) {
+    m_sessions->set_http_cache(cache);
+    m_event_loop->set_http_cache(std::move(cache), std::move(disk_executor));
+}
+
+void TvdbClient::stop_async_requests() {
+    m_event_loop->stop();
+}
+
+bool TvdbClient::has_token() {
+    return !get_auth_token()->value.empty();
+}
+
+void TvdbClient::start_authenticator(const TvdbCredentials& credentials, std::function<void (const std::string&)> on_error) {
+    auto lock = std::scoped_lock(m_authenticator_mutex);
+    if (m_authenticator != nullptr) {
+        return;
+    }
+    m_authenticator = std::make_unique<Authenticator>(*this, credentials, std::move(on_error));
+}
+
+// NOTE: The authenticator is never replaced once it is started so it is safe to use outside of the lock
+bool TvdbClient::reauthenticate(uint64_t stale_generation) {
+    Authenticator* authenticator = nullptr;
+    {
+        auto lock = std::scoped_lock(m_authenticator_mutex);
+        authenticator = m_authenticator.get();
+    }
+    if (authenticator == nullptr) {
+        return false;
+    }
+    return authenticator->reauthenticate(stale_generation);
+}
+
+bool TvdbClient::request_reauthentication(uint64_t stale_generation) {
+    Authenticator* authenticator = nullptr;
+    {
+        auto lock = std::scoped_lock(m_authenticator_mutex);
+        authenticator = m_authenticator.get();
+    }
+    if (authenticator == nullptr) {
+        return false;
+    }
+    return authenticator->request_reauthentication(stale_generation);
+}
+
+static tl::expected<SeriesInfo, std::string> parse_series(int status_code, const std::string& body, const char* url) {
+    if (status_code != HTTP_CODE_OK) {
+        auto err = fmt::format("Got invalid http_code for url={}, http_code={}", url, status_code);
+        return tl::make_unexpected<std::string>(std::move(err));
+    }
+
+    auto series_opt = parse_series_response(body.c_str(), body.size());
+    if (!series_opt) {
+        auto err = fmt::format("Got invalid series for url={}: {}", url, series_opt.error());
+        return tl::make_unexpected<std::string>(std::move(err));
+    }
+    return std::move(series_opt.value());
+}
+
+static tl::expected<EpisodesPage, std::string> parse_episodes_page(int status_code, const std::string& body, const char* url, int page) {
+    if (status_code != HTTP_CODE_OK) {
+        auto err = fmt::format("Got invalid http_code for url={}, page={}, http_code={}", url, page, status_code);
+        return tl::make_unexpected<std::string>(std::move(err));
+    }
+
+    auto page_opt = parse_episodes_page_response(body.c_str(), body.size());
+    if (!page_opt) {
+        auto err = fmt::format("Got invalid episodes for url={}, page={}: {}", url, page, page_opt.error());
+        return tl::make_unexpected<std::string>(std::move(err));
+    }
+    return std::move(page_opt.value());
+}
+
+// NOTE: Later pages replace duplicate episodes from earlier pages
+static void add_episodes_page(EpisodesMap& episodes, EpisodesPage& page) {
+    for (auto& ep: page.episodes) {
+        EpisodeKey key {ep.season, ep.episode};
+        episodes[key] = std::move(ep);
+    }
+}
+
+tl::expected<std::string, std::string> TvdbClient::login(const char* apikey, const char* userkey, const char* username) {
+    TRACE_SCOPE("network", "tvdb_api::login");
     rapidjson::StringBuffer sb;
     rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
     writer.StartObject();
@@ -41,11 +467,7 @@ tl::expected<std::string, std::string> login(const char* apikey, const char* use
     writer.String(username);
     writer.EndObject();
 
-    auto r = cpr::Post(
-        cpr::Url(BASE_URL "login"),
-        cpr::Header{{"Content-Type", "application/json"}},
-        cpr::Body(sb.GetString())
-    );
+    auto r = m_sessions->post_json("login", sb.GetString());
 
     if (r.status_code != HTTP_CODE_OK) {
         auto err = fmt::format("Got invalid http_code for url={}, http_code={}", r.url.c_str(), r.status_code);
@@ -69,146 +491,336 @@ tl::expected<std::string, std::string> login(const char* apikey, const char* use
         return tl::make_unexpected<std::string>(std::move(err));
     }
 
-    return doc["token"].GetString();
+    std::string token = doc["token"].GetString();
+    set_token(token);
+    return token;
 }
 
-bool refresh_token(const char* token) {
-    auto r = cpr::Get(
-        cpr::Url(BASE_URL "refresh_token"),
-        create_token_header(token)
-    );
-
-    return (r.status_code == HTTP_CODE_OK);
-}
-
-tl::expected<rapidjson::Document, std::string> search_series(const char* name, const char* token) {
-    auto r = cpr::Get(
-        cpr::Url(BASE_URL "search/series"),
-        create_token_header(token),
-        cpr::Parameters{{"name", name}}
-    );
-
+// NOTE: The api responds with a new token which replaces the current one
+bool TvdbClient::refresh_token() {
+    TRACE_SCOPE("network", "tvdb_api::refresh_token");
+    auto r = m_sessions->get("refresh_token");
     if (r.status_code != HTTP_CODE_OK) {
-        auto err = fmt::format("Got invalid http_code for url={}, http_code={}", r.url.c_str(), r.status_code);
-        return tl::make_unexpected<std::string>(std::move(err));
+        return false;
     }
 
+    // NOTE: A response without a token is a failure so that the authenticator backs off
     rapidjson::Document doc;
     rapidjson::ParseResult ok = doc.Parse(r.text.c_str());
-    if (ok.IsError()) {
-        auto err = fmt::format("Got invalid JSON for url={}, code={}, offset={}", r.url.c_str(), ok.Code(), ok.Offset());
-        return tl::make_unexpected<std::string>(std::move(err));
+    if (ok.IsError() || !doc.IsObject() || !doc.HasMember("token") || !doc["token"].IsString()) {
+        return false;
     }
+    set_token(doc["token"].GetString());
+    return true;
+}
 
-    if (!doc.HasMember("data")) {
-        auto err = fmt::format("Missing field 'data' in url={}", r.url.c_str());
-        return tl::make_unexpected<std::string>(std::move(err));
-    }
+tl::expected<rapidjson::Document, std::string> TvdbClient::search_series(const char* name) {
+    TRACE_SCOPE("network", "tvdb_api::search_series");
+    auto r = m_sessions->get(
+        "search/series", 
+        cpr::Parameters{{"name", name}},
+        fmt::format("search/series?name={}", name)
+    );
+    return parse_data_response(r.status_code, r.text, r.url.c_str());
+}
 
-    doc.Swap(doc["data"]);
-    return doc;
+tl::expected<SeriesInfo, std::string> TvdbClient::get_series(sid_t id) {
+    TRACE_SCOPE("network", "tvdb_api::get_series");
+    const auto path = "series/" + std::to_string(id);
+    auto r = m_sessions->get(path, {}, path, true);
+    return parse_series(r.status_code, r.text, r.url.c_str());
 }
 
-tl::expected<rapidjson::Document, std::string> get_series(sid_t id, const char* token) {
-    auto r = cpr::Get(
-        cpr::Url(BASE_URL "series/" + std::to_string(id)),
-        create_token_header(token)
+// fetch a single page of episodes
+tl::expected<EpisodesPage, std::string> TvdbClient::get_series_episodes_page(sid_t id, int page) {
+    const auto path = "series/" + std::to_string(id) + "/episodes";
+    auto r = m_sessions->get(
+        path,
+        cpr::Parameters{{"page", std::to_string(page)}},
+        fmt::format("{}?page={}", path, page),
+        true
     );
+    return parse_episodes_page(r.status_code, r.text, r.url.c_str(), page);
+}
 
-    if (r.status_code != HTTP_CODE_OK) {
-        auto err = fmt::format("Got invalid http_code for url={}, http_code={}", r.url.c_str(), r.status_code);
-        return tl::make_unexpected<std::string>(std::move(err));
+tl::expected<EpisodesMap, std::string> TvdbClient::get_series_episodes(sid_t id) {
+    TRACE_SCOPE("network", "tvdb_api::get_series_episodes");
+    auto episodes = EpisodesMap();
+
+    // Need first page to get number of pages
+    auto page_1_opt = get_series_episodes_page(id, 1);
+    if (!page_1_opt) {
+        return tl::make_unexpected<std::string>(std::move(page_1_opt.error()));
     }
+    auto& page_1 = page_1_opt.value();
+    add_episodes_page(episodes, page_1);
 
-    rapidjson::Document doc;
-    rapidjson::ParseResult ok = doc.Parse(r.text.c_str());
-    if (ok.IsError()) {
-        auto err = fmt::format("Got invalid JSON for url={}, code={}, offset={}", r.url.c_str(), ok.Code(), ok.Offset());
-        return tl::make_unexpected<std::string>(std::move(err));
+    // NOTE: If we do not have links to the next and last page
+    //       then we assume that this is the only page of episodes data
+    if (!page_1.next_page || !page_1.last_page) {
+        return episodes;
+    }
+    const int next_page = page_1.next_page.value();
+    const int last_page = page_1.last_page.value();
+    if (next_page > last_page) {
+        return episodes;
     }
 
-    if (!doc.HasMember("data")) {
-        auto err = fmt::format("Missing field 'data' in url={}", r.url.c_str());
-        return tl::make_unexpected<std::string>(std::move(err));
+    // Fetch the remaining pages concurrently with a limit on the number of requests in flight
+    // NOTE: Pages are stored by index so they can be added in order once they have all arrived
+    const int total_pages = last_page - next_page + 1;
+    std::vector<tl::expected<EpisodesPage, std::string>> pages(total_pages);
+    std::atomic<int> next_index = 0;
+    std::atomic<bool> is_failed = false;
+    auto fetch_pages = [&]() {
+        int i;
+        while (!is_failed && ((i = next_index++) < total_pages)) {
+            pages[i] = get_series_episodes_page(id, next_page + i);
+            if (!pages[i]) {
+                is_failed = true;
+            }
+        }
+    };
+
+    const int total_workers = std::clamp(m_cfg.max_pages_in_flight, 1, total_pages);
+    std::vector<std::thread> workers;
+    workers.reserve(total_workers-1);
+    for (int i = 0; i < (total_workers-1); i++) {
+        workers.emplace_back(fetch_pages);
+    }
+    // NOTE: The calling thread is one of the workers
+    fetch_pages();
+    for (auto& worker: workers) {
+        worker.join();
     }
 
-    doc.Swap(doc["data"]);
-    return doc;
+    for (int i = 0; i < total_pages; i++) {
+        if (!pages[i]) {
+            return tl::make_unexpected<std::string>(std::move(pages[i].error()));
+        }
+        add_episodes_page(episodes, pages[i].value());
+    }
+
+    return episodes;
 }
 
-tl::expected<rapidjson::Document, std::string> get_series_episodes(sid_t id, const char* token) {
-    // Append additional pages into our super document
-    rapidjson::Document combined_doc;
-    combined_doc.SetArray();
+// NOTE: A request that failed before getting a response has the reason in its error
+static std::string get_transport_error(const AsyncResponse& r) {
+    return fmt::format("Request failed for url={}: {}", r.url, r.error);
+}
 
-    auto add_page = [id, token, &combined_doc](const int page) -> tl::expected<rapidjson::Document, std::string> {
-        // Attempt to get page from url
-        auto r = cpr::Get(
-            cpr::Url(BASE_URL "series/" + std::to_string(id) + "/episodes"),
-            create_token_header(token),
-            cpr::Parameters{{"page", std::to_string(page)}}
-        );
+std::future<tl::expected<rapidjson::Document, std::string>> TvdbClient::search_series_async(const char* name) {
+    using Result = tl::expected<rapidjson::Document, std::string>;
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto future = promise->get_future();
+    m_event_loop->submit(
+        "search/series",
+        QueryParams{{"name", name}},
+        fmt::format("search/series?name={}", name),
+        false,
+        [promise](AsyncResponse& r) {
+            if (!r.error.empty()) {
+                promise->set_value(tl::make_unexpected<std::string>(get_transport_error(r)));
+                return;
+            }
+            promise->set_value(parse_data_response(r.status_code, r.text, r.url.c_str()));
+        }
+    );
+    return future;
+}
 
-        if (r.status_code != HTTP_CODE_OK) {
-            auto err = fmt::format("Got invalid http_code for url={}, page={}, http_code={}", r.url.c_str(), page, r.status_code);
-            return tl::make_unexpected<std::string>(std::move(err));
+std::future<tl::expected<std::vector<SeriesInfo>, std::string>> TvdbClient::search_series_info_async(const char* name) {
+    using Result = tl::expected<std::vector<SeriesInfo>, std::string>;
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto future = promise->get_future();
+    m_event_loop->submit(
+        "search/series",
+        QueryParams{{"name", name}},
+        fmt::format("search/series?name={}", name),
+        false,
+        [promise](AsyncResponse& r) {
+            if (!r.error.empty()) {
+                promise->set_value(tl::make_unexpected<std::string>(get_transport_error(r)));
+                return;
+            }
+            if (r.status_code == HTTP_CODE_NOT_FOUND) {
+                promise->set_value(std::vector<SeriesInfo>{});
+                return;
+            }
+            auto doc_opt = parse_data_response(r.status_code, r.text, r.url.c_str());
+            if (!doc_opt) {
+                promise->set_value(tl::make_unexpected<std::string>(std::move(doc_opt.error())));
+                return;
+            }
+            auto search_opt = load_search_info(doc_opt.value());
+            if (!search_opt) {
+                promise->set_value(tl::make_unexpected<std::string>(search_opt.error()));
+                return;
+            }
+            promise->set_value(std::move(search_opt.value()));
         }
+    );
+    return future;
+}
 
-        // Check if the response was valid json
-        rapidjson::Document doc;
-        rapidjson::ParseResult ok = doc.Parse(r.text.c_str());
-        if (ok.IsError()) {
-            auto err = fmt::format("Got invalid JSON for url={}, page={}, code={}, offset={}", r.url.c_str(), page, ok.Code(), ok.Offset());
-            return tl::make_unexpected<std::string>(std::move(err));
+std::future<tl::expected<std::vector<SeriesUpdate>, std::string>> TvdbClient::get_updated_series_async(int64_t from_time, int64_t to_time) {
+    using Result = tl::expected<std::vector<SeriesUpdate>, std::string>;
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto future = promise->get_future();
+    m_event_loop->submit(
+        "updated/query",
+        QueryParams{{"fromTime", std::to_string(from_time)}, {"toTime", std::to_string(to_time)}},
+        fmt::format("updated/query?fromTime={}&toTime={}", from_time, to_time),
+        false,
+        [promise](AsyncResponse& r) {
+            if (!r.error.empty()) {
+                promise->set_value(tl::make_unexpected<std::string>(get_transport_error(r)));
+                return;
+            }
+            auto doc_opt = parse_data_response(r.status_code, r.text, r.url.c_str());
+            if (!doc_opt) {
+                promise->set_value(tl::make_unexpected<std::string>(std::move(doc_opt.error())));
+                return;
+            }
+            auto updates_opt = load_updated_series(doc_opt.value());
+            if (!updates_opt) {
+                promise->set_value(tl::make_unexpected<std::string>(updates_opt.error()));
+                return;
+            }
+            promise->set_value(std::move(updates_opt.value()));
         }
+    );
+    return future;
+}
+
+std::future<tl::expected<SeriesInfo, std::string>> TvdbClient::get_series_async(sid_t id) {
+    using Result = tl::expected<SeriesInfo, std::string>;
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto future = promise->get_future();
+    get_series_async(id, [promise](Result result) {
+        promise->set_value(std::move(result));
+    });
+    return future;
+}
 
-        if (!doc.HasMember("data")) {
-            auto err = fmt::format("Missing field 'data' in url={}, page={}", r.url.c_str(), page);
-            return tl::make_unexpected<std::string>(std::move(err));
+void TvdbClient::get_series_async(sid_t id, std::function<void (tl::expected<SeriesInfo, std::string>)> callback) {
+    const auto path = "series/" + std::to_string(id);
+    m_event_loop->submit(path, {}, path, true, [callback = std::move(callback)](AsyncResponse& r) {
+        if (!r.error.empty()) {
+            callback(tl::make_unexpected<std::string>(get_transport_error(r)));
+            return;
         }
+        callback(parse_series(r.status_code, r.text, r.url.c_str()));
+    });
+}
 
-        // Append the json data to the combined document
-        auto episodes_data = doc["data"].GetArray();
-        for (auto& ep_data: episodes_data) {
-            rapidjson::Value ep_copy;
-            ep_copy.CopyFrom(ep_data, combined_doc.GetAllocator()) ;
-            combined_doc.PushBack(ep_copy, combined_doc.GetAllocator());
+using EpisodesPageCallback = std::function<void (tl::expected<EpisodesPage, std::string>)>;
+
+static void submit_series_episodes_page(TvdbClient::EventLoop& event_loop, sid_t id, int page, EpisodesPageCallback callback) {
+    const auto path = "series/" + std::to_string(id) + "/episodes";
+    event_loop.submit(
+        path,
+        QueryParams{{"page", std::to_string(page)}},
+        fmt::format("{}?page={}", path, page),
+        true,
+        [page, callback = std::move(callback)](AsyncResponse& r) {
+            if (!r.error.empty()) {
+                callback(tl::make_unexpected<std::string>(get_transport_error(r)));
+                return;
+            }
+            callback(parse_episodes_page(r.status_code, r.text, r.url.c_str(), page));
         }
+    );
+}
 
-        return doc;
-    };
+std::future<tl::expected<EpisodesMap, std::string>> TvdbClient::get_series_episodes_async(sid_t id) {
+    using Result = tl::expected<EpisodesMap, std::string>;
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto future = promise->get_future();
+    get_series_episodes_async(id, [promise](Result result) {
+        promise->set_value(std::move(result));
+    });
+    return future;
+}
 
-    // Need first page to get number of pages
-    auto page_1_doc_opt = add_page(1);
-    if (!page_1_doc_opt) {
-        return tl::make_unexpected<std::string>(std::move(page_1_doc_opt.error()));
-    }
-    auto& page_1_doc = page_1_doc_opt.value();
+// NOTE: Every callback runs on the event loop thread so the request does not need a lock
+struct EpisodesRequest {
+    sid_t id = 0;
+    std::function<void (tl::expected<EpisodesMap, std::string>)> callback;
+    // NOTE: Pages are stored by index so they can be added in order once they have all arrived
+    std::vector<tl::expected<EpisodesPage, std::string>> pages;
+    int first_remaining_page = 0;
+    int next_index = 1;
+    int max_in_flight = 1;
+    int total_in_flight = 0;
+    bool is_failed = false;
+};
 
-    // NOTE: If we do not have links to the next and last page
-    //       then we assume that this is the only page of episodes data
-    if (!page_1_doc.HasMember("links")) {
-        return combined_doc;
-    }
-    auto& links = page_1_doc["links"];
-    if (!links.HasMember("next") || !links["next"].IsInt()) {
-        return combined_doc;
+// NOTE: Pages are added in page order and the first error in page order is returned
+static void complete_series_episodes(EpisodesRequest& request) {
+    auto episodes = EpisodesMap();
+    for (auto& page_opt: request.pages) {
+        if (!page_opt) {
+            request.callback(tl::make_unexpected<std::string>(std::move(page_opt.error())));
+            return;
+        }
+        add_episodes_page(episodes, page_opt.value());
     }
-    if (!links.HasMember("last") || !links["last"].IsInt()) {
-        return combined_doc;
+    request.callback(std::move(episodes));
+}
+
+// The same limit on pages in flight as the blocking requests, the next page is submitted when one arrives
+// NOTE: No more pages are submitted after one fails, the request completes once those in flight arrive
+static void submit_remaining_episodes_pages(TvdbClient::EventLoop& event_loop, const std::shared_ptr<EpisodesRequest>& request) {
+    while (!request->is_failed && (request->total_in_flight < request->max_in_flight) && (request->next_index < int(request->pages.size()))) {
+        const int index = request->next_index++;
+        const int page = request->first_remaining_page + index - 1;
+        request->total_in_flight++;
+        submit_series_episodes_page(event_loop, request->id, page, [&event_loop, request, index](tl::expected<EpisodesPage, std::string> page_opt) {
+            if (!page_opt) {
+                request->is_failed = true;
+            }
+            request->pages[index] = std::move(page_opt);
+            request->total_in_flight--;
+            submit_remaining_episodes_pages(event_loop, request);
+            if (request->total_in_flight == 0) {
+                complete_series_episodes(*request);
+            }
+        });
     }
-    const int next_page = links["next"].GetInt();
-    const int last_page = links["last"].GetInt();
+}
 
-    // Iterate through the pagination list
-    for (int i = next_page; i <= last_page; i++) {
-        auto page_doc_opt = add_page(i);
-        if (!page_doc_opt) {
-            return tl::make_unexpected<std::string>(std::move(page_doc_opt.error()));
+// The remaining pages are submitted once the first page tells us how many there are
+void TvdbClient::get_series_episodes_async(sid_t id, std::function<void (tl::expected<EpisodesMap, std::string>)> callback) {
+    auto request = std::make_shared<EpisodesRequest>();
+    request->id = id;
+    request->callback = std::move(callback);
+
+    auto& event_loop = *m_event_loop;
+    const int max_pages_in_flight = m_cfg.max_pages_in_flight;
+    submit_series_episodes_page(event_loop, id, 1, [&event_loop, request, max_pages_in_flight](tl::expected<EpisodesPage, std::string> page_1_opt) {
+        const bool is_ok = bool(page_1_opt);
+        request->pages.push_back(std::move(page_1_opt));
+        if (!is_ok) {
+            complete_series_episodes(*request);
+            return;
+        }
+
+        // NOTE: If we do not have links to the next and last page
+        //       then we assume that this is the only page of episodes data
+        const auto& page_1 = request->pages[0].value();
+        if (!page_1.next_page || !page_1.last_page || (page_1.next_page.value() > page_1.last_page.value())) {
+            complete_series_episodes(*request);
+            return;
         }
-    }
 
-    return combined_doc;
+        const int next_page = page_1.next_page.value();
+        const int total_pages = page_1.last_page.value() - next_page + 1;
+        request->pages.resize(1 + total_pages);
+        request->first_remaining_page = next_page;
+        request->max_in_flight = std::clamp(max_pages_in_flight, 1, total_pages);
+        submit_remaining_episodes_pages(event_loop, request);
+    });
 }
 
 };
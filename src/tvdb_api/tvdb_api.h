@@ -3,24 +3,154 @@
 #include <string>
 #include <optional>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <chrono>
+#include <stdint.h>
 #include <rapidjson/document.h>
 #include "util/expected.hpp"
+#include "util/token_bucket.h"
+#include "./tvdb_models.h"
 
-namespace tvdb_api 
+namespace tvdb_api
 {
 
 using sid_t = uint32_t;
 
-// Unexpected value is a string containing the error message
-// NOTE: These api calls do not perform any JSON schema validation
-//       That is expected to be done through calls in tvdb_json.h
+constexpr const char* DEFAULT_BASE_URL = "https://api.thetvdb.com/";
+// NOTE: Pages after the first are fetched concurrently and are combined in page order
+constexpr int DEFAULT_MAX_PAGES_IN_FLIGHT = 4;
 
-// Returns an access token
-tl::expected<std::string, std::string> login(const char* apikey, const char* userkey, const char* username);
-bool refresh_token(const char* token);
+struct TvdbClientConfig {
+    std::string base_url = DEFAULT_BASE_URL;
+    // sessions that are kept alive after a request for reuse
+    // NOTE: More sessions than this are created if there are more concurrent requests
+    // NOTE: This is also the limit on connections that the async requests have open at a time
+    int max_idle_sessions = 16;
+    int max_pages_in_flight = DEFAULT_MAX_PAGES_IN_FLIGHT;
+    int timeout_ms = 30000;
+    int connect_timeout_ms = 10000;
+    // NOTE: A rate of 0 disables the rate limiter
+    int max_requests_per_second = 20;
+    int max_burst_requests = 20;
+    // rate limited and server errors are retried with a jittered exponential backoff
+    int max_retries = 4;
+    int retry_base_delay_ms = 250;
+    int retry_max_delay_ms = 8000;
+    // NOTE: A token is valid for 24 hours so it is refreshed well before then
+    int token_refresh_interval_ms = 20*60*60*1000;
+    // failed logins are retried with an exponential backoff while the network is down
+    int auth_retry_base_delay_ms = 1000;
+    int auth_retry_max_delay_ms = 5*60*1000;
+};
 
-tl::expected<rapidjson::Document, std::string> search_series(const char* name, const char* token);
-tl::expected<rapidjson::Document, std::string> get_series(sid_t id, const char* token);
-tl::expected<rapidjson::Document, std::string> get_series_episodes(sid_t id, const char* token);
+struct TvdbCredentials {
+    std::string apikey;
+    std::string userkey;
+    std::string username;
+};
+
+struct AuthToken {
+    std::string value;
+    // increases each time the token is replaced so that a request can tell if its token is stale
+    uint64_t generation = 0;
+    std::chrono::steady_clock::time_point acquired_at;
+};
+
+class HttpCache;
+struct EpisodesPage;
+
+// runs a blocking task such as a read or write of the http cache on another thread
+// NOTE: The executor must run every task it is given
+using DiskExecutor = std::function<void (std::function<void ()>)>;
+
+// Client for the tvdb api which keeps connections alive between requests
+// Each request borrows a session from a pool so it is safe to call from multiple threads
+// Identical requests that are in flight at the same time share a single response
+// NOTE: A session keeps its connection and tls session open after a request
+//       So a reused session skips the tcp and tls handshakes to the api
+// The async requests are driven by a single event loop thread instead of blocking the caller
+class TvdbClient
+{
+public:
+    // NOTE: Defined in the source files so that cpr and curl are not exposed through this header
+    class SessionPool;
+    class EventLoop;
+    class Authenticator;
+private:
+    const TvdbClientConfig m_cfg;
+    // NOTE: Shared by the blocking and async requests so that together they stay under the rate limit
+    util::TokenBucket m_rate_limiter;
+    std::unique_ptr<SessionPool> m_sessions;
+    std::unique_ptr<EventLoop> m_event_loop;
+    // NOTE: Readers use std::atomic_load so they never wait on a token being replaced
+    std::shared_ptr<const AuthToken> m_token;
+    std::mutex m_token_write_mutex;
+    std::unique_ptr<Authenticator> m_authenticator;
+    std::mutex m_authenticator_mutex;
+public:
+    TvdbClient(const TvdbClientConfig& cfg={});
+    ~TvdbClient();
+    TvdbClient(const TvdbClient&) = delete;
+    TvdbClient(TvdbClient&&) = delete;
+    TvdbClient& operator=(const TvdbClient&) = delete;
+    TvdbClient& operator=(TvdbClient&&) = delete;
+
+    const TvdbClientConfig& get_config() const { return m_cfg; }
+    void set_token(const std::string& token);
+    std::shared_ptr<const AuthToken> get_auth_token() const;
+    std::string get_token();
+    bool has_token();
+    // Logs in and keeps the token refreshed from a background thread
+    // Requests that get a 401 wait for a new token and are sent again once
+    // NOTE: The first error of a run of failed attempts is passed to the callback on the background thread
+    void start_authenticator(const TvdbCredentials& credentials, std::function<void (const std::string&)> on_error=nullptr);
+    // series and episodes responses are revalidated against this cache when it is set
+    // NOTE: Pass nullptr to disable the cache
+    //       The async requests read and write the cache through the executor so the event loop never waits on disk
+    //       Without an executor this is done on the event loop thread
+    void set_http_cache(std::shared_ptr<HttpCache> cache, DiskExecutor disk_executor=nullptr);
+    // fails every async request that is in flight and those that are submitted afterwards
+    // NOTE: Call this before destroying anything that the callbacks of async requests use
+    void stop_async_requests();
+
+    // Unexpected value is a string containing the error message
+
+    // Returns an access token which is also used for subsequent requests
+    tl::expected<std::string, std::string> login(const char* apikey, const char* userkey, const char* username);
+    // true once the new token from the response has replaced the current one
+    bool refresh_token();
+
+    // NOTE: Search results are not validated, that is expected to be done through calls in tvdb_json.h
+    tl::expected<rapidjson::Document, std::string> search_series(const char* name);
+    // NOTE: Series and episodes are parsed straight from the response into the models
+    //       The required fields are checked while parsing so there is no separate validation
+    tl::expected<SeriesInfo, std::string> get_series(sid_t id);
+    tl::expected<EpisodesMap, std::string> get_series_episodes(sid_t id);
+
+    // Same as above but the requests are sent without blocking the calling thread
+    // NOTE: The responses are parsed on the event loop thread which then completes the future
+    //       So many requests can be in flight while only a single thread is used
+    std::future<tl::expected<rapidjson::Document, std::string>> search_series_async(const char* name);
+    // NOTE: A search without any results gives an empty list instead of the 404 from the api
+    std::future<tl::expected<std::vector<SeriesInfo>, std::string>> search_series_info_async(const char* name);
+    std::future<tl::expected<SeriesInfo, std::string>> get_series_async(sid_t id);
+    std::future<tl::expected<EpisodesMap, std::string>> get_series_episodes_async(sid_t id);
+    // Same as above but the result is passed to a callback instead of a future
+    // NOTE: The callback is called on the event loop thread so it should not block
+    void get_series_async(sid_t id, std::function<void (tl::expected<SeriesInfo, std::string>)> callback);
+    void get_series_episodes_async(sid_t id, std::function<void (tl::expected<EpisodesMap, std::string>)> callback);
+    // series that were changed between the two unix times in seconds
+    // NOTE: The api only gives up to a week of updates at a time
+    std::future<tl::expected<std::vector<SeriesUpdate>, std::string>> get_updated_series_async(int64_t from_time, int64_t to_time);
+private:
+    tl::expected<EpisodesPage, std::string> get_series_episodes_page(sid_t id, int page);
+    // blocks until the stale token is replaced, returns false if there is no new token
+    bool reauthenticate(uint64_t stale_generation);
+    // returns true if there will be an attempt to replace the stale token
+    bool request_reauthentication(uint64_t stale_generation);
+};
 
 };
\ No newline at end of file
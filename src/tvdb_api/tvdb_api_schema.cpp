@@ -67,7 +67,7 @@ R"({
         "type": "object",
         "properties": {
             "id": { "type": "number", "exclusiveMinimum": 0 },
-            "airedSeason": { "type": "number", "exclusiveMinimum": 0 },
+            "airedSeason": { "type": "number", "minimum": 0 },
             "airedEpisodeNumber": { "type": "number", "exclusiveMinimum": 0 },
             "firstAired": { "type": ["string", "null"] },
             "episodeName": { "type": ["string", "null"] },
@@ -77,7 +77,24 @@ R"({
     }
 })";
 
+// NOTE: The api gives null instead of an empty array if nothing was updated
+const char* UPDATED_DATA_SCHEMA_STR =
+R"({
+    "title": "tvdb updated data",
+    "description": "An array of series that were updated within a time window",
+    "type": ["array", "null"],
+    "items": {
+        "type": "object",
+        "properties": {
+            "id": { "type": "number", "exclusiveMinimum": 0 },
+            "lastUpdated": { "type": "number" }
+        },
+        "required": ["id", "lastUpdated"]
+    }
+})";
+
 rapidjson::SchemaDocument SEARCH_DATA_SCHEMA = load_schema_from_cstr(SEARCH_DATA_SCHEMA_STR);
 rapidjson::SchemaDocument SERIES_DATA_SCHEMA = load_schema_from_cstr(SERIES_DATA_SCHEMA_STR);
 rapidjson::SchemaDocument EPISODES_DATA_SCHEMA = load_schema_from_cstr(EPISODES_DATA_SCHEMA_STR);
+rapidjson::SchemaDocument UPDATED_DATA_SCHEMA = load_schema_from_cstr(UPDATED_DATA_SCHEMA_STR);
 };
\ No newline at end of file
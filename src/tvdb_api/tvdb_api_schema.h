@@ -7,6 +7,7 @@ namespace tvdb_api {
 extern rapidjson::SchemaDocument SEARCH_DATA_SCHEMA;
 extern rapidjson::SchemaDocument SERIES_DATA_SCHEMA;
 extern rapidjson::SchemaDocument EPISODES_DATA_SCHEMA;
+extern rapidjson::SchemaDocument UPDATED_DATA_SCHEMA;
 
 
 }
\ No newline at end of file
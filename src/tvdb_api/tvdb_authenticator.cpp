@@ -0,0 +1,142 @@
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+#include "tvdb_authenticator.h"
+#include "tvdb_event_loop.h"
+#include "util/trace.h"
+#include "util/metrics.h"
+
+namespace tvdb_api
+{
+
+TvdbClient::Authenticator::Authenticator(
+    TvdbClient& client, const TvdbCredentials& credentials,
+    std::function<void (const std::string&)> on_error)
+: m_client(client), m_credentials(credentials), m_on_error(std::move(on_error))
+{
+    m_is_running = true;
+    m_is_reauth_requested = false;
+    m_total_attempts = 0;
+    m_total_failures = 0;
+    m_next_attempt_time = Clock::time_point::min();
+    m_thread = std::thread([this]() { run(); });
+}
+
+TvdbClient::Authenticator::~Authenticator() {
+    {
+        auto lock = std::scoped_lock(m_mutex);
+        m_is_running = false;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+// NOTE: Requests fail straight away with their 401 while the api is unreachable
+bool TvdbClient::Authenticator::get_is_backing_off() const {
+    return Clock::now() < m_next_attempt_time;
+}
+
+bool TvdbClient::Authenticator::reauthenticate(uint64_t stale_generation) {
+    auto lock = std::unique_lock(m_mutex);
+    if (m_client.get_auth_token()->generation != stale_generation) {
+        return true;
+    }
+    if (!m_is_running || get_is_backing_off()) {
+        return false;
+    }
+
+    m_is_reauth_requested = true;
+    m_cv.notify_all();
+    const uint64_t total_attempts = m_total_attempts;
+    m_cv.wait(lock, [this, total_attempts]() {
+        return !m_is_running || (m_total_attempts != total_attempts);
+    });
+    return m_client.get_auth_token()->generation != stale_generation;
+}
+
+bool TvdbClient::Authenticator::request_reauthentication(uint64_t stale_generation) {
+    auto lock = std::scoped_lock(m_mutex);
+    if (!m_is_running || get_is_backing_off()) {
+        return false;
+    }
+    // NOTE: The event loop sends the request again if the token has already been replaced
+    if (m_client.get_auth_token()->generation == stale_generation) {
+        m_is_reauth_requested = true;
+        m_cv.notify_all();
+    }
+    return true;
+}
+
+void TvdbClient::Authenticator::run() {
+    static auto& TOTAL_LOGINS = util::metrics::get_counter("tvdb.logins");
+    static auto& TOTAL_REFRESHES = util::metrics::get_counter("tvdb.token_refreshes");
+    static auto& TOTAL_FAILURES = util::metrics::get_counter("tvdb.auth_failures");
+    const auto& cfg = m_client.m_cfg;
+
+    auto lock = std::unique_lock(m_mutex);
+    while (m_is_running) {
+        const auto token = m_client.get_auth_token();
+        const bool has_token = !token->value.empty();
+        const auto refresh_time = token->acquired_at + std::chrono::milliseconds(cfg.token_refresh_interval_ms);
+        const bool is_due = !has_token || m_is_reauth_requested || (Clock::now() >= refresh_time);
+        const auto next_time = is_due ? m_next_attempt_time : std::max(m_next_attempt_time, refresh_time);
+        if (Clock::now() < next_time) {
+            m_cv.wait_until(lock, next_time);
+            continue;
+        }
+
+        // NOTE: A rejected token cannot be refreshed so we log in again
+        const bool is_refresh = has_token && !m_is_reauth_requested;
+        m_is_reauth_requested = false;
+        lock.unlock();
+
+        bool is_ok = false;
+        std::string error;
+        {
+            TRACE_SCOPE("network", "tvdb_api::authenticate");
+            if (is_refresh) {
+                is_ok = m_client.refresh_token();
+                TOTAL_REFRESHES.add();
+            }
+            if (!is_ok) {
+                auto token_opt = m_client.login(
+                    m_credentials.apikey.c_str(),
+                    m_credentials.userkey.c_str(),
+                    m_credentials.username.c_str());
+                TOTAL_LOGINS.add();
+                is_ok = bool(token_opt);
+                if (!token_opt) {
+                    error = std::move(token_opt.error());
+                }
+            }
+        }
+
+        lock.lock();
+        m_total_attempts++;
+        bool is_first_failure = false;
+        if (is_ok) {
+            m_total_failures = 0;
+            m_next_attempt_time = Clock::time_point::min();
+        } else {
+            TOTAL_FAILURES.add();
+            is_first_failure = (m_total_failures == 0);
+            const int64_t delay_ms = std::min(
+                int64_t(cfg.auth_retry_max_delay_ms),
+                int64_t(cfg.auth_retry_base_delay_ms) << std::min(m_total_failures, 20));
+            m_total_failures++;
+            m_next_attempt_time = Clock::now() + std::chrono::milliseconds(delay_ms);
+        }
+        m_cv.notify_all();
+        lock.unlock();
+
+        // NOTE: Requests that are waiting in the event loop are sent again or failed
+        m_client.m_event_loop->notify_authentication();
+        if (is_first_failure && m_on_error) {
+            m_on_error(error);
+        }
+        lock.lock();
+    }
+}
+
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <stdint.h>
+
+#include "tvdb_api.h"
+
+namespace tvdb_api
+{
+
+// Keeps the token of a client valid from a background thread
+// - Logs in when there is no token
+// - Refreshes the token before it expires and logs in again if that fails
+// - Replaces a token that was rejected with a 401 when a request asks for it
+// NOTE: Failed attempts are retried with a backoff so startup never waits on the network
+class TvdbClient::Authenticator
+{
+public:
+    using Clock = std::chrono::steady_clock;
+private:
+    TvdbClient& m_client;
+    const TvdbCredentials m_credentials;
+    const std::function<void (const std::string&)> m_on_error;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_is_running;
+    bool m_is_reauth_requested;
+    // incremented after every attempt so that waiting requests know when to check the token again
+    uint64_t m_total_attempts;
+    int m_total_failures;
+    Clock::time_point m_next_attempt_time;
+    std::thread m_thread;
+public:
+    Authenticator(TvdbClient& client, const TvdbCredentials& credentials, std::function<void (const std::string&)> on_error);
+    ~Authenticator();
+    Authenticator(const Authenticator&) = delete;
+    Authenticator(Authenticator&&) = delete;
+    Authenticator& operator=(const Authenticator&) = delete;
+    Authenticator& operator=(Authenticator&&) = delete;
+
+    // blocks until the stale token is replaced, returns false if there is no new token
+    bool reauthenticate(uint64_t stale_generation);
+    // returns true if there will be an attempt to replace the stale token
+    // NOTE: The event loop is notified once the attempt has finished
+    bool request_reauthentication(uint64_t stale_generation);
+private:
+    void run();
+    bool get_is_backing_off() const;
+};
+
+};
@@ -0,0 +1,611 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <optional>
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+
+#include <curl/curl.h>
+
+#include "tvdb_event_loop.h"
+#include "tvdb_http_cache.h"
+#include "tvdb_http_common.h"
+#include "util/metrics.h"
+
+namespace tvdb_api
+{
+
+using Clock = std::chrono::steady_clock;
+
+// NOTE: The loop still wakes up this often so a missed wakeup does not stall it
+constexpr int MAX_POLL_TIMEOUT_MS = 1000;
+constexpr const char* SHUTDOWN_ERROR = "Request was cancelled since the tvdb client was shut down";
+
+struct Transfer {
+    std::string key;
+    std::string url;
+    AsyncResponse response;
+    // snapshot of the cache when the request was submitted so a new root does not affect it
+    std::shared_ptr<HttpCache> http_cache;
+    std::optional<HttpCacheEntry> cache_entry;
+    // the read of the cache that the transfer is waiting on
+    enum class CacheRead { NONE, ENTRY, BODY } cache_read = CacheRead::NONE;
+    std::optional<std::string> cache_body;
+    // NOTE: Set if we got a 304 but the cached body was missing
+    bool is_cache_bypassed = false;
+    int attempt = 0;
+    // generation of the token that the request was sent with
+    uint64_t auth_generation = 0;
+    // NOTE: A request is only sent again once after a 401
+    bool is_reauthenticated = false;
+    std::string etag;
+    std::string last_modified;
+    std::string retry_after;
+    curl_slist* headers = nullptr;
+};
+
+// Transfers that are returned to the loop once their read of the cache is done
+// NOTE: Shared with the disk tasks since they can finish after the loop has stopped
+struct CacheResults {
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    CURLM* multi = nullptr;
+    bool is_closed = false;
+    std::mutex mutex;
+
+    void push(std::unique_ptr<Transfer> transfer) {
+        auto lock = std::scoped_lock(mutex);
+        if (is_closed) {
+            return;
+        }
+        transfers.push_back(std::move(transfer));
+        curl_multi_wakeup(multi);
+    }
+};
+
+// NOTE: The transfer is returned even if the task is dropped or throws so its requests aren't left waiting
+struct CacheTask {
+    std::shared_ptr<CacheResults> results;
+    std::unique_ptr<Transfer> transfer;
+    ~CacheTask() {
+        if (transfer) {
+            results->push(std::move(transfer));
+        }
+    }
+};
+
+struct Submission {
+    std::string key;
+    std::string url;
+    bool is_cacheable;
+    AsyncCallback callback;
+};
+
+struct TvdbClient::EventLoop::State {
+    CURLM* multi = nullptr;
+    // easy handles are reused so that their dns and tls session caches are kept
+    std::vector<CURL*> idle_handles;
+    // transfers waiting for the rate limiter or a retry backoff
+    std::multimap<Clock::time_point, std::unique_ptr<Transfer>> scheduled;
+    std::map<CURL*, std::unique_ptr<Transfer>> active;
+    // transfers that got a 401 and are waiting for the token to be replaced
+    std::vector<std::unique_ptr<Transfer>> unauthorized;
+    std::shared_ptr<CacheResults> cache_results = std::make_shared<CacheResults>();
+    // callbacks of every request that shares the transfer with the same key
+    std::map<std::string, std::vector<AsyncCallback>> waiting;
+    // NOTE: This is the only state that is accessed from outside the loop thread
+    std::vector<Submission> submissions;
+    bool is_closed = false;
+    bool is_auth_notified = false;
+    std::mutex submissions_mutex;
+
+    util::metrics::Counter& total_cache_hits = util::metrics::get_counter("tvdb.http_cache_hits");
+    util::metrics::Counter& total_cache_misses = util::metrics::get_counter("tvdb.http_cache_misses");
+    util::metrics::Counter& total_retries = util::metrics::get_counter("tvdb.retries");
+    util::metrics::Counter& total_shared_requests = util::metrics::get_counter("tvdb.shared_requests");
+    util::metrics::Histogram& rate_limit_wait = util::metrics::get_histogram("tvdb.rate_limit_wait");
+};
+
+// passes the response to every request that is waiting on the transfer
+static void complete_transfer(TvdbClient::EventLoop::State& state, Transfer& transfer) {
+    auto waiting = state.waiting.extract(transfer.key);
+    if (waiting.empty()) {
+        return;
+    }
+    auto& callbacks = waiting.mapped();
+    for (size_t i = 0; i < callbacks.size(); i++) {
+        if ((i+1) == callbacks.size()) {
+            callbacks[i](transfer.response);
+        } else {
+            auto shared = transfer.response;
+            callbacks[i](shared);
+        }
+    }
+}
+
+static std::string encode_url_component(const std::string& str) {
+    static const char* HEX = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(str.size());
+    for (const char c: str) {
+        const auto v = static_cast<unsigned char>(c);
+        if (isalnum(v) || (c == '-') || (c == '_') || (c == '.') || (c == '~')) {
+            out.push_back(c);
+        } else {
+            out.push_back('%');
+            out.push_back(HEX[v >> 4]);
+            out.push_back(HEX[v & 0xF]);
+        }
+    }
+    return out;
+}
+
+static size_t write_body(char* data, size_t size, size_t count, void* userdata) {
+    auto& transfer = *static_cast<Transfer*>(userdata);
+    transfer.response.text.append(data, size*count);
+    return size*count;
+}
+
+// NOTE: Headers are only kept from the last response if we were redirected
+static size_t write_header(char* data, size_t size, size_t count, void* userdata) {
+    auto& transfer = *static_cast<Transfer*>(userdata);
+    const size_t length = size*count;
+    auto line = std::string_view(data, length);
+    if (line.rfind("HTTP/", 0) == 0) {
+        transfer.etag.clear();
+        transfer.last_modified.clear();
+        transfer.retry_after.clear();
+        return length;
+    }
+
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return length;
+    }
+    std::string name(line.substr(0, colon));
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return char(tolower(c)); });
+    auto value = line.substr(colon+1);
+    while (!value.empty() && isspace(static_cast<unsigned char>(value.front()))) value.remove_prefix(1);
+    while (!value.empty() && isspace(static_cast<unsigned char>(value.back()))) value.remove_suffix(1);
+
+    if (name == "etag") transfer.etag = value;
+    else if (name == "last-modified") transfer.last_modified = value;
+    else if (name == "retry-after") transfer.retry_after = value;
+    return length;
+}
+
+// NOTE: Global initialisation is not thread safe in older versions of curl so it is only done once
+static void init_curl_global() {
+    static const bool is_init = (curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK);
+    (void)is_init;
+}
+
+TvdbClient::EventLoop::EventLoop(const TvdbClientConfig& cfg, util::TokenBucket& rate_limiter, std::function<bool (uint64_t)> request_reauthentication)
+: m_cfg(cfg), m_auth_generation(0),
+  m_request_reauthentication(std::move(request_reauthentication)),
+  m_rate_limiter(rate_limiter)
+{
+    init_curl_global();
+    m_state = std::make_unique<State>();
+    m_state->multi = curl_multi_init();
+    m_state->cache_results->multi = m_state->multi;
+    const long max_connections = long(std::max(cfg.max_idle_sessions, 1));
+    curl_multi_setopt(m_state->multi, CURLMOPT_MAX_HOST_CONNECTIONS, max_connections);
+    curl_multi_setopt(m_state->multi, CURLMOPT_MAXCONNECTS, max_connections);
+    m_is_running = true;
+    m_thread = std::thread([this]() { run(); });
+}
+
+TvdbClient::EventLoop::~EventLoop() {
+    stop();
+    for (auto* easy: m_state->idle_handles) {
+        curl_easy_cleanup(easy);
+    }
+    curl_multi_cleanup(m_state->multi);
+}
+
+void TvdbClient::EventLoop::stop() {
+    m_is_running = false;
+    curl_multi_wakeup(m_state->multi);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void TvdbClient::EventLoop::set_token(const std::string& token, uint64_t generation) {
+    auto lock = std::scoped_lock(m_auth_header_mutex);
+    m_auth_header = "Authorization: Bearer " + token;
+    m_auth_generation = generation;
+}
+
+std::pair<std::string, uint64_t> TvdbClient::EventLoop::get_auth_header() {
+    auto lock = std::scoped_lock(m_auth_header_mutex);
+    return { m_auth_header, m_auth_generation };
+}
+
+void TvdbClient::EventLoop::notify_authentication() {
+    auto lock = std::scoped_lock(m_state->submissions_mutex);
+    m_state->is_auth_notified = true;
+    curl_multi_wakeup(m_state->multi);
+}
+
+void TvdbClient::EventLoop::set_http_cache(std::shared_ptr<HttpCache> cache, DiskExecutor disk_executor) {
+    auto lock = std::scoped_lock(m_http_cache_mutex);
+    m_http_cache = std::move(cache);
+    m_disk_executor = std::move(disk_executor);
+}
+
+std::shared_ptr<HttpCache> TvdbClient::EventLoop::get_http_cache() {
+    auto lock = std::scoped_lock(m_http_cache_mutex);
+    return m_http_cache;
+}
+
+void TvdbClient::EventLoop::run_disk_task(std::function<void ()> task) {
+    DiskExecutor executor;
+    {
+        auto lock = std::scoped_lock(m_http_cache_mutex);
+        executor = m_disk_executor;
+    }
+    if (executor) {
+        executor(std::move(task));
+    } else {
+        task();
+    }
+}
+
+void TvdbClient::EventLoop::submit(
+    const std::string& path, const QueryParams& params, const std::string& key,
+    bool is_cacheable, AsyncCallback callback)
+{
+    auto url = m_cfg.base_url + path;
+    for (size_t i = 0; i < params.size(); i++) {
+        url.push_back((i == 0) ? '?' : '&');
+        url += encode_url_component(params[i].first);
+        url.push_back('=');
+        url += encode_url_component(params[i].second);
+    }
+
+    {
+        auto lock = std::scoped_lock(m_state->submissions_mutex);
+        if (!m_state->is_closed) {
+            m_state->submissions.push_back({ key, std::move(url), is_cacheable, std::move(callback) });
+            curl_multi_wakeup(m_state->multi);
+            return;
+        }
+    }
+
+    AsyncResponse r;
+    r.url = std::move(url);
+    r.error = SHUTDOWN_ERROR;
+    callback(r);
+}
+
+void TvdbClient::EventLoop::run() {
+    auto& state = *m_state;
+    while (m_is_running) {
+        accept_submissions();
+        release_unauthorized_transfers();
+        read_cache_results();
+        start_scheduled_transfers();
+        int total_running = 0;
+        curl_multi_perform(state.multi, &total_running);
+        // NOTE: Callbacks can submit more requests which wake up the poll below
+        read_completed_transfers();
+
+        int timeout_ms = MAX_POLL_TIMEOUT_MS;
+        if (!state.scheduled.empty()) {
+            const auto delay = state.scheduled.begin()->first - Clock::now();
+            const auto delay_ms = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+            timeout_ms = int(std::clamp(int64_t(delay_ms), int64_t(0), int64_t(MAX_POLL_TIMEOUT_MS)));
+        }
+        curl_multi_poll(state.multi, NULL, 0, timeout_ms, NULL);
+    }
+    fail_remaining_transfers();
+}
+
+// Requests that share a key with one in flight wait on its response instead of being sent
+void TvdbClient::EventLoop::accept_submissions() {
+    auto& state = *m_state;
+    std::vector<Submission> submissions;
+    {
+        auto lock = std::scoped_lock(state.submissions_mutex);
+        submissions.swap(state.submissions);
+    }
+
+    for (auto& submission: submissions) {
+        auto res = state.waiting.find(submission.key);
+        if (res != state.waiting.end()) {
+            state.total_shared_requests.add();
+            res->second.push_back(std::move(submission.callback));
+            continue;
+        }
+        state.waiting[submission.key].push_back(std::move(submission.callback));
+
+        auto transfer = std::make_unique<Transfer>();
+        transfer->key = std::move(submission.key);
+        transfer->url = std::move(submission.url);
+        if (submission.is_cacheable) {
+            transfer->http_cache = get_http_cache();
+        }
+        const auto wait_time = m_rate_limiter.reserve();
+        state.rate_limit_wait.record(std::chrono::duration_cast<std::chrono::microseconds>(wait_time).count());
+        state.scheduled.insert({ Clock::now() + wait_time, std::move(transfer) });
+    }
+}
+
+void TvdbClient::EventLoop::start_scheduled_transfers() {
+    auto& state = *m_state;
+    const auto now = Clock::now();
+    while (!state.scheduled.empty() && (state.scheduled.begin()->first <= now)) {
+        auto transfer = std::move(state.scheduled.begin()->second);
+        state.scheduled.erase(state.scheduled.begin());
+
+        // NOTE: The validators are looked up on every attempt in case another request stored a newer response
+        //       The lookup runs as a disk task and the transfer is scheduled again once it is done
+        const bool is_looked_up = (transfer->cache_read == Transfer::CacheRead::ENTRY);
+        transfer->cache_read = Transfer::CacheRead::NONE;
+        if (!is_looked_up) {
+            transfer->cache_entry = std::nullopt;
+            if ((transfer->http_cache != nullptr) && !transfer->is_cache_bypassed) {
+                transfer->cache_read = Transfer::CacheRead::ENTRY;
+                auto task = std::make_shared<CacheTask>();
+                task->results = state.cache_results;
+                task->transfer = std::move(transfer);
+                run_disk_task([task]() {
+                    auto& transfer = *task->transfer;
+                    transfer.cache_entry = transfer.http_cache->find(transfer.key);
+                });
+                continue;
+            }
+        }
+
+        CURL* easy = NULL;
+        if (!state.idle_handles.empty()) {
+            easy = state.idle_handles.back();
+            state.idle_handles.pop_back();
+            curl_easy_reset(easy);
+        } else {
+            easy = curl_easy_init();
+        }
+
+        auto [auth_header, auth_generation] = get_auth_header();
+        transfer->auth_generation = auth_generation;
+        if (!auth_header.empty()) {
+            transfer->headers = curl_slist_append(transfer->headers, auth_header.c_str());
+        }
+        transfer->headers = curl_slist_append(transfer->headers, "Accept: application/json");
+        if (transfer->cache_entry) {
+            const auto& entry = transfer->cache_entry.value();
+            if (!entry.etag.empty()) {
+                transfer->headers = curl_slist_append(transfer->headers, ("If-None-Match: " + entry.etag).c_str());
+            }
+            if (!entry.last_modified.empty()) {
+                transfer->headers = curl_slist_append(transfer->headers, ("If-Modified-Since: " + entry.last_modified).c_str());
+            }
+        }
+
+        curl_easy_setopt(easy, CURLOPT_URL, transfer->url.c_str());
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->headers);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_body);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer.get());
+        curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, write_header);
+        curl_easy_setopt(easy, CURLOPT_HEADERDATA, transfer.get());
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, long(m_cfg.timeout_ms));
+        curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, long(m_cfg.connect_timeout_ms));
+        curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+
+        curl_multi_add_handle(state.multi, easy);
+        state.active.insert({ easy, std::move(transfer) });
+    }
+}
+
+void TvdbClient::EventLoop::read_completed_transfers() {
+    auto& state = *m_state;
+    CURLMsg* msg = NULL;
+    int total_remaining = 0;
+    while ((msg = curl_multi_info_read(state.multi, &total_remaining)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        CURL* easy = msg->easy_handle;
+        const CURLcode result = msg->data.result;
+        auto res = state.active.find(easy);
+        auto transfer = std::move(res->second);
+        state.active.erase(res);
+
+        long status_code = 0;
+        double elapsed = 0.0;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status_code);
+        curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME, &elapsed);
+        curl_multi_remove_handle(state.multi, easy);
+        state.idle_handles.push_back(easy);
+        curl_slist_free_all(transfer->headers);
+        transfer->headers = nullptr;
+
+        auto& r = transfer->response;
+        r.status_code = (result == CURLE_OK) ? int(status_code) : 0;
+        r.elapsed = elapsed;
+        r.url = transfer->url;
+        if (result != CURLE_OK) {
+            r.error = curl_easy_strerror(result);
+        }
+        record_response_metrics(r.status_code, r.elapsed, r.text.size());
+
+        if ((r.status_code == HTTP_CODE_UNAUTHORIZED) && !transfer->is_reauthenticated) {
+            // NOTE: Requests sent before the first login keep their one chance to be sent again
+            transfer->is_reauthenticated = (transfer->auth_generation != 0);
+            if (get_auth_header().second != transfer->auth_generation) {
+                transfer->response = AsyncResponse{};
+                state.scheduled.insert({ Clock::now() + m_rate_limiter.reserve(), std::move(transfer) });
+                continue;
+            }
+            if (m_request_reauthentication && m_request_reauthentication(transfer->auth_generation)) {
+                state.unauthorized.push_back(std::move(transfer));
+                continue;
+            }
+        }
+
+        // NOTE: The retry is also rate limited by reserving a token when it is scheduled
+        if (get_is_retryable(r.status_code) && (transfer->attempt < m_cfg.max_retries)) {
+            state.total_retries.add();
+            const auto delay = get_retry_delay(m_cfg, transfer->attempt, transfer->retry_after);
+            const auto wait_time = std::max<Clock::duration>(delay, m_rate_limiter.reserve());
+            transfer->attempt++;
+            transfer->response = AsyncResponse{};
+            state.scheduled.insert({ Clock::now() + wait_time, std::move(transfer) });
+            continue;
+        }
+
+        // NOTE: The body is read by a disk task and the transfer is completed once it is done
+        if ((r.status_code == HTTP_CODE_NOT_MODIFIED) && transfer->cache_entry) {
+            transfer->cache_read = Transfer::CacheRead::BODY;
+            auto task = std::make_shared<CacheTask>();
+            task->results = state.cache_results;
+            task->transfer = std::move(transfer);
+            run_disk_task([task]() {
+                auto& transfer = *task->transfer;
+                transfer.cache_body = transfer.http_cache->load_body(transfer.cache_entry.value());
+            });
+            continue;
+        }
+
+        // NOTE: The response is passed on without waiting for it to be stored
+        if ((r.status_code == HTTP_CODE_OK) && (transfer->http_cache != nullptr)) {
+            state.total_cache_misses.add();
+            run_disk_task([cache = transfer->http_cache, key = transfer->key, etag = transfer->etag,
+                           last_modified = transfer->last_modified, body = r.text]() 
+            {
+                cache->store(key, etag, last_modified, body);
+            });
+        }
+
+        complete_transfer(state, *transfer);
+    }
+}
+
+void TvdbClient::EventLoop::read_cache_results() {
+    auto& state = *m_state;
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    {
+        auto lock = std::scoped_lock(state.cache_results->mutex);
+        transfers.swap(state.cache_results->transfers);
+    }
+
+    for (auto& transfer: transfers) {
+        // NOTE: The rate limiter was already reserved when the transfer was scheduled
+        if (transfer->cache_read == Transfer::CacheRead::ENTRY) {
+            state.scheduled.insert({ Clock::now(), std::move(transfer) });
+            continue;
+        }
+
+        transfer->cache_read = Transfer::CacheRead::NONE;
+        auto body_opt = std::move(transfer->cache_body);
+        transfer->cache_body = std::nullopt;
+        if (!body_opt) {
+            // NOTE: If the body is missing then we need the full response again
+            transfer->is_cache_bypassed = true;
+            transfer->response = AsyncResponse{};
+            state.scheduled.insert({ Clock::now() + m_rate_limiter.reserve(), std::move(transfer) });
+            continue;
+        }
+        state.total_cache_hits.add();
+        auto& r = transfer->response;
+        r.status_code = HTTP_CODE_OK;
+        r.text = std::move(body_opt.value());
+        complete_transfer(state, *transfer);
+    }
+}
+
+// NOTE: Checked on every iteration so requests are released soon after an attempt to authenticate
+void TvdbClient::EventLoop::release_unauthorized_transfers() {
+    auto& state = *m_state;
+    {
+        auto lock = std::scoped_lock(state.submissions_mutex);
+        if (!state.is_auth_notified) {
+            return;
+        }
+        state.is_auth_notified = false;
+    }
+
+    const uint64_t generation = get_auth_header().second;
+    auto transfers = std::move(state.unauthorized);
+    state.unauthorized.clear();
+    for (auto& transfer: transfers) {
+        if (transfer->auth_generation == generation) {
+            complete_transfer(state, *transfer);
+            continue;
+        }
+        transfer->response = AsyncResponse{};
+        state.scheduled.insert({ Clock::now() + m_rate_limiter.reserve(), std::move(transfer) });
+    }
+}
+
+// NOTE: Callbacks that submit more requests have them fail straight away since we are closed
+void TvdbClient::EventLoop::fail_remaining_transfers() {
+    auto& state = *m_state;
+    std::vector<Submission> submissions;
+    {
+        auto lock = std::scoped_lock(state.submissions_mutex);
+        state.is_closed = true;
+        submissions.swap(state.submissions);
+    }
+
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    for (auto& [easy, transfer]: state.active) {
+        curl_multi_remove_handle(state.multi, easy);
+        state.idle_handles.push_back(easy);
+        curl_slist_free_all(transfer->headers);
+        transfer->headers = nullptr;
+        transfers.push_back(std::move(transfer));
+    }
+    for (auto& [time, transfer]: state.scheduled) {
+        transfers.push_back(std::move(transfer));
+    }
+    for (auto& transfer: state.unauthorized) {
+        transfers.push_back(std::move(transfer));
+    }
+    // NOTE: Disk tasks that finish after this drop their transfer
+    {
+        auto& cache_results = *state.cache_results;
+        auto lock = std::scoped_lock(cache_results.mutex);
+        cache_results.is_closed = true;
+        for (auto& transfer: cache_results.transfers) {
+            transfers.push_back(std::move(transfer));
+        }
+        cache_results.transfers.clear();
+    }
+    state.active.clear();
+    state.scheduled.clear();
+    state.unauthorized.clear();
+
+    auto fail_waiting = [](std::vector<AsyncCallback>& callbacks, const std::string& url) {
+        for (auto& callback: callbacks) {
+            AsyncResponse r;
+            r.url = url;
+            r.error = SHUTDOWN_ERROR;
+            callback(r);
+        }
+    };
+    for (auto& transfer: transfers) {
+        auto waiting = state.waiting.extract(transfer->key);
+        if (!waiting.empty()) {
+            fail_waiting(waiting.mapped(), transfer->url);
+        }
+    }
+    // requests whose transfer is still held by a disk task
+    while (!state.waiting.empty()) {
+        auto waiting = state.waiting.extract(state.waiting.begin());
+        fail_waiting(waiting.mapped(), waiting.key());
+    }
+    for (auto& submission: submissions) {
+        AsyncResponse r;
+        r.url = std::move(submission.url);
+        r.error = SHUTDOWN_ERROR;
+        submission.callback(r);
+    }
+}
+
+};
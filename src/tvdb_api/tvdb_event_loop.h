@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+#include "tvdb_api.h"
+#include "util/token_bucket.h"
+
+namespace tvdb_api
+{
+
+using QueryParams = std::vector<std::pair<std::string, std::string>>;
+
+struct AsyncResponse {
+    // NOTE: A status code of 0 means the request failed before we got a response
+    int status_code = 0;
+    std::string text;
+    std::string url;
+    double elapsed = 0.0;
+    std::string error;
+};
+
+// NOTE: The callback is called on the event loop thread so it should not block
+using AsyncCallback = std::function<void (AsyncResponse&)>;
+
+// Sends get requests to the api from a single thread using curl multi
+// The same rate limit, retries, revalidation and sharing of identical requests apply as the blocking requests
+// NOTE: Connections are kept alive by curl multi and reused by later requests
+class TvdbClient::EventLoop
+{
+public:
+    // NOTE: Defined in the source file so that curl is not exposed through this header
+    struct State;
+private:
+    const TvdbClientConfig& m_cfg;
+    std::unique_ptr<State> m_state;
+    std::string m_auth_header;
+    uint64_t m_auth_generation;
+    std::mutex m_auth_header_mutex;
+    // NOTE: Called when a request gets a 401 so it can wait for a new token
+    const std::function<bool (uint64_t)> m_request_reauthentication;
+    std::shared_ptr<HttpCache> m_http_cache;
+    DiskExecutor m_disk_executor;
+    std::mutex m_http_cache_mutex;
+    util::TokenBucket& m_rate_limiter;
+    std::atomic<bool> m_is_running;
+    std::thread m_thread;
+public:
+    // NOTE: The rate limiter is shared with the blocking requests
+    EventLoop(const TvdbClientConfig& cfg, util::TokenBucket& rate_limiter, std::function<bool (uint64_t)> request_reauthentication);
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop(EventLoop&&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    EventLoop& operator=(EventLoop&&) = delete;
+
+    void set_token(const std::string& token, uint64_t generation);
+    // requests that got a 401 are sent again if the token was replaced, otherwise they fail with it
+    void notify_authentication();
+    // NOTE: Reads and writes of the cache are run by the executor, or on the loop thread without one
+    void set_http_cache(std::shared_ptr<HttpCache> cache, DiskExecutor disk_executor);
+    // The key identifies the request by its path and parameters
+    // Requests with the same key that are in flight at the same time are only sent once
+    // NOTE: Requests submitted after the loop has stopped fail straight away
+    void submit(const std::string& path, const QueryParams& params, const std::string& key, bool is_cacheable, AsyncCallback callback);
+    // fails every request that is still in flight and waits for the loop to exit
+    void stop();
+private:
+    void run();
+    void accept_submissions();
+    void start_scheduled_transfers();
+    void read_completed_transfers();
+    void read_cache_results();
+    void release_unauthorized_transfers();
+    void fail_remaining_transfers();
+    std::pair<std::string, uint64_t> get_auth_header();
+    std::shared_ptr<HttpCache> get_http_cache();
+    void run_disk_task(std::function<void ()> task);
+};
+
+};
@@ -0,0 +1,257 @@
+#include "tvdb_http_cache.h"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <optional>
+#include <vector>
+#include <unordered_set>
+#include <string.h>
+#include <fmt/core.h>
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+
+#include "util/trace.h"
+
+namespace fs = std::filesystem;
+
+constexpr const char* ENTRY_EXTENSION = ".entry.json";
+constexpr const char* BODY_EXTENSION = ".body";
+constexpr const char* TEMP_EXTENSION = ".tmp";
+// bodies with the same hash but different contents are stored as hash-1, hash-2, ...
+constexpr int MAX_BODY_COLLISIONS = 16;
+
+// 64bit fnv-1a which is used to name entries and bodies
+static uint64_t get_fnv1a_hash(const std::string& str) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char c: str) {
+        hash ^= uint64_t(uint8_t(c));
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static std::string get_hash_string(uint64_t hash) {
+    return fmt::format("{:016x}", hash);
+}
+
+static std::string get_hash_string(const std::string& str) {
+    return get_hash_string(get_fnv1a_hash(str));
+}
+
+static std::string get_body_name(uint64_t hash, int collision) {
+    if (collision == 0) {
+        return get_hash_string(hash);
+    }
+    return fmt::format("{}-{}", get_hash_string(hash), collision);
+}
+
+static std::optional<std::string> read_file(const fs::path& path) {
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+static bool write_file_atomic(const fs::path& path, const std::string& data) {
+    auto tmp_path = path;
+    tmp_path += TEMP_EXTENSION;
+    {
+        auto file = std::ofstream(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file.write(data.data(), std::streamsize(data.size()));
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        fs::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+static bool get_has_suffix(const std::string& str, const char* suffix) {
+    const size_t length = strlen(suffix);
+    return (str.size() >= length) && (str.compare(str.size()-length, length, suffix) == 0);
+}
+
+namespace tvdb_api
+{
+
+HttpCache::HttpCache(const fs::path& directory)
+: m_directory(directory)
+{}
+
+std::optional<HttpCacheEntry> HttpCache::find(const std::string& key) {
+    TRACE_SCOPE("disk", "HttpCache::find");
+    auto entry_opt = load_entry(m_directory / (get_hash_string(key) + ENTRY_EXTENSION));
+    // NOTE: The key is stored so that a hash collision is treated as a miss
+    if (!entry_opt || (entry_opt->key != key)) {
+        return std::nullopt;
+    }
+    return entry_opt->entry;
+}
+
+std::optional<HttpCache::StoredEntry> HttpCache::load_entry(const fs::path& entry_path) {
+    auto data_opt = read_file(entry_path);
+    if (!data_opt) {
+        return std::nullopt;
+    }
+
+    rapidjson::Document doc;
+    rapidjson::ParseResult ok = doc.Parse(data_opt.value().c_str());
+    if (ok.IsError() || !doc.IsObject()) {
+        return std::nullopt;
+    }
+
+    if (!doc.HasMember("key") || !doc["key"].IsString()) {
+        return std::nullopt;
+    }
+    if (!doc.HasMember("body") || !doc["body"].IsString()) {
+        return std::nullopt;
+    }
+    if (!doc.HasMember("hash") || !doc["hash"].IsUint64()) {
+        return std::nullopt;
+    }
+    if (!doc.HasMember("size") || !doc["size"].IsUint64()) {
+        return std::nullopt;
+    }
+
+    StoredEntry stored;
+    stored.key = doc["key"].GetString();
+    auto& entry = stored.entry;
+    entry.body_name = doc["body"].GetString();
+    entry.body_hash = doc["hash"].GetUint64();
+    entry.body_size = size_t(doc["size"].GetUint64());
+    if (doc.HasMember("etag") && doc["etag"].IsString()) {
+        entry.etag = doc["etag"].GetString();
+    }
+    if (doc.HasMember("last_modified") && doc["last_modified"].IsString()) {
+        entry.last_modified = doc["last_modified"].GetString();
+    }
+    return stored;
+}
+
+std::optional<std::string> HttpCache::load_body(const HttpCacheEntry& entry) {
+    TRACE_SCOPE("disk", "HttpCache::load_body");
+    auto body_opt = read_file(m_directory / (entry.body_name + BODY_EXTENSION));
+    if (!body_opt || (body_opt.value().size() != entry.body_size)) {
+        return std::nullopt;
+    }
+    if (get_fnv1a_hash(body_opt.value()) != entry.body_hash) {
+        return std::nullopt;
+    }
+    return body_opt;
+}
+
+bool HttpCache::store(const std::string& key, const std::string& etag, const std::string& last_modified, const std::string& body) {
+    TRACE_SCOPE("disk", "HttpCache::store");
+    if (etag.empty() && last_modified.empty()) {
+        return false;
+    }
+
+    const uint64_t body_hash = get_fnv1a_hash(body);
+    auto lock = std::scoped_lock(m_write_mutex);
+    std::error_code ec;
+    fs::create_directories(m_directory, ec);
+    if (ec) {
+        return false;
+    }
+
+    // NOTE: The body is written before the entry that refers to it
+    //       An existing body with the same hash is only shared if its contents are the same
+    std::optional<std::string> body_name = std::nullopt;
+    for (int collision = 0; collision < MAX_BODY_COLLISIONS; collision++) {
+        auto name = get_body_name(body_hash, collision);
+        const auto body_path = m_directory / (name + BODY_EXTENSION);
+        auto existing_opt = read_file(body_path);
+        if (existing_opt && (existing_opt.value() == body)) {
+            body_name = std::move(name);
+            break;
+        }
+        if (!existing_opt) {
+            if (!write_file_atomic(body_path, body)) {
+                return false;
+            }
+            body_name = std::move(name);
+            break;
+        }
+    }
+    if (!body_name) {
+        return false;
+    }
+
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    writer.StartObject();
+    writer.Key("key");
+    writer.String(key.c_str());
+    writer.Key("etag");
+    writer.String(etag.c_str());
+    writer.Key("last_modified");
+    writer.String(last_modified.c_str());
+    writer.Key("body");
+    writer.String(body_name.value().c_str());
+    writer.Key("hash");
+    writer.Uint64(body_hash);
+    writer.Key("size");
+    writer.Uint64(uint64_t(body.size()));
+    writer.EndObject();
+
+    const auto entry_path = m_directory / (get_hash_string(key) + ENTRY_EXTENSION);
+    return write_file_atomic(entry_path, sb.GetString());
+}
+
+// NOTE: Stores wait for the collection so a new body is never deleted before its entry is written
+size_t HttpCache::collect_garbage() {
+    TRACE_SCOPE("disk", "HttpCache::collect_garbage");
+    auto lock = std::scoped_lock(m_write_mutex);
+    std::error_code ec;
+    if (!fs::is_directory(m_directory, ec)) {
+        return 0;
+    }
+
+    // NOTE: An entry that can't be read doesn't keep its body alive since it will never be used
+    std::unordered_set<std::string> used_bodies;
+    std::vector<fs::path> bodies;
+    std::vector<fs::path> stale_files;
+    for (auto& file: fs::directory_iterator(m_directory, ec)) {
+        const auto filename = file.path().filename().string();
+        if (get_has_suffix(filename, ENTRY_EXTENSION)) {
+            auto entry_opt = load_entry(file.path());
+            if (entry_opt) {
+                used_bodies.insert(entry_opt->entry.body_name + BODY_EXTENSION);
+            }
+        } else if (get_has_suffix(filename, BODY_EXTENSION)) {
+            bodies.push_back(file.path());
+        } else if (get_has_suffix(filename, TEMP_EXTENSION)) {
+            stale_files.push_back(file.path());
+        }
+    }
+    for (auto& body: bodies) {
+        if (used_bodies.find(body.filename().string()) == used_bodies.end()) {
+            stale_files.push_back(body);
+        }
+    }
+
+    size_t total_removed = 0;
+    for (auto& path: stale_files) {
+        if (fs::remove(path, ec)) {
+            total_removed++;
+        }
+    }
+    return total_removed;
+}
+
+};
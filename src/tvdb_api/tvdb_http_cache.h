@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <optional>
+#include <filesystem>
+#include <mutex>
+
+namespace tvdb_api
+{
+
+// validators of a cached response which are sent with a conditional request
+struct HttpCacheEntry {
+    std::string etag;
+    std::string last_modified;
+    // name of the body file which is the hash of its contents
+    // NOTE: A body whose hash collides with a different body gets a numbered suffix
+    std::string body_name;
+    uint64_t body_hash = 0;
+    size_t body_size = 0;
+};
+
+// On disk cache of api responses which are revalidated with conditional requests
+// Each request has a small entry file containing its validators
+// The bodies are stored by the hash of their contents so identical responses share a file
+// NOTE: Files are written to a temporary path and renamed so that readers never see a partial file
+//       Bodies are compared before they are shared so a hash collision never serves the wrong body
+class HttpCache
+{
+private:
+    const std::filesystem::path m_directory;
+    std::mutex m_write_mutex;
+public:
+    HttpCache(const std::filesystem::path& directory);
+    HttpCache(const HttpCache&) = delete;
+    HttpCache(HttpCache&&) = delete;
+    HttpCache& operator=(const HttpCache&) = delete;
+    HttpCache& operator=(HttpCache&&) = delete;
+
+    const std::filesystem::path& get_directory() const { return m_directory; }
+    // key is the request path with its parameters
+    std::optional<HttpCacheEntry> find(const std::string& key);
+    std::optional<std::string> load_body(const HttpCacheEntry& entry);
+    // NOTE: Responses without any validators are not stored since they can't be revalidated
+    bool store(const std::string& key, const std::string& etag, const std::string& last_modified, const std::string& body);
+    // delete bodies that no entry refers to and temporary files left by an interrupted write
+    // returns the number of files that were deleted
+    size_t collect_garbage();
+private:
+    struct StoredEntry {
+        std::string key;
+        HttpCacheEntry entry;
+    };
+    std::optional<StoredEntry> load_entry(const std::filesystem::path& entry_path);
+};
+
+};
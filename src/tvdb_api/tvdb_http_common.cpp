@@ -0,0 +1,74 @@
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+
+#include <rapidjson/document.h>
+#include <fmt/core.h>
+
+#include "tvdb_http_common.h"
+#include "tvdb_api.h"
+#include "util/expected.hpp"
+#include "util/metrics.h"
+
+namespace tvdb_api
+{
+
+void record_response_metrics(int status_code, double elapsed_seconds, size_t body_size) {
+    static auto& TOTAL_REQUESTS = util::metrics::get_counter("tvdb.requests");
+    static auto& TOTAL_FAILED_REQUESTS = util::metrics::get_counter("tvdb.failed_requests");
+    static auto& TOTAL_JSON_BYTES = util::metrics::get_counter("json.bytes_parsed");
+    static auto& REQUEST_LATENCY = util::metrics::get_histogram("tvdb.request_latency");
+    TOTAL_REQUESTS.add();
+    REQUEST_LATENCY.record(int64_t(elapsed_seconds * 1e6));
+    if (status_code == HTTP_CODE_OK) {
+        TOTAL_JSON_BYTES.add(int64_t(body_size));
+    } else if (status_code != HTTP_CODE_NOT_MODIFIED) {
+        TOTAL_FAILED_REQUESTS.add();
+    }
+}
+
+bool get_is_retryable(int status_code) {
+    return (status_code == 0) ||
+           (status_code == HTTP_CODE_TOO_MANY_REQUESTS) ||
+           (status_code >= HTTP_CODE_SERVER_ERROR);
+}
+
+std::chrono::milliseconds get_retry_delay(const TvdbClientConfig& cfg, int attempt, const std::string& retry_after) {
+    static thread_local auto rng = std::mt19937(std::random_device{}());
+    const int64_t max_delay_ms = std::min(
+        int64_t(cfg.retry_max_delay_ms),
+        int64_t(cfg.retry_base_delay_ms) << std::min(attempt, 20));
+    auto dist = std::uniform_int_distribution<int64_t>(0, std::max(max_delay_ms, int64_t(0)));
+    int64_t delay_ms = dist(rng);
+
+    if (!retry_after.empty()) {
+        const int64_t retry_after_ms = int64_t(std::atoi(retry_after.c_str())) * 1000;
+        delay_ms = std::max(delay_ms, std::min(retry_after_ms, int64_t(cfg.retry_max_delay_ms)));
+    }
+    return std::chrono::milliseconds(delay_ms);
+}
+
+tl::expected<rapidjson::Document, std::string> parse_data_response(int status_code, const std::string& body, const char* url) {
+    if (status_code != HTTP_CODE_OK) {
+        auto err = fmt::format("Got invalid http_code for url={}, http_code={}", url, status_code);
+        return tl::make_unexpected<std::string>(std::move(err));
+    }
+
+    rapidjson::Document doc;
+    rapidjson::ParseResult ok = doc.Parse(body.c_str());
+    if (ok.IsError()) {
+        auto err = fmt::format("Got invalid JSON for url={}, code={}, offset={}", url, ok.Code(), ok.Offset());
+        return tl::make_unexpected<std::string>(std::move(err));
+    }
+
+    if (!doc.HasMember("data")) {
+        auto err = fmt::format("Missing field 'data' in url={}", url);
+        return tl::make_unexpected<std::string>(std::move(err));
+    }
+
+    doc.Swap(doc["data"]);
+    return doc;
+}
+
+};
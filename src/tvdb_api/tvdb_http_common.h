@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <stddef.h>
+#include <rapidjson/document.h>
+#include "util/expected.hpp"
+
+// Helpers that are shared by the blocking and asynchronous requests of the tvdb client
+namespace tvdb_api
+{
+
+struct TvdbClientConfig;
+
+constexpr int HTTP_CODE_OK = 200;
+constexpr int HTTP_CODE_NOT_MODIFIED = 304;
+constexpr int HTTP_CODE_UNAUTHORIZED = 401;
+constexpr int HTTP_CODE_NOT_FOUND = 404;
+constexpr int HTTP_CODE_TOO_MANY_REQUESTS = 429;
+constexpr int HTTP_CODE_SERVER_ERROR = 500;
+
+// record every response from the api so latency and failure rate are visible
+void record_response_metrics(int status_code, double elapsed_seconds, size_t body_size);
+// NOTE: A status code of 0 means the request failed before we got a response
+bool get_is_retryable(int status_code);
+// NOTE: The delay is picked at random up to the backoff so that retries from many requests are spread out
+//       The server can ask for a longer delay through the Retry-After header
+std::chrono::milliseconds get_retry_delay(const TvdbClientConfig& cfg, int attempt, const std::string& retry_after);
+// parse the json body of a response whose payload is in the data field
+tl::expected<rapidjson::Document, std::string> parse_data_response(int status_code, const std::string& body, const char* url);
+
+};
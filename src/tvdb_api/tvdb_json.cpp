@@ -1,10 +1,14 @@
 #include "tvdb_json.h"
 #include "tvdb_models.h"
 #include <vector>
+#include <algorithm>
 #include <rapidjson/document.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
 
 #include "tvdb_api_schema.h"
 #include "util/file_loading.h"
+#include "util/trace.h"
 
 static 
 const char* get_string_default(const rapidjson::Value& v) {
@@ -16,6 +20,7 @@ namespace tvdb_api
 
 // NOTE: Refer to tvdb_api_schema.cpp for schemas
 tl::expected<SeriesInfo, const char*> load_series_info(const rapidjson::Document& doc) {
+    TRACE_SCOPE("parse", "load_series_info");
     if (!util::validate_document(doc, tvdb_api::SERIES_DATA_SCHEMA)) {
         return tl::make_unexpected<const char*>("Failed to validate series data");
     }
@@ -39,6 +44,7 @@ tl::expected<SeriesInfo, const char*> load_series_info(const rapidjson::Document
 
 // NOTE: Refer to tvdb_api_schema.cpp for schemas
 tl::expected<EpisodesMap, const char*> load_series_episodes_info(const rapidjson::Document& doc) {
+    TRACE_SCOPE("parse", "load_series_episodes_info");
     if (!util::validate_document(doc, tvdb_api::EPISODES_DATA_SCHEMA)) {
         return tl::make_unexpected<const char*>("Failed to validate episodes data");
     }
@@ -65,6 +71,7 @@ tl::expected<EpisodesMap, const char*> load_series_episodes_info(const rapidjson
 
 // NOTE: Refer to tvdb_api_schema.cpp for schemas
 tl::expected<std::vector<SeriesInfo>, const char*> load_search_info(const rapidjson::Document& doc) {
+    TRACE_SCOPE("parse", "load_search_info");
     if (!util::validate_document(doc, tvdb_api::SEARCH_DATA_SCHEMA)) {
         return tl::make_unexpected<const char*>("Failed to validate series search data");
     }
@@ -84,4 +91,85 @@ tl::expected<std::vector<SeriesInfo>, const char*> load_search_info(const rapidj
     return series;
 }
 
+tl::expected<std::vector<SeriesUpdate>, const char*> load_updated_series(const rapidjson::Document& doc) {
+    TRACE_SCOPE("parse", "load_updated_series");
+    if (!util::validate_document(doc, tvdb_api::UPDATED_DATA_SCHEMA)) {
+        return tl::make_unexpected<const char*>("Failed to validate updated series data");
+    }
+
+    auto updates = std::vector<SeriesUpdate>();
+    if (doc.IsNull()) {
+        return updates;
+    }
+
+    auto data = doc.GetArray();
+    updates.reserve(data.Size());
+    for (auto& u: data) {
+        auto& o = updates.emplace_back();
+        o.id = u["id"].GetUint();
+        o.last_updated = u["lastUpdated"].GetInt64();
+    }
+    return updates;
+}
+
+// NOTE: Refer to tvdb_api_schema.cpp for schemas
+std::string json_stringify_series_info(const SeriesInfo& series) {
+    rapidjson::StringBuffer sb;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+    writer.SetIndent(' ', 1);
+    writer.StartObject();
+    writer.Key("id");
+    writer.Uint(series.id);
+    writer.Key("seriesName");
+    writer.String(series.name.c_str());
+    writer.Key("firstAired");
+    writer.String(series.air_date.c_str());
+    writer.Key("status");
+    writer.String(series.status.c_str());
+    if (series.overview) {
+        writer.Key("overview");
+        writer.String(series.overview.value().c_str());
+    }
+    writer.EndObject();
+    return sb.GetString();
+}
+
+// NOTE: Episodes are written in order so that the file is the same for the same episodes
+std::string json_stringify_episodes_info(const EpisodesMap& episodes) {
+    std::vector<const EpisodeInfo*> sorted_episodes;
+    sorted_episodes.reserve(episodes.size());
+    for (auto& [key, ep]: episodes) {
+        sorted_episodes.push_back(&ep);
+    }
+    std::sort(sorted_episodes.begin(), sorted_episodes.end(), [](const EpisodeInfo* a, const EpisodeInfo* b) {
+        if (a->season != b->season) return a->season < b->season;
+        return a->episode < b->episode;
+    });
+
+    rapidjson::StringBuffer sb;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+    writer.SetIndent(' ', 1);
+    writer.StartArray();
+    for (auto* ep: sorted_episodes) {
+        writer.StartObject();
+        writer.Key("id");
+        writer.Uint(ep->id);
+        writer.Key("airedSeason");
+        writer.Int(ep->season);
+        writer.Key("airedEpisodeNumber");
+        writer.Int(ep->episode);
+        writer.Key("firstAired");
+        writer.String(ep->air_date.c_str());
+        writer.Key("episodeName");
+        writer.String(ep->name.c_str());
+        if (ep->overview) {
+            writer.Key("overview");
+            writer.String(ep->overview.value().c_str());
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+    return sb.GetString();
+}
+
 }
\ No newline at end of file
@@ -12,5 +12,10 @@ namespace tvdb_api {
 tl::expected<SeriesInfo, const char*> load_series_info(const rapidjson::Document& doc);
 tl::expected<EpisodesMap, const char*> load_series_episodes_info(const rapidjson::Document& doc);
 tl::expected<std::vector<SeriesInfo>, const char*> load_search_info(const rapidjson::Document& doc);
+tl::expected<std::vector<SeriesUpdate>, const char*> load_updated_series(const rapidjson::Document& doc);
+
+// write models in the same format that they are loaded from
+std::string json_stringify_series_info(const SeriesInfo& series);
+std::string json_stringify_episodes_info(const EpisodesMap& episodes);
 
 }
\ No newline at end of file
@@ -0,0 +1,350 @@
+#include "tvdb_json_sax.h"
+#include "tvdb_models.h"
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <string.h>
+#include <stdint.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/error/en.h>
+#include <fmt/core.h>
+
+#include "util/trace.h"
+
+namespace tvdb_api {
+
+// A value that is stored into a field of a model
+// NOTE: Nested objects and arrays are reported as a separate type so they can be rejected
+struct JsonScalar {
+    enum class Type { NULL_VALUE, BOOL, INTEGER, NUMBER, STRING, NESTED } type;
+    int64_t integer = 0;
+    const char* str = nullptr;
+    size_t length = 0;
+};
+
+// Each record type sets its fields from the scalars and checks its required fields once it has ended
+// Record must provide:
+// - int get_field(const char* key, size_t length) which returns -1 for ignored fields
+// - const char* set_field(int field, const JsonScalar& v) which returns an error or nullptr
+// - const char* finish() which returns an error or nullptr
+struct EpisodeRecord {
+    enum Field { ID=0, SEASON, EPISODE, AIR_DATE, NAME, OVERVIEW };
+    static constexpr uint32_t REQUIRED_FIELDS = (1u<<ID) | (1u<<SEASON) | (1u<<EPISODE) | (1u<<AIR_DATE) | (1u<<NAME);
+    EpisodeInfo info;
+    uint32_t present_fields = 0;
+
+    static int get_field(const char* key, size_t length) {
+        if (strncmp(key, "id", length+1) == 0) return ID;
+        if (strncmp(key, "airedSeason", length+1) == 0) return SEASON;
+        if (strncmp(key, "airedEpisodeNumber", length+1) == 0) return EPISODE;
+        if (strncmp(key, "firstAired", length+1) == 0) return AIR_DATE;
+        if (strncmp(key, "episodeName", length+1) == 0) return NAME;
+        if (strncmp(key, "overview", length+1) == 0) return OVERVIEW;
+        return -1;
+    }
+
+    const char* set_field(int field, const JsonScalar& v) {
+        present_fields |= (1u << field);
+        const bool is_positive_integer = (v.type == JsonScalar::Type::INTEGER) && (v.integer > 0);
+        const bool is_integer = (v.type == JsonScalar::Type::INTEGER) && (v.integer <= int64_t(INT32_MAX));
+        // NOTE: Optional strings are stored as empty strings if they are null
+        const bool is_nullable_string = (v.type == JsonScalar::Type::STRING) || (v.type == JsonScalar::Type::NULL_VALUE);
+        auto get_string = [&v]() {
+            return (v.type == JsonScalar::Type::STRING) ? std::string(v.str, v.length) : std::string();
+        };
+        switch (field) {
+        case ID:
+            if (!is_positive_integer || (v.integer > int64_t(UINT32_MAX))) return "Episode field 'id' must be a positive integer";
+            info.id = uint32_t(v.integer);
+            return nullptr;
+        case SEASON:
+            // NOTE: Specials are listed under season 0
+            if (!is_integer || (v.integer < 0)) return "Episode field 'airedSeason' must be a non-negative integer";
+            info.season = int(v.integer);
+            return nullptr;
+        case EPISODE:
+            if (!is_positive_integer || !is_integer) return "Episode field 'airedEpisodeNumber' must be a positive integer";
+            info.episode = int(v.integer);
+            return nullptr;
+        case AIR_DATE:
+            if (!is_nullable_string) return "Episode field 'firstAired' must be a string or null";
+            info.air_date = get_string();
+            return nullptr;
+        case NAME:
+            if (!is_nullable_string) return "Episode field 'episodeName' must be a string or null";
+            info.name = get_string();
+            return nullptr;
+        case OVERVIEW:
+            if (!is_nullable_string) return "Episode field 'overview' must be a string or null";
+            info.overview = get_string();
+            return nullptr;
+        }
+        return nullptr;
+    }
+
+    const char* finish() const {
+        if ((present_fields & REQUIRED_FIELDS) != REQUIRED_FIELDS) {
+            return "Episode is missing a required field";
+        }
+        return nullptr;
+    }
+};
+
+struct SeriesRecord {
+    enum Field { ID=0, NAME, AIR_DATE, STATUS, OVERVIEW };
+    static constexpr uint32_t REQUIRED_FIELDS = (1u<<ID) | (1u<<NAME) | (1u<<AIR_DATE) | (1u<<STATUS);
+    SeriesInfo info;
+    uint32_t present_fields = 0;
+
+    static int get_field(const char* key, size_t length) {
+        if (strncmp(key, "id", length+1) == 0) return ID;
+        if (strncmp(key, "seriesName", length+1) == 0) return NAME;
+        if (strncmp(key, "firstAired", length+1) == 0) return AIR_DATE;
+        if (strncmp(key, "status", length+1) == 0) return STATUS;
+        if (strncmp(key, "overview", length+1) == 0) return OVERVIEW;
+        return -1;
+    }
+
+    const char* set_field(int field, const JsonScalar& v) {
+        present_fields |= (1u << field);
+        const bool is_string = (v.type == JsonScalar::Type::STRING);
+        switch (field) {
+        case ID:
+            if ((v.type != JsonScalar::Type::INTEGER) || (v.integer <= 0) || (v.integer > int64_t(UINT32_MAX))) {
+                return "Series field 'id' must be a positive integer";
+            }
+            info.id = uint32_t(v.integer);
+            return nullptr;
+        case NAME:
+            if (!is_string) return "Series field 'seriesName' must be a string";
+            info.name = std::string(v.str, v.length);
+            return nullptr;
+        case AIR_DATE:
+            if (!is_string) return "Series field 'firstAired' must be a string";
+            info.air_date = std::string(v.str, v.length);
+            return nullptr;
+        case STATUS:
+            if (!is_string) return "Series field 'status' must be a string";
+            info.status = std::string(v.str, v.length);
+            return nullptr;
+        case OVERVIEW:
+            // NOTE: A null overview is left empty like load_series_info
+            if (is_string) {
+                info.overview = std::string(v.str, v.length);
+            }
+            return nullptr;
+        }
+        return nullptr;
+    }
+
+    const char* finish() const {
+        if ((present_fields & REQUIRED_FIELDS) != REQUIRED_FIELDS) {
+            return "Series is missing a required field";
+        }
+        return nullptr;
+    }
+};
+
+// Reads the records in the data field of a response and the page links if there are any
+// The data field is either a single record or an array of records
+// Depth is the number of objects and arrays that we are inside of
+// - 1: response object with the fields links, data and errors
+// - 2: links object, data array or the data record
+// - 3: data record inside of the data array
+template <typename Record>
+class ResponseHandler: public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, ResponseHandler<Record>>
+{
+private:
+    enum class Section { NONE, LINKS, DATA };
+    const bool m_is_data_array;
+    int m_depth = 0;
+    Section m_section = Section::NONE;
+    int m_record_depth = 0;
+    bool m_is_in_record = false;
+    Record m_record;
+    int m_field = -1;
+    // NOTE: Only the next and last links are needed to fetch the remaining pages
+    enum class Link { NONE, NEXT, LAST } m_link = Link::NONE;
+    const char* m_error = nullptr;
+public:
+    std::vector<Record> records;
+    bool is_data_found = false;
+    std::optional<int> next_page = std::nullopt;
+    std::optional<int> last_page = std::nullopt;
+public:
+    ResponseHandler(bool is_data_array)
+    : m_is_data_array(is_data_array) {}
+
+    const char* get_error() const { return m_error; }
+
+    bool Null() { return on_scalar({ JsonScalar::Type::NULL_VALUE }); }
+    bool Bool(bool b) { return on_scalar({ JsonScalar::Type::BOOL, int64_t(b) }); }
+    bool Int(int i) { return on_scalar({ JsonScalar::Type::INTEGER, int64_t(i) }); }
+    bool Uint(unsigned u) { return on_scalar({ JsonScalar::Type::INTEGER, int64_t(u) }); }
+    bool Int64(int64_t i) { return on_scalar({ JsonScalar::Type::INTEGER, i }); }
+    bool Uint64(uint64_t u) { 
+        if (u > uint64_t(INT64_MAX)) return on_scalar({ JsonScalar::Type::NUMBER });
+        return on_scalar({ JsonScalar::Type::INTEGER, int64_t(u) });
+    }
+    bool Double(double d) { return on_scalar({ JsonScalar::Type::NUMBER }); }
+    bool String(const char* str, rapidjson::SizeType length, bool copy) {
+        return on_scalar({ JsonScalar::Type::STRING, 0, str, size_t(length) });
+    }
+
+    bool Key(const char* str, rapidjson::SizeType length, bool copy) {
+        if (m_depth == 1) {
+            m_section = Section::NONE;
+            if (strncmp(str, "data", length+1) == 0) m_section = Section::DATA;
+            if (strncmp(str, "links", length+1) == 0) m_section = Section::LINKS;
+        } else if (m_is_in_record && (m_depth == m_record_depth)) {
+            m_field = Record::get_field(str, size_t(length));
+        } else if ((m_section == Section::LINKS) && (m_depth == 2)) {
+            m_link = Link::NONE;
+            if (strncmp(str, "next", length+1) == 0) m_link = Link::NEXT;
+            if (strncmp(str, "last", length+1) == 0) m_link = Link::LAST;
+        }
+        return true;
+    }
+
+    bool StartObject() {
+        if (!on_container(false)) {
+            return false;
+        }
+        m_depth++;
+        const int record_depth = m_is_data_array ? 3 : 2;
+        if ((m_section == Section::DATA) && (m_depth == record_depth)) {
+            m_is_in_record = true;
+            m_record_depth = m_depth;
+            m_record = Record{};
+            m_field = -1;
+        }
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType total_members) {
+        if (m_is_in_record && (m_depth == m_record_depth)) {
+            m_is_in_record = false;
+            m_error = m_record.finish();
+            if (m_error != nullptr) {
+                return false;
+            }
+            records.push_back(std::move(m_record));
+        }
+        m_depth--;
+        return true;
+    }
+
+    bool StartArray() {
+        if (!on_container(true)) {
+            return false;
+        }
+        m_depth++;
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType total_elements) {
+        m_depth--;
+        return true;
+    }
+private:
+    // objects and arrays are only expected as the data field or inside of ignored fields
+    bool on_container(bool is_array) {
+        if (m_is_in_record && (m_depth == m_record_depth)) {
+            if (m_field < 0) {
+                return true;
+            }
+            m_error = m_record.set_field(m_field, { JsonScalar::Type::NESTED });
+            return (m_error == nullptr);
+        }
+        if ((m_section == Section::DATA) && (m_depth == 1)) {
+            is_data_found = true;
+            if (is_array != m_is_data_array) {
+                m_error = m_is_data_array ? "Field 'data' must be an array" : "Field 'data' must be an object";
+                return false;
+            }
+            return true;
+        }
+        if ((m_section == Section::DATA) && (m_depth == 2) && m_is_data_array && is_array) {
+            m_error = "Field 'data' must only contain objects";
+            return false;
+        }
+        return true;
+    }
+
+    bool on_scalar(const JsonScalar& v) {
+        if (m_is_in_record && (m_depth == m_record_depth)) {
+            if (m_field < 0) {
+                return true;
+            }
+            m_error = m_record.set_field(m_field, v);
+            return (m_error == nullptr);
+        }
+        if ((m_section == Section::DATA) && (m_depth == 1)) {
+            is_data_found = true;
+            m_error = m_is_data_array ? "Field 'data' must be an array" : "Field 'data' must be an object";
+            return false;
+        }
+        if ((m_section == Section::DATA) && (m_depth == 2) && m_is_data_array) {
+            m_error = "Field 'data' must only contain objects";
+            return false;
+        }
+        if ((m_section == Section::LINKS) && (m_depth == 2) && (v.type == JsonScalar::Type::INTEGER)) {
+            if (m_link == Link::NEXT) next_page = int(v.integer);
+            if (m_link == Link::LAST) last_page = int(v.integer);
+        }
+        return true;
+    }
+};
+
+// returns an error message if the response was invalid
+template <typename Record>
+static std::optional<std::string> parse_response(const char* json, size_t length, ResponseHandler<Record>& handler) {
+    auto stream = rapidjson::MemoryStream(json, length);
+    auto reader = rapidjson::Reader();
+    rapidjson::ParseResult ok = reader.Parse(stream, handler);
+    if (handler.get_error() != nullptr) {
+        return fmt::format("{} at offset={}", handler.get_error(), ok.Offset());
+    }
+    if (ok.IsError()) {
+        return fmt::format("Got invalid JSON: {} at offset={}", rapidjson::GetParseError_En(ok.Code()), ok.Offset());
+    }
+    if (!handler.is_data_found) {
+        return "Missing field 'data'";
+    }
+    return std::nullopt;
+}
+
+tl::expected<SeriesInfo, std::string> parse_series_response(const char* json, size_t length) {
+    TRACE_SCOPE("parse", "parse_series_response");
+    auto handler = ResponseHandler<SeriesRecord>(false);
+    auto err = parse_response(json, length, handler);
+    if (err) {
+        return tl::make_unexpected<std::string>(std::move(err.value()));
+    }
+    if (handler.records.size() != 1) {
+        return tl::make_unexpected<std::string>("Field 'data' must be an object");
+    }
+    return std::move(handler.records[0].info);
+}
+
+tl::expected<EpisodesPage, std::string> parse_episodes_page_response(const char* json, size_t length) {
+    TRACE_SCOPE("parse", "parse_episodes_page_response");
+    auto handler = ResponseHandler<EpisodeRecord>(true);
+    auto err = parse_response(json, length, handler);
+    if (err) {
+        return tl::make_unexpected<std::string>(std::move(err.value()));
+    }
+
+    EpisodesPage page;
+    page.episodes.reserve(handler.records.size());
+    for (auto& record: handler.records) {
+        page.episodes.push_back(std::move(record.info));
+    }
+    page.next_page = handler.next_page;
+    page.last_page = handler.last_page;
+    return page;
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include "./tvdb_models.h"
+#include "util/expected.hpp"
+
+namespace tvdb_api {
+
+// a single page of the paginated episodes response
+struct EpisodesPage {
+    std::vector<EpisodeInfo> episodes;
+    std::optional<int> next_page = std::nullopt;
+    std::optional<int> last_page = std::nullopt;
+};
+
+// Parse api responses straight into models without building a document
+// NOTE: The required fields are checked while parsing with the same rules as tvdb_api_schema.cpp
+//       Fields which aren't used by the models are skipped
+tl::expected<SeriesInfo, std::string> parse_series_response(const char* json, size_t length);
+tl::expected<EpisodesPage, std::string> parse_episodes_page_response(const char* json, size_t length);
+
+}
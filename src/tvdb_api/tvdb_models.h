@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <string>
 #include <optional>
+#include <stdint.h>
 
 namespace tvdb_api {
 
@@ -15,6 +16,12 @@ struct SeriesInfo {
     std::optional<std::string> overview = std::nullopt;
 };
 
+// a series that was changed on the api at the given time
+struct SeriesUpdate {
+    uint32_t id = 0;
+    int64_t last_updated = 0;   // unix time in seconds
+};
+
 // stores info about an episode 
 struct EpisodeInfo {
     uint32_t id = 0;
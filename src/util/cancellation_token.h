@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace util 
+{
+
+// Shared flag which lets a long running task know that its result is no longer wanted
+// NOTE: A default constructed token can never be cancelled
+class CancellationToken 
+{
+private:
+    std::shared_ptr<std::atomic<bool>> m_is_cancelled;
+public:
+    CancellationToken() = default;
+    static CancellationToken create() {
+        auto token = CancellationToken();
+        token.m_is_cancelled = std::make_shared<std::atomic<bool>>(false);
+        return token;
+    }
+    void cancel() {
+        if (m_is_cancelled) {
+            *m_is_cancelled = true;
+        }
+    }
+    bool is_cancelled() const {
+        return m_is_cancelled && *m_is_cancelled;
+    }
+    // tokens are equal if they share the same flag
+    bool operator==(const CancellationToken& other) const {
+        return m_is_cancelled == other.m_is_cancelled;
+    }
+};
+
+};
@@ -1,4 +1,6 @@
 #include "file_loading.h"
+#include "util/trace.h"
+#include "util/metrics.h"
 
 #include <ostream>
 #include <fstream>
@@ -35,6 +37,7 @@ rapidjson::SchemaDocument load_schema_from_cstr(const char* cstr) {
 }
 
 bool validate_document(const rapidjson::Document& doc, rapidjson::SchemaDocument& schema_doc) {
+    TRACE_SCOPE("parse", "validate_document");
     rapidjson::SchemaValidator validator(schema_doc);
     if (!doc.Accept(validator)) {
         spdlog::error("Doc doesn't match schema");
@@ -56,6 +59,7 @@ bool validate_document(const rapidjson::Document& doc, rapidjson::SchemaDocument
 }
 
 DocumentLoadResult load_document_from_file(const char* fn) {
+    TRACE_SCOPE("io", "load_document_from_file");
     DocumentLoadResult res;
 
     std::ifstream file(fn);
@@ -69,8 +73,12 @@ DocumentLoadResult load_document_from_file(const char* fn) {
     ss << file.rdbuf();
     file.close();
 
+    static auto& TOTAL_JSON_BYTES = util::metrics::get_counter("json.bytes_parsed");
+    const auto str = ss.str();
+    TOTAL_JSON_BYTES.add(int64_t(str.size()));
+
     rapidjson::Document doc;
-    rapidjson::ParseResult ok = doc.Parse(ss.str().c_str());
+    rapidjson::ParseResult ok = doc.Parse(str.c_str());
     if (!ok) {
         spdlog::error(fmt::format("JSON parse error: {} ({})", 
             rapidjson::GetParseError_En(ok.Code()), ok.Offset()));
@@ -92,6 +100,7 @@ void write_json_to_stream(const rapidjson::Document& doc, std::ostream& os) {
 }
 
 bool write_document_to_file(const char* fn, const rapidjson::Document& doc) {
+    TRACE_SCOPE("io", "write_document_to_file");
     std::ofstream file(fn);
     if (!file.is_open()) {
         return false;
@@ -102,4 +111,16 @@ bool write_document_to_file(const char* fn, const rapidjson::Document& doc) {
     return true;
 }
 
+bool write_json_string_to_file(const char* fn, const std::string& json_str) {
+    TRACE_SCOPE("io", "write_json_string_to_file");
+    std::ofstream file(fn);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << json_str << std::endl;
+    file.close();
+    return true;
+}
+
 };
\ No newline at end of file
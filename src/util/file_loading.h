@@ -6,6 +6,7 @@
 // - validate a json document against a schema document
 
 #include <ostream>
+#include <string>
 #include <rapidjson/document.h>
 #include <rapidjson/schema.h>
 
@@ -30,5 +31,6 @@ DocumentLoadResult load_document_from_file(const char* fn);
 
 void write_json_to_stream(const rapidjson::Document& doc, std::ostream& os);
 bool write_document_to_file(const char* fn, const rapidjson::Document& doc);
+bool write_json_string_to_file(const char* fn, const std::string& json_str);
 
 };
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "mapped_file.h"
+
+#include <fmt/core.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+namespace util
+{
+
+MappedFile::MappedFile() {
+    m_data = nullptr;
+    m_size = 0;
+#ifdef _WIN32
+    m_file_handle = INVALID_HANDLE_VALUE;
+    m_mapping_handle = NULL;
+#endif
+}
+
+// NOTE: An empty file can't be mapped so it is left with a null pointer and a size of 0
+#ifdef _WIN32
+tl::expected<std::unique_ptr<MappedFile>, std::string> MappedFile::open(const char* filename) {
+    auto file = std::unique_ptr<MappedFile>(new MappedFile());
+    file->m_file_handle = CreateFileA(
+        filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->m_file_handle == INVALID_HANDLE_VALUE) {
+        return tl::make_unexpected(fmt::format("Failed to open {} for mapping, error={}", filename, GetLastError()));
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->m_file_handle, &size)) {
+        return tl::make_unexpected(fmt::format("Failed to get the size of {}, error={}", filename, GetLastError()));
+    }
+    file->m_size = size_t(size.QuadPart);
+    if (file->m_size == 0) {
+        return file;
+    }
+
+    file->m_mapping_handle = CreateFileMappingA(file->m_file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (file->m_mapping_handle == NULL) {
+        return tl::make_unexpected(fmt::format("Failed to create a mapping of {}, error={}", filename, GetLastError()));
+    }
+    file->m_data = static_cast<const uint8_t*>(MapViewOfFile(file->m_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (file->m_data == nullptr) {
+        return tl::make_unexpected(fmt::format("Failed to map a view of {}, error={}", filename, GetLastError()));
+    }
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping_handle != NULL) {
+        CloseHandle(m_mapping_handle);
+    }
+    if (m_file_handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file_handle);
+    }
+}
+#else
+tl::expected<std::unique_ptr<MappedFile>, std::string> MappedFile::open(const char* filename) {
+    auto file = std::unique_ptr<MappedFile>(new MappedFile());
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        return tl::make_unexpected(fmt::format("Failed to open {} for mapping: {}", filename, strerror(errno)));
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        const int error = errno;
+        close(fd);
+        return tl::make_unexpected(fmt::format("Failed to get the size of {}: {}", filename, strerror(error)));
+    }
+    file->m_size = size_t(info.st_size);
+    if (file->m_size == 0) {
+        close(fd);
+        return file;
+    }
+
+    // NOTE: The mapping stays valid after the descriptor is closed
+    void* data = mmap(NULL, file->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int error = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+        file->m_size = 0;
+        return tl::make_unexpected(fmt::format("Failed to map {}: {}", filename, strerror(error)));
+    }
+    file->m_data = static_cast<const uint8_t*>(data);
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+}
+#endif
+
+};
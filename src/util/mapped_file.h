@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include "util/expected.hpp"
+
+namespace util
+{
+
+// A read only memory mapping of a whole file
+// NOTE: Pages are read in by the os when they are first touched so opening a large file is cheap
+class MappedFile
+{
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_file_handle;
+    void* m_mapping_handle;
+#endif
+public:
+    static tl::expected<std::unique_ptr<MappedFile>, std::string> open(const char* filename);
+    ~MappedFile();
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+private:
+    MappedFile();
+};
+
+};
@@ -0,0 +1,165 @@
+#include "metrics.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include <rapidjson/writer.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+namespace util::metrics 
+{
+
+Histogram::Histogram() {
+    for (auto& bucket: m_buckets) {
+        bucket = 0;
+    }
+    m_total_count = 0;
+    m_total_sum = 0;
+    m_max = 0;
+}
+
+void Histogram::record(int64_t value_us) {
+    value_us = std::max(value_us, int64_t(0));
+    int i = 0;
+    while ((i < (TOTAL_BUCKETS-1)) && (value_us >= (int64_t(1) << i))) {
+        i++;
+    }
+    m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+    m_total_count.fetch_add(1, std::memory_order_relaxed);
+    m_total_sum.fetch_add(value_us, std::memory_order_relaxed);
+
+    int64_t max = m_max.load(std::memory_order_relaxed);
+    while ((value_us > max) && !m_max.compare_exchange_weak(max, value_us, std::memory_order_relaxed)) {}
+}
+
+int64_t Histogram::get_bucket_upper_bound(int i) {
+    return int64_t(1) << i;
+}
+
+int64_t Histogram::get_percentile(float p) const {
+    const int64_t total_count = get_count();
+    if (total_count == 0) {
+        return 0;
+    }
+
+    const auto target = int64_t(p * float(total_count));
+    int64_t count = 0;
+    for (int i = 0; i < TOTAL_BUCKETS; i++) {
+        count += get_bucket(i);
+        if (count > target) {
+            return std::min(get_bucket_upper_bound(i), get_max());
+        }
+    }
+    return get_max();
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+};
+
+static Registry& get_registry() {
+    static Registry registry;
+    return registry;
+}
+
+Counter& get_counter(const char* name) {
+    auto& registry = get_registry();
+    auto lock = std::scoped_lock(registry.mutex);
+    auto& counter = registry.counters[name];
+    if (!counter) {
+        counter = std::make_unique<Counter>();
+    }
+    return *counter;
+}
+
+Histogram& get_histogram(const char* name) {
+    auto& registry = get_registry();
+    auto lock = std::scoped_lock(registry.mutex);
+    auto& histogram = registry.histograms[name];
+    if (!histogram) {
+        histogram = std::make_unique<Histogram>();
+    }
+    return *histogram;
+}
+
+std::vector<CounterSnapshot> get_counters() {
+    auto& registry = get_registry();
+    auto lock = std::scoped_lock(registry.mutex);
+    std::vector<CounterSnapshot> snapshots;
+    snapshots.reserve(registry.counters.size());
+    for (auto& [name, counter]: registry.counters) {
+        snapshots.push_back({ name, counter->get() });
+    }
+    return snapshots;
+}
+
+std::vector<HistogramSnapshot> get_histograms() {
+    auto& registry = get_registry();
+    auto lock = std::scoped_lock(registry.mutex);
+    std::vector<HistogramSnapshot> snapshots;
+    snapshots.reserve(registry.histograms.size());
+    for (auto& [name, histogram]: registry.histograms) {
+        auto snapshot = HistogramSnapshot{};
+        snapshot.name = name;
+        snapshot.count = histogram->get_count();
+        snapshot.sum = histogram->get_sum();
+        snapshot.max = histogram->get_max();
+        snapshot.p50 = histogram->get_percentile(0.50f);
+        snapshot.p90 = histogram->get_percentile(0.90f);
+        snapshot.p99 = histogram->get_percentile(0.99f);
+        snapshots.push_back(std::move(snapshot));
+    }
+    return snapshots;
+}
+
+double get_uptime_seconds() {
+    const auto dt = std::chrono::steady_clock::now() - get_registry().start_time;
+    return std::chrono::duration<double>(dt).count();
+}
+
+std::string json_stringify_metrics() {
+    const double uptime = get_uptime_seconds();
+    rapidjson::StringBuffer sb;
+    auto writer = rapidjson::PrettyWriter<rapidjson::StringBuffer>(sb);
+    writer.SetIndent(' ', 1);
+    writer.StartObject();
+    writer.Key("uptime_seconds");
+    writer.Double(uptime);
+
+    writer.Key("counters");
+    writer.StartObject();
+    for (auto& counter: get_counters()) {
+        writer.Key(counter.name.c_str());
+        writer.StartObject();
+        writer.Key("total"); writer.Int64(counter.value);
+        writer.Key("per_second"); writer.Double((uptime > 0.0) ? (double(counter.value) / uptime) : 0.0);
+        writer.EndObject();
+    }
+    writer.EndObject();
+
+    writer.Key("histograms_us");
+    writer.StartObject();
+    for (auto& histogram: get_histograms()) {
+        writer.Key(histogram.name.c_str());
+        writer.StartObject();
+        writer.Key("count"); writer.Int64(histogram.count);
+        writer.Key("mean"); writer.Double((histogram.count > 0) ? (double(histogram.sum) / double(histogram.count)) : 0.0);
+        writer.Key("p50"); writer.Int64(histogram.p50);
+        writer.Key("p90"); writer.Int64(histogram.p90);
+        writer.Key("p99"); writer.Int64(histogram.p99);
+        writer.Key("max"); writer.Int64(histogram.max);
+        writer.EndObject();
+    }
+    writer.EndObject();
+
+    writer.EndObject();
+    return std::string(sb.GetString(), sb.GetSize());
+}
+
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+// Always on metrics which are cheap enough to leave in hot paths
+// - Counters and histograms are registered once by name and then updated with relaxed atomics
+// - Keep a reference to the metric in a function local static so the lookup only happens once
+//   e.g. static auto& FILES_SCANNED = util::metrics::get_counter("scan.files");
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace util::metrics 
+{
+
+class Counter 
+{
+private:
+    std::atomic<int64_t> m_value;
+public:
+    Counter(): m_value(0) {}
+    void add(int64_t n=1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t get() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+// Histogram of microsecond durations with power of two buckets
+// Bucket i holds values in [2^(i-1), 2^i) with bucket 0 holding values below 1us
+class Histogram 
+{
+public:
+    static constexpr int TOTAL_BUCKETS = 32;
+private:
+    std::array<std::atomic<int64_t>, TOTAL_BUCKETS> m_buckets;
+    std::atomic<int64_t> m_total_count;
+    std::atomic<int64_t> m_total_sum;
+    std::atomic<int64_t> m_max;
+public:
+    Histogram();
+    void record(int64_t value_us);
+    int64_t get_count() const { return m_total_count.load(std::memory_order_relaxed); }
+    int64_t get_sum() const { return m_total_sum.load(std::memory_order_relaxed); }
+    int64_t get_max() const { return m_max.load(std::memory_order_relaxed); }
+    int64_t get_bucket(int i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+    // upper bound of the bucket that contains the percentile, where p is between 0 and 1
+    int64_t get_percentile(float p) const;
+    static int64_t get_bucket_upper_bound(int i);
+};
+
+// records the lifetime of the scope in microseconds
+class ScopedLatency 
+{
+private:
+    Histogram& m_histogram;
+    const std::chrono::steady_clock::time_point m_start;
+public:
+    explicit ScopedLatency(Histogram& histogram)
+    : m_histogram(histogram), m_start(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency() {
+        const auto dt = std::chrono::steady_clock::now() - m_start;
+        m_histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(dt).count());
+    }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency(ScopedLatency&&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(ScopedLatency&&) = delete;
+};
+
+// NOTE: Metrics live until the end of the program so references to them never dangle
+Counter& get_counter(const char* name);
+Histogram& get_histogram(const char* name);
+
+struct CounterSnapshot {
+    std::string name;
+    int64_t value;
+};
+
+struct HistogramSnapshot {
+    std::string name;
+    int64_t count;
+    int64_t sum;
+    int64_t max;
+    int64_t p50;
+    int64_t p90;
+    int64_t p99;
+};
+
+// sorted by name
+std::vector<CounterSnapshot> get_counters();
+std::vector<HistogramSnapshot> get_histograms();
+// seconds since the first metric was registered
+double get_uptime_seconds();
+
+// all metrics along with the rate of each counter over the uptime
+std::string json_stringify_metrics();
+
+};
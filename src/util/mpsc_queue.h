@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+namespace util 
+{
+
+// Bounded lock free queue for many producers and a single consumer
+// Each slot has a sequence number which tells producers and the consumer whose turn it is
+// Pushing into a full queue fails instead of blocking so producers are never held up
+template <typename T>
+class MPSCQueue 
+{
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    std::unique_ptr<Slot[]> m_slots;
+    const size_t m_mask;
+    // NOTE: Separate cache lines so producers don't contend with the consumer
+    alignas(64) std::atomic<size_t> m_write_index;
+    alignas(64) size_t m_read_index;
+public:
+    // NOTE: The capacity is rounded up to a power of two
+    explicit MPSCQueue(size_t capacity)
+    : m_mask(get_power_of_two(capacity)-1), m_write_index(0), m_read_index(0)
+    {
+        const size_t total_slots = m_mask+1;
+        m_slots = std::make_unique<Slot[]>(total_slots);
+        for (size_t i = 0; i < total_slots; i++) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // safe to call from any thread, returns false if the queue is full
+    bool try_push(T&& value) {
+        size_t index = m_write_index.load(std::memory_order_relaxed);
+        while (true) {
+            auto& slot = m_slots[index & m_mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = intptr_t(sequence) - intptr_t(index);
+            if (diff == 0) {
+                if (m_write_index.compare_exchange_weak(index, index+1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(index+1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                index = m_write_index.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // NOTE: Only the consumer thread may call this
+    bool try_pop(T& value) {
+        auto& slot = m_slots[m_read_index & m_mask];
+        const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != (m_read_index+1)) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.sequence.store(m_read_index+m_mask+1, std::memory_order_release);
+        m_read_index++;
+        return true;
+    }
+
+    size_t get_capacity() const { return m_mask+1; }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue(MPSCQueue&&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(MPSCQueue&&) = delete;
+private:
+    static size_t get_power_of_two(size_t n) {
+        size_t v = 1;
+        while (v < n) v <<= 1;
+        return v;
+    }
+};
+
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace util
+{
+
+// Rate limiter which lets through callers at an average rate with bursts of up to a capacity
+// Each caller reserves a token and sleeps until it is available so callers are let through in order
+// NOTE: A rate of 0 disables the limiter
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+private:
+    const double m_rate;
+    const double m_capacity;
+    double m_tokens;
+    Clock::time_point m_last_refill;
+    std::mutex m_mutex;
+public:
+    TokenBucket(double rate, double capacity)
+    : m_rate(std::max(rate, 0.0)), m_capacity(std::max(capacity, 1.0)),
+      m_tokens(std::max(capacity, 1.0)), m_last_refill(Clock::now()) {}
+    TokenBucket(const TokenBucket&) = delete;
+    TokenBucket(TokenBucket&&) = delete;
+    TokenBucket& operator=(const TokenBucket&) = delete;
+    TokenBucket& operator=(TokenBucket&&) = delete;
+
+    // blocks until a token is available and returns how long we waited
+    Clock::duration acquire() {
+        const auto wait_time = reserve();
+        if (wait_time > Clock::duration::zero()) {
+            std::this_thread::sleep_for(wait_time);
+        }
+        return wait_time;
+    }
+
+    // reserves a token without blocking and returns how long until it is available
+    // NOTE: This is for event loops which schedule the caller instead of sleeping
+    Clock::duration reserve() {
+        if (m_rate <= 0.0) {
+            return Clock::duration::zero();
+        }
+
+        auto lock = std::scoped_lock(m_mutex);
+        const auto now = Clock::now();
+        const double elapsed = std::chrono::duration<double>(now - m_last_refill).count();
+        m_tokens = std::min(m_capacity, m_tokens + elapsed*m_rate);
+        m_last_refill = now;
+        // NOTE: Tokens go negative when they are reserved ahead of time by waiting callers
+        m_tokens -= 1.0;
+        if (m_tokens >= 0.0) {
+            return Clock::duration::zero();
+        }
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-m_tokens / m_rate));
+    }
+};
+
+};
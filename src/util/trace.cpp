@@ -0,0 +1,144 @@
+#include "trace.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+
+namespace util::trace 
+{
+
+#ifdef ENABLE_TRACING
+
+// stop recording on a thread instead of growing without bound if tracing is left on
+constexpr size_t MAX_SPANS_PER_THREAD = 1u << 20;
+
+struct Span {
+    const char* category;
+    const char* name;
+    int64_t start_us;
+    int64_t duration_us;
+};
+
+// NOTE: The mutex is only contended when the trace is being written or cleared
+struct ThreadBuffer {
+    uint32_t thread_id;
+    std::vector<Span> spans;
+    std::mutex mutex;
+};
+
+// NOTE: Buffers are kept after their thread exits so its spans still get written
+static std::mutex BUFFERS_MUTEX;
+static std::vector<std::shared_ptr<ThreadBuffer>> BUFFERS;
+static std::atomic<uint32_t> NEXT_THREAD_ID = 1;
+static std::atomic<bool> IS_ENABLED = false;
+static const auto START_TIME = std::chrono::steady_clock::now();
+
+static int64_t get_timestamp_us() {
+    const auto dt = std::chrono::steady_clock::now() - START_TIME;
+    return std::chrono::duration_cast<std::chrono::microseconds>(dt).count();
+}
+
+static ThreadBuffer& get_thread_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = []() {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->thread_id = NEXT_THREAD_ID++;
+        auto lock = std::scoped_lock(BUFFERS_MUTEX);
+        BUFFERS.push_back(buffer);
+        return buffer;
+    }();
+    return *buffer;
+}
+
+void set_is_enabled(bool is_enabled) {
+    IS_ENABLED = is_enabled;
+}
+
+bool get_is_enabled() {
+    return IS_ENABLED;
+}
+
+void clear() {
+    auto lock = std::scoped_lock(BUFFERS_MUTEX);
+    for (auto& buffer: BUFFERS) {
+        auto buffer_lock = std::scoped_lock(buffer->mutex);
+        buffer->spans.clear();
+    }
+}
+
+bool write_chrome_trace(const char* filepath) {
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    writer.StartObject();
+    writer.Key("displayTimeUnit");
+    writer.String("ms");
+    writer.Key("traceEvents");
+    writer.StartArray();
+    {
+        auto lock = std::scoped_lock(BUFFERS_MUTEX);
+        for (auto& buffer: BUFFERS) {
+            auto buffer_lock = std::scoped_lock(buffer->mutex);
+            for (auto& span: buffer->spans) {
+                writer.StartObject();
+                writer.Key("name"); writer.String(span.name);
+                writer.Key("cat"); writer.String(span.category);
+                writer.Key("ph"); writer.String("X");
+                writer.Key("ts"); writer.Int64(span.start_us);
+                writer.Key("dur"); writer.Int64(span.duration_us);
+                writer.Key("pid"); writer.Int(1);
+                writer.Key("tid"); writer.Uint(buffer->thread_id);
+                writer.EndObject();
+            }
+        }
+    }
+    writer.EndArray();
+    writer.EndObject();
+
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write(sb.GetString(), std::streamsize(sb.GetSize()));
+    return true;
+}
+
+ScopedSpan::ScopedSpan(const char* category, const char* name)
+: m_category(category), m_name(name), m_start_us(-1)
+{
+    if (IS_ENABLED.load(std::memory_order_relaxed)) {
+        m_start_us = get_timestamp_us();
+    }
+}
+
+ScopedSpan::~ScopedSpan() {
+    if (m_start_us < 0) {
+        return;
+    }
+
+    const int64_t end_us = get_timestamp_us();
+    auto& buffer = get_thread_buffer();
+    auto lock = std::scoped_lock(buffer.mutex);
+    if (buffer.spans.size() >= MAX_SPANS_PER_THREAD) {
+        return;
+    }
+    buffer.spans.push_back({ m_category, m_name, m_start_us, end_us-m_start_us });
+}
+
+#else
+
+void set_is_enabled(bool is_enabled) {}
+bool get_is_enabled() { return false; }
+void clear() {}
+bool write_chrome_trace(const char* filepath) { return false; }
+ScopedSpan::ScopedSpan(const char* category, const char* name)
+: m_category(category), m_name(name), m_start_us(-1) {}
+ScopedSpan::~ScopedSpan() {}
+
+#endif
+
+};
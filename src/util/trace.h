@@ -0,0 +1,54 @@
+#pragma once
+
+// Scoped span tracer which writes chrome://tracing and Perfetto compatible json
+// - Spans are recorded into a buffer owned by each thread so recording never contends
+// - Recording is off until it is enabled at runtime
+// - Tracing is compiled out unless ENABLE_TRACING is defined
+
+#include <stdint.h>
+
+namespace util::trace 
+{
+
+// NOTE: These are no-ops if tracing is compiled out
+void set_is_enabled(bool is_enabled);
+bool get_is_enabled();
+constexpr bool get_is_compiled() {
+#ifdef ENABLE_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+// discard all recorded spans
+void clear();
+// write all recorded spans as a chrome trace
+bool write_chrome_trace(const char* filepath);
+
+// NOTE: The name and category must outlive the trace, so string literals should be used
+class ScopedSpan 
+{
+private:
+    const char* m_category;
+    const char* m_name;
+    int64_t m_start_us;
+public:
+    ScopedSpan(const char* category, const char* name);
+    ~ScopedSpan();
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan(ScopedSpan&&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(ScopedSpan&&) = delete;
+};
+
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_TRACING
+#define TRACE_SCOPE(category, name) util::trace::ScopedSpan TRACE_CONCAT(_trace_span_, __LINE__)(category, name)
+#else
+#define TRACE_SCOPE(category, name) ((void)0)
+#endif
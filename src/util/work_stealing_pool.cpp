@@ -0,0 +1,195 @@
+#include "work_stealing_pool.h"
+
+#include <utility>
+#include <chrono>
+#include <algorithm>
+
+namespace util 
+{
+
+// a background task shouldn't stall for too long in case an interactive task is waiting on it
+constexpr auto MAX_YIELD_DURATION = std::chrono::milliseconds(250);
+
+// used to push into our own queue when a task queues more work
+static thread_local WorkStealingPool* CURRENT_POOL = nullptr;
+static thread_local int CURRENT_WORKER_ID = -1;
+static thread_local TaskPriority CURRENT_PRIORITY = TaskPriority::BACKGROUND;
+
+WorkStealingPool::WorkStealingPool(int total_threads, int total_reserved_threads)
+: m_total_general_workers(std::max(total_threads, 1)), 
+  m_next_worker(0), m_is_stopping(false)
+{
+    for (auto& v: m_total_pending) v = 0;
+    for (auto& v: m_total_running) v = 0;
+
+    const int total_workers = m_total_general_workers + std::max(total_reserved_threads, 0);
+    m_workers.reserve(total_workers);
+    for (int i = 0; i < total_workers; i++) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+
+    m_threads.reserve(total_workers);
+    for (int i = 0; i < total_workers; i++) {
+        m_threads.emplace_back([this, i]() { run_worker(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        auto lock = std::scoped_lock(m_wakeup_mutex);
+        m_is_stopping = true;
+    }
+    m_wakeup_cv.notify_all();
+    m_reserved_wakeup_cv.notify_all();
+    m_interactive_done_cv.notify_all();
+    for (auto& thread: m_threads) {
+        thread.join();
+    }
+}
+
+int WorkStealingPool::get_total_pending() const {
+    int total = 0;
+    for (auto& v: m_total_pending) total += v;
+    return total;
+}
+
+int WorkStealingPool::get_total_running() const {
+    int total = 0;
+    for (auto& v: m_total_running) total += v;
+    return total;
+}
+
+void WorkStealingPool::push(Task task, TaskPriority priority) {
+    // NOTE: Reserved workers only steal so we only queue onto general workers
+    size_t index = 0;
+    if ((CURRENT_POOL == this) && !get_is_reserved(CURRENT_WORKER_ID)) {
+        index = size_t(CURRENT_WORKER_ID);
+    } else {
+        index = m_next_worker.fetch_add(1) % size_t(m_total_general_workers);
+    }
+
+    {
+        auto& worker = *m_workers[index];
+        auto lock = std::scoped_lock(worker.mutex);
+        worker.tasks[int(priority)].push_back(std::move(task));
+    }
+
+    // NOTE: Increment under the wakeup mutex so a worker can't miss the notification
+    {
+        auto lock = std::scoped_lock(m_wakeup_mutex);
+        m_total_pending[int(priority)]++;
+    }
+
+    // reserved workers need to be woken up for interactive tasks
+    m_wakeup_cv.notify_one();
+    if (priority == TaskPriority::INTERACTIVE) {
+        m_reserved_wakeup_cv.notify_all();
+    }
+}
+
+// take from the front of our queue, otherwise steal from the back of another
+bool WorkStealingPool::try_pop(int id, TaskPriority priority, Task& task) {
+    const int p = int(priority);
+    {
+        auto& worker = *m_workers[id];
+        auto lock = std::scoped_lock(worker.mutex);
+        auto& tasks = worker.tasks[p];
+        if (!tasks.empty()) {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            return true;
+        }
+    }
+
+    const int total_workers = int(m_workers.size());
+    for (int i = 1; i < total_workers; i++) {
+        auto& victim = *m_workers[(id + i) % total_workers];
+        auto lock = std::scoped_lock(victim.mutex);
+        auto& tasks = victim.tasks[p];
+        if (!tasks.empty()) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WorkStealingPool::get_has_work(int id) const {
+    if (m_total_pending[int(TaskPriority::INTERACTIVE)] > 0) {
+        return true;
+    }
+    if (get_is_reserved(id)) {
+        return false;
+    }
+    return m_total_pending[int(TaskPriority::BACKGROUND)] > 0;
+}
+
+void WorkStealingPool::run_worker(int id) {
+    CURRENT_POOL = this;
+    CURRENT_WORKER_ID = id;
+
+    while (true) {
+        {
+            auto lock = std::unique_lock(m_wakeup_mutex);
+            auto& wakeup_cv = get_is_reserved(id) ? m_reserved_wakeup_cv : m_wakeup_cv;
+            wakeup_cv.wait(lock, [this, id]() { 
+                return m_is_stopping || get_has_work(id); 
+            });
+            if (m_is_stopping) {
+                return;
+            }
+        }
+
+        Task task;
+        auto priority = TaskPriority::INTERACTIVE;
+        bool is_popped = try_pop(id, priority, task);
+        if (!is_popped && !get_is_reserved(id)) {
+            priority = TaskPriority::BACKGROUND;
+            is_popped = try_pop(id, priority, task);
+        }
+
+        if (!is_popped) {
+            // another worker got to it first
+            std::this_thread::yield();
+            continue;
+        }
+
+        const int p = int(priority);
+        m_total_running[p]++;
+        m_total_pending[p]--;
+        CURRENT_PRIORITY = priority;
+        task(id);
+        CURRENT_PRIORITY = TaskPriority::BACKGROUND;
+
+        if (priority == TaskPriority::INTERACTIVE) {
+            {
+                auto lock = std::scoped_lock(m_wakeup_mutex);
+                m_total_running[p]--;
+            }
+            m_interactive_done_cv.notify_all();
+        } else {
+            m_total_running[p]--;
+        }
+    }
+}
+
+void WorkStealingPool::yield_to_interactive() {
+    auto* pool = CURRENT_POOL;
+    if ((pool == nullptr) || (CURRENT_PRIORITY != TaskPriority::BACKGROUND)) {
+        return;
+    }
+    pool->wait_for_interactive();
+}
+
+void WorkStealingPool::wait_for_interactive() {
+    const int p = int(TaskPriority::INTERACTIVE);
+    auto lock = std::unique_lock(m_wakeup_mutex);
+    m_interactive_done_cv.wait_for(lock, MAX_YIELD_DURATION, [this, p]() {
+        return m_is_stopping || 
+            ((m_total_pending[p] == 0) && (m_total_running[p] == 0));
+    });
+}
+
+};
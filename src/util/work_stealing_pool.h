@@ -0,0 +1,80 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+namespace util 
+{
+
+// Interactive tasks are requested by the user and are run before any background task
+enum class TaskPriority: int {
+    INTERACTIVE = 0, 
+    BACKGROUND = 1,
+};
+
+// Thread pool where each worker owns a queue of tasks
+// - Tasks pushed from a worker thread go into that worker's queue
+// - Tasks pushed from outside are distributed round robin
+// - Idle workers steal from the back of other worker's queues
+// - Interactive tasks are always taken before background tasks
+// - Reserved workers only run interactive tasks so they never wait behind background work
+// The callable receives the id of the worker that runs it
+class WorkStealingPool 
+{
+public:
+    using Task = std::function<void (int)>;
+    static constexpr int TOTAL_PRIORITIES = 2;
+private:
+    struct Worker {
+        std::array<std::deque<Task>, TOTAL_PRIORITIES> tasks;
+        std::mutex mutex;
+    };
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    const int m_total_general_workers;
+    std::atomic<size_t> m_next_worker;
+    std::array<std::atomic<int>, TOTAL_PRIORITIES> m_total_pending;
+    std::array<std::atomic<int>, TOTAL_PRIORITIES> m_total_running;
+    std::mutex m_wakeup_mutex;
+    std::condition_variable m_wakeup_cv;
+    // NOTE: Reserved workers wait separately so a background push can't wake one instead of a general worker
+    std::condition_variable m_reserved_wakeup_cv;
+    std::condition_variable m_interactive_done_cv;
+    bool m_is_stopping;
+public:
+    WorkStealingPool(int total_threads, int total_reserved_threads=1);
+    // NOTE: Tasks that haven't started are discarded, running tasks are joined
+    ~WorkStealingPool();
+    void push(Task task, TaskPriority priority=TaskPriority::BACKGROUND);
+    int get_total_threads() const { return int(m_threads.size()); }
+    int get_total_pending() const;
+    int get_total_running() const;
+    int get_total_pending(TaskPriority priority) const { return m_total_pending[int(priority)]; }
+    int get_total_running(TaskPriority priority) const { return m_total_running[int(priority)]; }
+
+    // Called by long running background tasks at convenient points to give way to interactive tasks
+    // This blocks for a bounded amount of time while interactive tasks are queued or running
+    // NOTE: Does nothing if not called from a background task of a pool
+    //       Don't hold any lock that an interactive task may wait on or both will stall
+    static void yield_to_interactive();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool(WorkStealingPool&&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+private:
+    void run_worker(int id);
+    void wait_for_interactive();
+    bool try_pop(int id, TaskPriority priority, Task& task);
+    bool get_is_reserved(int id) const { return id >= m_total_general_workers; }
+    bool get_has_work(int id) const;
+};
+
+};